@@ -10,13 +10,13 @@
 #define ALGO_EXECUTION_SERVICE_HPP
 
 #include <string>
+#include <thread>
 #include "soa.hpp"
 #include "marketdataservice.hpp"
+#include "executionalgo.hpp"
 
 enum OrderType { FOK, IOC, MARKET, LIMIT, STOP };
 
-enum Market { BROKERTEC, ESPEED, CME };
-
 /**
 * An execution order that can be placed on an exchange.
 * Type T is the product type.
@@ -31,7 +31,7 @@ public:
 	ExecutionOrder() = default;
 
 	// ctor for an order
-	ExecutionOrder(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder);
+	ExecutionOrder(const T& _product, PricingSide _side, Identifier _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, Identifier _parentOrderId, bool _isChildOrder, TradeIdentifier _executionId = TradeIdentifier());
 
 	// Get the product
 	const T& GetProduct() const;
@@ -40,7 +40,7 @@ public:
 	PricingSide GetPricingSide() const;
 
 	// Get the order ID
-	const string& GetOrderId() const;
+	const Identifier& GetOrderId() const;
 
 	// Get the order type on this order
 	OrderType GetOrderType() const;
@@ -55,30 +55,34 @@ public:
 	long GetHiddenQuantity() const;
 
 	// Get the parent order ID
-	const string& GetParentOrderId() const;
+	const Identifier& GetParentOrderId() const;
 
 	// Is child order?
 	bool IsChildOrder() const;
 
+	// Get the execution ID, unique to each fill reported and empty on an order
+	const TradeIdentifier& GetExecutionId() const;
+
 	// Change attributes to strings
 	vector<string> ToStrings() const;
 
 private:
 	T product;
 	PricingSide side;
-	string orderId;
+	Identifier orderId;
 	OrderType orderType;
 	double price;
 	long visibleQuantity;
 	long hiddenQuantity;
-	string parentOrderId;
+	Identifier parentOrderId;
 	bool isChildOrder;
+	TradeIdentifier executionId;
 
 };
 
 
 template<typename T>
-ExecutionOrder<T>::ExecutionOrder(const T& _product, PricingSide _side, string _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, string _parentOrderId, bool _isChildOrder) :
+ExecutionOrder<T>::ExecutionOrder(const T& _product, PricingSide _side, Identifier _orderId, OrderType _orderType, double _price, long _visibleQuantity, long _hiddenQuantity, Identifier _parentOrderId, bool _isChildOrder, TradeIdentifier _executionId) :
 	product(_product)
 {
 	side = _side;
@@ -89,6 +93,7 @@ ExecutionOrder<T>::ExecutionOrder(const T& _product, PricingSide _side, string _
 	hiddenQuantity = _hiddenQuantity;
 	parentOrderId = _parentOrderId;
 	isChildOrder = _isChildOrder;
+	executionId = _executionId;
 }
 
 template<typename T>
@@ -104,7 +109,7 @@ PricingSide ExecutionOrder<T>::GetPricingSide() const
 }
 
 template<typename T>
-const string& ExecutionOrder<T>::GetOrderId() const
+const Identifier& ExecutionOrder<T>::GetOrderId() const
 {
 	return orderId;
 }
@@ -134,7 +139,7 @@ long ExecutionOrder<T>::GetHiddenQuantity() const
 }
 
 template<typename T>
-const string& ExecutionOrder<T>::GetParentOrderId() const
+const Identifier& ExecutionOrder<T>::GetParentOrderId() const
 {
 	return parentOrderId;
 }
@@ -145,6 +150,12 @@ bool ExecutionOrder<T>::IsChildOrder() const
 	return isChildOrder;
 }
 
+template<typename T>
+const TradeIdentifier& ExecutionOrder<T>::GetExecutionId() const
+{
+	return executionId;
+}
+
 template<typename T>
 vector<string> ExecutionOrder<T>::ToStrings() const
 {
@@ -242,9 +253,32 @@ ExecutionOrder<T>* AlgoExecution<T>::GetExecutionOrder() const
 	return executionOrder;
 }
 
+/**
+* A parent order worked over time by an execution algorithm.
+* Type T is the product type.
+*/
+template<typename T>
+struct ParentOrder
+{
+	T product;
+	PricingSide side;
+	Identifier orderId;
+	double limitPrice;
+	AlgoProgress progress;
+	const ExecutionAlgo* algo;
+	long interval;
+	long startVolume;
+	Identifier childOrderId;
+	TimerHandle timer;
+	bool isDue;
+	bool isActive;
+};
+
 // Pre-declearations
 template<typename T>
 class AlgoExecutionToMarketDataListener;
+template<typename T>
+class AlgoExecutionToExecutionListener;
 
 /**
 * Service for algo executing orders on an exchange.
@@ -257,11 +291,35 @@ class AlgoExecutionService : public Service<string, AlgoExecution<T>>
 
 private:
 
-	map<string, AlgoExecution<T>> algoExecutions;
+	map<Identifier, AlgoExecution<T>> algoExecutions;
 	vector<ServiceListener<AlgoExecution<T>>*> listeners;
 	AlgoExecutionToMarketDataListener<T>* listener;
+	AlgoExecutionToExecutionListener<T>* executionListener;
 	double spread;
-	long count;
+	vector<long> counts;
+	vector<ParentOrder<T>> parentOrders;
+	vector<int> freeParents;
+	unordered_map<Identifier, int> parentIndices;
+	unordered_map<Identifier, int> childParents;
+	vector<vector<int>> dueParents;
+	vector<long> marketVolumes;
+	vector<int> workingParents;
+	long activeCount;
+
+	// Set the timer of a parent order to mark it due at a time
+	void Schedule(int _index, long _time);
+
+	// Stop working a parent order
+	void DeactivateParentOrder(int _index);
+
+	// Work the parent orders of a product due by now
+	void WorkParentOrders(const OrderBook<T>& _orderBook);
+
+	// Send the next child order of a parent order
+	void SendChildOrder(int _index, const OrderBook<T>& _orderBook, long _now);
+
+	// Recycle the slot of a parent order
+	void ReleaseParentOrder(int _index);
 
 public:
 
@@ -284,19 +342,48 @@ public:
 	// Get the listener of the service
 	AlgoExecutionToMarketDataListener<T>* GetListener();
 
+	// Get the execution listener of the service
+	AlgoExecutionToExecutionListener<T>* GetExecutionListener();
+
 	// Execute an order on a market
 	void AlgoExecuteOrder(OrderBook<T>& _orderBook);
 
+	// Add a parent order worked by an algorithm over a duration, sending a child order at most every interval (in microseconds)
+	string AddParentOrder(const T& _product, PricingSide _side, long _quantity, long _visibleQuantity, double _limitPrice, const ExecutionAlgo* _algo, long _duration, long _interval);
+
+	// Cancel a parent order
+	bool CancelParentOrder(const string& _orderId);
+
+	// Get the quantity filled of a parent order, until it is done and released
+	long GetFilledQuantity(const string& _orderId) const;
+
+	// Get the number of active parent orders
+	long GetActiveParentCount() const;
+
+	// Get the number of parent order slots, in use or free for reuse
+	long GetParentSlotCount() const;
+
+	// Get the number of orders executed on the books of a product, whose parity picks the side of the next
+	long GetExecutionCount(const string& _productId) const;
+
+	// Set the number of orders executed on the books of a product, when restoring the service
+	void SetExecutionCount(const string& _productId, long _count);
+
+	// The callback for an execution of a child order
+	void OnExecution(const ExecutionOrder<T>& _execution);
+
 };
 
 template<typename T>
 AlgoExecutionService<T>::AlgoExecutionService()
 {
-	algoExecutions = map<string, AlgoExecution<T>>();
+	algoExecutions = map<Identifier, AlgoExecution<T>>();
 	listeners = vector<ServiceListener<AlgoExecution<T>>*>();
 	listener = new AlgoExecutionToMarketDataListener<T>(this);
+	executionListener = new AlgoExecutionToExecutionListener<T>(this);
 	spread = 1.0 / 128.0;
-	count = 0;
+	counts = vector<long>();
+	activeCount = 0;
 }
 
 template<typename T>
@@ -332,16 +419,27 @@ AlgoExecutionToMarketDataListener<T>* AlgoExecutionService<T>::GetListener()
 	return listener;
 }
 
-// Generate random IDs.
+template<typename T>
+AlgoExecutionToExecutionListener<T>* AlgoExecutionService<T>::GetExecutionListener()
+{
+	return executionListener;
+}
+
+// Generate random IDs, the same ones every run for the same seed of the thread.
 string GenerateId()
 {
+	// Each ID mixes the seed with its number in the sequence, so a sequence restored from a count carries on exactly.
+	IdSequence& _sequence = GetIdSequence();
+	uint64_t _bits = _sequence.seed + ++_sequence.count * 0x9e3779b97f4a7c15;
+	_bits = (_bits ^ (_bits >> 30)) * 0xbf58476d1ce4e5b9;
+	_bits = (_bits ^ (_bits >> 27)) * 0x94d049bb133111eb;
+	_bits ^= _bits >> 31;
 	string _base = "1234567890QWERTYUIOPASDFGHJKLZXCVBNM";
-	vector<double> _randoms = GenerateUniform(12, GetMillisecond());
 	string _id = "";
-	for (auto& r : _randoms)
+	for (int i = 0; i < 12; ++i)
 	{
-		int i = r * 36;
-		_id.push_back(_base[i]);
+		_id.push_back(_base[_bits % 36]);
+		_bits /= 36;
 	}
 	return _id;
 }
@@ -350,7 +448,7 @@ template<typename T>
 void AlgoExecutionService<T>::AlgoExecuteOrder(OrderBook<T>& _orderBook)
 {
 	T _product = _orderBook.GetProduct();
-	string _productId = _product.GetProductId();
+	Identifier _productId = _product.GetProductId();
 	PricingSide _side;
 	string _orderId = GenerateId();
 	double _price;
@@ -364,9 +462,14 @@ void AlgoExecutionService<T>::AlgoExecuteOrder(OrderBook<T>& _orderBook)
 	double _offerPrice = _offerOrder.GetPrice();
 	long _offerQuantity = _offerOrder.GetQuantity();
 
+	WorkParentOrders(_orderBook);
+
 	if (_offerPrice - _bidPrice <= spread)
 	{
-		switch (count % 2)
+		// Sides alternate per product, so products never depend on each other's books.
+		int _handle = GetProductHandle(_productId);
+		if (_handle >= (int)counts.size()) counts.resize(_handle + 1);
+		switch (counts[_handle] % 2)
 		{
 		case 0:
 			_price = _bidPrice;
@@ -379,7 +482,7 @@ void AlgoExecutionService<T>::AlgoExecuteOrder(OrderBook<T>& _orderBook)
 			_side = OFFER;
 			break;
 		}
-		count++;
+		counts[_handle]++;
 		AlgoExecution<T> _algoExecution(_product, _side, _orderId, MARKET, _price, _quantity, 0, "", false);
 		algoExecutions[_productId] = _algoExecution;
 
@@ -390,6 +493,198 @@ void AlgoExecutionService<T>::AlgoExecuteOrder(OrderBook<T>& _orderBook)
 	}
 }
 
+template<typename T>
+string AlgoExecutionService<T>::AddParentOrder(const T& _product, PricingSide _side, long _quantity, long _visibleQuantity, double _limitPrice, const ExecutionAlgo* _algo, long _duration, long _interval)
+{
+	int _index;
+	if (freeParents.empty())
+	{
+		_index = (int)parentOrders.size();
+		parentOrders.push_back(ParentOrder<T>());
+	}
+	else
+	{
+		_index = freeParents.back();
+		freeParents.pop_back();
+	}
+
+	int _handle = GetProductHandle(_product.GetProductId());
+	if (_handle >= (int)dueParents.size())
+	{
+		dueParents.resize(_handle + 1);
+		marketVolumes.resize(_handle + 1);
+	}
+
+	long _now = GetTimerWheel().Now();
+	ParentOrder<T>& _parent = parentOrders[_index];
+	_parent.product = _product;
+	_parent.side = _side;
+	_parent.orderId = GenerateId();
+	_parent.limitPrice = _limitPrice;
+	_parent.progress = { _quantity, _visibleQuantity, 0, _now, _now + _duration, 0 };
+	_parent.algo = _algo;
+	_parent.interval = _interval;
+	_parent.startVolume = marketVolumes[_handle];
+	_parent.childOrderId = "";
+	_parent.isDue = false;
+	_parent.isActive = true;
+	parentIndices[_parent.orderId] = _index;
+	activeCount++;
+
+	Schedule(_index, _now);
+	return _parent.orderId;
+}
+
+template<typename T>
+bool AlgoExecutionService<T>::CancelParentOrder(const string& _orderId)
+{
+	auto _it = parentIndices.find(_orderId);
+	if (_it == parentIndices.end() || !parentOrders[_it->second].isActive) return false;
+
+	DeactivateParentOrder(_it->second);
+	return true;
+}
+
+template<typename T>
+void AlgoExecutionService<T>::DeactivateParentOrder(int _index)
+{
+	ParentOrder<T>& _parent = parentOrders[_index];
+	_parent.isActive = false;
+	activeCount--;
+
+	// A parent already due is released when its product next ticks.
+	if (GetTimerWheel().Cancel(_parent.timer)) ReleaseParentOrder(_index);
+}
+
+template<typename T>
+long AlgoExecutionService<T>::GetFilledQuantity(const string& _orderId) const
+{
+	auto _it = parentIndices.find(_orderId);
+	if (_it == parentIndices.end()) return 0;
+	return parentOrders[_it->second].progress.filledQuantity;
+}
+
+template<typename T>
+long AlgoExecutionService<T>::GetActiveParentCount() const
+{
+	return activeCount;
+}
+
+template<typename T>
+long AlgoExecutionService<T>::GetParentSlotCount() const
+{
+	return (long)parentOrders.size();
+}
+
+template<typename T>
+long AlgoExecutionService<T>::GetExecutionCount(const string& _productId) const
+{
+	int _handle = GetProductHandle(_productId);
+	return _handle < (int)counts.size() ? counts[_handle] : 0;
+}
+
+template<typename T>
+void AlgoExecutionService<T>::SetExecutionCount(const string& _productId, long _count)
+{
+	int _handle = GetProductHandle(_productId);
+	if (_handle >= (int)counts.size()) counts.resize(_handle + 1);
+	counts[_handle] = _count;
+}
+
+template<typename T>
+void AlgoExecutionService<T>::Schedule(int _index, long _time)
+{
+	parentOrders[_index].timer = GetTimerWheel().Schedule(_time, [this, _index]()
+	{
+		ParentOrder<T>& _parent = parentOrders[_index];
+		_parent.isDue = true;
+		dueParents[GetProductHandle(_parent.product.GetProductId())].push_back(_index);
+	});
+}
+
+template<typename T>
+void AlgoExecutionService<T>::WorkParentOrders(const OrderBook<T>& _orderBook)
+{
+	int _handle = GetProductHandle(_orderBook.GetProduct().GetProductId());
+	if (_handle >= (int)dueParents.size()) return;
+
+	// Only the parent orders whose timers fired since the last tick of the product are worked.
+	long _now = GetTimerWheel().Now();
+	workingParents.clear();
+	workingParents.swap(dueParents[_handle]);
+	for (auto& i : workingParents)
+	{
+		parentOrders[i].isDue = false;
+		if (!parentOrders[i].isActive)
+		{
+			ReleaseParentOrder(i);
+			continue;
+		}
+
+		// A parent filled by the child order it just sent is done, so it is released rather than rescheduled.
+		SendChildOrder(i, _orderBook, _now);
+		if (parentOrders[i].isActive) Schedule(i, _now + parentOrders[i].interval);
+		else ReleaseParentOrder(i);
+	}
+}
+
+template<typename T>
+void AlgoExecutionService<T>::SendChildOrder(int _index, const OrderBook<T>& _orderBook, long _now)
+{
+	ParentOrder<T>& _parent = parentOrders[_index];
+	int _handle = GetProductHandle(_parent.product.GetProductId());
+	_parent.progress.marketVolume = marketVolumes[_handle] - _parent.startVolume;
+
+	// Child orders are IOC, so the previous one has been filled or cancelled by the next tick.
+	childParents.erase(_parent.childOrderId);
+	long _quantity = _parent.algo->GetTarget(_parent.progress, _now) - _parent.progress.filledQuantity;
+	if (_quantity <= 0) return;
+
+	BidOffer _bidOffer = _orderBook.GetBidOffer();
+	const Order& _touch = _parent.side == OFFER ? _bidOffer.GetOfferOrder() : _bidOffer.GetBidOrder();
+	if (_touch.GetQuantity() <= 0) return;
+	double _price = _touch.GetPrice();
+	if (_parent.limitPrice > 0 && (_parent.side == OFFER ? _price > _parent.limitPrice : _price < _parent.limitPrice)) return;
+
+	string _orderId = GenerateId();
+	_parent.childOrderId = _orderId;
+	childParents[_orderId] = _index;
+	AlgoExecution<T> _algoExecution(_parent.product, _parent.side, _orderId, IOC, _price, _quantity, 0, _parent.orderId, true);
+	algoExecutions[_parent.product.GetProductId()] = _algoExecution;
+
+	for (auto& l : listeners)
+	{
+		l->ProcessAdd(_algoExecution);
+	}
+}
+
+template<typename T>
+void AlgoExecutionService<T>::ReleaseParentOrder(int _index)
+{
+	ParentOrder<T>& _parent = parentOrders[_index];
+	childParents.erase(_parent.childOrderId);
+	parentIndices.erase(_parent.orderId);
+	freeParents.push_back(_index);
+}
+
+template<typename T>
+void AlgoExecutionService<T>::OnExecution(const ExecutionOrder<T>& _execution)
+{
+	// Every execution of a product counts toward the volume its parent orders participate in.
+	long _quantity = _execution.GetVisibleQuantity() + _execution.GetHiddenQuantity();
+	int _handle = GetProductHandle(_execution.GetProduct().GetProductId());
+	if (_handle < (int)marketVolumes.size()) marketVolumes[_handle] += _quantity;
+
+	// Executions of a child order come from the venue orders it was routed as.
+	auto _it = childParents.find(_execution.GetParentOrderId());
+	if (_it == childParents.end()) return;
+
+	ParentOrder<T>& _parent = parentOrders[_it->second];
+	if (!_parent.isActive) return;
+	_parent.progress.filledQuantity += _quantity;
+	if (_parent.progress.filledQuantity >= _parent.progress.quantity) DeactivateParentOrder(_it->second);
+}
+
 /**
 * Algo Execution Service Listener subscribing data from Market Data Service to Algo Execution Service.
 * Type T is the product type.
@@ -440,4 +735,54 @@ void AlgoExecutionToMarketDataListener<T>::ProcessRemove(OrderBook<T>& _data) {}
 template<typename T>
 void AlgoExecutionToMarketDataListener<T>::ProcessUpdate(OrderBook<T>& _data) {}
 
+/**
+* Algo Execution Service Listener subscribing data from Execution Service to Algo Execution Service.
+* Type T is the product type.
+*/
+template<typename T>
+class AlgoExecutionToExecutionListener : public ServiceListener<ExecutionOrder<T>>
+{
+
+private:
+
+	AlgoExecutionService<T>* service;
+
+public:
+
+	// Connector and Destructor
+	AlgoExecutionToExecutionListener(AlgoExecutionService<T>* _service);
+	~AlgoExecutionToExecutionListener();
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(ExecutionOrder<T>& _data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(ExecutionOrder<T>& _data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(ExecutionOrder<T>& _data);
+
+};
+
+template<typename T>
+AlgoExecutionToExecutionListener<T>::AlgoExecutionToExecutionListener(AlgoExecutionService<T>* _service)
+{
+	service = _service;
+}
+
+template<typename T>
+AlgoExecutionToExecutionListener<T>::~AlgoExecutionToExecutionListener() {}
+
+template<typename T>
+void AlgoExecutionToExecutionListener<T>::ProcessAdd(ExecutionOrder<T>& _data)
+{
+	service->OnExecution(_data);
+}
+
+template<typename T>
+void AlgoExecutionToExecutionListener<T>::ProcessRemove(ExecutionOrder<T>& _data) {}
+
+template<typename T>
+void AlgoExecutionToExecutionListener<T>::ProcessUpdate(ExecutionOrder<T>& _data) {}
+
 #endif
@@ -10,8 +10,10 @@
 #define ALGO_STREAMING_SERVICE_HPP
 
 #include <string>
+#include <cmath>
 #include "soa.hpp"
 #include "pricingservice.hpp"
+#include "riskservice.hpp"
 
 /**
 * A price stream order with price and quantity (visible and hidden)
@@ -42,6 +44,9 @@ public:
 	// Change attributes to strings
 	vector<string> ToStrings() const;
 
+	// Compare price, quantities and side with another order
+	bool operator==(const PriceStreamOrder& _other) const;
+
 private:
 	double price;
 	long visibleQuantity;
@@ -102,6 +107,11 @@ vector<string> PriceStreamOrder::ToStrings() const
 	return _strings;
 }
 
+bool PriceStreamOrder::operator==(const PriceStreamOrder& _other) const
+{
+	return price == _other.price && visibleQuantity == _other.visibleQuantity && hiddenQuantity == _other.hiddenQuantity && side == _other.side;
+}
+
 /**
 * Price Stream with a two-way market.
 * Type T is the product type.
@@ -209,9 +219,153 @@ PriceStream<T>* AlgoStream<T>::GetPriceStream() const
 	return priceStream;
 }
 
+/**
+* Skew of a two-way price for one product, cached from its live position and risk.
+*/
+struct PriceSkew
+{
+	long position = 0;
+	double risk = 0;
+	double shift = 0;
+	double widening = 1;
+	double bidSizeFactor = 1;
+	double offerSizeFactor = 1;
+};
+
+/**
+* Skew engine that shifts and widens two-way prices by inventory and risk.
+* Skews are recomputed only when a position or risk changes, so applying
+* them on a price update is a single lookup.
+*/
+class SkewEngine
+{
+
+public:
+
+	// ctor for a skew engine
+	SkewEngine();
+
+	// Update the position of a product and recompute its skew
+	void UpdatePosition(const string& _productId, long _position);
+
+	// Update the risk of a product and recompute its skew
+	void UpdateRisk(const string& _productId, double _risk);
+
+	// Get the skew of a product
+	const PriceSkew& GetSkew(const string& _productId) const;
+
+	// Set the position at which the price shift is at its maximum
+	void SetPositionLimit(long _positionLimit);
+
+	// Set the maximum price shift
+	void SetMaxShift(double _maxShift);
+
+	// Set the risk at which the spread widening is at its maximum
+	void SetRiskLimit(double _riskLimit);
+
+	// Set the maximum spread widening as a fraction of the spread
+	void SetMaxWidening(double _maxWidening);
+
+	// Set the maximum size reduction on the side that adds to the position
+	void SetMaxSizeCut(double _maxSizeCut);
+
+private:
+	unordered_map<Identifier, PriceSkew> skews;
+	PriceSkew noSkew;
+	long positionLimit;
+	double maxShift;
+	double riskLimit;
+	double maxWidening;
+	double maxSizeCut;
+
+	// Recompute the cached skew from its position and risk
+	void Recompute(PriceSkew& _skew) const;
+
+};
+
+SkewEngine::SkewEngine()
+{
+	// Limits are sized to the book: positions run to hundreds of millions a product, and their risk to 1e8.
+	skews = unordered_map<Identifier, PriceSkew>();
+	positionLimit = 1000000000;
+	maxShift = 1.0 / 128.0;
+	riskLimit = 200000000.0;
+	maxWidening = 1.0;
+	maxSizeCut = 0.5;
+}
+
+void SkewEngine::UpdatePosition(const string& _productId, long _position)
+{
+	PriceSkew& _skew = skews[_productId];
+	_skew.position = _position;
+	Recompute(_skew);
+}
+
+void SkewEngine::UpdateRisk(const string& _productId, double _risk)
+{
+	PriceSkew& _skew = skews[_productId];
+	_skew.risk = _risk;
+	Recompute(_skew);
+}
+
+const PriceSkew& SkewEngine::GetSkew(const string& _productId) const
+{
+	auto _it = skews.find(_productId);
+	if (_it == skews.end()) return noSkew;
+	return _it->second;
+}
+
+void SkewEngine::SetPositionLimit(long _positionLimit)
+{
+	positionLimit = _positionLimit;
+	for (auto& s : skews) Recompute(s.second);
+}
+
+void SkewEngine::SetMaxShift(double _maxShift)
+{
+	maxShift = _maxShift;
+	for (auto& s : skews) Recompute(s.second);
+}
+
+void SkewEngine::SetRiskLimit(double _riskLimit)
+{
+	riskLimit = _riskLimit;
+	for (auto& s : skews) Recompute(s.second);
+}
+
+void SkewEngine::SetMaxWidening(double _maxWidening)
+{
+	maxWidening = _maxWidening;
+	for (auto& s : skews) Recompute(s.second);
+}
+
+void SkewEngine::SetMaxSizeCut(double _maxSizeCut)
+{
+	maxSizeCut = _maxSizeCut;
+	for (auto& s : skews) Recompute(s.second);
+}
+
+void SkewEngine::Recompute(PriceSkew& _skew) const
+{
+	// A long position lowers both sides to attract buyers and shrinks the bid,
+	// a short position does the opposite; risk widens the spread symmetrically.
+	double _ratio = (double)_skew.position / positionLimit;
+	_ratio = max(-1.0, min(1.0, _ratio));
+	double _riskRatio = min(fabs(_skew.risk) / riskLimit, 1.0);
+
+	_skew.shift = -_ratio * maxShift;
+	_skew.widening = 1.0 + _riskRatio * maxWidening;
+	_skew.bidSizeFactor = 1.0 - max(_ratio, 0.0) * maxSizeCut;
+	_skew.offerSizeFactor = 1.0 - max(-_ratio, 0.0) * maxSizeCut;
+}
+
 // Pre-declearations to avoid errors.
 template<typename T>
 class AlgoStreamingToPricingListener;
+template<typename T>
+class AlgoStreamingToPositionListener;
+template<typename T>
+class AlgoStreamingToRiskListener;
 
 /**
 * Service for algo streaming orders on an exchange.
@@ -224,9 +378,12 @@ class AlgoStreamingService : public Service<string, AlgoStream<T>>
 
 private:
 
-	map<string, AlgoStream<T>> algoStreams;
+	map<Identifier, AlgoStream<T>> algoStreams;
 	vector<ServiceListener<AlgoStream<T>>*> listeners;
 	ServiceListener<Price<T>>* listener;
+	ServiceListener<Position<T>>* positionListener;
+	ServiceListener<PV01<T>>* riskListener;
+	SkewEngine skewEngine;
 	long count;
 
 public:
@@ -250,6 +407,21 @@ public:
 	// Get the listener of the service
 	ServiceListener<Price<T>>* GetListener();
 
+	// Get the position listener of the service
+	ServiceListener<Position<T>>* GetPositionListener();
+
+	// Get the risk listener of the service
+	ServiceListener<PV01<T>>* GetRiskListener();
+
+	// Get the skew engine of the service
+	SkewEngine& GetSkewEngine();
+
+	// Get the number of two-way prices published, whose parity picks the size of the next
+	long GetCount() const;
+
+	// Set the number of two-way prices published, when restoring the service
+	void SetCount(long _count);
+
 	// Publish two-way prices
 	void AlgoPublishPrice(Price<T>& _price);
 
@@ -258,9 +430,12 @@ public:
 template<typename T>
 AlgoStreamingService<T>::AlgoStreamingService()
 {
-	algoStreams = map<string, AlgoStream<T>>();
+	algoStreams = map<Identifier, AlgoStream<T>>();
 	listeners = vector<ServiceListener<AlgoStream<T>>*>();
 	listener = new AlgoStreamingToPricingListener<T>(this);
+	positionListener = new AlgoStreamingToPositionListener<T>(this);
+	riskListener = new AlgoStreamingToRiskListener<T>(this);
+	skewEngine = SkewEngine();
 	count = 0;
 }
 
@@ -297,22 +472,61 @@ ServiceListener<Price<T>>* AlgoStreamingService<T>::GetListener()
 	return listener;
 }
 
+template<typename T>
+ServiceListener<Position<T>>* AlgoStreamingService<T>::GetPositionListener()
+{
+	return positionListener;
+}
+
+template<typename T>
+ServiceListener<PV01<T>>* AlgoStreamingService<T>::GetRiskListener()
+{
+	return riskListener;
+}
+
+template<typename T>
+SkewEngine& AlgoStreamingService<T>::GetSkewEngine()
+{
+	return skewEngine;
+}
+
+template<typename T>
+long AlgoStreamingService<T>::GetCount() const
+{
+	return count;
+}
+
+template<typename T>
+void AlgoStreamingService<T>::SetCount(long _count)
+{
+	count = _count;
+}
+
+// Scale a quantity and round it to whole millions, keeping at least one million.
+long ScaleQuantity(long _quantity, double _factor)
+{
+	long _millions = (long)(_quantity * _factor / 1000000.0 + 0.5);
+	return max(_millions, 1L) * 1000000;
+}
+
 template<typename T>
 void AlgoStreamingService<T>::AlgoPublishPrice(Price<T>& _price)
 {
 	T _product = _price.GetProduct();
-	string _productId = _product.GetProductId();
+	Identifier _productId = _product.GetProductId();
+	const PriceSkew& _skew = skewEngine.GetSkew(_productId);
 
-	double _mid = _price.GetMid();
-	double _bidOfferSpread = _price.GetBidOfferSpread();
+	double _mid = _price.GetMid() + _skew.shift;
+	double _bidOfferSpread = _price.GetBidOfferSpread() * _skew.widening;
 	double _bidPrice = _mid - _bidOfferSpread / 2.0;
 	double _offerPrice = _mid + _bidOfferSpread / 2.0;
 	long _visibleQuantity = (count % 2 + 1) * 10000000;
-	long _hiddenQuantity = _visibleQuantity * 2;
+	long _bidVisibleQuantity = ScaleQuantity(_visibleQuantity, _skew.bidSizeFactor);
+	long _offerVisibleQuantity = ScaleQuantity(_visibleQuantity, _skew.offerSizeFactor);
 
 	count++;
-	PriceStreamOrder _bidOrder(_bidPrice, _visibleQuantity, _hiddenQuantity, BID);
-	PriceStreamOrder _offerOrder(_offerPrice, _visibleQuantity, _hiddenQuantity, OFFER);
+	PriceStreamOrder _bidOrder(_bidPrice, _bidVisibleQuantity, _bidVisibleQuantity * 2, BID);
+	PriceStreamOrder _offerOrder(_offerPrice, _offerVisibleQuantity, _offerVisibleQuantity * 2, OFFER);
 	AlgoStream<T> _algoStream(_product, _bidOrder, _offerOrder);
 	algoStreams[_productId] = _algoStream;
 
@@ -372,4 +586,104 @@ void AlgoStreamingToPricingListener<T>::ProcessRemove(Price<T>& _data) {}
 template<typename T>
 void AlgoStreamingToPricingListener<T>::ProcessUpdate(Price<T>& _data) {}
 
+/**
+* Algo Streaming Service Listener subscribing data from Position Service to Algo Streaming Service.
+* Type T is the product type.
+*/
+template<typename T>
+class AlgoStreamingToPositionListener : public ServiceListener<Position<T>>
+{
+
+private:
+
+	AlgoStreamingService<T>* service;
+
+public:
+
+	// Connector and Destructor
+	AlgoStreamingToPositionListener(AlgoStreamingService<T>* _service);
+	~AlgoStreamingToPositionListener();
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(Position<T>& _data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(Position<T>& _data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(Position<T>& _data);
+
+};
+
+template<typename T>
+AlgoStreamingToPositionListener<T>::AlgoStreamingToPositionListener(AlgoStreamingService<T>* _service)
+{
+	service = _service;
+}
+
+template<typename T>
+AlgoStreamingToPositionListener<T>::~AlgoStreamingToPositionListener() {}
+
+template<typename T>
+void AlgoStreamingToPositionListener<T>::ProcessAdd(Position<T>& _data)
+{
+	service->GetSkewEngine().UpdatePosition(_data.GetProduct().GetProductId(), _data.GetAggregatePosition());
+}
+
+template<typename T>
+void AlgoStreamingToPositionListener<T>::ProcessRemove(Position<T>& _data) {}
+
+template<typename T>
+void AlgoStreamingToPositionListener<T>::ProcessUpdate(Position<T>& _data) {}
+
+/**
+* Algo Streaming Service Listener subscribing data from Risk Service to Algo Streaming Service.
+* Type T is the product type.
+*/
+template<typename T>
+class AlgoStreamingToRiskListener : public ServiceListener<PV01<T>>
+{
+
+private:
+
+	AlgoStreamingService<T>* service;
+
+public:
+
+	// Connector and Destructor
+	AlgoStreamingToRiskListener(AlgoStreamingService<T>* _service);
+	~AlgoStreamingToRiskListener();
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(PV01<T>& _data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(PV01<T>& _data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(PV01<T>& _data);
+
+};
+
+template<typename T>
+AlgoStreamingToRiskListener<T>::AlgoStreamingToRiskListener(AlgoStreamingService<T>* _service)
+{
+	service = _service;
+}
+
+template<typename T>
+AlgoStreamingToRiskListener<T>::~AlgoStreamingToRiskListener() {}
+
+template<typename T>
+void AlgoStreamingToRiskListener<T>::ProcessAdd(PV01<T>& _data)
+{
+	service->GetSkewEngine().UpdateRisk(_data.GetProduct().GetProductId(), _data.GetPV01() * _data.GetQuantity());
+}
+
+template<typename T>
+void AlgoStreamingToRiskListener<T>::ProcessRemove(PV01<T>& _data) {}
+
+template<typename T>
+void AlgoStreamingToRiskListener<T>::ProcessUpdate(PV01<T>& _data) {}
+
 #endif
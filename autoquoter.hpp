@@ -0,0 +1,136 @@
+/**
+* autoquoter.hpp
+* Defines the quoter pricing customer inquiries from live prices and inventory.
+*
+* @author Haonan Lu
+*/
+
+#ifndef AUTO_QUOTER_HPP
+#define AUTO_QUOTER_HPP
+
+#include <vector>
+#include <algorithm>
+#include <climits>
+#include "soa.hpp"
+#include "inquiryservice.hpp"
+#include "pricingservice.hpp"
+#include "positionservice.hpp"
+
+using namespace std;
+
+/**
+* A size tier of the quoter: inquiries up to a quantity get the bid/offer
+* spread widened by a multiple.
+*/
+struct QuoteTier
+{
+	long maxQuantity;
+	double spreadMultiple;
+};
+
+/**
+* Auto quoter.
+* Prices an inquiry off the latest mid of its product: a client buy is
+* offered above the mid and a client sell bid below it, by half the
+* bid/offer spread times the multiple of the size tier of the inquiry. The
+* quote is skewed against the inventory of the product, lower when long and
+* higher when short, up to a cap. Mids and positions are read from the
+* snapshots the services publish, so a quote takes no lock and allocates
+* nothing, whatever threads the prices and positions are updated on.
+* Type T is the product type.
+*/
+template<typename T>
+class AutoQuoter : public InquiryQuoter<T>
+{
+
+public:
+
+	// ctor for a quoter on the pricing and position services
+	AutoQuoter(const PricingService<T>* _pricingService, const PositionService<T>* _positionService);
+
+	// Price an inquiry, false when its product has no price yet
+	bool Quote(const Inquiry<T>& _inquiry, double& _price) override;
+
+	// Set the size tiers, ordered by quantity; larger inquiries get the last tier
+	void SetTiers(const vector<QuoteTier>& _tiers);
+
+	// Set the skew per million of inventory and the largest skew, in price
+	void SetSkew(double _skewPerMillion, double _maxSkew);
+
+	// Get the number of inquiries quoted
+	long GetQuoteCount() const;
+
+private:
+
+	const PricingService<T>* pricingService;
+	const PositionService<T>* positionService;
+	vector<QuoteTier> tiers;
+	double skewPerMillion;
+	double maxSkew;
+	long quoteCount;
+
+};
+
+template<typename T>
+AutoQuoter<T>::AutoQuoter(const PricingService<T>* _pricingService, const PositionService<T>* _positionService)
+{
+	pricingService = _pricingService;
+	positionService = _positionService;
+	tiers = { { 1000000, 1.0 }, { 5000000, 1.5 }, { 10000000, 2.0 }, { LONG_MAX, 3.0 } };
+	skewPerMillion = 1.0 / 4096.0;
+	maxSkew = 1.0 / 128.0;
+	quoteCount = 0;
+}
+
+template<typename T>
+bool AutoQuoter<T>::Quote(const Inquiry<T>& _inquiry, double& _price)
+{
+	const string& _productId = _inquiry.GetProduct().GetProductId();
+	PriceSnapshot _priceSnapshot;
+	if (!pricingService->GetSnapshot(_productId, _priceSnapshot)) return false;
+
+	long _quantity = _inquiry.GetQuantity();
+	double _multiple = tiers.back().spreadMultiple;
+	for (auto& t : tiers)
+	{
+		if (_quantity <= t.maxQuantity)
+		{
+			_multiple = t.spreadMultiple;
+			break;
+		}
+	}
+	double _halfSpread = _priceSnapshot.bidOfferSpread / 2.0 * _multiple;
+
+	PositionSnapshot _positionSnapshot;
+	double _skew = 0;
+	if (positionService->GetSnapshot(_productId, _positionSnapshot))
+	{
+		_skew = -_positionSnapshot.aggregatePosition / 1000000.0 * skewPerMillion;
+		_skew = max(-maxSkew, min(maxSkew, _skew));
+	}
+
+	_price = _priceSnapshot.mid + _skew + (_inquiry.GetSide() == BUY ? _halfSpread : -_halfSpread);
+	quoteCount++;
+	return true;
+}
+
+template<typename T>
+void AutoQuoter<T>::SetTiers(const vector<QuoteTier>& _tiers)
+{
+	if (!_tiers.empty()) tiers = _tiers;
+}
+
+template<typename T>
+void AutoQuoter<T>::SetSkew(double _skewPerMillion, double _maxSkew)
+{
+	skewPerMillion = _skewPerMillion;
+	maxSkew = _maxSkew;
+}
+
+template<typename T>
+long AutoQuoter<T>::GetQuoteCount() const
+{
+	return quoteCount;
+}
+
+#endif
@@ -0,0 +1,739 @@
+/**
+* checkpoint.hpp
+* Defines the checkpoints of service state taken during a replay and restored on restart.
+*
+* @author Haonan Lu
+*/
+
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "soa.hpp"
+#include "replayengine.hpp"
+#include "pricingservice.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.hpp"
+#include "executionservice.hpp"
+#include "tradebookingservice.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+#include "inquiryservice.hpp"
+#include "algostreamingservice.hpp"
+#include "streamingservice.hpp"
+#include "curveservice.hpp"
+#include "historicaldataservice.hpp"
+#include "sharedmemoryconnector.hpp"
+
+using namespace std;
+
+/**
+* Checkpoint record of the position of a product in one book.
+*/
+struct PositionRecord
+{
+	char productId[16];
+	char book[16];
+	long quantity;
+};
+
+/**
+* Checkpoint record of the risk of a product.
+*/
+struct RiskRecord
+{
+	char productId[16];
+	double pv01;
+	long quantity;
+};
+
+/**
+* Checkpoint record of a live inquiry.
+*/
+struct InquiryRecord
+{
+	char inquiryId[24];
+	char productId[16];
+	int side;
+	int state;
+	long quantity;
+	double price;
+};
+
+/**
+* Checkpoint record of the number of orders executed on the books of a product.
+*/
+struct AlgoCountRecord
+{
+	char productId[16];
+	long count;
+};
+
+/**
+* Checkpoint record of the mid and par yield a curve pillar was last fitted to.
+*/
+struct CurveRecord
+{
+	char productId[16];
+	double mid;
+	double parYield;
+};
+
+/**
+* Checkpoint record of the last two-way price of a product sent to listeners and when it was sent.
+*/
+struct StreamRecord
+{
+	char productId[16];
+	double bidPrice;
+	long bidVisibleQuantity;
+	long bidHiddenQuantity;
+	double offerPrice;
+	long offerVisibleQuantity;
+	long offerHiddenQuantity;
+	long publishedTime;
+};
+
+/**
+* Checkpoint record of an order working on a market and the number of fills it had.
+*/
+struct WorkingOrderRecord
+{
+	ExecutionOrderWire order;
+	long fillCount;
+};
+
+/**
+* Checkpoint record of a child order the router tracks until it is done.
+*/
+struct ChildOrderRecord
+{
+	char orderId[24];
+	int market;
+	long quantity;
+	long filledQuantity;
+};
+
+/**
+* Checkpoint record of how far a history file had been written.
+*/
+struct HistoryRecord
+{
+	char path[64];
+	long size;
+	long entryCount;
+};
+
+/**
+* Header of a checkpoint file, followed by arrays of records in this order:
+* input offsets, positions, risk, inquiries, prices, venue books, venue
+* liquidity, algo execution counts, working orders, fills not yet collected,
+* child orders, streams, curve pillars and history files.
+*/
+struct CheckpointHeader
+{
+	uint64_t magic;
+	uint64_t version;
+	long time;
+	long journalCount;
+	long executionCount;
+	long streamCount;
+	double fillProbabilities[NUM_MARKETS];
+	long offsetCount;
+	long positionCount;
+	long riskCount;
+	long inquiryCount;
+	long priceCount;
+	long bookCount;
+	long liquidityCount;
+	long algoCount;
+	long workingCount;
+	long fillCount;
+	long childCount;
+	long publishedCount;
+	long pillarCount;
+	long historyCount;
+	uint64_t idSeed;
+	uint64_t idCount;
+};
+
+static_assert(is_trivially_copyable<InputOffset>::value && is_trivially_copyable<PositionRecord>::value
+	&& is_trivially_copyable<RiskRecord>::value && is_trivially_copyable<InquiryRecord>::value
+	&& is_trivially_copyable<AlgoCountRecord>::value && is_trivially_copyable<WorkingOrderRecord>::value && is_trivially_copyable<ExecutionFill>::value
+	&& is_trivially_copyable<ChildOrderRecord>::value && is_trivially_copyable<StreamRecord>::value && is_trivially_copyable<CurveRecord>::value && is_trivially_copyable<HistoryRecord>::value, "checkpoint records must be trivially copyable");
+
+/**
+* Checkpointer of the services a replay drives.
+* A checkpoint is taken between two events of a replay, so the state saved
+* matches the input offsets saved with it. It is only taken at a quiescent
+* point, with no book partly received, no order resting on a venue, no
+* parent order active and no stream held back by conflation; state in flight
+* is then nothing but what is saved:
+* - positions, risk and live inquiries;
+* - the latest price of each product;
+* - the latest book of each product on each venue, which also rebuilds the
+*   quotes of the router, and the venue liquidity left after our fills;
+* - the fill probabilities of the router and the algo execution counts;
+* - the orders whose fills the venues have queued for the next book, with
+*   those fills and the child orders the router tracks;
+* - the number of two-way prices streamed and the last stream of each
+*   product, against which unchanged quotes are suppressed;
+* - the quotes the curve was last fitted to, refitted on restore so that
+*   positions are risked off the same curve;
+* - the record count of the trade journal, whose trades are already in it;
+* - the size of each history file and of its index.
+* Taking one only copies the state into flat records; the file is written on
+* the executor, to a temporary file renamed over the last checkpoint, while
+* the replay carries on. A checkpoint due while the previous one is still
+* being written is skipped. On restart the file is mapped, the history files
+* are cut back to where they were, the services are restored on the event
+* time of the checkpoint and the replay resumes from the offsets, replaying
+* only the tail.
+* Type T is the product type.
+*/
+template<typename T>
+class Checkpointer
+{
+
+public:
+
+	// ctor for a checkpointer writing to a file
+	Checkpointer(const string& _path, PricingService<T>* _pricingService, MarketDataService<T>* _marketDataService, AlgoExecutionService<T>* _algoExecutionService, ExecutionService<T>* _executionService,
+		TradeBookingService<T>* _tradeBookingService, PositionService<T>* _positionService, RiskService<T>* _riskService, InquiryService<T>* _inquiryService,
+		AlgoStreamingService<T>* _algoStreamingService, StreamingService<T>* _streamingService, CurveService<T>* _curveService);
+
+	// Add a history file to cut back on restore to where it was at the checkpoint
+	void AddHistory(HistoryFile* _history);
+
+	// Is the state between two events wholly saved by a checkpoint?
+	bool IsQuiescent() const;
+
+	// Take a checkpoint at an event time with the input offsets reached, false if skipped
+	bool Take(long _time, const vector<InputOffset>& _offsets);
+
+	// Wait until the checkpoint being written is done
+	void Wait();
+
+	// Restore the services from the checkpoint file on a virtual clock set to its time and get its input offsets, false if there is none
+	bool Restore(vector<InputOffset>& _offsets, VirtualClock& _clock);
+
+	// Get the event time of the last checkpoint taken or restored
+	long GetTime() const;
+
+	// Get the number of checkpoints taken
+	long GetCount() const;
+
+	// Get the number of checkpoints skipped while one was being written
+	long GetSkippedCount() const;
+
+private:
+
+	static const uint64_t MAGIC = 0x54504b4843545352;
+	static const uint64_t VERSION = 3;
+
+	string path;
+	PricingService<T>* pricingService;
+	MarketDataService<T>* marketDataService;
+	AlgoExecutionService<T>* algoExecutionService;
+	ExecutionService<T>* executionService;
+	TradeBookingService<T>* tradeBookingService;
+	PositionService<T>* positionService;
+	RiskService<T>* riskService;
+	InquiryService<T>* inquiryService;
+	AlgoStreamingService<T>* algoStreamingService;
+	StreamingService<T>* streamingService;
+	CurveService<T>* curveService;
+	vector<HistoryFile*> histories;
+	TaskGroup writes;
+	long time;
+	long count;
+	long skippedCount;
+
+	// Write a captured checkpoint to the file
+	static void Write(const string& _path, const vector<char>& _buffer);
+
+	// Append the bytes of records to a buffer
+	template<typename R>
+	static void Append(vector<char>& _buffer, const vector<R>& _records);
+
+	// Get the records following a cursor and move the cursor past them
+	template<typename R>
+	static const R* Next(const char*& _cursor, long _count);
+
+};
+
+template<typename T>
+Checkpointer<T>::Checkpointer(const string& _path, PricingService<T>* _pricingService, MarketDataService<T>* _marketDataService, AlgoExecutionService<T>* _algoExecutionService, ExecutionService<T>* _executionService,
+	TradeBookingService<T>* _tradeBookingService, PositionService<T>* _positionService, RiskService<T>* _riskService, InquiryService<T>* _inquiryService,
+	AlgoStreamingService<T>* _algoStreamingService, StreamingService<T>* _streamingService, CurveService<T>* _curveService)
+{
+	path = _path;
+	pricingService = _pricingService;
+	marketDataService = _marketDataService;
+	algoExecutionService = _algoExecutionService;
+	executionService = _executionService;
+	tradeBookingService = _tradeBookingService;
+	positionService = _positionService;
+	riskService = _riskService;
+	inquiryService = _inquiryService;
+	algoStreamingService = _algoStreamingService;
+	streamingService = _streamingService;
+	curveService = _curveService;
+	histories = vector<HistoryFile*>();
+	time = 0;
+	count = 0;
+	skippedCount = 0;
+}
+
+template<typename T>
+void Checkpointer<T>::AddHistory(HistoryFile* _history)
+{
+	histories.push_back(_history);
+}
+
+template<typename T>
+bool Checkpointer<T>::IsQuiescent() const
+{
+	if (!marketDataService->GetConnector()->IsBetweenBooks() || algoExecutionService->GetActiveParentCount() > 0) return false;
+	for (int m = 0; m < NUM_MARKETS; ++m)
+	{
+		if (executionService->GetConnector((Market)m)->GetEngine().GetRestingCount() > 0) return false;
+	}
+	for (auto& c : streamingService->GetConflations())
+	{
+		if (c.second.hasPending) return false;
+	}
+	return true;
+}
+
+template<typename T>
+template<typename R>
+void Checkpointer<T>::Append(vector<char>& _buffer, const vector<R>& _records)
+{
+	const char* _bytes = (const char*)_records.data();
+	_buffer.insert(_buffer.end(), _bytes, _bytes + _records.size() * sizeof(R));
+}
+
+template<typename T>
+template<typename R>
+const R* Checkpointer<T>::Next(const char*& _cursor, long _count)
+{
+	const R* _records = (const R*)_cursor;
+	_cursor += _count * sizeof(R);
+	return _records;
+}
+
+template<typename T>
+bool Checkpointer<T>::Take(long _time, const vector<InputOffset>& _offsets)
+{
+	if (writes.GetPendingCount() > 0)
+	{
+		skippedCount++;
+		return false;
+	}
+
+	vector<PositionRecord> _positions;
+	for (auto& p : positionService->GetAllPositions())
+	{
+		Position<T> _position = p.second;
+		for (auto& b : _position.GetPositions())
+		{
+			PositionRecord _record;
+			CopyField(_record.productId, p.first);
+			CopyField(_record.book, b.first);
+			_record.quantity = b.second;
+			_positions.push_back(_record);
+		}
+	}
+
+	vector<RiskRecord> _risks;
+	for (auto& r : riskService->GetAllRisk())
+	{
+		RiskRecord _record;
+		CopyField(_record.productId, r.first);
+		_record.pv01 = r.second.GetPV01();
+		_record.quantity = r.second.GetQuantity();
+		_risks.push_back(_record);
+	}
+
+	vector<InquiryRecord> _inquiries;
+	for (auto& i : inquiryService->GetLiveInquiries())
+	{
+		InquiryRecord _record;
+		CopyField(_record.inquiryId, i.GetInquiryId());
+		CopyField(_record.productId, i.GetProduct().GetProductId());
+		_record.side = i.GetSide();
+		_record.state = i.GetState();
+		_record.quantity = i.GetQuantity();
+		_record.price = i.GetPrice();
+		_inquiries.push_back(_record);
+	}
+
+	vector<PriceWire> _prices;
+	for (auto& p : pricingService->GetAllPrices())
+	{
+		PriceWire _wire;
+		WireFormat<Price<T>>::Encode(p.second, _wire);
+		_prices.push_back(_wire);
+	}
+
+	// The latest book of a product is saved after its other venues, so it is restored last.
+	vector<OrderBookWire> _books;
+	vector<OrderBookWire> _liquidity;
+	vector<AlgoCountRecord> _algoCounts;
+	for (auto& b : marketDataService->GetVenueBooks())
+	{
+		Market _latest = marketDataService->GetData(b.first).GetMarket();
+		for (int m = 0; m < NUM_MARKETS; ++m)
+		{
+			Market _market = (Market)((_latest + 1 + m) % NUM_MARKETS);
+			const OrderBook<T>& _book = b.second[_market];
+			if (_book.GetBidStack().empty() && _book.GetOfferStack().empty()) continue;
+			OrderBookWire _wire;
+			WireFormat<OrderBook<T>>::Encode(_book, _wire);
+			_books.push_back(_wire);
+		}
+
+		for (int m = 0; m < NUM_MARKETS; ++m)
+		{
+			OrderBook<T> _book;
+			if (!executionService->GetConnector((Market)m)->GetEngine().GetLiquidity(b.first, _book)) continue;
+			OrderBookWire _wire;
+			WireFormat<OrderBook<T>>::Encode(_book, _wire);
+			_liquidity.push_back(_wire);
+		}
+
+		AlgoCountRecord _record;
+		CopyField(_record.productId, b.first);
+		_record.count = algoExecutionService->GetExecutionCount(b.first);
+		_algoCounts.push_back(_record);
+	}
+
+	vector<WorkingOrderRecord> _workingOrders;
+	for (auto& w : executionService->GetWorkingOrders())
+	{
+		WorkingOrderRecord _record;
+		WireFormat<ExecutionOrder<T>>::Encode(w.second.order, _record.order);
+		_record.fillCount = w.second.fillCount;
+		_workingOrders.push_back(_record);
+	}
+
+	// Fills are saved in the order the markets are polled, so they are collected in the same order.
+	vector<ExecutionFill> _fills;
+	for (int m = 0; m < NUM_MARKETS; ++m)
+	{
+		const vector<ExecutionFill>& _queued = executionService->GetConnector((Market)m)->GetEngine().GetFills();
+		_fills.insert(_fills.end(), _queued.begin(), _queued.end());
+	}
+
+	vector<ChildOrderRecord> _childOrders;
+	for (auto& c : executionService->GetRouter().GetChildOrders())
+	{
+		ChildOrderRecord _record;
+		CopyField(_record.orderId, c.first);
+		_record.market = c.second.market;
+		_record.quantity = c.second.quantity;
+		_record.filledQuantity = c.second.filledQuantity;
+		_childOrders.push_back(_record);
+	}
+
+	vector<StreamRecord> _streams;
+	for (auto& c : streamingService->GetConflations())
+	{
+		if (!c.second.hasPublished) continue;
+		const PriceStream<T>& _stream = c.second.published;
+		StreamRecord _record;
+		CopyField(_record.productId, c.first);
+		_record.bidPrice = _stream.GetBidOrder().GetPrice();
+		_record.bidVisibleQuantity = _stream.GetBidOrder().GetVisibleQuantity();
+		_record.bidHiddenQuantity = _stream.GetBidOrder().GetHiddenQuantity();
+		_record.offerPrice = _stream.GetOfferOrder().GetPrice();
+		_record.offerVisibleQuantity = _stream.GetOfferOrder().GetVisibleQuantity();
+		_record.offerHiddenQuantity = _stream.GetOfferOrder().GetHiddenQuantity();
+		_record.publishedTime = c.second.publishedTime;
+		_streams.push_back(_record);
+	}
+
+	vector<CurveRecord> _pillars;
+	for (auto& c : CUSIPS)
+	{
+		CurveRecord _record;
+		if (!curveService->GetQuote(c, _record.mid, _record.parYield)) continue;
+		CopyField(_record.productId, c);
+		_pillars.push_back(_record);
+	}
+
+	vector<HistoryRecord> _histories;
+	for (auto& h : histories)
+	{
+		HistoryRecord _record;
+		CopyField(_record.path, h->GetPath());
+		_record.size = h->GetSize();
+		_record.entryCount = h->GetEntryCount();
+		_histories.push_back(_record);
+	}
+
+	CheckpointHeader _header = {};
+	_header.magic = MAGIC;
+	_header.version = VERSION;
+	_header.time = _time;
+	_header.idSeed = GetIdSequence().seed;
+	_header.idCount = GetIdSequence().count;
+	_header.journalCount = tradeBookingService->GetJournal()->GetCount();
+	_header.executionCount = tradeBookingService->GetListener()->GetCount();
+	_header.streamCount = algoStreamingService->GetCount();
+	for (int m = 0; m < NUM_MARKETS; ++m)
+	{
+		_header.fillProbabilities[m] = executionService->GetRouter().GetFillProbability((Market)m);
+	}
+	_header.offsetCount = (long)_offsets.size();
+	_header.positionCount = (long)_positions.size();
+	_header.riskCount = (long)_risks.size();
+	_header.inquiryCount = (long)_inquiries.size();
+	_header.priceCount = (long)_prices.size();
+	_header.bookCount = (long)_books.size();
+	_header.liquidityCount = (long)_liquidity.size();
+	_header.algoCount = (long)_algoCounts.size();
+	_header.workingCount = (long)_workingOrders.size();
+	_header.fillCount = (long)_fills.size();
+	_header.childCount = (long)_childOrders.size();
+	_header.publishedCount = (long)_streams.size();
+	_header.pillarCount = (long)_pillars.size();
+	_header.historyCount = (long)_histories.size();
+
+	vector<char> _buffer((const char*)&_header, (const char*)&_header + sizeof(CheckpointHeader));
+	Append(_buffer, _offsets);
+	Append(_buffer, _positions);
+	Append(_buffer, _risks);
+	Append(_buffer, _inquiries);
+	Append(_buffer, _prices);
+	Append(_buffer, _books);
+	Append(_buffer, _liquidity);
+	Append(_buffer, _algoCounts);
+	Append(_buffer, _workingOrders);
+	Append(_buffer, _fills);
+	Append(_buffer, _childOrders);
+	Append(_buffer, _streams);
+	Append(_buffer, _pillars);
+	Append(_buffer, _histories);
+
+	tradeBookingService->GetJournal()->Flush();
+	string _path = path;
+	GetExecutor().Submit(writes, [_path, _buffer]() { Write(_path, _buffer); });
+	time = _time;
+	count++;
+	return true;
+}
+
+template<typename T>
+void Checkpointer<T>::Write(const string& _path, const vector<char>& _buffer)
+{
+	// The new checkpoint replaces the last one only once it is wholly on disk.
+	string _temporary = _path + ".tmp";
+	int _fd = open(_temporary.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0644);
+	if (_fd < 0) return;
+
+	size_t _written = 0;
+	while (_written < _buffer.size())
+	{
+		ssize_t _result = write(_fd, _buffer.data() + _written, _buffer.size() - _written);
+		if (_result <= 0) break;
+		_written += _result;
+	}
+	bool _complete = _written == _buffer.size() && fsync(_fd) == 0;
+	close(_fd);
+	if (_complete) rename(_temporary.c_str(), _path.c_str());
+	else unlink(_temporary.c_str());
+}
+
+template<typename T>
+void Checkpointer<T>::Wait()
+{
+	GetExecutor().Wait(writes);
+}
+
+template<typename T>
+bool Checkpointer<T>::Restore(vector<InputOffset>& _offsets, VirtualClock& _clock)
+{
+	int _fd = open(path.c_str(), O_RDONLY);
+	if (_fd < 0) return false;
+	struct stat _stat;
+	if (fstat(_fd, &_stat) != 0 || (size_t)_stat.st_size < sizeof(CheckpointHeader))
+	{
+		close(_fd);
+		return false;
+	}
+	size_t _size = _stat.st_size;
+	void* _memory = mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0);
+	close(_fd);
+	if (_memory == MAP_FAILED) return false;
+
+	const CheckpointHeader* _header = (const CheckpointHeader*)_memory;
+	size_t _expected = sizeof(CheckpointHeader) + _header->offsetCount * sizeof(InputOffset) + _header->positionCount * sizeof(PositionRecord)
+		+ _header->riskCount * sizeof(RiskRecord) + _header->inquiryCount * sizeof(InquiryRecord) + _header->priceCount * sizeof(PriceWire)
+		+ (_header->bookCount + _header->liquidityCount) * sizeof(OrderBookWire) + _header->algoCount * sizeof(AlgoCountRecord) + _header->workingCount * sizeof(WorkingOrderRecord) + _header->fillCount * sizeof(ExecutionFill)
+		+ _header->childCount * sizeof(ChildOrderRecord) + _header->publishedCount * sizeof(StreamRecord) + _header->pillarCount * sizeof(CurveRecord) + _header->historyCount * sizeof(HistoryRecord);
+	if (_header->magic != MAGIC || _header->version != VERSION || _size != _expected)
+	{
+		munmap(_memory, _size);
+		return false;
+	}
+
+	const char* _cursor = (const char*)_memory + sizeof(CheckpointHeader);
+	const InputOffset* _inputOffsets = Next<InputOffset>(_cursor, _header->offsetCount);
+	const PositionRecord* _positions = Next<PositionRecord>(_cursor, _header->positionCount);
+	const RiskRecord* _risks = Next<RiskRecord>(_cursor, _header->riskCount);
+	const InquiryRecord* _inquiries = Next<InquiryRecord>(_cursor, _header->inquiryCount);
+	const PriceWire* _prices = Next<PriceWire>(_cursor, _header->priceCount);
+	const OrderBookWire* _books = Next<OrderBookWire>(_cursor, _header->bookCount);
+	const OrderBookWire* _liquidity = Next<OrderBookWire>(_cursor, _header->liquidityCount);
+	const AlgoCountRecord* _algoCounts = Next<AlgoCountRecord>(_cursor, _header->algoCount);
+	const WorkingOrderRecord* _workingOrders = Next<WorkingOrderRecord>(_cursor, _header->workingCount);
+	const ExecutionFill* _fills = Next<ExecutionFill>(_cursor, _header->fillCount);
+	const ChildOrderRecord* _childOrders = Next<ChildOrderRecord>(_cursor, _header->childCount);
+	const StreamRecord* _streams = Next<StreamRecord>(_cursor, _header->publishedCount);
+	const CurveRecord* _pillars = Next<CurveRecord>(_cursor, _header->pillarCount);
+	const HistoryRecord* _histories = Next<HistoryRecord>(_cursor, _header->historyCount);
+	_offsets.assign(_inputOffsets, _inputOffsets + _header->offsetCount);
+
+	// Timers the services arm again run on event time, from the time of the checkpoint.
+	_clock.SetTime(_header->time);
+	ClockGuard _clockGuard(GetTimerWheel(), &_clock);
+	GetIdSequence() = { _header->idSeed, _header->idCount };
+
+	// History files are cut back first, before restored services write to them again.
+	for (long i = 0; i < _header->historyCount; ++i)
+	{
+		for (auto& h : histories)
+		{
+			if (h->GetPath() == _histories[i].path) h->Truncate(_histories[i].size, _histories[i].entryCount);
+		}
+	}
+
+	// Books of a product are saved as separate records, next to each other.
+	map<string, Position<T>> _restored;
+	for (long i = 0; i < _header->positionCount; ++i)
+	{
+		string _productId = _positions[i].productId;
+		string _book = _positions[i].book;
+		auto _it = _restored.find(_productId);
+		if (_it == _restored.end()) _it = _restored.insert({ _productId, Position<T>(GetBond(_productId)) }).first;
+		_it->second.AddPosition(_book, _positions[i].quantity);
+	}
+	// The skew of the streamed prices follows the positions and risk restored.
+	SkewEngine& _skewEngine = algoStreamingService->GetSkewEngine();
+	for (auto& p : _restored)
+	{
+		positionService->OnMessage(p.second);
+		_skewEngine.UpdatePosition(p.first, p.second.GetAggregatePosition());
+	}
+
+	for (long i = 0; i < _header->riskCount; ++i)
+	{
+		PV01<T> _pv01(GetBond(_risks[i].productId), _risks[i].pv01, _risks[i].quantity);
+		riskService->OnMessage(_pv01);
+		_skewEngine.UpdateRisk(_risks[i].productId, _risks[i].pv01 * _risks[i].quantity);
+	}
+
+	// The curve is refitted once all its pillars are back, which hands it to the risk service.
+	for (long i = 0; i < _header->pillarCount; ++i)
+	{
+		curveService->Restore(_pillars[i].productId, _pillars[i].mid, _pillars[i].parYield);
+	}
+
+	tradeBookingService->Restore(_header->journalCount);
+	tradeBookingService->GetListener()->SetCount(_header->executionCount);
+
+	for (long i = 0; i < _header->priceCount; ++i)
+	{
+		Price<T> _price = WireFormat<Price<T>>::Decode(_prices[i]);
+		pricingService->Restore(_price);
+	}
+
+	// The router quotes the latest venue books, while the engines match what our fills left of them.
+	SmartOrderRouter<T>& _router = executionService->GetRouter();
+	for (long i = 0; i < _header->bookCount; ++i)
+	{
+		OrderBook<T> _book = WireFormat<OrderBook<T>>::Decode(_books[i]);
+		marketDataService->Restore(_book);
+		_router.UpdateQuote(_book);
+	}
+	for (long i = 0; i < _header->liquidityCount; ++i)
+	{
+		OrderBook<T> _book = WireFormat<OrderBook<T>>::Decode(_liquidity[i]);
+		executionService->GetConnector(_book.GetMarket())->UpdateBook(_book);
+	}
+	for (int m = 0; m < NUM_MARKETS; ++m)
+	{
+		_router.SetFillProbability((Market)m, _header->fillProbabilities[m]);
+	}
+	for (long i = 0; i < _header->algoCount; ++i)
+	{
+		algoExecutionService->SetExecutionCount(_algoCounts[i].productId, _algoCounts[i].count);
+	}
+
+	// Fills queued for the next book are collected after the liquidity they were taken from is restored.
+	for (long i = 0; i < _header->workingCount; ++i)
+	{
+		ExecutionOrder<T> _order = WireFormat<ExecutionOrder<T>>::Decode(_workingOrders[i].order);
+		executionService->RestoreWorkingOrder(_order, _workingOrders[i].fillCount);
+	}
+	for (long i = 0; i < _header->fillCount; ++i)
+	{
+		executionService->GetConnector(_fills[i].GetMarket())->GetEngine().RestoreFill(_fills[i]);
+	}
+	for (long i = 0; i < _header->childCount; ++i)
+	{
+		const ChildOrderRecord& _record = _childOrders[i];
+		_router.RestoreChildOrder(_record.orderId, { (Market)_record.market, _record.quantity, _record.filledQuantity });
+	}
+
+	algoStreamingService->SetCount(_header->streamCount);
+	for (long i = 0; i < _header->publishedCount; ++i)
+	{
+		const StreamRecord& _record = _streams[i];
+		PriceStreamOrder _bidOrder(_record.bidPrice, _record.bidVisibleQuantity, _record.bidHiddenQuantity, BID);
+		PriceStreamOrder _offerOrder(_record.offerPrice, _record.offerVisibleQuantity, _record.offerHiddenQuantity, OFFER);
+		streamingService->RestorePublished(PriceStream<T>(GetBond(_record.productId), _bidOrder, _offerOrder), _record.publishedTime);
+	}
+
+	for (long i = 0; i < _header->inquiryCount; ++i)
+	{
+		const InquiryRecord& _record = _inquiries[i];
+		Inquiry<T> _inquiry(_record.inquiryId, GetBond(_record.productId), (Side)_record.side, _record.quantity, _record.price, (InquiryState)_record.state);
+		inquiryService->Restore(_inquiry);
+	}
+
+	time = _header->time;
+	munmap(_memory, _size);
+	return true;
+}
+
+template<typename T>
+long Checkpointer<T>::GetTime() const
+{
+	return time;
+}
+
+template<typename T>
+long Checkpointer<T>::GetCount() const
+{
+	return count;
+}
+
+template<typename T>
+long Checkpointer<T>::GetSkippedCount() const
+{
+	return skippedCount;
+}
+
+#endif
@@ -0,0 +1,544 @@
+/**
+* curveservice.hpp
+* Defines the data types and Service for the treasury yield curve.
+*
+* @author Haonan Lu
+*/
+
+#ifndef CURVE_SERVICE_HPP
+#define CURVE_SERVICE_HPP
+
+#include <string>
+#include <vector>
+#include <cmath>
+#include "soa.hpp"
+#include "pricingservice.hpp"
+#include "datagenerator.hpp"
+
+using namespace std;
+
+/**
+* A yield curve with par yields at the bond pillars and a bootstrapped
+* zero curve on a semi-annual grid, in years from its settlement date.
+* Bonds are priced and risked off the zero curve per 100 face.
+*/
+class YieldCurve
+{
+
+public:
+
+	// default constructor
+	YieldCurve() = default;
+
+	// ctor for a yield curve
+	YieldCurve(string _name, year_month_day _settlementDate);
+
+	// Get the name of the curve
+	const string& GetName() const;
+
+	// Get the version of the curve, bumped on every refit
+	long GetVersion() const;
+
+	// Get the tenor in years of a date from the settlement date
+	double GetTenor(year_month_day _date) const;
+
+	// Get the pillar tenors in years
+	const vector<double>& GetPillarTenors() const;
+
+	// Get the par yields at the pillars
+	const vector<double>& GetParYields() const;
+
+	// Get the tenors of the semi-annual zero grid in years
+	const vector<double>& GetTenors() const;
+
+	// Get the continuously compounded zero rates on the grid
+	const vector<double>& GetZeroRates() const;
+
+	// Get the discount factors on the grid
+	const vector<double>& GetDiscountFactors() const;
+
+	// Get the interpolated par yield for a tenor
+	double GetParYield(double _tenor) const;
+
+	// Get the interpolated zero rate for a tenor
+	double GetZeroRate(double _tenor) const;
+
+	// Get the discount factor for a tenor
+	double GetDiscountFactor(double _tenor) const;
+
+	// Get the dirty price of a bond paying a semi-annual coupon to a tenor, with the zero rates shifted in parallel
+	double GetBondPrice(double _coupon, double _tenor, double _shift = 0) const;
+
+	// Get the price gain of a bond paying a semi-annual coupon to a tenor for a one basis point fall in zero rates
+	double GetPV01(double _coupon, double _tenor) const;
+
+	// Bootstrap the zero curve from par yields at the pillars
+	void Fit(const vector<double>& _pillarTenors, const vector<double>& _parYields);
+
+	// Change attributes to strings
+	vector<string> ToStrings() const;
+
+private:
+	string name;
+	year_month_day settlementDate{};
+	long version = 0;
+	vector<double> pillarTenors;
+	vector<double> parYields;
+	vector<double> tenors;
+	vector<double> zeroRates;
+	vector<double> discountFactors;
+
+};
+
+YieldCurve::YieldCurve(string _name, year_month_day _settlementDate)
+{
+	name = _name;
+	settlementDate = _settlementDate;
+}
+
+const string& YieldCurve::GetName() const
+{
+	return name;
+}
+
+long YieldCurve::GetVersion() const
+{
+	return version;
+}
+
+double YieldCurve::GetTenor(year_month_day _date) const
+{
+	return (sys_days(_date) - sys_days(settlementDate)).count() / 365.25;
+}
+
+const vector<double>& YieldCurve::GetPillarTenors() const
+{
+	return pillarTenors;
+}
+
+const vector<double>& YieldCurve::GetParYields() const
+{
+	return parYields;
+}
+
+const vector<double>& YieldCurve::GetTenors() const
+{
+	return tenors;
+}
+
+const vector<double>& YieldCurve::GetZeroRates() const
+{
+	return zeroRates;
+}
+
+const vector<double>& YieldCurve::GetDiscountFactors() const
+{
+	return discountFactors;
+}
+
+double YieldCurve::GetParYield(double _tenor) const
+{
+	if (pillarTenors.empty()) return 0;
+	if (_tenor <= pillarTenors.front()) return parYields.front();
+	if (_tenor >= pillarTenors.back()) return parYields.back();
+
+	size_t _i = 1;
+	while (pillarTenors[_i] < _tenor) _i++;
+	double _w = (_tenor - pillarTenors[_i - 1]) / (pillarTenors[_i] - pillarTenors[_i - 1]);
+	return parYields[_i - 1] + _w * (parYields[_i] - parYields[_i - 1]);
+}
+
+double YieldCurve::GetZeroRate(double _tenor) const
+{
+	if (tenors.empty()) return 0;
+	if (_tenor <= tenors.front()) return zeroRates.front();
+	if (_tenor >= tenors.back()) return zeroRates.back();
+
+	// The grid is uniform, so the bracketing node is found directly.
+	size_t _i = (size_t)(_tenor * 2.0);
+	double _t0 = tenors[_i - 1];
+	double _t1 = tenors[_i];
+	double _w = (_tenor - _t0) / (_t1 - _t0);
+	double _rt = zeroRates[_i - 1] * _t0 + _w * (zeroRates[_i] * _t1 - zeroRates[_i - 1] * _t0);
+	return _rt / _tenor;
+}
+
+double YieldCurve::GetDiscountFactor(double _tenor) const
+{
+	return exp(-GetZeroRate(_tenor) * _tenor);
+}
+
+double YieldCurve::GetBondPrice(double _coupon, double _tenor, double _shift) const
+{
+	// Coupons fall every six months back from maturity.
+	double _halfCoupon = _coupon * 100.0 / 2.0;
+	double _price = 100.0 * GetDiscountFactor(_tenor) * exp(-_shift * _tenor);
+	for (double _t = _tenor; _t > 1e-9; _t -= 0.5)
+	{
+		_price += _halfCoupon * GetDiscountFactor(_t) * exp(-_shift * _t);
+	}
+	return _price;
+}
+
+double YieldCurve::GetPV01(double _coupon, double _tenor) const
+{
+	return GetBondPrice(_coupon, _tenor, -0.00005) - GetBondPrice(_coupon, _tenor, 0.00005);
+}
+
+void YieldCurve::Fit(const vector<double>& _pillarTenors, const vector<double>& _parYields)
+{
+	pillarTenors = _pillarTenors;
+	parYields = _parYields;
+
+	int _periods = (int)ceil(pillarTenors.back() * 2.0 - 1e-9);
+	tenors.resize(_periods);
+	zeroRates.resize(_periods);
+	discountFactors.resize(_periods);
+
+	// Standard par bootstrap: a par bond with coupon c prices at 1, so
+	// D_n = (1 - c/2 * sum(D_1..D_n-1)) / (1 + c/2).
+	double _annuity = 0;
+	for (int i = 0; i < _periods; ++i)
+	{
+		double _tenor = (i + 1) / 2.0;
+		double _halfCoupon = GetParYield(_tenor) / 2.0;
+		double _discountFactor = (1.0 - _halfCoupon * _annuity) / (1.0 + _halfCoupon);
+		_annuity += _discountFactor;
+
+		tenors[i] = _tenor;
+		discountFactors[i] = _discountFactor;
+		zeroRates[i] = -log(_discountFactor) / _tenor;
+	}
+	version++;
+}
+
+vector<string> YieldCurve::ToStrings() const
+{
+	vector<string> _strings;
+	_strings.push_back(name);
+	_strings.push_back(to_string(version));
+	for (size_t i = 0; i < pillarTenors.size(); ++i)
+	{
+		_strings.push_back(to_string(pillarTenors[i]));
+		_strings.push_back(to_string(parYields[i]));
+	}
+	return _strings;
+}
+
+// Get the semi-annual yield of a bond from its clean price (per 100 face).
+double GetBondYield(double _cleanPrice, double _coupon, double _tenor, double _guess)
+{
+	int _n = (int)ceil(_tenor * 2.0 - 1e-9);
+	if (_n < 1) _n = 1;
+	double _f = _tenor * 2.0 - (_n - 1);
+	double _halfCoupon = _coupon * 100.0 / 2.0;
+	double _dirtyPrice = _cleanPrice + _halfCoupon * (1.0 - _f);
+
+	double _yield = _guess;
+	for (int k = 0; k < 20; ++k)
+	{
+		double _v = 1.0 / (1.0 + _yield / 2.0);
+		double _vf = pow(_v, _f);
+		double _pv = 0;
+		double _dpv = 0;
+		for (int i = 0; i < _n; ++i)
+		{
+			double _cash = (i == _n - 1) ? _halfCoupon + 100.0 : _halfCoupon;
+			double _exponent = _f + i;
+			_pv += _cash * _vf;
+			_dpv -= _cash * _exponent * _vf * _v / 2.0;
+			_vf *= _v;
+		}
+
+		double _step = (_pv - _dirtyPrice) / _dpv;
+		_yield -= _step;
+		if (fabs(_step) < 1e-12) break;
+	}
+	return _yield;
+}
+
+// Pre-declearations
+template<typename T>
+class CurveToPricingListener;
+
+/**
+* Curve Service fitting the treasury curve from on-the-run mid prices.
+* Keyed on curve name.
+* Type T is the product type.
+*/
+template<typename T>
+class CurveService : public Service<string, YieldCurve>
+{
+
+private:
+
+	map<string, YieldCurve> curves;
+	vector<ServiceListener<YieldCurve>*> listeners;
+	CurveToPricingListener<T>* listener;
+	string curveName;
+	year_month_day settlementDate;
+	double tolerance;
+	long fitCount;
+	unordered_map<string, int> pillars;
+	vector<double> pillarTenors;
+	vector<double> coupons;
+	vector<double> mids;
+	vector<double> parYields;
+	vector<bool> quoted;
+	int quotedCount;
+
+	// Bootstrap the curve from the par yields of the pillars and notify the listeners
+	void Refit();
+
+public:
+
+	// Constructor and destructor
+	CurveService();
+	CurveService(year_month_day _settlementDate);
+	~CurveService();
+
+	// Get data on our service given a key
+	YieldCurve& GetData(string _key);
+
+	// The callback that a Connector should invoke for any new or updated data
+	void OnMessage(YieldCurve& _data);
+
+	// Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
+	void AddListener(ServiceListener<YieldCurve>* _listener);
+
+	// Get all listeners on the Service
+	const vector<ServiceListener<YieldCurve>*>& GetListeners() const;
+
+	// Get the listener of the service
+	CurveToPricingListener<T>* GetListener();
+
+	// Get the fitted curve
+	const YieldCurve& GetCurve();
+
+	// Get the price move (in points) that triggers a refit
+	double GetTolerance() const;
+
+	// Set the price move (in points) that triggers a refit
+	void SetTolerance(double _tolerance);
+
+	// Get the number of refits performed
+	long GetFitCount() const;
+
+	// Update the curve with a new price
+	void UpdatePrice(Price<T>& _price);
+
+	// Get the mid and par yield the pillar of a product was last fitted to, false if it is not quoted yet
+	bool GetQuote(const string& _productId, double& _mid, double& _parYield) const;
+
+	// Restore the mid and par yield of the pillar of a product, refitting once every pillar is quoted
+	void Restore(const string& _productId, double _mid, double _parYield);
+
+};
+
+template<typename T>
+CurveService<T>::CurveService() :
+	CurveService(from_string("2023/12/01"))
+{
+}
+
+template<typename T>
+CurveService<T>::CurveService(year_month_day _settlementDate)
+{
+	curves = map<string, YieldCurve>();
+	listeners = vector<ServiceListener<YieldCurve>*>();
+	listener = new CurveToPricingListener<T>(this);
+	curveName = "UST";
+	settlementDate = _settlementDate;
+	tolerance = 1.0 / 512.0;
+	fitCount = 0;
+	quotedCount = 0;
+	curves[curveName] = YieldCurve(curveName, settlementDate);
+
+	for (auto& c : CUSIPS)
+	{
+		T _product = GetBond(c);
+		double _tenor = curves[curveName].GetTenor(_product.GetMaturityDate());
+		pillars[c] = (int)pillarTenors.size();
+		pillarTenors.push_back(_tenor);
+		coupons.push_back(_product.GetCoupon());
+		mids.push_back(0);
+		parYields.push_back(_product.GetCoupon());
+		quoted.push_back(false);
+	}
+}
+
+template<typename T>
+CurveService<T>::~CurveService() {}
+
+template<typename T>
+YieldCurve& CurveService<T>::GetData(string _key)
+{
+	return curves[_key];
+}
+
+template<typename T>
+void CurveService<T>::OnMessage(YieldCurve& _data)
+{
+	curves[_data.GetName()] = _data;
+
+	for (auto& l : listeners)
+	{
+		l->ProcessAdd(_data);
+	}
+}
+
+template<typename T>
+void CurveService<T>::AddListener(ServiceListener<YieldCurve>* _listener)
+{
+	listeners.push_back(_listener);
+}
+
+template<typename T>
+const vector<ServiceListener<YieldCurve>*>& CurveService<T>::GetListeners() const
+{
+	return listeners;
+}
+
+template<typename T>
+CurveToPricingListener<T>* CurveService<T>::GetListener()
+{
+	return listener;
+}
+
+template<typename T>
+const YieldCurve& CurveService<T>::GetCurve()
+{
+	return curves[curveName];
+}
+
+template<typename T>
+double CurveService<T>::GetTolerance() const
+{
+	return tolerance;
+}
+
+template<typename T>
+void CurveService<T>::SetTolerance(double _tolerance)
+{
+	tolerance = _tolerance;
+}
+
+template<typename T>
+long CurveService<T>::GetFitCount() const
+{
+	return fitCount;
+}
+
+template<typename T>
+void CurveService<T>::UpdatePrice(Price<T>& _price)
+{
+	auto _it = pillars.find(_price.GetProduct().GetProductId());
+	if (_it == pillars.end()) return;
+
+	int _i = _it->second;
+	double _mid = _price.GetMid();
+	if (quoted[_i] && fabs(_mid - mids[_i]) < tolerance) return;
+
+	if (!quoted[_i])
+	{
+		quoted[_i] = true;
+		quotedCount++;
+	}
+	mids[_i] = _mid;
+	parYields[_i] = GetBondYield(_mid, coupons[_i], pillarTenors[_i], parYields[_i]);
+
+	// Only the moved pillar is re-solved; the bootstrap itself is a single pass.
+	if (quotedCount == (int)pillarTenors.size()) Refit();
+}
+
+template<typename T>
+bool CurveService<T>::GetQuote(const string& _productId, double& _mid, double& _parYield) const
+{
+	auto _it = pillars.find(_productId);
+	if (_it == pillars.end() || !quoted[_it->second]) return false;
+	_mid = mids[_it->second];
+	_parYield = parYields[_it->second];
+	return true;
+}
+
+template<typename T>
+void CurveService<T>::Restore(const string& _productId, double _mid, double _parYield)
+{
+	auto _it = pillars.find(_productId);
+	if (_it == pillars.end()) return;
+
+	int _i = _it->second;
+	if (!quoted[_i])
+	{
+		quoted[_i] = true;
+		quotedCount++;
+	}
+	mids[_i] = _mid;
+	parYields[_i] = _parYield;
+	if (quotedCount == (int)pillarTenors.size()) Refit();
+}
+
+template<typename T>
+void CurveService<T>::Refit()
+{
+	YieldCurve& _curve = curves[curveName];
+	_curve.Fit(pillarTenors, parYields);
+	fitCount++;
+
+	for (auto& l : listeners)
+	{
+		l->ProcessAdd(_curve);
+	}
+}
+
+/**
+* Curve Service Listener subscribing data from Pricing Service to Curve Service.
+* Type T is the product type.
+*/
+template<typename T>
+class CurveToPricingListener : public ServiceListener<Price<T>>
+{
+
+private:
+
+	CurveService<T>* service;
+
+public:
+
+	// Connector and Destructor
+	CurveToPricingListener(CurveService<T>* _service);
+	~CurveToPricingListener();
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(Price<T>& _data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(Price<T>& _data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(Price<T>& _data);
+
+};
+
+template<typename T>
+CurveToPricingListener<T>::CurveToPricingListener(CurveService<T>* _service)
+{
+	service = _service;
+}
+
+template<typename T>
+CurveToPricingListener<T>::~CurveToPricingListener() {}
+
+template<typename T>
+void CurveToPricingListener<T>::ProcessAdd(Price<T>& _data)
+{
+	service->UpdatePrice(_data);
+}
+
+template<typename T>
+void CurveToPricingListener<T>::ProcessRemove(Price<T>& _data) {}
+
+template<typename T>
+void CurveToPricingListener<T>::ProcessUpdate(Price<T>& _data) {}
+
+#endif
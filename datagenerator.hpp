@@ -24,23 +24,33 @@ const int NUM_INQUIRIES = 10;
 const std::vector<std::string> CUSIPS = {
     "91282CJL6", "91282CJP7", "91282CJN2", "91282CJM4", "91282CJJ1", "912810TW8", "912810TV0"
 };
+const std::vector<std::string> MARKETS = { "BROKERTEC", "ESPEED", "CME" };
+
+// Event time spacing of each file in microseconds, so every file spans one second of session time.
+const long PRICE_INTERVAL = 1000000 / NUM_PRICES;
+const long TRADE_INTERVAL = 1000000 / NUM_TRADES;
+const long MARKETDATA_INTERVAL = 1000000 / (NUM_MARKETDATA / 5);
+const long INQUIRY_INTERVAL = 1000000 / NUM_INQUIRIES;
 
 // Generate prices.txt
 void GeneratePriceData() {
     std::ofstream file("prices.txt");
-    for (int i = 0; i < NUM_SECURITIES; ++i) {
-        double midprice = 99.0;
-        bool direction = true, spread = true;
-        for (int j = 0; j < NUM_PRICES; ++j) {
-            double bidprice = midprice - (spread ? 1.0 / 256 : 1.0 / 128);
-            double offerprice = midprice + (spread ? 1.0 / 256 : 1.0 / 128);
-            spread = !spread;
+    std::vector<double> midprices(NUM_SECURITIES, 99.0);
+    std::vector<bool> directions(NUM_SECURITIES, true), spreads(NUM_SECURITIES, true);
+    // Lines are written in event time order, the securities interleaved at each time.
+    for (int j = 0; j < NUM_PRICES; ++j) {
+        for (int i = 0; i < NUM_SECURITIES; ++i) {
+            double& midprice = midprices[i];
+            double bidprice = midprice - (spreads[i] ? 1.0 / 256 : 1.0 / 128);
+            double offerprice = midprice + (spreads[i] ? 1.0 / 256 : 1.0 / 128);
+            spreads[i] = !spreads[i];
+            long timestamp = j * PRICE_INTERVAL + i;
 
-            file << CUSIPS[i] << "," << ConvertPrice(bidprice) << "," << ConvertPrice(offerprice) << endl;
+            file << CUSIPS[i] << "," << ConvertPrice(bidprice) << "," << ConvertPrice(offerprice) << "," << timestamp << endl;
 
-            midprice += direction ? 1.0 / 256 : -1.0 / 256;
+            midprice += directions[i] ? 1.0 / 256 : -1.0 / 256;
             if (std::abs(midprice - 99.0) < 1e-6 || std::abs(midprice - 101.0) < 1e-6) {
-                direction = !direction;
+                directions[i] = !directions[i];
             }
         }
     }
@@ -49,17 +59,17 @@ void GeneratePriceData() {
 // Generate trades.txt
 void GenerateTradeData() {
     std::ofstream file("trades.txt");
-    int tradeCount = 0;
-    for (int i = 0; i < NUM_SECURITIES; ++i) {
-        for (int j = 0; j < NUM_TRADES; ++j) {
+    for (int j = 0; j < NUM_TRADES; ++j) {
+        for (int i = 0; i < NUM_SECURITIES; ++i) {
+            int tradeCount = i * NUM_TRADES + j;
             std::string tradeId = GenerateId();
             std::string side = tradeCount % 2 ? "BUY" : "SELL";
             std::string price = ConvertPrice(tradeCount % 2 ? 99.0 : 100.0);
             std::string book = "TRSY" + std::to_string(tradeCount % 3 + 1);
             long quantity = ((tradeCount % 5) + 1) * 1000000;
+            long timestamp = j * TRADE_INTERVAL + i;
 
-            file << CUSIPS[i] << "," << tradeId << "," << price << "," << book << "," << quantity << "," << side << endl;
-            ++tradeCount;
+            file << CUSIPS[i] << "," << tradeId << "," << price << "," << book << "," << quantity << "," << side << "," << timestamp << endl;
         }
     }
 }
@@ -67,24 +77,31 @@ void GenerateTradeData() {
 // Generate marketdata.txt
 void GenerateMarketData() {
     std::ofstream file("marketdata.txt");
-    long count = 0;
-    for (int i = 0; i < NUM_SECURITIES; ++i) {
-        double midprice = 99.0;
-        bool direction = true, spread = true;
-        for (int j = 0; j < NUM_MARKETDATA; ++j) {
-            long quantity = 1000000 * ((count % 5) + 1);
-            double bidprice = midprice - (spread ? 1.0 / 256 : 1.0 / 128);
-            double offerprice = midprice + (spread ? 1.0 / 256 : 1.0 / 128);
-            spread = !spread;
-
-            file << CUSIPS[i] << "," << ConvertPrice(bidprice) << "," << quantity << ",BID" << endl;
-            file << CUSIPS[i] << "," << ConvertPrice(offerprice) << "," << quantity << ",OFFER" << endl;
-
-            midprice += direction ? 1.0 / 256 : -1.0 / 256;
-            if (std::abs(midprice - 99.0) < 1e-6 || std::abs(midprice - 101.0) < 1e-6) {
-                direction = !direction;
+    std::vector<double> midprices(NUM_SECURITIES, 99.0);
+    std::vector<bool> directions(NUM_SECURITIES, true), spreads(NUM_SECURITIES, true);
+    // A book is five consecutive levels of one security, so books rather than levels are interleaved.
+    for (int k = 0; k < NUM_MARKETDATA / 5; ++k) {
+        for (int i = 0; i < NUM_SECURITIES; ++i) {
+            long timestamp = k * MARKETDATA_INTERVAL + i;
+            for (int l = 0; l < 5; ++l) {
+                long count = (long)i * NUM_MARKETDATA + k * 5 + l;
+                double& midprice = midprices[i];
+                long quantity = 1000000 * ((count % 5) + 1);
+                double bidprice = midprice - (spreads[i] ? 1.0 / 256 : 1.0 / 128);
+                double offerprice = midprice + (spreads[i] ? 1.0 / 256 : 1.0 / 128);
+                spreads[i] = !spreads[i];
+
+                // Each book of five levels comes from one venue, rotating across venues.
+                std::string venue = MARKETS[(count / 5) % 3];
+
+                file << CUSIPS[i] << "," << ConvertPrice(bidprice) << "," << quantity << ",BID," << venue << "," << timestamp << endl;
+                file << CUSIPS[i] << "," << ConvertPrice(offerprice) << "," << quantity << ",OFFER," << venue << "," << timestamp << endl;
+
+                midprice += directions[i] ? 1.0 / 256 : -1.0 / 256;
+                if (std::abs(midprice - 99.0) < 1e-6 || std::abs(midprice - 101.0) < 1e-6) {
+                    directions[i] = !directions[i];
+                }
             }
-            ++count;
         }
     }
 }
@@ -92,16 +109,16 @@ void GenerateMarketData() {
 // Generate inquiries.txt
 void GenerateInquiries() {
     std::ofstream file("inquiries.txt");
-    int tradeCount = 0;
-    for (int i = 0; i < NUM_SECURITIES; ++i) {
-        for (int j = 0; j < NUM_INQUIRIES; ++j) {
+    for (int j = 0; j < NUM_INQUIRIES; ++j) {
+        for (int i = 0; i < NUM_SECURITIES; ++i) {
+            int tradeCount = i * NUM_INQUIRIES + j;
             std::string tradeId = GenerateId();
             std::string side = tradeCount % 2 ? "BUY" : "SELL";
             std::string price = ConvertPrice(tradeCount % 2 ? 99.0 : 100.0);
             long quantity = ((tradeCount % 5) + 1) * 1000000;
+            long timestamp = j * INQUIRY_INTERVAL + INQUIRY_INTERVAL / 2 + i;
 
-            file << tradeId << "," << CUSIPS[i] << "," << side << "," << quantity << "," << price << ",RECEIVED" << endl;
-            ++tradeCount;
+            file << tradeId << "," << CUSIPS[i] << "," << side << "," << quantity << "," << price << ",RECEIVED," << timestamp << endl;
         }
     }
 }
@@ -0,0 +1,246 @@
+/**
+* eventqueue.hpp
+* Defines the event queue serializing the work of a service on its own thread.
+*
+* @author Haonan Lu
+*/
+
+#ifndef EVENT_QUEUE_HPP
+#define EVENT_QUEUE_HPP
+
+#include <string>
+#include <deque>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include "soa.hpp"
+
+using namespace std;
+
+/**
+* Event queue running posted tasks one at a time, in order, on a worker thread,
+* so services behind it see a single consumer however many threads produce.
+* The worker also polls its own timer wheel. A queue that is not started runs
+* tasks inline on the posting thread.
+*/
+class EventQueue
+{
+
+public:
+
+	// ctor for a queue
+	EventQueue(string _name);
+	~EventQueue();
+
+	// Get the name of the queue
+	const string& GetName() const;
+
+	// Start the worker thread
+	void Start();
+
+	// Stop the worker thread once the posted tasks are done
+	void Stop();
+
+	// Post a task to the queue
+	void Post(function<void()> _task);
+
+	// Wait until all posted tasks are done
+	void Drain();
+
+	// Get the number of tasks done
+	long GetProcessedCount() const;
+
+	// Get the largest number of tasks waiting at once
+	long GetMaxDepth() const;
+
+private:
+
+	string name;
+	deque<function<void()>> tasks;
+	mutable mutex lock;
+	condition_variable ready;
+	condition_variable idle;
+	thread worker;
+	bool isRunning;
+	bool isStopping;
+	long pendingCount;
+	long processedCount;
+	long maxDepth;
+
+	// Run tasks until stopped
+	void Work();
+
+};
+
+EventQueue::EventQueue(string _name)
+{
+	name = _name;
+	tasks = deque<function<void()>>();
+	isRunning = false;
+	isStopping = false;
+	pendingCount = 0;
+	processedCount = 0;
+	maxDepth = 0;
+}
+
+EventQueue::~EventQueue()
+{
+	Stop();
+}
+
+const string& EventQueue::GetName() const
+{
+	return name;
+}
+
+void EventQueue::Start()
+{
+	if (isRunning) return;
+	isRunning = true;
+	isStopping = false;
+	worker = thread(&EventQueue::Work, this);
+}
+
+void EventQueue::Stop()
+{
+	if (!isRunning) return;
+	{
+		lock_guard<mutex> _lock(lock);
+		isStopping = true;
+	}
+	ready.notify_one();
+	worker.join();
+	isRunning = false;
+}
+
+void EventQueue::Post(function<void()> _task)
+{
+	if (!isRunning)
+	{
+		_task();
+		processedCount++;
+		return;
+	}
+
+	{
+		lock_guard<mutex> _lock(lock);
+		tasks.push_back(move(_task));
+		pendingCount++;
+		maxDepth = max(maxDepth, (long)tasks.size());
+	}
+	ready.notify_one();
+}
+
+void EventQueue::Drain()
+{
+	unique_lock<mutex> _lock(lock);
+	idle.wait(_lock, [this]() { return pendingCount == 0; });
+}
+
+long EventQueue::GetProcessedCount() const
+{
+	lock_guard<mutex> _lock(lock);
+	return processedCount;
+}
+
+long EventQueue::GetMaxDepth() const
+{
+	lock_guard<mutex> _lock(lock);
+	return maxDepth;
+}
+
+void EventQueue::Work()
+{
+	deque<function<void()>> _batch;
+	while (true)
+	{
+		{
+			// Wake up at least every timer tick so timers fire on an idle queue.
+			unique_lock<mutex> _lock(lock);
+			ready.wait_for(_lock, milliseconds(1), [this]() { return !tasks.empty() || isStopping; });
+			if (tasks.empty() && isStopping) return;
+			_batch.swap(tasks);
+		}
+
+		// Tasks are taken in batches so producers rarely contend with the worker.
+		long _count = (long)_batch.size();
+		for (auto& t : _batch)
+		{
+			t();
+			PollTimers();
+		}
+		_batch.clear();
+		if (_count == 0) PollTimers();
+
+		{
+			lock_guard<mutex> _lock(lock);
+			pendingCount -= _count;
+			processedCount += _count;
+			if (pendingCount == 0) idle.notify_all();
+		}
+	}
+}
+
+/**
+* Listener handing the events of a Service to another listener through an event queue.
+* Type V is the data type of the Service.
+*/
+template<typename V>
+class QueuedListener : public ServiceListener<V>
+{
+
+private:
+
+	ServiceListener<V>* listener;
+	EventQueue* queue;
+
+public:
+
+	// Connector and Destructor
+	QueuedListener(ServiceListener<V>* _listener, EventQueue* _queue);
+	~QueuedListener();
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(V& _data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(V& _data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(V& _data);
+
+};
+
+template<typename V>
+QueuedListener<V>::QueuedListener(ServiceListener<V>* _listener, EventQueue* _queue)
+{
+	listener = _listener;
+	queue = _queue;
+}
+
+template<typename V>
+QueuedListener<V>::~QueuedListener() {}
+
+template<typename V>
+void QueuedListener<V>::ProcessAdd(V& _data)
+{
+	ServiceListener<V>* _listener = listener;
+	queue->Post([_listener, _data]() mutable { _listener->ProcessAdd(_data); });
+}
+
+template<typename V>
+void QueuedListener<V>::ProcessRemove(V& _data)
+{
+	ServiceListener<V>* _listener = listener;
+	queue->Post([_listener, _data]() mutable { _listener->ProcessRemove(_data); });
+}
+
+template<typename V>
+void QueuedListener<V>::ProcessUpdate(V& _data)
+{
+	ServiceListener<V>* _listener = listener;
+	queue->Post([_listener, _data]() mutable { _listener->ProcessUpdate(_data); });
+}
+
+#endif
@@ -0,0 +1,195 @@
+/**
+* executionalgo.hpp
+* Defines the execution algorithms working parent orders over time.
+*
+* @author Haonan Lu
+*/
+
+#ifndef EXECUTION_ALGO_HPP
+#define EXECUTION_ALGO_HPP
+
+#include <vector>
+#include <algorithm>
+
+using namespace std;
+
+/**
+* The progress of a parent order that an execution algorithm works from.
+* Times are in microseconds and market volume is the quantity executed in the
+* product since the start, the parent order's own fills included.
+*/
+struct AlgoProgress
+{
+	long quantity;
+	long visibleQuantity;
+	long filledQuantity;
+	long startTime;
+	long endTime;
+	long marketVolume;
+};
+
+/**
+* Execution algorithm deciding how much of a parent order should be filled by now.
+*/
+class ExecutionAlgo
+{
+
+public:
+
+	virtual ~ExecutionAlgo() = default;
+
+	// Get the quantity of the parent order that should be filled by a time
+	virtual long GetTarget(const AlgoProgress& _progress, long _now) const = 0;
+
+};
+
+// Get the fraction of the schedule of a parent order elapsed by a time.
+double GetElapsedFraction(const AlgoProgress& _progress, long _now)
+{
+	if (_now >= _progress.endTime || _progress.endTime <= _progress.startTime) return 1.0;
+	if (_now <= _progress.startTime) return 0.0;
+	return (double)(_now - _progress.startTime) / (double)(_progress.endTime - _progress.startTime);
+}
+
+// Round a quantity down to whole lots.
+long RoundToLot(long _quantity, long _lotSize)
+{
+	return _quantity / _lotSize * _lotSize;
+}
+
+/**
+* Time-weighted algorithm filling the parent order evenly over its schedule.
+*/
+class TwapAlgo : public ExecutionAlgo
+{
+
+public:
+
+	// ctor for the algorithm
+	TwapAlgo(long _lotSize = 1000000);
+
+	// Get the quantity of the parent order that should be filled by a time
+	long GetTarget(const AlgoProgress& _progress, long _now) const override;
+
+private:
+
+	long lotSize;
+
+};
+
+TwapAlgo::TwapAlgo(long _lotSize)
+{
+	lotSize = _lotSize;
+}
+
+long TwapAlgo::GetTarget(const AlgoProgress& _progress, long _now) const
+{
+	double _fraction = GetElapsedFraction(_progress, _now);
+	if (_fraction >= 1.0) return _progress.quantity;
+	return RoundToLot((long)(_progress.quantity * _fraction), lotSize);
+}
+
+/**
+* Volume-weighted algorithm filling the parent order along a volume profile,
+* given as the weights of equal buckets of its schedule.
+*/
+class VwapAlgo : public ExecutionAlgo
+{
+
+public:
+
+	// ctor for the algorithm
+	VwapAlgo(const vector<double>& _profile, long _lotSize = 1000000);
+
+	// Get the quantity of the parent order that should be filled by a time
+	long GetTarget(const AlgoProgress& _progress, long _now) const override;
+
+private:
+
+	vector<double> cumulativeProfile;
+	long lotSize;
+
+};
+
+VwapAlgo::VwapAlgo(const vector<double>& _profile, long _lotSize)
+{
+	double _total = 0;
+	for (auto& w : _profile) _total += w;
+
+	double _sum = 0;
+	cumulativeProfile = vector<double>();
+	for (auto& w : _profile)
+	{
+		_sum += w;
+		cumulativeProfile.push_back(_sum / _total);
+	}
+	lotSize = _lotSize;
+}
+
+long VwapAlgo::GetTarget(const AlgoProgress& _progress, long _now) const
+{
+	double _fraction = GetElapsedFraction(_progress, _now);
+	if (_fraction >= 1.0 || cumulativeProfile.empty()) return _progress.quantity;
+
+	// Interpolate the cumulative volume within the current bucket.
+	double _position = _fraction * cumulativeProfile.size();
+	size_t _bucket = (size_t)_position;
+	double _before = _bucket == 0 ? 0.0 : cumulativeProfile[_bucket - 1];
+	double _volume = _before + (cumulativeProfile[_bucket] - _before) * (_position - _bucket);
+	return RoundToLot((long)(_progress.quantity * _volume), lotSize);
+}
+
+/**
+* Iceberg algorithm showing only the visible quantity of the parent order at a time
+* and refreshing it as it fills.
+*/
+class IcebergAlgo : public ExecutionAlgo
+{
+
+public:
+
+	// Get the quantity of the parent order that should be filled by a time
+	long GetTarget(const AlgoProgress& _progress, long _now) const override;
+
+};
+
+long IcebergAlgo::GetTarget(const AlgoProgress& _progress, long /* _now */) const
+{
+	return min(_progress.quantity, _progress.filledQuantity + _progress.visibleQuantity);
+}
+
+/**
+* Participation limit capping another algorithm at a fraction of the quantity
+* executed in the product since the parent order started.
+*/
+class ParticipationCap : public ExecutionAlgo
+{
+
+public:
+
+	// ctor for the limit
+	ParticipationCap(const ExecutionAlgo* _algo, double _rate);
+
+	// Get the quantity of the parent order that should be filled by a time
+	long GetTarget(const AlgoProgress& _progress, long _now) const override;
+
+private:
+
+	const ExecutionAlgo* algo;
+	double rate;
+
+};
+
+ParticipationCap::ParticipationCap(const ExecutionAlgo* _algo, double _rate)
+{
+	algo = _algo;
+	rate = _rate;
+}
+
+long ParticipationCap::GetTarget(const AlgoProgress& _progress, long _now) const
+{
+	long _cap = (long)(rate * _progress.marketVolume);
+	return min(algo->GetTarget(_progress, _now), max(_cap, _progress.filledQuantity));
+}
+
+#endif
@@ -12,11 +12,28 @@
 #include <string>
 #include "soa.hpp"
 #include "algoexecutionservice.hpp"
+#include "matchingengine.hpp"
+#include "smartorderrouter.hpp"
 
 
+/**
+* An order working on a market and the number of fills it has had.
+* Type T is the product type.
+*/
+template<typename T>
+struct WorkingOrder
+{
+	ExecutionOrder<T> order;
+	long fillCount;
+};
+
 // Pre-declearations
 template<typename T>
+class ExecutionConnector;
+template<typename T>
 class ExecutionToAlgoExecutionListener;
+template<typename T>
+class ExecutionToMarketDataListener;
 
 /**
 * Service for executing orders on an exchange.
@@ -29,9 +46,14 @@ class ExecutionService : public Service<string, ExecutionOrder<T>>
 
 private:
 
-	map<string, ExecutionOrder<T>> executionOrders;
+	map<Identifier, ExecutionOrder<T>> executionOrders;
+	unordered_map<Identifier, WorkingOrder<T>> workingOrders;
 	vector<ServiceListener<ExecutionOrder<T>>*> listeners;
+	vector<ExecutionConnector<T>*> connectors;
+	SmartOrderRouter<T> router;
+	vector<RouteSlice> slices;
 	ExecutionToAlgoExecutionListener<T>* listener;
+	ExecutionToMarketDataListener<T>* marketDataListener;
 
 public:
 
@@ -54,17 +76,54 @@ public:
 	// Get the listener of the service
 	ExecutionToAlgoExecutionListener<T>* GetListener();
 
-	// Execute an order on a market
+	// Get the market data listener of the service
+	ExecutionToMarketDataListener<T>* GetMarketDataListener();
+
+	// Get the connector of a market
+	ExecutionConnector<T>* GetConnector(Market _market);
+
+	// Get the smart order router of the service
+	SmartOrderRouter<T>& GetRouter();
+
+	// Execute an order, split into child orders across markets by the smart order router
 	void ExecuteOrder(ExecutionOrder<T>& _executionOrder);
 
+	// Execute an order on a market
+	void ExecuteOrder(ExecutionOrder<T>& _executionOrder, Market _market);
+
+	// Cancel a working order on a market
+	bool CancelOrder(const string& _orderId, Market _market);
+
+	// Update the market data of a market
+	void UpdateBook(OrderBook<T>& _orderBook);
+
+	// The callback that a Connector should invoke for a fill of a working order
+	void OnFill(const ExecutionFill& _fill);
+
+	// Collect the fills of all markets
+	void ProcessFills();
+
+	// Get the orders working on the markets, including those with fills not yet collected
+	const unordered_map<Identifier, WorkingOrder<T>>& GetWorkingOrders() const;
+
+	// Restore an order working on a market with the number of fills it had, when restoring the service
+	void RestoreWorkingOrder(const ExecutionOrder<T>& _executionOrder, long _fillCount);
+
 };
 
 template<typename T>
 ExecutionService<T>::ExecutionService()
 {
-	executionOrders = map<string, ExecutionOrder<T>>();
+	executionOrders = map<Identifier, ExecutionOrder<T>>();
 	listeners = vector<ServiceListener<ExecutionOrder<T>>*>();
+	workingOrders = unordered_map<Identifier, WorkingOrder<T>>();
 	listener = new ExecutionToAlgoExecutionListener<T>(this);
+	marketDataListener = new ExecutionToMarketDataListener<T>(this);
+	connectors = vector<ExecutionConnector<T>*>();
+	connectors.push_back(new ExecutionConnector<T>(this, BROKERTEC));
+	connectors.push_back(new ExecutionConnector<T>(this, ESPEED));
+	connectors.push_back(new ExecutionConnector<T>(this, CME));
+	slices = vector<RouteSlice>();
 }
 
 template<typename T>
@@ -100,18 +159,206 @@ ExecutionToAlgoExecutionListener<T>* ExecutionService<T>::GetListener()
 	return listener;
 }
 
+template<typename T>
+ExecutionToMarketDataListener<T>* ExecutionService<T>::GetMarketDataListener()
+{
+	return marketDataListener;
+}
+
+template<typename T>
+ExecutionConnector<T>* ExecutionService<T>::GetConnector(Market _market)
+{
+	return connectors[_market];
+}
+
+template<typename T>
+SmartOrderRouter<T>& ExecutionService<T>::GetRouter()
+{
+	return router;
+}
+
 template<typename T>
 void ExecutionService<T>::ExecuteOrder(ExecutionOrder<T>& _executionOrder)
 {
-	string _productId = _executionOrder.GetProduct().GetProductId();
+	executionOrders[_executionOrder.GetProduct().GetProductId()] = _executionOrder;
+	router.Route(_executionOrder, slices);
+
+	// Each slice becomes a child order, splitting the visible and hidden quantity in proportion.
+	long _quantity = _executionOrder.GetVisibleQuantity() + _executionOrder.GetHiddenQuantity();
+	long _hidden = _executionOrder.GetHiddenQuantity();
+	for (size_t i = 0; i < slices.size(); ++i)
+	{
+		const RouteSlice& _slice = slices[i];
+		long _sliceHidden = i + 1 == slices.size() ? min(_hidden, _slice.quantity) : _executionOrder.GetHiddenQuantity() * _slice.quantity / _quantity;
+		_hidden -= _sliceHidden;
+
+		string _childId = string(_executionOrder.GetOrderId()) + "-" + to_string(i + 1);
+		ExecutionOrder<T> _child(_executionOrder.GetProduct(), _executionOrder.GetPricingSide(), _childId, _executionOrder.GetOrderType(), _executionOrder.GetPrice(), _slice.quantity - _sliceHidden, _sliceHidden, _executionOrder.GetOrderId(), true);
+		router.AddChildOrder(_childId, _slice.market, _slice.quantity);
+		workingOrders[_childId] = { _child, 0 };
+		connectors[_slice.market]->Publish(_child);
+	}
+}
+
+template<typename T>
+void ExecutionService<T>::ExecuteOrder(ExecutionOrder<T>& _executionOrder, Market _market)
+{
+	Identifier _productId = _executionOrder.GetProduct().GetProductId();
 	executionOrders[_productId] = _executionOrder;
+	workingOrders[_executionOrder.GetOrderId()] = { _executionOrder, 0 };
+	connectors[_market]->Publish(_executionOrder);
+}
+
+template<typename T>
+bool ExecutionService<T>::CancelOrder(const string& _orderId, Market _market)
+{
+	workingOrders.erase(_orderId);
+	return connectors[_market]->Cancel(_orderId);
+}
+
+template<typename T>
+void ExecutionService<T>::UpdateBook(OrderBook<T>& _orderBook)
+{
+	ProcessFills();
+	router.UpdateQuote(_orderBook);
+	connectors[_orderBook.GetMarket()]->UpdateBook(_orderBook);
+}
+
+template<typename T>
+void ExecutionService<T>::OnFill(const ExecutionFill& _fill)
+{
+	router.OnFill(_fill);
+	auto _it = workingOrders.find(_fill.GetOrderId());
+	if (_it == workingOrders.end()) return;
+	if (_fill.GetQuantity() == 0)
+	{
+		workingOrders.erase(_it);
+		return;
+	}
+
+	// Listeners see each fill as an execution of the filled quantity at the fill price,
+	// identified by the order ID and the sequence number of the fill.
+	const ExecutionOrder<T>& _order = _it->second.order;
+	long _fillSequence = ++_it->second.fillCount;
+	string _executionId = string(_order.GetOrderId()) + "." + to_string(_fillSequence);
+	ExecutionOrder<T> _execution(_order.GetProduct(), _order.GetPricingSide(), _order.GetOrderId(), _order.GetOrderType(), _fill.GetPrice(), _fill.GetQuantity(), 0, _order.GetParentOrderId(), _order.IsChildOrder(), _executionId);
+	if (_fill.GetLeavesQuantity() == 0) workingOrders.erase(_it);
 
 	for (auto& l : listeners)
 	{
-		l->ProcessAdd(_executionOrder);
+		l->ProcessAdd(_execution);
+	}
+}
+
+template<typename T>
+void ExecutionService<T>::ProcessFills()
+{
+	for (auto& c : connectors)
+	{
+		c->Poll();
 	}
 }
 
+template<typename T>
+const unordered_map<Identifier, WorkingOrder<T>>& ExecutionService<T>::GetWorkingOrders() const
+{
+	return workingOrders;
+}
+
+template<typename T>
+void ExecutionService<T>::RestoreWorkingOrder(const ExecutionOrder<T>& _executionOrder, long _fillCount)
+{
+	workingOrders[_executionOrder.GetOrderId()] = { _executionOrder, _fillCount };
+}
+
+/**
+* Execution Connector publishing orders from Execution Service to the matching engine of a market
+* and subscribing its fills back to Execution Service.
+* Type T is the product type.
+*/
+template<typename T>
+class ExecutionConnector : public Connector<ExecutionOrder<T>>
+{
+
+private:
+
+	ExecutionService<T>* service;
+	MatchingEngine<T> engine;
+	vector<ExecutionFill> fills;
+
+public:
+
+	// Connector and Destructor
+	ExecutionConnector(ExecutionService<T>* _service, Market _market);
+	~ExecutionConnector();
+
+	// Publish data to the Connector
+	void Publish(ExecutionOrder<T>& _data);
+
+	// Subscribe data from the Connector
+	void Subscribe(ifstream& _data);
+
+	// Cancel a working order
+	bool Cancel(const string& _orderId);
+
+	// Update the market data of the market
+	void UpdateBook(OrderBook<T>& _orderBook);
+
+	// Deliver the fills of the market to the service
+	void Poll();
+
+	// Get the matching engine of the market
+	MatchingEngine<T>& GetEngine();
+
+};
+
+template<typename T>
+ExecutionConnector<T>::ExecutionConnector(ExecutionService<T>* _service, Market _market) :
+	engine(_market)
+{
+	service = _service;
+}
+
+template<typename T>
+ExecutionConnector<T>::~ExecutionConnector() {}
+
+template<typename T>
+void ExecutionConnector<T>::Publish(ExecutionOrder<T>& _data)
+{
+	engine.SubmitOrder(_data);
+}
+
+template<typename T>
+void ExecutionConnector<T>::Subscribe(ifstream& _data) {}
+
+template<typename T>
+bool ExecutionConnector<T>::Cancel(const string& _orderId)
+{
+	return engine.CancelOrder(_orderId);
+}
+
+template<typename T>
+void ExecutionConnector<T>::UpdateBook(OrderBook<T>& _orderBook)
+{
+	engine.UpdateBook(_orderBook);
+}
+
+template<typename T>
+void ExecutionConnector<T>::Poll()
+{
+	engine.PollFills(fills);
+	for (auto& f : fills)
+	{
+		service->OnFill(f);
+	}
+}
+
+template<typename T>
+MatchingEngine<T>& ExecutionConnector<T>::GetEngine()
+{
+	return engine;
+}
+
 /**
 * Execution Service Listener subscribing data from Algo Execution Service to Execution Service.
 * Type T is the product type.
@@ -164,4 +411,54 @@ void ExecutionToAlgoExecutionListener<T>::ProcessRemove(AlgoExecution<T>& _data)
 template<typename T>
 void ExecutionToAlgoExecutionListener<T>::ProcessUpdate(AlgoExecution<T>& _data) {}
 
+/**
+* Execution Service Listener subscribing data from Market Data Service to Execution Service.
+* Type T is the product type.
+*/
+template<typename T>
+class ExecutionToMarketDataListener : public ServiceListener<OrderBook<T>>
+{
+
+private:
+
+	ExecutionService<T>* service;
+
+public:
+
+	// Connector and Destructor
+	ExecutionToMarketDataListener(ExecutionService<T>* _service);
+	~ExecutionToMarketDataListener();
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(OrderBook<T>& _data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(OrderBook<T>& _data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(OrderBook<T>& _data);
+
+};
+
+template<typename T>
+ExecutionToMarketDataListener<T>::ExecutionToMarketDataListener(ExecutionService<T>* _service)
+{
+	service = _service;
+}
+
+template<typename T>
+ExecutionToMarketDataListener<T>::~ExecutionToMarketDataListener() {}
+
+template<typename T>
+void ExecutionToMarketDataListener<T>::ProcessAdd(OrderBook<T>& _data)
+{
+	service->UpdateBook(_data);
+}
+
+template<typename T>
+void ExecutionToMarketDataListener<T>::ProcessRemove(OrderBook<T>& _data) {}
+
+template<typename T>
+void ExecutionToMarketDataListener<T>::ProcessUpdate(OrderBook<T>& _data) {}
+
 #endif
@@ -0,0 +1,467 @@
+/**
+* executor.hpp
+* Defines the work-stealing executor shared by the services.
+*
+* @author Haonan Lu
+*/
+
+#ifndef EXECUTOR_HPP
+#define EXECUTOR_HPP
+
+#include <string>
+#include <vector>
+#include <deque>
+#include <fstream>
+#include <sstream>
+#include <functional>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <chrono>
+#include <cctype>
+#include <algorithm>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+using namespace std;
+
+// Parse a cpu list of sysfs such as "0-3,8,10-11".
+vector<int> ParseCpuList(const string& _list)
+{
+	vector<int> _cpus;
+	stringstream _listStream(_list);
+	string _range;
+	while (getline(_listStream, _range, ','))
+	{
+		if (_range.empty() || !isdigit(_range[0])) continue;
+		size_t _dash = _range.find('-');
+		int _first = stoi(_range.substr(0, _dash));
+		int _last = _dash == string::npos ? _first : stoi(_range.substr(_dash + 1));
+		for (int c = _first; c <= _last; ++c) _cpus.push_back(c);
+	}
+	return _cpus;
+}
+
+// Get the NUMA node of every cpu from sysfs, all on node 0 when it is not available.
+vector<int> GetCpuNodes()
+{
+	int _cpuCount = max(1, (int)thread::hardware_concurrency());
+	vector<int> _nodes(_cpuCount, 0);
+	for (int n = 0; ; ++n)
+	{
+		ifstream _file("/sys/devices/system/node/node" + to_string(n) + "/cpulist");
+		if (!_file) break;
+		string _list;
+		getline(_file, _list);
+		for (auto& c : ParseCpuList(_list))
+		{
+			if (c >= (int)_nodes.size()) _nodes.resize(c + 1, 0);
+			_nodes[c] = n;
+		}
+	}
+	return _nodes;
+}
+
+// Pin the calling thread to a cpu, false when the platform refuses.
+bool PinThread(int _cpu)
+{
+#ifdef __linux__
+	cpu_set_t _set;
+	CPU_ZERO(&_set);
+	CPU_SET(_cpu, &_set);
+	return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &_set) == 0;
+#else
+	return false;
+#endif
+}
+
+/**
+* Counters of a worker of the executor.
+*/
+struct WorkerStats
+{
+	int cpu;
+	int node;
+	long depth;
+	long maxDepth;
+	long executed;
+	long stolen;
+};
+
+/**
+* Group of tasks submitted together and waited for together.
+*/
+class TaskGroup
+{
+
+public:
+
+	// ctor for an empty group
+	TaskGroup();
+
+	// Get the number of tasks of the group not done yet
+	long GetPendingCount() const;
+
+private:
+
+	atomic<long> pendingCount;
+
+	friend class Executor;
+
+};
+
+TaskGroup::TaskGroup()
+{
+	pendingCount.store(0);
+}
+
+long TaskGroup::GetPendingCount() const
+{
+	return pendingCount.load(memory_order_acquire);
+}
+
+/**
+* Work-stealing executor.
+* Each worker is pinned to a cpu and owns a deque: it runs its own tasks
+* newest first, and when it runs dry steals the oldest task of another
+* worker, trying workers on its own NUMA node before the rest. Tasks
+* submitted from a worker go to its own deque; others are dealt round-robin.
+* Workers fill the cpus node by node, so a small executor stays on one
+* node. Services share one executor rather than starting their own threads.
+* An executor with no workers runs tasks inline.
+*/
+class Executor
+{
+
+public:
+
+	// ctor for an executor with no workers
+	Executor();
+	~Executor();
+
+	// Start a number of workers on the given cpus, or on all cpus if none given; the executor must be idle
+	void Configure(int _workerCount, const vector<int>& _cpus = vector<int>());
+
+	// Stop the workers once the submitted tasks are done
+	void Shutdown();
+
+	// Get the number of workers
+	int GetWorkerCount() const;
+
+	// Submit a task
+	void Submit(function<void()> _task);
+
+	// Submit a task of a group
+	void Submit(TaskGroup& _group, function<void()> _task);
+
+	// Wait until the tasks of a group are done, running tasks meanwhile
+	void Wait(TaskGroup& _group);
+
+	// Run a function over a range of indices in chunks and wait for it
+	void ParallelFor(long _begin, long _end, function<void(long)> _function, long _chunk = 1);
+
+	// Get the counters of the workers
+	vector<WorkerStats> GetStats() const;
+
+	// Get the number of tasks run by threads outside the executor while waiting on a group
+	long GetHelpedCount() const;
+
+private:
+
+	struct Worker
+	{
+		deque<function<void()>> tasks;
+		mutable mutex lock;
+		thread worker;
+		int cpu;
+		int node;
+		long maxDepth;
+		atomic<long> executed;
+		atomic<long> stolen;
+		vector<int> victims;
+	};
+
+	vector<Worker*> workers;
+	atomic<long> queuedCount;
+	atomic<int> sleepingCount;
+	atomic<unsigned> nextWorker;
+	atomic<long> helpedCount;
+	mutex sleepLock;
+	condition_variable ready;
+	bool isStopping;
+
+	// Push a task onto the deque of a worker
+	void Push(int _index, function<void()> _task);
+
+	// Take a task for a worker, its own newest first, else the oldest of a victim
+	bool Take(int _index, function<void()>& _task);
+
+	// Run tasks until stopped
+	void Work(int _index);
+
+	// Get the index of the worker of this executor running the calling thread, -1 if none
+	int GetCurrentWorker() const;
+
+};
+
+// Executor and worker index of the calling thread, if it is a worker.
+thread_local const Executor* currentExecutor = nullptr;
+thread_local int currentWorker = -1;
+
+Executor::Executor()
+{
+	workers = vector<Worker*>();
+	queuedCount.store(0);
+	sleepingCount.store(0);
+	nextWorker.store(0);
+	helpedCount.store(0);
+	isStopping = false;
+}
+
+Executor::~Executor()
+{
+	Shutdown();
+}
+
+void Executor::Configure(int _workerCount, const vector<int>& _cpus)
+{
+	Shutdown();
+
+	// Cpus are taken node by node so neighbouring workers share a node.
+	vector<int> _nodes = GetCpuNodes();
+	vector<int> _available = _cpus;
+	if (_available.empty())
+	{
+		for (int c = 0; c < (int)_nodes.size(); ++c) _available.push_back(c);
+	}
+	stable_sort(_available.begin(), _available.end(), [&_nodes](int _a, int _b)
+	{
+		int _nodeA = _a < (int)_nodes.size() ? _nodes[_a] : 0;
+		int _nodeB = _b < (int)_nodes.size() ? _nodes[_b] : 0;
+		return _nodeA < _nodeB;
+	});
+
+	isStopping = false;
+	for (int i = 0; i < _workerCount; ++i)
+	{
+		Worker* _worker = new Worker();
+		_worker->cpu = _available[i % _available.size()];
+		_worker->node = _worker->cpu < (int)_nodes.size() ? _nodes[_worker->cpu] : 0;
+		_worker->maxDepth = 0;
+		_worker->executed.store(0);
+		_worker->stolen.store(0);
+		workers.push_back(_worker);
+	}
+
+	// Victims on the same node come first, each worker starting after itself to spread the steals.
+	for (int i = 0; i < _workerCount; ++i)
+	{
+		vector<int> _far;
+		for (int k = 1; k < _workerCount; ++k)
+		{
+			int _victim = (i + k) % _workerCount;
+			if (workers[_victim]->node == workers[i]->node) workers[i]->victims.push_back(_victim);
+			else _far.push_back(_victim);
+		}
+		workers[i]->victims.insert(workers[i]->victims.end(), _far.begin(), _far.end());
+	}
+
+	for (int i = 0; i < _workerCount; ++i)
+	{
+		workers[i]->worker = thread(&Executor::Work, this, i);
+	}
+}
+
+void Executor::Shutdown()
+{
+	if (workers.empty()) return;
+	{
+		lock_guard<mutex> _lock(sleepLock);
+		isStopping = true;
+	}
+	ready.notify_all();
+	for (auto& w : workers)
+	{
+		w->worker.join();
+	}
+	for (auto& w : workers)
+	{
+		delete w;
+	}
+	workers.clear();
+}
+
+int Executor::GetWorkerCount() const
+{
+	return (int)workers.size();
+}
+
+int Executor::GetCurrentWorker() const
+{
+	return currentExecutor == this ? currentWorker : -1;
+}
+
+void Executor::Push(int _index, function<void()> _task)
+{
+	Worker* _worker = workers[_index];
+	{
+		lock_guard<mutex> _lock(_worker->lock);
+		_worker->tasks.push_back(move(_task));
+		_worker->maxDepth = max(_worker->maxDepth, (long)_worker->tasks.size());
+	}
+	queuedCount.fetch_add(1);
+
+	// Sleepers count themselves before checking the queued count, so one is woken only when there is one.
+	if (sleepingCount.load() > 0)
+	{
+		lock_guard<mutex> _lock(sleepLock);
+		ready.notify_one();
+	}
+}
+
+void Executor::Submit(function<void()> _task)
+{
+	if (workers.empty())
+	{
+		_task();
+		return;
+	}
+
+	int _current = GetCurrentWorker();
+	int _index = _current >= 0 ? _current : (int)(nextWorker.fetch_add(1, memory_order_relaxed) % workers.size());
+	Push(_index, move(_task));
+}
+
+void Executor::Submit(TaskGroup& _group, function<void()> _task)
+{
+	_group.pendingCount.fetch_add(1, memory_order_relaxed);
+	TaskGroup* _groupPtr = &_group;
+	Submit([_groupPtr, _task]()
+	{
+		_task();
+		_groupPtr->pendingCount.fetch_sub(1, memory_order_release);
+	});
+}
+
+bool Executor::Take(int _index, function<void()>& _task)
+{
+	if (_index >= 0)
+	{
+		Worker* _worker = workers[_index];
+		lock_guard<mutex> _lock(_worker->lock);
+		if (!_worker->tasks.empty())
+		{
+			_task = move(_worker->tasks.back());
+			_worker->tasks.pop_back();
+			queuedCount.fetch_sub(1, memory_order_relaxed);
+			return true;
+		}
+	}
+
+	// A thread outside the executor steals from every worker in turn.
+	const vector<int>* _victims = _index >= 0 ? &workers[_index]->victims : nullptr;
+	size_t _count = _victims ? _victims->size() : workers.size();
+	for (size_t k = 0; k < _count; ++k)
+	{
+		Worker* _victim = workers[_victims ? (*_victims)[k] : k];
+		lock_guard<mutex> _lock(_victim->lock);
+		if (_victim->tasks.empty()) continue;
+		_task = move(_victim->tasks.front());
+		_victim->tasks.pop_front();
+		queuedCount.fetch_sub(1, memory_order_relaxed);
+		if (_index >= 0) workers[_index]->stolen.fetch_add(1, memory_order_relaxed);
+		return true;
+	}
+	return false;
+}
+
+void Executor::Work(int _index)
+{
+	currentExecutor = this;
+	currentWorker = _index;
+	Worker* _worker = workers[_index];
+	PinThread(_worker->cpu);
+
+	function<void()> _task;
+	while (true)
+	{
+		if (Take(_index, _task))
+		{
+			_task();
+			_task = nullptr;
+			_worker->executed.fetch_add(1, memory_order_relaxed);
+			continue;
+		}
+
+		unique_lock<mutex> _lock(sleepLock);
+		sleepingCount.fetch_add(1);
+		ready.wait(_lock, [this]() { return queuedCount.load() > 0 || isStopping; });
+		sleepingCount.fetch_sub(1);
+		if (isStopping && queuedCount.load() == 0) return;
+	}
+}
+
+void Executor::Wait(TaskGroup& _group)
+{
+	// The waiting thread helps rather than blocks, so a worker may wait on tasks it submitted.
+	int _current = GetCurrentWorker();
+	function<void()> _task;
+	while (_group.GetPendingCount() > 0)
+	{
+		if (!workers.empty() && Take(_current, _task))
+		{
+			_task();
+			_task = nullptr;
+			if (_current >= 0) workers[_current]->executed.fetch_add(1, memory_order_relaxed);
+			else helpedCount.fetch_add(1, memory_order_relaxed);
+		}
+		else
+		{
+			this_thread::yield();
+		}
+	}
+}
+
+void Executor::ParallelFor(long _begin, long _end, function<void(long)> _function, long _chunk)
+{
+	TaskGroup _group;
+	for (long i = _begin; i < _end; i += _chunk)
+	{
+		long _last = min(_end, i + _chunk);
+		Submit(_group, [i, _last, &_function]()
+		{
+			for (long j = i; j < _last; ++j) _function(j);
+		});
+	}
+	Wait(_group);
+}
+
+vector<WorkerStats> Executor::GetStats() const
+{
+	vector<WorkerStats> _stats;
+	for (auto& w : workers)
+	{
+		WorkerStats _stat;
+		_stat.cpu = w->cpu;
+		_stat.node = w->node;
+		{
+			lock_guard<mutex> _lock(w->lock);
+			_stat.depth = (long)w->tasks.size();
+			_stat.maxDepth = w->maxDepth;
+		}
+		_stat.executed = w->executed.load(memory_order_relaxed);
+		_stat.stolen = w->stolen.load(memory_order_relaxed);
+		_stats.push_back(_stat);
+	}
+	return _stats;
+}
+
+long Executor::GetHelpedCount() const
+{
+	return helpedCount.load(memory_order_relaxed);
+}
+
+#endif
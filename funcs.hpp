@@ -14,7 +14,13 @@
 #include <vector>
 #include <random>
 #include <chrono>
+#include <unordered_map>
+#include <shared_mutex>
+#include <mutex>
+#include <cstring>
+#include <algorithm>
 #include "products.hpp"
+#include "referencedata.hpp"
 
 using namespace std;
 using namespace chrono;
@@ -50,16 +56,46 @@ vector<double> GenerateUniform(long count, unsigned long seed = 0) {
 
 
 // Get Bond object for US Treasury 2Y, 3Y, 5Y, 7Y, 10Y, 20Y and 30Y.
-Bond GetBond(string _cusip) {
-	Bond _bond;
-	if (_cusip == "91282CJL6") _bond = Bond("91282CJL6", CUSIP, "US2Y", 0.04875, from_string("2025/11/30"));
-	if (_cusip == "91282CJP7") _bond = Bond("91282CJP7", CUSIP, "US3Y", 0.04375, from_string("2026/12/15"));
-	if (_cusip == "91282CJN2") _bond = Bond("91282CJN2", CUSIP, "US5Y", 0.04375, from_string("2028/11/30"));
-	if (_cusip == "91282CJM4") _bond = Bond("91282CJM4", CUSIP, "US7Y", 0.04375, from_string("2030/11/30"));
-	if (_cusip == "91282CJJ1") _bond = Bond("91282CJJ1", CUSIP, "US10Y", 0.04500, from_string("2033/11/15"));
-	if (_cusip == "912810TW8") _bond = Bond("912810TW8", CUSIP, "US20Y", 0.04750, from_string("2043/11/15"));
-	if (_cusip == "912810TV0") _bond = Bond("912810TV0", CUSIP, "US30Y", 0.04750, from_string("2053/11/15"));
-	return _bond;
+Bond GetBond(const string& _cusip) {
+	const BondReference* _reference = ReferenceData::Instance().Find(_cusip);
+	if (_reference == nullptr) return Bond();
+	return Bond(_reference);
+}
+
+
+// Get a dense integer handle for a product identifier, assigned on first use.
+int GetProductHandle(const Identifier& _productId)
+{
+	static unordered_map<Identifier, int> _handles;
+	static shared_mutex _mutex;
+
+	// Handles never change once assigned, so each thread keeps the ones it has seen
+	// and only takes the shared lock for products new to it.
+	thread_local unordered_map<Identifier, int> _seen;
+	auto _seenIt = _seen.find(_productId);
+	if (_seenIt != _seen.end()) return _seenIt->second;
+
+	{
+		shared_lock<shared_mutex> _lock(_mutex);
+		auto _it = _handles.find(_productId);
+		if (_it != _handles.end()) return _seen[_productId] = _it->second;
+	}
+
+	unique_lock<shared_mutex> _lock(_mutex);
+	auto _it = _handles.find(_productId);
+	if (_it != _handles.end()) return _seen[_productId] = _it->second;
+	int _handle = (int)_handles.size();
+	_handles[_productId] = _handle;
+	return _seen[_productId] = _handle;
+}
+
+
+// Copy a string into a fixed-size, zero-padded character field.
+template<size_t N>
+void CopyField(char (&_field)[N], const string& _value)
+{
+	memset(_field, 0, N);
+	memcpy(_field, _value.data(), min(_value.size(), N - 1));
 }
 
 
@@ -129,10 +165,9 @@ std::string ConvertPrice(double doublePrice) {
 }
 
 
-// Output Time Stamp with millisecond precision.
-string TimeStamp()
+// Output Time Stamp with millisecond precision, of now unless given a time.
+string TimeStamp(system_clock::time_point _timePoint = system_clock::now())
 {
-	auto _timePoint = system_clock::now();
 	auto _sec = chrono::time_point_cast<chrono::seconds>(_timePoint);
 	auto _millisec = chrono::duration_cast<chrono::milliseconds>(_timePoint - _sec);
 
@@ -143,7 +178,9 @@ string TimeStamp()
 
 	time_t _timeT = system_clock::to_time_t(_timePoint);
 	char _timeChar[24];
-	strftime(_timeChar, 24, "%F %T", localtime(&_timeT));
+	tm _tm;
+	localtime_r(&_timeT, &_tm);
+	strftime(_timeChar, 24, "%F %T", &_tm);
 	string _timeString = string(_timeChar) + "." + _milliString + " ";
 
 	return _timeString;
@@ -161,4 +198,31 @@ long GetMillisecond()
 }
 
 
+// Get the microseconds since the epoch of a time of the system clock.
+long GetEpochMicrosecond(system_clock::time_point _timePoint = system_clock::now())
+{
+	return (long)duration_cast<microseconds>(_timePoint.time_since_epoch()).count();
+}
+
+
+// Parse a time stamp back into microseconds since the epoch, -1 if it is not one.
+long ParseTimeStamp(const string& _timeStamp)
+{
+	tm _tm = {};
+	int _millisecond = 0;
+	if (sscanf(_timeStamp.c_str(), "%d-%d-%d %d:%d:%d.%d", &_tm.tm_year, &_tm.tm_mon, &_tm.tm_mday, &_tm.tm_hour, &_tm.tm_min, &_tm.tm_sec, &_millisecond) != 7) return -1;
+	_tm.tm_year -= 1900;
+	_tm.tm_mon -= 1;
+	_tm.tm_isdst = -1;
+	return (long)mktime(&_tm) * 1000000 + _millisecond * 1000L;
+}
+
+
+// Get the microsecond count of the steady clock.
+long GetMicrosecond()
+{
+	return (long)duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
+}
+
+
 #endif
\ No newline at end of file
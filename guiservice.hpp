@@ -28,12 +28,13 @@ class GUIService : Service<string, Price<T> >
 
 private:
 
-	map<string, Price<T>> guis;
+	map<Identifier, Price<T>> guis;
 	vector<ServiceListener<Price<T>>*> listeners;
 	GUIConnector<T>* connector;
 	ServiceListener<Price<T>>* listener;
 	int throttle;
-	long millisec;
+	bool isThrottled;
+	TimerHandle throttleTimer;
 
 public:
 
@@ -62,23 +63,23 @@ public:
 	// Get the throttle of the service
 	int GetThrottle() const;
 
-	// Get the millisec of the service
-	long GetMillisec() const;
+	// Is the output held back by the throttle?
+	bool IsThrottled() const;
 
-	// Set the millisec of the service
-	void SetMillisec(long _millisec);
+	// Hold back the output for the throttle
+	void StartThrottle();
 
 };
 
 template<typename T>
 GUIService<T>::GUIService()
 {
-	guis = map<string, Price<T>>();
+	guis = map<Identifier, Price<T>>();
 	listeners = vector<ServiceListener<Price<T>>*>();
 	connector = new GUIConnector<T>(this);
 	listener = new GUIToPricingListener<T>(this);
 	throttle = 300;
-	millisec = 0;
+	isThrottled = false;
 }
 
 template<typename T>
@@ -128,15 +129,16 @@ int GUIService<T>::GetThrottle() const
 }
 
 template<typename T>
-long GUIService<T>::GetMillisec() const
+bool GUIService<T>::IsThrottled() const
 {
-	return millisec;
+	return isThrottled;
 }
 
 template<typename T>
-void GUIService<T>::SetMillisec(long _millisec)
+void GUIService<T>::StartThrottle()
 {
-	millisec = _millisec;
+	isThrottled = true;
+	throttleTimer = GetTimerWheel().ScheduleAfter(throttle * 1000L, [this]() { isThrottled = false; });
 }
 
 
@@ -178,13 +180,9 @@ GUIConnector<T>::~GUIConnector() {}
 template<typename T>
 void GUIConnector<T>::Publish(Price<T>& _data)
 {
-	int _throttle = service->GetThrottle();
-	long _millisec = service->GetMillisec();
-	long _millisecNow = GetMillisecond();
-	while (_millisecNow < _millisec) _millisecNow += 1000;
-	if (_millisecNow - _millisec >= _throttle)
+	if (!service->IsThrottled())
 	{
-		service->SetMillisec(_millisecNow);
+		service->StartThrottle();
 		ofstream _file;
 		_file.open("gui.txt", ios::app);
 
@@ -0,0 +1,400 @@
+/**
+* hashindex.hpp
+* Defines the open-addressing hash index over short string identifiers.
+*
+* @author Haonan Lu
+*/
+
+#ifndef HASH_INDEX_HPP
+#define HASH_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+using namespace std;
+
+/**
+* Open-addressing hash index from short string identifiers to values, laid
+* out like a SwissTable. Keys of up to N characters, such as the 12-character
+* IDs of GenerateId and the IDs of their child orders, are stored inline in
+* the slots, so an insert allocates nothing and a lookup compares a few
+* machine words. A control byte per slot holds 7 bits of the hash, and a
+* lookup matches a group of 16 control bytes at once, touching the slots only
+* on a match. Tables grow by doubling at a load of 7/8; erased slots are left
+* as tombstones, reused by inserts probing past them, until the next rehash.
+* Keys longer than N, or holding a null character, are kept in an ordinary
+* map on the side.
+* Type V is the value type; N is the inline key size, a multiple of 8.
+*/
+template<typename V, size_t N = 16>
+class HashIndex
+{
+
+	static_assert(N % 8 == 0 && N > 0, "the inline key size must be a multiple of 8");
+
+public:
+
+	// ctor for an empty index
+	HashIndex();
+
+	// Find the value of a key, nullptr when absent; the pointer is valid until the next insert
+	V* Find(const string& _key);
+	const V* Find(const string& _key) const;
+
+	// Insert a key with a value unless present; returns the value of the key and whether it was inserted
+	pair<V*, bool> Insert(const string& _key, const V& _value);
+
+	// Erase a key, false when absent
+	bool Erase(const string& _key);
+
+	// Get the number of keys
+	size_t Size() const;
+
+	// Get the number of slots
+	size_t GetCapacity() const;
+
+	// Get the number of erased slots not yet reused or cleaned by a rehash
+	size_t GetDeletedCount() const;
+
+	// Make room for a number of keys without growing
+	void Reserve(size_t _count);
+
+	// Remove all keys
+	void Clear();
+
+	// Call a function with every key and value, in no particular order
+	template<typename F>
+	void ForEach(F _function);
+
+private:
+
+	struct Key
+	{
+		uint64_t words[N / 8];
+	};
+
+	struct Slot
+	{
+		Key key;
+		V value;
+	};
+
+	static constexpr size_t GROUP = 16;
+	static constexpr int8_t EMPTY = -128;
+	static constexpr int8_t DELETED = -2;
+	static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+	vector<int8_t> controls;
+	vector<Slot> slots;
+	size_t capacity;
+	size_t size;
+	size_t deletedCount;
+	size_t growthLeft;
+	unordered_map<string, V> overflow;
+
+	// Pack a key into its inline form, false when it does not fit
+	static bool MakeKey(const string& _key, Key& _inline);
+
+	// Hash an inline key
+	static uint64_t Hash(const Key& _key);
+
+	// Compare two inline keys
+	static bool Equal(const Key& _a, const Key& _b);
+
+	// Get the bitmask of the group at a position whose control bytes equal a value
+	uint32_t Match(size_t _position, int8_t _control) const;
+
+	// Get the bitmask of the group at a position whose slots are empty or deleted
+	uint32_t MatchFree(size_t _position) const;
+
+	// Set the control byte of a slot, and its copy past the end for groups that wrap
+	void SetControl(size_t _index, int8_t _control);
+
+	// Get the slot of a key, NOT_FOUND when absent
+	size_t FindIndex(const Key& _key, uint64_t _hash) const;
+
+	// Get the first free slot along the probe sequence of a hash
+	size_t FindFree(uint64_t _hash) const;
+
+	// Move every key into a table of a new capacity
+	void Rehash(size_t _capacity);
+
+};
+
+template<typename V, size_t N>
+HashIndex<V, N>::HashIndex()
+{
+	controls = vector<int8_t>();
+	slots = vector<Slot>();
+	capacity = 0;
+	size = 0;
+	deletedCount = 0;
+	growthLeft = 0;
+	overflow = unordered_map<string, V>();
+}
+
+template<typename V, size_t N>
+bool HashIndex<V, N>::MakeKey(const string& _key, Key& _inline)
+{
+	if (_key.size() > N || memchr(_key.data(), 0, _key.size())) return false;
+	memset(&_inline, 0, sizeof(Key));
+	memcpy(&_inline, _key.data(), _key.size());
+	return true;
+}
+
+template<typename V, size_t N>
+uint64_t HashIndex<V, N>::Hash(const Key& _key)
+{
+	uint64_t _hash = 0x9e3779b97f4a7c15ULL;
+	for (auto& w : _key.words)
+	{
+		_hash = (_hash ^ w) * 0xbf58476d1ce4e5b9ULL;
+		_hash ^= _hash >> 31;
+	}
+	return _hash * 0x94d049bb133111ebULL;
+}
+
+template<typename V, size_t N>
+bool HashIndex<V, N>::Equal(const Key& _a, const Key& _b)
+{
+	for (size_t i = 0; i < N / 8; ++i)
+	{
+		if (_a.words[i] != _b.words[i]) return false;
+	}
+	return true;
+}
+
+template<typename V, size_t N>
+uint32_t HashIndex<V, N>::Match(size_t _position, int8_t _control) const
+{
+#ifdef __SSE2__
+	__m128i _group = _mm_loadu_si128((const __m128i*)&controls[_position]);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(_control), _group));
+#else
+	uint32_t _mask = 0;
+	for (size_t i = 0; i < GROUP; ++i)
+	{
+		if (controls[_position + i] == _control) _mask |= 1u << i;
+	}
+	return _mask;
+#endif
+}
+
+template<typename V, size_t N>
+uint32_t HashIndex<V, N>::MatchFree(size_t _position) const
+{
+	// Empty and deleted are the only negative control bytes below -1.
+#ifdef __SSE2__
+	__m128i _group = _mm_loadu_si128((const __m128i*)&controls[_position]);
+	return (uint32_t)_mm_movemask_epi8(_mm_cmpgt_epi8(_mm_set1_epi8(-1), _group));
+#else
+	uint32_t _mask = 0;
+	for (size_t i = 0; i < GROUP; ++i)
+	{
+		if (controls[_position + i] < -1) _mask |= 1u << i;
+	}
+	return _mask;
+#endif
+}
+
+template<typename V, size_t N>
+void HashIndex<V, N>::SetControl(size_t _index, int8_t _control)
+{
+	controls[_index] = _control;
+	if (_index < GROUP - 1) controls[capacity + _index] = _control;
+}
+
+template<typename V, size_t N>
+size_t HashIndex<V, N>::FindIndex(const Key& _key, uint64_t _hash) const
+{
+	if (capacity == 0) return NOT_FOUND;
+	size_t _mask = capacity - 1;
+	size_t _position = (_hash >> 7) & _mask;
+	int8_t _control = (int8_t)(_hash & 0x7f);
+
+	// Groups are probed triangularly, which visits every group of a power-of-two table.
+	for (size_t _step = GROUP; ; _step += GROUP)
+	{
+		for (uint32_t m = Match(_position, _control); m; m &= m - 1)
+		{
+			size_t _index = (_position + __builtin_ctz(m)) & _mask;
+			if (Equal(slots[_index].key, _key)) return _index;
+		}
+		if (Match(_position, EMPTY)) return NOT_FOUND;
+		_position = (_position + _step) & _mask;
+	}
+}
+
+template<typename V, size_t N>
+size_t HashIndex<V, N>::FindFree(uint64_t _hash) const
+{
+	size_t _mask = capacity - 1;
+	size_t _position = (_hash >> 7) & _mask;
+	for (size_t _step = GROUP; ; _step += GROUP)
+	{
+		uint32_t _free = MatchFree(_position);
+		if (_free) return (_position + __builtin_ctz(_free)) & _mask;
+		_position = (_position + _step) & _mask;
+	}
+}
+
+template<typename V, size_t N>
+void HashIndex<V, N>::Rehash(size_t _capacity)
+{
+	vector<int8_t> _controls;
+	vector<Slot> _slots;
+	_controls.swap(controls);
+	_slots.swap(slots);
+	size_t _oldCapacity = capacity;
+
+	capacity = _capacity;
+	controls = vector<int8_t>(capacity + GROUP - 1, EMPTY);
+	slots = vector<Slot>(capacity);
+	for (size_t i = 0; i < _oldCapacity; ++i)
+	{
+		if (_controls[i] < 0) continue;
+		uint64_t _hash = Hash(_slots[i].key);
+		size_t _index = FindFree(_hash);
+		SetControl(_index, (int8_t)(_hash & 0x7f));
+		slots[_index] = move(_slots[i]);
+	}
+	deletedCount = 0;
+	growthLeft = capacity - capacity / 8 - (size - overflow.size());
+}
+
+template<typename V, size_t N>
+V* HashIndex<V, N>::Find(const string& _key)
+{
+	Key _inline;
+	if (!MakeKey(_key, _inline))
+	{
+		auto _it = overflow.find(_key);
+		return _it == overflow.end() ? nullptr : &_it->second;
+	}
+	size_t _index = FindIndex(_inline, Hash(_inline));
+	return _index == NOT_FOUND ? nullptr : &slots[_index].value;
+}
+
+template<typename V, size_t N>
+const V* HashIndex<V, N>::Find(const string& _key) const
+{
+	return const_cast<HashIndex<V, N>*>(this)->Find(_key);
+}
+
+template<typename V, size_t N>
+pair<V*, bool> HashIndex<V, N>::Insert(const string& _key, const V& _value)
+{
+	Key _inline;
+	if (!MakeKey(_key, _inline))
+	{
+		auto _inserted = overflow.emplace(_key, _value);
+		if (_inserted.second) size++;
+		return make_pair(&_inserted.first->second, _inserted.second);
+	}
+
+	uint64_t _hash = Hash(_inline);
+	size_t _index = FindIndex(_inline, _hash);
+	if (_index != NOT_FOUND) return make_pair(&slots[_index].value, false);
+
+	// A tombstone on the probe sequence is reused as is; only taking an empty slot uses up growth,
+	// and a table mostly full of tombstones is cleaned in place rather than grown.
+	_index = capacity == 0 ? NOT_FOUND : FindFree(_hash);
+	if (_index == NOT_FOUND || (controls[_index] == EMPTY && growthLeft == 0))
+	{
+		size_t _inlineCount = size - overflow.size();
+		if (capacity > 0 && _inlineCount < capacity / 2) Rehash(capacity);
+		else Rehash(capacity == 0 ? GROUP : capacity * 2);
+		_index = FindFree(_hash);
+	}
+
+	if (controls[_index] == EMPTY) growthLeft--;
+	else deletedCount--;
+	SetControl(_index, (int8_t)(_hash & 0x7f));
+	slots[_index].key = _inline;
+	slots[_index].value = _value;
+	size++;
+	return make_pair(&slots[_index].value, true);
+}
+
+template<typename V, size_t N>
+bool HashIndex<V, N>::Erase(const string& _key)
+{
+	Key _inline;
+	if (!MakeKey(_key, _inline))
+	{
+		if (overflow.erase(_key) == 0) return false;
+		size--;
+		return true;
+	}
+
+	size_t _index = FindIndex(_inline, Hash(_inline));
+	if (_index == NOT_FOUND) return false;
+	SetControl(_index, DELETED);
+	slots[_index].value = V();
+	size--;
+	deletedCount++;
+	return true;
+}
+
+template<typename V, size_t N>
+size_t HashIndex<V, N>::Size() const
+{
+	return size;
+}
+
+template<typename V, size_t N>
+size_t HashIndex<V, N>::GetCapacity() const
+{
+	return capacity;
+}
+
+template<typename V, size_t N>
+size_t HashIndex<V, N>::GetDeletedCount() const
+{
+	return deletedCount;
+}
+
+template<typename V, size_t N>
+void HashIndex<V, N>::Reserve(size_t _count)
+{
+	size_t _capacity = GROUP;
+	while (_capacity - _capacity / 8 < _count) _capacity *= 2;
+	if (_capacity > capacity) Rehash(_capacity);
+}
+
+template<typename V, size_t N>
+void HashIndex<V, N>::Clear()
+{
+	controls = vector<int8_t>();
+	slots = vector<Slot>();
+	capacity = 0;
+	size = 0;
+	deletedCount = 0;
+	growthLeft = 0;
+	overflow.clear();
+}
+
+template<typename V, size_t N>
+template<typename F>
+void HashIndex<V, N>::ForEach(F _function)
+{
+	for (size_t i = 0; i < capacity; ++i)
+	{
+		if (controls[i] < 0) continue;
+		const char* _key = (const char*)&slots[i].key;
+		_function(string(_key, strnlen(_key, N)), slots[i].value);
+	}
+	for (auto& o : overflow)
+	{
+		_function(o.first, o.second);
+	}
+}
+
+#endif
@@ -9,10 +9,87 @@
 #ifndef HISTORICAL_DATA_SERVICE_HPP
 #define HISTORICAL_DATA_SERVICE_HPP
 
+#include <cstring>
+#include <mutex>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include "soa.hpp"
+#include "historyindex.hpp"
 
 enum ServiceType { POSITION, RISK, EXECUTION, STREAMING, INQUIRY };
 
+// Number of records parsed per task when history is read back
+const long HISTORY_READ_CHUNK = 256;
+
+// Get the file the history of a service type is persisted to.
+string GetHistoryPath(ServiceType _type)
+{
+	switch (_type)
+	{
+	case POSITION: return "positions.txt";
+	case RISK: return "risk.txt";
+	case EXECUTION: return "executions.txt";
+	case STREAMING: return "streaming.txt";
+	case INQUIRY: return "allinquiries.txt";
+	default: return "";
+	}
+}
+
+// Get the column of the product in the persisted records of a service type.
+int GetHistoryProductColumn(ServiceType _type)
+{
+	return _type == INQUIRY ? 1 : 0;
+}
+
+// Get the column indexed as the key of the persisted records of a service type, -1 if none:
+// the side of executions and the state of inquiries.
+int GetHistoryKeyColumn(ServiceType _type)
+{
+	switch (_type)
+	{
+	case EXECUTION: return 1;
+	case INQUIRY: return 5;
+	default: return -1;
+	}
+}
+
+/**
+* A record read back from a history file: the time it was written, in
+* microseconds since the epoch, and its columns.
+*/
+struct HistoricalRecord
+{
+	long time;
+	vector<string> cells;
+};
+
+
+/**
+* A history file as a checkpoint sees it: how far it has been written, in
+* bytes and in index entries, and the cut back to an earlier point.
+*/
+class HistoryFile
+{
+
+public:
+
+	virtual ~HistoryFile() = default;
+
+	// Get the path of the file
+	virtual const string& GetPath() const = 0;
+
+	// Get the size of the file in bytes
+	virtual long GetSize() const = 0;
+
+	// Get the number of records indexed
+	virtual long GetEntryCount() const = 0;
+
+	// Cut the file and its index back to a size and a number of records
+	virtual void Truncate(long _size, long _entryCount) = 0;
+
+};
 
 // Pre-declearations
 template<typename T>
@@ -23,6 +100,8 @@ class HistoricalDataListener;
 /**
 * Service for processing and persisting historical data to a persistent store.
 * Keyed on some persistent key.
+* The persisted records are indexed as they are written, so history can be
+* queried back by product, time and key without scanning the file.
 * Type V is the data type to persist.
 */
 template<typename T>
@@ -31,7 +110,7 @@ class HistoricalDataService : Service<string, T>
 
 private:
 
-	map<string, T> historicalDatas;
+	map<Identifier, T> historicalDatas;
 	vector<ServiceListener<T>*> listeners;	
 	HistoricalDataConnector<T>* connector;
 	ServiceListener<T>* listener;
@@ -68,30 +147,46 @@ public:
 	// Persist data to a store
 	void PersistData(string persistKey, T& data);
 
+	// Get the records of a product persisted in a time range
+	vector<HistoricalRecord> Query(const string& _productId, long _start, long _end);
+
+	// Get the records of all products persisted in a time range
+	vector<HistoricalRecord> Query(long _start, long _end);
+
+	// Get the records with a key persisted in a time range, such as the executions of a side
+	vector<HistoricalRecord> QueryByKey(const string& _key, long _start, long _end);
+
+	// Get the last record of every product persisted at or before a time
+	map<string, HistoricalRecord> QueryLast(long _time);
+
 };
 
 template<typename T>
 HistoricalDataService<T>::HistoricalDataService()
 {
-	historicalDatas = map<string, T>();
+	historicalDatas = map<Identifier, T>();
 	listeners = vector<ServiceListener<T>*>();
+	type = INQUIRY;
 	connector = new HistoricalDataConnector<T>(this);
 	listener = new HistoricalDataListener<T>(this);
-	type = INQUIRY;
 }
 
 template<typename T>
 HistoricalDataService<T>::HistoricalDataService(ServiceType _type)
 {
-	historicalDatas = map<string, T>();
+	historicalDatas = map<Identifier, T>();
 	listeners = vector<ServiceListener<T>*>();
+	type = _type;
 	connector = new HistoricalDataConnector<T>(this);
 	listener = new HistoricalDataListener<T>(this);
-	type = _type;
 }
 
 template<typename T>
-HistoricalDataService<T>::~HistoricalDataService() {}
+HistoricalDataService<T>::~HistoricalDataService()
+{
+	delete connector;
+	delete listener;
+}
 
 template<typename T>
 T& HistoricalDataService<T>::GetData(string _key)
@@ -141,17 +236,70 @@ void HistoricalDataService<T>::PersistData(string persistKey, T& data)
 	connector->Publish(data);
 }
 
+template<typename T>
+vector<HistoricalRecord> HistoricalDataService<T>::Query(const string& _productId, long _start, long _end)
+{
+	return connector->Read(connector->GetIndex().Find(_productId, _start, _end));
+}
+
+template<typename T>
+vector<HistoricalRecord> HistoricalDataService<T>::Query(long _start, long _end)
+{
+	return connector->Read(connector->GetIndex().FindAll(_start, _end));
+}
+
+template<typename T>
+vector<HistoricalRecord> HistoricalDataService<T>::QueryByKey(const string& _key, long _start, long _end)
+{
+	return connector->Read(connector->GetIndex().FindByKey(_key, _start, _end));
+}
+
+template<typename T>
+map<string, HistoricalRecord> HistoricalDataService<T>::QueryLast(long _time)
+{
+	const HistoryIndex& _index = connector->GetIndex();
+	vector<string> _products = _index.GetProducts();
+	vector<long> _entries;
+	for (auto& p : _products)
+	{
+		_entries.push_back(_index.FindLast(p, _time));
+	}
+
+	vector<HistoricalRecord> _records = connector->Read(_entries);
+	map<string, HistoricalRecord> _last;
+	for (size_t i = 0; i < _products.size(); ++i)
+	{
+		if (_entries[i] >= 0) _last[_products[i]] = _records[i];
+	}
+	return _last;
+}
+
 /**
-* Historical Data Connector publishing data from Historical Data Service.
+* Historical Data Connector publishing data from Historical Data Service
+* to its history file and reading records back from it.
+* The file stays open for appending, and each record written is flushed to
+* it at once and added to the index of the file, kept next to it with an
+* .idx suffix, so the file always holds every record the index points at. A file with
+* no index yet, or an index left behind by another file, is indexed by
+* subscribing the file once when the connector opens. Records are published
+* under a lock, so the services of several shards can share a history file.
+* Records read back are parsed in parallel on the shared executor.
 * Type V is the data type to persist.
 */
 template<typename T>
-class HistoricalDataConnector : public Connector<T>
+class HistoricalDataConnector : public Connector<T>, public HistoryFile
 {
 
 private:
 
 	HistoricalDataService<T>* service;
+	string path;
+	ofstream file;
+	long fileSize;
+	HistoryIndex* index;
+	int productColumn;
+	int keyColumn;
+	mutex lock;
 
 public:
 
@@ -162,55 +310,176 @@ public:
 	// Publish data to the Connector
 	void Publish(T& _data);
 
-	// Subscribe data from the Connector
+	// Subscribe data from the Connector, indexing the records of a history file
 	void Subscribe(ifstream& _data);
 
+	// Get the index of the history file
+	const HistoryIndex& GetIndex() const;
+
+	// Read the records of index entries back from the history file, an empty record for entry -1
+	vector<HistoricalRecord> Read(const vector<long>& _entries);
+
+	// Get the path of the history file
+	const string& GetPath() const;
+
+	// Get the size of the history file in bytes
+	long GetSize() const;
+
+	// Get the number of records indexed
+	long GetEntryCount() const;
+
+	// Cut the history file and its index back to a size and a number of records
+	void Truncate(long _size, long _entryCount);
+
 };
 
+// Split a history line into its columns.
+vector<string> SplitHistoryLine(const string& _line)
+{
+	vector<string> _cells;
+	size_t _start = 0;
+	while (_start < _line.size())
+	{
+		size_t _comma = _line.find(',', _start);
+		if (_comma == string::npos) _comma = _line.size();
+		_cells.push_back(_line.substr(_start, _comma - _start));
+		_start = _comma + 1;
+	}
+	return _cells;
+}
+
 template<typename T>
 HistoricalDataConnector<T>::HistoricalDataConnector(HistoricalDataService<T>* _service)
 {
 	service = _service;
+	ServiceType _type = service->GetServiceType();
+	path = GetHistoryPath(_type);
+	productColumn = GetHistoryProductColumn(_type);
+	keyColumn = GetHistoryKeyColumn(_type);
+	index = new HistoryIndex(path + ".idx");
+
+	struct stat _stat;
+	fileSize = stat(path.c_str(), &_stat) == 0 ? (long)_stat.st_size : 0;
+	long _count = index->GetCount();
+	if (_count > 0 && index->Get(_count - 1).offset >= fileSize) index->Clear();
+	if (index->GetCount() == 0 && fileSize > 0)
+	{
+		ifstream _data(path);
+		Subscribe(_data);
+	}
+	file.open(path, ios::app);
 }
 
 template<typename T>
-HistoricalDataConnector<T>::~HistoricalDataConnector() {}
+HistoricalDataConnector<T>::~HistoricalDataConnector()
+{
+	file.flush();
+	delete index;
+}
 
 template<typename T>
 void HistoricalDataConnector<T>::Publish(T& _data)
 {
-	ServiceType _type = service->GetServiceType();
-	ofstream _file;
-	switch (_type)
+	system_clock::time_point _now = system_clock::now();
+	vector<string> _strings = _data.ToStrings();
+	string _line = TimeStamp(_now) + ",";
+	for (auto& s : _strings)
 	{
-	case POSITION:
-		_file.open("positions.txt", ios::app);
-		break;
-	case RISK:
-		_file.open("risk.txt", ios::app);
-		break;
-	case EXECUTION:
-		_file.open("executions.txt", ios::app);
-		break;
-	case STREAMING:
-		_file.open("streaming.txt", ios::app);
-		break;
-	case INQUIRY:
-		_file.open("allinquiries.txt", ios::app);
-		break;
+		_line += s + ",";
 	}
+	_line += "\n";
 
-	_file << TimeStamp() << ",";
-	vector<string> _strings = _data.ToStrings();
-	for (auto& s : _strings)
+	string _key = keyColumn >= 0 && keyColumn < (int)_strings.size() ? _strings[keyColumn] : "";
+	lock_guard<mutex> _lock(lock);
+	index->Add(GetEpochMicrosecond(_now), fileSize, _strings[productColumn], _key);
+	file << _line << flush;
+	fileSize += (long)_line.size();
+}
+
+template<typename T>
+void HistoricalDataConnector<T>::Subscribe(ifstream& _data)
+{
+	long _offset = 0;
+	string _line;
+	while (getline(_data, _line))
 	{
-		_file << s << ",";
+		long _lineOffset = _offset;
+		_offset += (long)_line.size() + 1;
+
+		// Columns follow the time stamp; lines without one are not history records.
+		vector<string> _cells = SplitHistoryLine(_line);
+		long _time = _cells.empty() ? -1 : ParseTimeStamp(_cells[0]);
+		if (_time < 0 || (int)_cells.size() <= productColumn + 1) continue;
+		string _key = keyColumn >= 0 && keyColumn + 1 < (int)_cells.size() ? _cells[keyColumn + 1] : "";
+		index->Add(_time, _lineOffset, _cells[productColumn + 1], _key);
 	}
-	_file << endl;
 }
 
 template<typename T>
-void HistoricalDataConnector<T>::Subscribe(ifstream& _data) {}
+const HistoryIndex& HistoricalDataConnector<T>::GetIndex() const
+{
+	return *index;
+}
+
+template<typename T>
+vector<HistoricalRecord> HistoricalDataConnector<T>::Read(const vector<long>& _entries)
+{
+	// Lines are sliced out of a read-only mapping of the file, with no seek or read per record.
+	vector<HistoricalRecord> _records(_entries.size(), { -1, vector<string>() });
+	int _fd = open(path.c_str(), O_RDONLY);
+	if (_fd < 0) return _records;
+	struct stat _stat;
+	size_t _size = fstat(_fd, &_stat) == 0 ? _stat.st_size : 0;
+	void* _memory = _size > 0 ? mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, _fd, 0) : MAP_FAILED;
+	close(_fd);
+	if (_memory == MAP_FAILED) return _records;
+
+	// Records are parsed in chunks on the executor, each into its own slot of the result.
+	const char* _text = (const char*)_memory;
+	GetExecutor().ParallelFor(0, (long)_entries.size(), [&](long i)
+	{
+		if (_entries[i] < 0) return;
+		const HistoryEntry& _entry = index->Get(_entries[i]);
+		if (_entry.offset < 0 || (size_t)_entry.offset >= _size) return;
+
+		const char* _begin = _text + _entry.offset;
+		const char* _end = (const char*)memchr(_begin, '\n', _size - _entry.offset);
+		if (!_end) _end = _text + _size;
+		_records[i].time = _entry.time;
+		_records[i].cells = SplitHistoryLine(string(_begin, _end));
+		if (!_records[i].cells.empty()) _records[i].cells.erase(_records[i].cells.begin());
+	}, HISTORY_READ_CHUNK);
+	munmap(_memory, _size);
+	return _records;
+}
+
+template<typename T>
+const string& HistoricalDataConnector<T>::GetPath() const
+{
+	return path;
+}
+
+template<typename T>
+long HistoricalDataConnector<T>::GetSize() const
+{
+	return fileSize;
+}
+
+template<typename T>
+long HistoricalDataConnector<T>::GetEntryCount() const
+{
+	return index->GetCount();
+}
+
+template<typename T>
+void HistoricalDataConnector<T>::Truncate(long _size, long _entryCount)
+{
+	// The file is appended to, so later records land right after the cut.
+	if (_size >= fileSize) return;
+	if (truncate(path.c_str(), _size) != 0) return;
+	fileSize = _size;
+	index->Truncate(_entryCount);
+}
 
 /**
 * Historical Data Service Listener subscribing data to Historical Data.
@@ -0,0 +1,219 @@
+/**
+* historyindex.hpp
+* Defines the index of the records of a persisted history file.
+*
+* @author Haonan Lu
+*/
+
+#ifndef HISTORY_INDEX_HPP
+#define HISTORY_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+#include "funcs.hpp"
+#include "journal.hpp"
+
+using namespace std;
+
+/**
+* Index entry of one record of a history file: when it was written, where
+* its line starts in the file, its product and its key attribute.
+*/
+struct HistoryEntry
+{
+	long time;
+	long offset;
+	char productId[16];
+	char key[16];
+};
+
+/**
+* Index of a history file, built while the file is written.
+* Entries are appended in writing order to a memory-mapped journal next to
+* the file, so they are sorted by time and survive the process: the
+* journal itself is the time index, searched by bisection. Entry numbers
+* per product and per key are kept in memory and rebuilt from the journal
+* on open, which reads fixed-size entries and never the text file.
+* Times are microseconds since the epoch.
+*/
+class HistoryIndex
+{
+
+public:
+
+	// ctor for the index of a history file, reopening the entries already in it
+	HistoryIndex(const string& _path);
+
+	// Add the entry of a record written at an offset of the file
+	void Add(long _time, long _offset, const string& _productId, const string& _key);
+
+	// Get the entry numbers of a product written in a time range, in order
+	vector<long> Find(const string& _productId, long _start, long _end) const;
+
+	// Get the entry numbers with a key written in a time range, in order
+	vector<long> FindByKey(const string& _key, long _start, long _end) const;
+
+	// Get the entry numbers of all records written in a time range, in order
+	vector<long> FindAll(long _start, long _end) const;
+
+	// Get the entry number of the last record of a product written at or before a time, -1 if none
+	long FindLast(const string& _productId, long _time) const;
+
+	// Get the products indexed
+	vector<string> GetProducts() const;
+
+	// Get an entry
+	const HistoryEntry& Get(long _entry) const;
+
+	// Get the number of entries
+	long GetCount() const;
+
+	// Drop all entries, when the file they index is gone
+	void Clear();
+
+	// Drop the entries after a number of them, when the file they index is cut back
+	void Truncate(long _count);
+
+private:
+
+	Journal<HistoryEntry> entries;
+	unordered_map<Identifier, vector<long>> productEntries;
+	unordered_map<Identifier, vector<long>> keyEntries;
+
+	// Get the entries of a list written in a time range
+	vector<long> Find(const vector<long>& _list, long _start, long _end) const;
+
+	// Drop the entry numbers from a number on from the lists of a map
+	static void Truncate(unordered_map<Identifier, vector<long>>& _lists, long _count);
+
+};
+
+HistoryIndex::HistoryIndex(const string& _path) :
+	entries(_path, 4096)
+{
+	long _count = entries.GetCount();
+	for (long i = 0; i < _count; ++i)
+	{
+		const HistoryEntry& _entry = entries.Get(i);
+		productEntries[Identifier(_entry.productId)].push_back(i);
+		if (_entry.key[0]) keyEntries[Identifier(_entry.key)].push_back(i);
+	}
+}
+
+void HistoryIndex::Add(long _time, long _offset, const string& _productId, const string& _key)
+{
+	HistoryEntry _entry;
+	_entry.time = _time;
+	_entry.offset = _offset;
+	CopyField(_entry.productId, _productId);
+	CopyField(_entry.key, _key);
+	long _number = entries.Append(_entry);
+	if (_number < 0) return;
+
+	productEntries[Identifier(_productId)].push_back(_number);
+	if (!_key.empty()) keyEntries[Identifier(_key)].push_back(_number);
+}
+
+vector<long> HistoryIndex::Find(const vector<long>& _list, long _start, long _end) const
+{
+	auto _first = lower_bound(_list.begin(), _list.end(), _start, [this](long _entry, long _time) { return entries.Get(_entry).time < _time; });
+	auto _last = upper_bound(_first, _list.end(), _end, [this](long _time, long _entry) { return _time < entries.Get(_entry).time; });
+	return vector<long>(_first, _last);
+}
+
+vector<long> HistoryIndex::Find(const string& _productId, long _start, long _end) const
+{
+	auto _it = productEntries.find(Identifier(_productId));
+	if (_it == productEntries.end()) return vector<long>();
+	return Find(_it->second, _start, _end);
+}
+
+vector<long> HistoryIndex::FindByKey(const string& _key, long _start, long _end) const
+{
+	auto _it = keyEntries.find(Identifier(_key));
+	if (_it == keyEntries.end()) return vector<long>();
+	return Find(_it->second, _start, _end);
+}
+
+vector<long> HistoryIndex::FindAll(long _start, long _end) const
+{
+	// Entry numbers are their own positions, so the range is found by bisecting the journal.
+	long _low = 0;
+	long _high = entries.GetCount();
+	while (_low < _high)
+	{
+		long _middle = (_low + _high) / 2;
+		if (entries.Get(_middle).time < _start) _low = _middle + 1;
+		else _high = _middle;
+	}
+
+	vector<long> _found;
+	for (long i = _low; i < entries.GetCount() && entries.Get(i).time <= _end; ++i)
+	{
+		_found.push_back(i);
+	}
+	return _found;
+}
+
+long HistoryIndex::FindLast(const string& _productId, long _time) const
+{
+	auto _it = productEntries.find(Identifier(_productId));
+	if (_it == productEntries.end()) return -1;
+
+	const vector<long>& _list = _it->second;
+	auto _next = upper_bound(_list.begin(), _list.end(), _time, [this](long _value, long _entry) { return _value < entries.Get(_entry).time; });
+	if (_next == _list.begin()) return -1;
+	return *(_next - 1);
+}
+
+vector<string> HistoryIndex::GetProducts() const
+{
+	vector<string> _products;
+	for (auto& p : productEntries)
+	{
+		_products.push_back(p.first);
+	}
+	sort(_products.begin(), _products.end());
+	return _products;
+}
+
+const HistoryEntry& HistoryIndex::Get(long _entry) const
+{
+	return entries.Get(_entry);
+}
+
+long HistoryIndex::GetCount() const
+{
+	return entries.GetCount();
+}
+
+void HistoryIndex::Clear()
+{
+	entries.Truncate(0);
+	productEntries.clear();
+	keyEntries.clear();
+}
+
+void HistoryIndex::Truncate(long _count)
+{
+	if (_count >= entries.GetCount()) return;
+	entries.Truncate(_count);
+	Truncate(productEntries, _count);
+	Truncate(keyEntries, _count);
+}
+
+void HistoryIndex::Truncate(unordered_map<Identifier, vector<long>>& _lists, long _count)
+{
+	// Lists are in entry order, so the entries dropped are at their ends.
+	for (auto _it = _lists.begin(); _it != _lists.end();)
+	{
+		vector<long>& _list = _it->second;
+		while (!_list.empty() && _list.back() >= _count) _list.pop_back();
+		if (_list.empty()) _it = _lists.erase(_it);
+		else ++_it;
+	}
+}
+
+#endif
@@ -0,0 +1,144 @@
+/**
+* ingestionmanager.hpp
+* Defines the ingestion manager reading the input files concurrently.
+*
+* @author Haonan Lu
+*/
+
+#ifndef INGESTION_MANAGER_HPP
+#define INGESTION_MANAGER_HPP
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include "soa.hpp"
+#include "eventqueue.hpp"
+
+using namespace std;
+
+/**
+* An input file of the ingestion, the connector its lines go to and,
+* optionally, the event queue the connector runs on.
+*/
+struct IngestionSource
+{
+	string name;
+	function<void(const string&)> subscribe;
+	EventQueue* queue;
+	long count;
+	long elapsed;
+};
+
+/**
+* Ingestion manager.
+* Reads every input file on its own thread, so sources arrive interleaved as
+* in a live session. Lines of a source with an event queue are posted to it
+* and parsed on its worker; otherwise the reading thread feeds the connector.
+*/
+class IngestionManager
+{
+
+public:
+
+	// ctor for a manager
+	IngestionManager();
+
+	// Add an input file feeding a connector, through an event queue if given
+	template<typename V>
+	void AddSource(const string& _path, Connector<V>* _connector, EventQueue* _queue = nullptr);
+
+	// Read all sources concurrently and wait until their queues are drained, returning the microseconds taken
+	long Run();
+
+	// Get the number of lines read from a source
+	long GetLineCount(const string& _name) const;
+
+	// Get the microseconds a source took to read and feed its lines
+	long GetElapsed(const string& _name) const;
+
+private:
+
+	vector<IngestionSource> sources;
+
+	// Read and feed one source
+	void Ingest(IngestionSource& _source);
+
+};
+
+IngestionManager::IngestionManager()
+{
+	sources = vector<IngestionSource>();
+}
+
+template<typename V>
+void IngestionManager::AddSource(const string& _path, Connector<V>* _connector, EventQueue* _queue)
+{
+	IngestionSource _source;
+	_source.name = _path;
+	_source.subscribe = [_connector](const string& _line) { _connector->Subscribe(_line); };
+	_source.queue = _queue;
+	_source.count = 0;
+	_source.elapsed = 0;
+	sources.push_back(_source);
+}
+
+void IngestionManager::Ingest(IngestionSource& _source)
+{
+	long _start = GetMicrosecond();
+	ifstream _file(_source.name);
+	string _line;
+	while (getline(_file, _line))
+	{
+		if (_line.empty()) continue;
+		if (_source.queue)
+		{
+			function<void(const string&)>* _subscribe = &_source.subscribe;
+			_source.queue->Post([_subscribe, _line]() { (*_subscribe)(_line); });
+		}
+		else
+		{
+			PollTimers();
+			_source.subscribe(_line);
+		}
+		_source.count++;
+	}
+	if (_source.queue) _source.queue->Drain();
+	_source.elapsed = GetMicrosecond() - _start;
+}
+
+long IngestionManager::Run()
+{
+	long _start = GetMicrosecond();
+	vector<thread> _threads;
+	for (auto& s : sources)
+	{
+		_threads.push_back(thread(&IngestionManager::Ingest, this, ref(s)));
+	}
+	for (auto& t : _threads)
+	{
+		t.join();
+	}
+	return GetMicrosecond() - _start;
+}
+
+long IngestionManager::GetLineCount(const string& _name) const
+{
+	for (auto& s : sources)
+	{
+		if (s.name == _name) return s.count;
+	}
+	return 0;
+}
+
+long IngestionManager::GetElapsed(const string& _name) const
+{
+	for (auto& s : sources)
+	{
+		if (s.name == _name) return s.elapsed;
+	}
+	return 0;
+}
+
+#endif
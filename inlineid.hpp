@@ -0,0 +1,192 @@
+/**
+* inlineid.hpp
+* Defines the fixed-capacity identifier stored inline in the objects holding it.
+*
+* @author Haonan Lu
+*/
+
+#ifndef INLINE_ID_HPP
+#define INLINE_ID_HPP
+
+#include <iostream>
+#include <cassert>
+#include <string>
+#include <string_view>
+#include <cstring>
+#include <cstdint>
+#include <functional>
+
+using namespace std;
+
+/**
+* Identifier of up to N characters stored inline and zero-padded, so it
+* never allocates and copies as a few machine words. Comparison and hashing
+* work on whole 8-byte words, two for the 16-character identifiers of the
+* system. A value longer than N characters fails an assertion rather than
+* being cut short into another identifier. It converts implicitly to and
+* from strings and string views, so it can stand in wherever an identifier
+* used to be a string.
+* N is the capacity, a multiple of 8.
+*/
+template<size_t N>
+class alignas(8) InlineId
+{
+
+	static_assert(N % 8 == 0 && N > 0, "the capacity must be a multiple of 8");
+
+public:
+
+	// ctor for an empty identifier
+	constexpr InlineId();
+
+	// ctor for an identifier from characters
+	constexpr InlineId(const char* _value);
+	constexpr InlineId(string_view _value);
+	InlineId(const string& _value);
+
+	// Get the number of characters
+	constexpr size_t size() const;
+
+	// Is the identifier empty?
+	constexpr bool empty() const;
+
+	// Get the characters, not null-terminated when the identifier is full
+	constexpr const char* data() const;
+
+	// Convert to a string view over the characters
+	constexpr operator string_view() const;
+
+	// Convert to a string
+	operator string() const;
+
+	// Hash the identifier
+	size_t Hash() const;
+
+	// Compare identifiers word by word
+	friend bool operator==(const InlineId& _a, const InlineId& _b)
+	{
+		for (size_t i = 0; i < N / 8; ++i)
+		{
+			if (_a.GetWord(i) != _b.GetWord(i)) return false;
+		}
+		return true;
+	}
+
+	// Order identifiers as their strings are ordered
+	friend bool operator<(const InlineId& _a, const InlineId& _b)
+	{
+		return memcmp(_a.chars, _b.chars, N) < 0;
+	}
+
+	// Print the identifier
+	friend ostream& operator<<(ostream& _output, const InlineId& _id)
+	{
+		return _output << (string_view)_id;
+	}
+
+private:
+
+	char chars[N];
+
+	// Get a word of the characters
+	uint64_t GetWord(size_t _index) const;
+
+};
+
+template<size_t N>
+constexpr InlineId<N>::InlineId() :
+	chars()
+{
+}
+
+template<size_t N>
+constexpr InlineId<N>::InlineId(const char* _value) :
+	InlineId(string_view(_value))
+{
+}
+
+template<size_t N>
+constexpr InlineId<N>::InlineId(string_view _value) :
+	chars()
+{
+	assert(_value.size() <= N && "identifier longer than its capacity");
+	for (size_t i = 0; i < N && i < _value.size(); ++i)
+	{
+		chars[i] = _value[i];
+	}
+}
+
+template<size_t N>
+InlineId<N>::InlineId(const string& _value) :
+	InlineId(string_view(_value))
+{
+}
+
+template<size_t N>
+constexpr size_t InlineId<N>::size() const
+{
+	size_t _size = 0;
+	while (_size < N && chars[_size] != 0) _size++;
+	return _size;
+}
+
+template<size_t N>
+constexpr bool InlineId<N>::empty() const
+{
+	return chars[0] == 0;
+}
+
+template<size_t N>
+constexpr const char* InlineId<N>::data() const
+{
+	return chars;
+}
+
+template<size_t N>
+constexpr InlineId<N>::operator string_view() const
+{
+	return string_view(chars, size());
+}
+
+template<size_t N>
+InlineId<N>::operator string() const
+{
+	return string(chars, size());
+}
+
+template<size_t N>
+uint64_t InlineId<N>::GetWord(size_t _index) const
+{
+	uint64_t _word;
+	memcpy(&_word, chars + _index * 8, 8);
+	return _word;
+}
+
+template<size_t N>
+size_t InlineId<N>::Hash() const
+{
+	uint64_t _hash = 0x9e3779b97f4a7c15ULL;
+	for (size_t i = 0; i < N / 8; ++i)
+	{
+		_hash = (_hash ^ GetWord(i)) * 0xbf58476d1ce4e5b9ULL;
+		_hash ^= _hash >> 31;
+	}
+	return (size_t)_hash;
+}
+
+template<size_t N>
+struct std::hash<InlineId<N>>
+{
+	size_t operator()(const InlineId<N>& _id) const
+	{
+		return _id.Hash();
+	}
+};
+
+// Identifier of products, orders and inquiries: CUSIPs and generated IDs with their child suffixes fit inline.
+typedef InlineId<16> Identifier;
+
+// Identifier of trades, wide enough for the execution ID of a fill: its order ID and fill sequence.
+typedef InlineId<24> TradeIdentifier;
+
+#endif
@@ -9,11 +9,50 @@
 #ifndef INQUIRY_SERVICE_HPP
 #define INQUIRY_SERVICE_HPP
 
+#include <deque>
 #include "soa.hpp"
+#include "hashindex.hpp"
 #include "tradebookingservice.hpp"
 
 // Various inqyury states
 enum InquiryState { RECEIVED, QUOTED, DONE, REJECTED, CUSTOMER_REJECTED };
+const int NUM_INQUIRY_STATES = 5;
+
+// Events moving an inquiry through its states
+enum InquiryEvent { RECEIVE, QUOTE, ACCEPT, REJECT, CUSTOMER_REJECT, EXPIRE };
+const int NUM_INQUIRY_EVENTS = 6;
+
+// Marks an event that is not allowed in a state
+const int INVALID_TRANSITION = -1;
+
+// State an inquiry moves to on an event, by current state and event; RECEIVE creates an inquiry rather than moving one.
+const int INQUIRY_TRANSITIONS[NUM_INQUIRY_STATES][NUM_INQUIRY_EVENTS] =
+{
+	//              RECEIVE             QUOTE               ACCEPT              REJECT              CUSTOMER_REJECT     EXPIRE
+	/* RECEIVED */ { INVALID_TRANSITION, QUOTED,             INVALID_TRANSITION, REJECTED,           CUSTOMER_REJECTED,  REJECTED },
+	/* QUOTED   */ { INVALID_TRANSITION, QUOTED,             DONE,               REJECTED,           CUSTOMER_REJECTED,  CUSTOMER_REJECTED },
+	/* DONE     */ { INVALID_TRANSITION, INVALID_TRANSITION, INVALID_TRANSITION, INVALID_TRANSITION, INVALID_TRANSITION, INVALID_TRANSITION },
+	/* REJECTED */ { INVALID_TRANSITION, INVALID_TRANSITION, INVALID_TRANSITION, INVALID_TRANSITION, INVALID_TRANSITION, INVALID_TRANSITION },
+	/* CUSTOMER_REJECTED */ { INVALID_TRANSITION, INVALID_TRANSITION, INVALID_TRANSITION, INVALID_TRANSITION, INVALID_TRANSITION, INVALID_TRANSITION },
+};
+
+// Get the event an inquiry message from the client stands for.
+InquiryEvent GetInquiryEvent(InquiryState _state)
+{
+	switch (_state)
+	{
+	case RECEIVED:
+		return RECEIVE;
+	case QUOTED:
+	case DONE:
+		return ACCEPT;
+	case REJECTED:
+		return REJECT;
+	case CUSTOMER_REJECTED:
+		return CUSTOMER_REJECT;
+	}
+	return RECEIVE;
+}
 
 /**
 * Inquiry object modeling a customer inquiry from a client.
@@ -29,10 +68,10 @@ public:
 	Inquiry() = default;
 
 	// ctor for an inquiry
-	Inquiry(string _inquiryId, const T& _product, Side _side, long _quantity, double _price, InquiryState _state);
+	Inquiry(Identifier _inquiryId, const T& _product, Side _side, long _quantity, double _price, InquiryState _state);
 
 	// Get the inquiry ID
-	const string& GetInquiryId() const;
+	const Identifier& GetInquiryId() const;
 
 	// Get the product
 	const T& GetProduct() const;
@@ -47,7 +86,7 @@ public:
 	double GetPrice() const;
 
 	// Set the price that we have responded back with
-	double SetPrice(double _price);
+	void SetPrice(double _price);
 
 	// Get the current state on the inquiry
 	InquiryState GetState() const;
@@ -59,7 +98,7 @@ public:
 	vector<string> ToStrings() const;
 
 private:
-	string inquiryId;
+	Identifier inquiryId;
 	T product;
 	Side side;
 	long quantity;
@@ -68,6 +107,50 @@ private:
 
 };
 
+/**
+* A slot of the live inquiries. The generation moves on each time the slot
+* is freed, so events and timers for a retired inquiry never reach the
+* inquiry that reuses its slot.
+* Type T is the product type.
+*/
+template<typename T>
+struct InquirySlot
+{
+	Inquiry<T> inquiry;
+	unsigned generation;
+	bool isLive;
+	TimerHandle timer;
+	long receivedTime;
+};
+
+/**
+* An event waiting to be applied to an inquiry, with the quote price if any.
+*/
+struct PendingInquiryEvent
+{
+	int handle;
+	unsigned generation;
+	InquiryEvent event;
+	double price;
+};
+
+/**
+* Prices received inquiries for the Inquiry Service.
+* Type T is the product type.
+*/
+template<typename T>
+class InquiryQuoter
+{
+
+public:
+
+	virtual ~InquiryQuoter() = default;
+
+	// Price an inquiry, false when it cannot be quoted now
+	virtual bool Quote(const Inquiry<T>& _inquiry, double& _price) = 0;
+
+};
+
 // Pre-declearations
 template<typename T>
 class InquiryConnector;
@@ -75,6 +158,14 @@ class InquiryConnector;
 /**
 * Service for customer inquirry objects.
 * Keyed on inquiry identifier (NOTE: this is NOT a product identifier since each inquiry must be unique).
+* Inquiries live in slots indexed by a handle interned from their identifier
+* and move between states only through the transition table. Events are
+* queued and applied one at a time, so an event raised while another is
+* being applied, by the connector or a listener, waits its turn instead of
+* recursing, and the stack stays one event deep. Once an inquiry is done or
+* rejected and its listeners, the historical store among them, have it,
+* it is retired and its slot reused, so memory follows the inquiries in
+* flight; quotes left unanswered expire after a time to live.
 * Type T is the product type.
 */
 template<typename T>
@@ -83,10 +174,39 @@ class InquiryService : public Service<string, Inquiry<T> >
 
 private:
 
-	map<string, Inquiry<T>> inquiries;
+	deque<InquirySlot<T>> slots;
+	vector<int> freeSlots;
+	HashIndex<int> inquiryHandles;
+	deque<PendingInquiryEvent> pendingEvents;
+	bool isDispatching;
+	long liveCount;
+	long retiredCount;
+	long invalidCount;
+	Inquiry<T> emptyInquiry;
+	InquiryQuoter<T>* quoter;
+	long quoteTimeout;
+	long quoteTtl;
+	long maxQuoteLatency;
+	long timeoutCount;
+	long expiredCount;
 	vector<ServiceListener<Inquiry<T>>*> listeners;
 	InquiryConnector<T>* connector;
 
+	// Take a free slot for a new inquiry and return its handle
+	int Allocate(const Inquiry<T>& _inquiry);
+
+	// Free the slot of an inquiry that is done with
+	void Retire(int _handle);
+
+	// Queue an event for an inquiry and apply the queued events unless already applying them
+	void Dispatch(int _handle, unsigned _generation, InquiryEvent _event, double _price);
+
+	// Apply an event to an inquiry through the transition table
+	void Apply(const PendingInquiryEvent& _pending);
+
+	// Try to quote a received inquiry, retrying on the next tick until quoted or timed out
+	void TryQuote(int _handle);
+
 public:
 
 	// Constructor and destructor
@@ -114,6 +234,42 @@ public:
 	// Reject an inquiry from the client
 	void RejectInquiry(const string& _inquiryId);
 
+	// Get the handle of a live inquiry, -1 if unknown or retired
+	int GetInquiryHandle(const string& _inquiryId) const;
+
+	// Get the number of live inquiries
+	long GetInquiryCount() const;
+
+	// Get the number of inquiries retired
+	long GetRetiredCount() const;
+
+	// Get the number of slots, live or free
+	long GetSlotCount() const;
+
+	// Expire quotes the client has not answered within a time in microseconds, 0 for never
+	void SetQuoteTtl(long _ttl);
+
+	// Get the number of quotes expired
+	long GetExpiredCount() const;
+
+	// Get the number of events dropped as not allowed in the state of their inquiry
+	long GetInvalidEventCount() const;
+
+	// Price received inquiries with a quoter, rejecting those not quoted within a timeout in microseconds
+	void SetQuoter(InquiryQuoter<T>* _quoter, long _timeout);
+
+	// Get the longest time from receipt to quote in microseconds
+	long GetMaxQuoteLatency() const;
+
+	// Get the number of inquiries rejected for not being quoted in time
+	long GetTimeoutCount() const;
+
+	// Get copies of the live inquiries
+	vector<Inquiry<T>> GetLiveInquiries() const;
+
+	// Bring back a live inquiry saved earlier, quoting it again if it was not yet quoted
+	void Restore(const Inquiry<T>& _inquiry);
+
 };
 
 
@@ -140,6 +296,9 @@ public:
 
 	// Subscribe data from the Connector
 	void Subscribe(ifstream& _data);
+
+	// Subscribe one line of data from the Connector
+	void Subscribe(const string& _line);
 	
 	// Re-subscribe data from the Connector
 	void Subscribe(Inquiry<T>& _data);
@@ -148,7 +307,7 @@ public:
 
 
 template<typename T>
-Inquiry<T>::Inquiry(string _inquiryId, const T& _product, Side _side, long _quantity, double _price, InquiryState _state) :
+Inquiry<T>::Inquiry(Identifier _inquiryId, const T& _product, Side _side, long _quantity, double _price, InquiryState _state) :
 	product(_product)
 {
 	inquiryId = _inquiryId;
@@ -159,7 +318,7 @@ Inquiry<T>::Inquiry(string _inquiryId, const T& _product, Side _side, long _quan
 }
 
 template<typename T>
-const string& Inquiry<T>::GetInquiryId() const
+const Identifier& Inquiry<T>::GetInquiryId() const
 {
 	return inquiryId;
 }
@@ -189,7 +348,7 @@ double Inquiry<T>::GetPrice() const
 }
 
 template<typename T>
-double Inquiry<T>::SetPrice(double _price)
+void Inquiry<T>::SetPrice(double _price)
 {
 	price = _price;
 }
@@ -257,7 +416,20 @@ vector<string> Inquiry<T>::ToStrings() const
 template<typename T>
 InquiryService<T>::InquiryService()
 {
-	inquiries = map<string, Inquiry<T>>();
+	slots = deque<InquirySlot<T>>();
+	freeSlots = vector<int>();
+	inquiryHandles = HashIndex<int>();
+	pendingEvents = deque<PendingInquiryEvent>();
+	isDispatching = false;
+	liveCount = 0;
+	retiredCount = 0;
+	invalidCount = 0;
+	quoter = nullptr;
+	quoteTimeout = 0;
+	quoteTtl = 0;
+	maxQuoteLatency = 0;
+	timeoutCount = 0;
+	expiredCount = 0;
 	listeners = vector<ServiceListener<Inquiry<T>>*>();
 	connector = new InquiryConnector<T>(this);
 }
@@ -268,32 +440,186 @@ InquiryService<T>::~InquiryService() {}
 template<typename T>
 Inquiry<T>& InquiryService<T>::GetData(string _key)
 {
-	return inquiries[_key];
+	int _handle = GetInquiryHandle(_key);
+	if (_handle < 0)
+	{
+		emptyInquiry = Inquiry<T>();
+		return emptyInquiry;
+	}
+	return slots[_handle].inquiry;
 }
 
 template<typename T>
 void InquiryService<T>::OnMessage(Inquiry<T>& _data)
 {
-	InquiryState _state = _data.GetState();
-	switch (_state)
+	InquiryEvent _event = GetInquiryEvent(_data.GetState());
+	int _handle = GetInquiryHandle(_data.GetInquiryId());
+
+	// Only a new inquiry can be received.
+	if ((_handle < 0) != (_event == RECEIVE))
 	{
-	case RECEIVED:
-		inquiries[_data.GetInquiryId()] = _data;
-		connector->Publish(_data);
-		break;
-	case QUOTED:
-		_data.SetState(DONE);
-		inquiries[_data.GetInquiryId()] = _data;
+		invalidCount++;
+		return;
+	}
+	if (_handle < 0) _handle = Allocate(_data);
 
-		for (auto& l : listeners)
+	Dispatch(_handle, slots[_handle].generation, _event, _data.GetPrice());
+}
+
+template<typename T>
+int InquiryService<T>::Allocate(const Inquiry<T>& _inquiry)
+{
+	// Slots live in a deque, so growing it keeps references to the others valid.
+	int _handle;
+	if (freeSlots.empty())
+	{
+		_handle = (int)slots.size();
+		slots.push_back(InquirySlot<T>());
+		slots[_handle].generation = 0;
+	}
+	else
+	{
+		_handle = freeSlots.back();
+		freeSlots.pop_back();
+	}
+
+	InquirySlot<T>& _slot = slots[_handle];
+	_slot.inquiry = _inquiry;
+	_slot.isLive = true;
+	_slot.timer = TimerHandle();
+	_slot.receivedTime = 0;
+	*inquiryHandles.Insert(_inquiry.GetInquiryId(), _handle).first = _handle;
+	liveCount++;
+	return _handle;
+}
+
+template<typename T>
+void InquiryService<T>::Retire(int _handle)
+{
+	InquirySlot<T>& _slot = slots[_handle];
+	GetTimerWheel().Cancel(_slot.timer);
+	inquiryHandles.Erase(_slot.inquiry.GetInquiryId());
+	_slot.inquiry = Inquiry<T>();
+	_slot.isLive = false;
+	_slot.generation++;
+	freeSlots.push_back(_handle);
+	liveCount--;
+	retiredCount++;
+}
+
+template<typename T>
+void InquiryService<T>::Dispatch(int _handle, unsigned _generation, InquiryEvent _event, double _price)
+{
+	pendingEvents.push_back({ _handle, _generation, _event, _price });
+	if (isDispatching) return;
+
+	isDispatching = true;
+	while (!pendingEvents.empty())
+	{
+		PendingInquiryEvent _pending = pendingEvents.front();
+		pendingEvents.pop_front();
+		Apply(_pending);
+	}
+	isDispatching = false;
+}
+
+template<typename T>
+void InquiryService<T>::Apply(const PendingInquiryEvent& _pending)
+{
+	InquirySlot<T>& _slot = slots[_pending.handle];
+	if (!_slot.isLive || _slot.generation != _pending.generation)
+	{
+		invalidCount++;
+		return;
+	}
+	Inquiry<T>& _inquiry = _slot.inquiry;
+
+	// A received inquiry is already in its slot in RECEIVED. Without a quoter it is quoted back at the
+	// price asked; with one it is priced as soon as its product can be, within the timeout.
+	if (_pending.event == RECEIVE)
+	{
+		if (!quoter)
 		{
-			l->ProcessAdd(_data);
+			pendingEvents.push_back({ _pending.handle, _pending.generation, QUOTE, _inquiry.GetPrice() });
+			return;
 		}
+		_slot.receivedTime = GetTimerWheel().Now();
+		TryQuote(_pending.handle);
+		return;
+	}
+
+	int _next = INQUIRY_TRANSITIONS[_inquiry.GetState()][_pending.event];
+	if (_next == INVALID_TRANSITION)
+	{
+		invalidCount++;
+		return;
+	}
+	if (_pending.event == EXPIRE) expiredCount++;
+
+	// The timer of a state, the quote retry while RECEIVED or the expiry while QUOTED, ends with it;
+	// a quote later than the timeout is a rejection instead.
+	GetTimerWheel().Cancel(_slot.timer);
+	if (quoter && _inquiry.GetState() == RECEIVED && _next == QUOTED)
+	{
+		long _latency = GetTimerWheel().Now() - _slot.receivedTime;
+		maxQuoteLatency = max(maxQuoteLatency, _latency);
+		if (_latency > quoteTimeout)
+		{
+			timeoutCount++;
+			_next = REJECTED;
+		}
+	}
+	_inquiry.SetState((InquiryState)_next);
 
+	switch (_next)
+	{
+	case QUOTED:
+		_inquiry.SetPrice(_pending.price);
+		if (quoteTtl > 0)
+		{
+			int _handle = _pending.handle;
+			unsigned _generation = _pending.generation;
+			_slot.timer = GetTimerWheel().ScheduleAfter(quoteTtl, [this, _handle, _generation]() { Dispatch(_handle, _generation, EXPIRE, 0); });
+		}
+		for (auto& l : listeners)
+		{
+			l->ProcessUpdate(_inquiry);
+		}
+		connector->Publish(_inquiry);
+		break;
+	case DONE:
+	case REJECTED:
+	case CUSTOMER_REJECTED:
+		for (auto& l : listeners)
+		{
+			l->ProcessAdd(_inquiry);
+		}
+		Retire(_pending.handle);
 		break;
 	}
 }
 
+template<typename T>
+void InquiryService<T>::TryQuote(int _handle)
+{
+	InquirySlot<T>& _slot = slots[_handle];
+	unsigned _generation = _slot.generation;
+	double _price;
+	if (quoter->Quote(_slot.inquiry, _price))
+	{
+		Dispatch(_handle, _generation, QUOTE, _price);
+		return;
+	}
+
+	if (GetTimerWheel().Now() - _slot.receivedTime >= quoteTimeout)
+	{
+		timeoutCount++;
+		Dispatch(_handle, _generation, REJECT, 0);
+		return;
+	}
+	_slot.timer = GetTimerWheel().ScheduleAfter(1, [this, _handle]() { TryQuote(_handle); });
+}
+
 template<typename T>
 void InquiryService<T>::AddListener(ServiceListener<Inquiry<T>>* _listener)
 {
@@ -315,20 +641,110 @@ InquiryConnector<T>* InquiryService<T>::GetConnector()
 template<typename T>
 void InquiryService<T>::SendQuote(const string& _inquiryId, double _price)
 {
-	Inquiry<T>& _inquiry = inquiries[_inquiryId];
-	InquiryState _state = _inquiry.GetState();
-	_inquiry.SetPrice(_price);
-	for (auto& l : listeners)
+	int _handle = GetInquiryHandle(_inquiryId);
+	if (_handle < 0) return;
+	Dispatch(_handle, slots[_handle].generation, QUOTE, _price);
+}
+
+template<typename T>
+void InquiryService<T>::RejectInquiry(const string& _inquiryId)
+{
+	int _handle = GetInquiryHandle(_inquiryId);
+	if (_handle < 0) return;
+	Dispatch(_handle, slots[_handle].generation, REJECT, 0);
+}
+
+template<typename T>
+int InquiryService<T>::GetInquiryHandle(const string& _inquiryId) const
+{
+	const int* _handle = inquiryHandles.Find(_inquiryId);
+	return _handle ? *_handle : -1;
+}
+
+template<typename T>
+long InquiryService<T>::GetInquiryCount() const
+{
+	return liveCount;
+}
+
+template<typename T>
+long InquiryService<T>::GetRetiredCount() const
+{
+	return retiredCount;
+}
+
+template<typename T>
+long InquiryService<T>::GetSlotCount() const
+{
+	return (long)slots.size();
+}
+
+template<typename T>
+void InquiryService<T>::SetQuoteTtl(long _ttl)
+{
+	quoteTtl = _ttl;
+}
+
+template<typename T>
+long InquiryService<T>::GetExpiredCount() const
+{
+	return expiredCount;
+}
+
+template<typename T>
+long InquiryService<T>::GetInvalidEventCount() const
+{
+	return invalidCount;
+}
+
+template<typename T>
+void InquiryService<T>::SetQuoter(InquiryQuoter<T>* _quoter, long _timeout)
+{
+	quoter = _quoter;
+	quoteTimeout = _timeout;
+}
+
+template<typename T>
+long InquiryService<T>::GetMaxQuoteLatency() const
+{
+	return maxQuoteLatency;
+}
+
+template<typename T>
+long InquiryService<T>::GetTimeoutCount() const
+{
+	return timeoutCount;
+}
+
+
+template<typename T>
+vector<Inquiry<T>> InquiryService<T>::GetLiveInquiries() const
+{
+	vector<Inquiry<T>> _inquiries;
+	_inquiries.reserve(liveCount);
+	for (auto& s : slots)
 	{
-		l->ProcessAdd(_inquiry);
+		if (s.isLive) _inquiries.push_back(s.inquiry);
 	}
+	return _inquiries;
 }
 
 template<typename T>
-void InquiryService<T>::RejectInquiry(const string& _inquiryId)
+void InquiryService<T>::Restore(const Inquiry<T>& _inquiry)
 {
-	Inquiry<T>& _inquiry = inquiries[_inquiryId];
-	_inquiry.SetState(REJECTED);
+	if (GetInquiryHandle(_inquiry.GetInquiryId()) >= 0) return;
+	int _handle = Allocate(_inquiry);
+	unsigned _generation = slots[_handle].generation;
+
+	// The quote clock starts over on restore: a received inquiry is priced again and a quote gets a full TTL.
+	if (_inquiry.GetState() == RECEIVED)
+	{
+		Dispatch(_handle, _generation, RECEIVE, _inquiry.GetPrice());
+	}
+	else if (_inquiry.GetState() == QUOTED && quoteTtl > 0)
+	{
+		slots[_handle].timer = GetTimerWheel().ScheduleAfter(quoteTtl, [this, _handle, _generation]() { Dispatch(_handle, _generation, EXPIRE, 0); });
+	}
 }
 
 
@@ -344,11 +760,11 @@ InquiryConnector<T>::~InquiryConnector() {}
 template<typename T>
 void InquiryConnector<T>::Publish(Inquiry<T>& _data)
 {
-	InquiryState _state = _data.GetState();
-	if (_state == RECEIVED)
+	// The simulated client accepts every quote it is sent; its reply is queued by the service.
+	if (_data.GetState() == QUOTED)
 	{
-		_data.SetState(QUOTED);
-		this->Subscribe(_data);
+		Inquiry<T> _reply = _data;
+		this->Subscribe(_reply);
 	}
 }
 
@@ -358,31 +774,38 @@ void InquiryConnector<T>::Subscribe(ifstream& _data)
 	string _line;
 	while (getline(_data, _line))
 	{
-		stringstream _lineStream(_line);
-		string _cell;
-		vector<string> _cells;
-		while (getline(_lineStream, _cell, ','))
-		{
-			_cells.push_back(_cell);
-		}
+		PollTimers();
+		Subscribe(_line);
+	}
+}
 
-		string _inquiryId = _cells[0];
-		string _productId = _cells[1];
-		Side _side;
-		if (_cells[2] == "BUY") _side = BUY;
-		else if (_cells[2] == "SELL") _side = SELL;
-		long _quantity = stol(_cells[3]);
-		double _price = ConvertPrice(_cells[4]);
-		InquiryState _state;
-		if (_cells[5] == "RECEIVED") _state = RECEIVED;
-		else if (_cells[5] == "QUOTED") _state = QUOTED;
-		else if (_cells[5] == "DONE") _state = DONE;
-		else if (_cells[5] == "REJECTED") _state = REJECTED;
-		else if (_cells[5] == "CUSTOMER_REJECTED") _state = CUSTOMER_REJECTED;
-		T _product = GetBond(_productId);
-		Inquiry<T> _inquiry(_inquiryId, _product, _side, _quantity, _price, _state);
-		service->OnMessage(_inquiry);
+template<typename T>
+void InquiryConnector<T>::Subscribe(const string& _line)
+{
+	stringstream _lineStream(_line);
+	string _cell;
+	vector<string> _cells;
+	while (getline(_lineStream, _cell, ','))
+	{
+		_cells.push_back(_cell);
 	}
+
+	string _inquiryId = _cells[0];
+	string _productId = _cells[1];
+	Side _side;
+	if (_cells[2] == "BUY") _side = BUY;
+	else if (_cells[2] == "SELL") _side = SELL;
+	long _quantity = stol(_cells[3]);
+	double _price = ConvertPrice(_cells[4]);
+	InquiryState _state;
+	if (_cells[5] == "RECEIVED") _state = RECEIVED;
+	else if (_cells[5] == "QUOTED") _state = QUOTED;
+	else if (_cells[5] == "DONE") _state = DONE;
+	else if (_cells[5] == "REJECTED") _state = REJECTED;
+	else if (_cells[5] == "CUSTOMER_REJECTED") _state = CUSTOMER_REJECTED;
+	T _product = GetBond(_productId);
+	Inquiry<T> _inquiry(_inquiryId, _product, _side, _quantity, _price, _state);
+	service->OnMessage(_inquiry);
 }
 
 template<typename T>
@@ -0,0 +1,197 @@
+/**
+* journal.hpp
+* Defines the append-only, memory-mapped journal of fixed-size records.
+*
+* @author Haonan Lu
+*/
+
+#ifndef JOURNAL_HPP
+#define JOURNAL_HPP
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <algorithm>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace std;
+
+/**
+* Append-only journal of fixed-size records in a memory-mapped file.
+* Records are addressed by their offset, the number of records before
+* them, which never changes. The file starts with a header holding the
+* record count, so a journal reopened after a restart carries on after its
+* last record. The mapping doubles when full; references to records are
+* valid until the next append.
+* Type R is the trivially-copyable record type.
+*/
+template<typename R>
+class Journal
+{
+
+	static_assert(is_trivially_copyable<R>::value, "journal records must be trivially copyable");
+
+public:
+
+	// ctor for a journal in a file, reopening the records already in it
+	Journal(const string& _path, long _initialCapacity = 65536);
+	~Journal();
+
+	// Is the journal file open and mapped?
+	bool IsOpen() const;
+
+	// Get the path of the journal file
+	const string& GetPath() const;
+
+	// Append a record and return its offset, -1 if the journal is not open
+	long Append(const R& _record);
+
+	// Get the record at an offset
+	const R& Get(long _offset) const;
+
+	// Get the number of records
+	long GetCount() const;
+
+	// Drop the records from an offset on, so they can be appended again
+	void Truncate(long _count);
+
+	// Ask the system to write the records out to the file
+	void Flush();
+
+private:
+
+	struct Header
+	{
+		uint64_t magic;
+		uint64_t recordSize;
+		uint64_t count;
+		uint64_t capacity;
+	};
+
+	static const uint64_t MAGIC = 0x4c4e524a44415254;
+
+	string path;
+	int fd;
+	Header* header;
+	R* records;
+	size_t mappedSize;
+
+	// Map the file for a capacity of records, growing the file if needed
+	bool Map(uint64_t _capacity);
+
+};
+
+template<typename R>
+Journal<R>::Journal(const string& _path, long _initialCapacity)
+{
+	path = _path;
+	header = nullptr;
+	records = nullptr;
+	mappedSize = 0;
+	fd = open(_path.c_str(), O_CREAT | O_RDWR, 0644);
+	if (fd < 0) return;
+
+	// A file that is not a journal of this record type is started over.
+	struct stat _stat;
+	Header _header;
+	bool _valid = fstat(fd, &_stat) == 0 && (size_t)_stat.st_size >= sizeof(Header)
+		&& pread(fd, &_header, sizeof(Header), 0) == (ssize_t)sizeof(Header)
+		&& _header.magic == MAGIC && _header.recordSize == sizeof(R)
+		&& (size_t)_stat.st_size >= sizeof(Header) + _header.capacity * sizeof(R);
+	if (!_valid)
+	{
+		if (ftruncate(fd, 0) != 0 || !Map(max(1L, _initialCapacity))) return;
+		header->magic = MAGIC;
+		header->recordSize = sizeof(R);
+		header->count = 0;
+		return;
+	}
+	Map(_header.capacity);
+}
+
+template<typename R>
+Journal<R>::~Journal()
+{
+	if (header)
+	{
+		msync(header, mappedSize, MS_ASYNC);
+		munmap(header, mappedSize);
+	}
+	if (fd >= 0) close(fd);
+}
+
+template<typename R>
+bool Journal<R>::Map(uint64_t _capacity)
+{
+	if (header) munmap(header, mappedSize);
+	header = nullptr;
+	records = nullptr;
+
+	size_t _size = sizeof(Header) + _capacity * sizeof(R);
+	struct stat _stat;
+	if (fstat(fd, &_stat) != 0) return false;
+	if ((size_t)_stat.st_size < _size && ftruncate(fd, _size) != 0) return false;
+
+	void* _memory = mmap(nullptr, _size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (_memory == MAP_FAILED) return false;
+	mappedSize = _size;
+	header = (Header*)_memory;
+	records = (R*)((char*)_memory + sizeof(Header));
+	header->capacity = _capacity;
+	return true;
+}
+
+template<typename R>
+bool Journal<R>::IsOpen() const
+{
+	return header != nullptr;
+}
+
+template<typename R>
+const string& Journal<R>::GetPath() const
+{
+	return path;
+}
+
+template<typename R>
+long Journal<R>::Append(const R& _record)
+{
+	if (!header) return -1;
+	if (header->count == header->capacity && !Map(header->capacity * 2)) return -1;
+
+	// The record is written before the count that makes it part of the journal.
+	uint64_t _offset = header->count;
+	memcpy(&records[_offset], &_record, sizeof(R));
+	header->count = _offset + 1;
+	return (long)_offset;
+}
+
+template<typename R>
+const R& Journal<R>::Get(long _offset) const
+{
+	return records[_offset];
+}
+
+template<typename R>
+long Journal<R>::GetCount() const
+{
+	return header ? (long)header->count : 0;
+}
+
+template<typename R>
+void Journal<R>::Truncate(long _count)
+{
+	if (header && _count >= 0 && (uint64_t)_count < header->count) header->count = _count;
+}
+
+template<typename R>
+void Journal<R>::Flush()
+{
+	if (header) msync(header, mappedSize, MS_ASYNC);
+}
+
+#endif
@@ -24,23 +24,64 @@
 #include "streamingservice.hpp"
 #include "tradebookingservice.hpp"
 #include "datagenerator.hpp"
+#include "curveservice.hpp"
+#include "replayengine.hpp"
+#include "eventqueue.hpp"
+#include "ingestionmanager.hpp"
+#include "shardedpipeline.hpp"
+#include "autoquoter.hpp"
+#include "statestore.hpp"
+#include "checkpoint.hpp"
 
 using namespace std;
 
 
-int main() {
+int main(int argc, char* argv[]) {
 	cout << "---------------------- Program Start ----------------------" << endl;
 
-	std::cout << TimeStamp() << "Data generating..." << endl;
-	GeneratePriceData();
-	GenerateTradeData();
-	GenerateMarketData();
-	GenerateInquiries();
-	std::cout << TimeStamp() << "Data generated successfully." << endl;
+	// One executor serves every service: --workers sets its size and --cores the isolated cores it is pinned to.
+	// A replay checkpoints every --checkpoint-interval microseconds of event time; --restart resumes the replay from the last checkpoint.
+	// Streamed prices are conflated within --conflation-window microseconds, 0 for only suppressing unchanged quotes.
+	int workerCount = (int)thread::hardware_concurrency();
+	vector<int> isolatedCores;
+	long checkpointInterval = 100000;
+	long conflationWindow = 0;
+	bool restart = false;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (string(argv[i]) == "--restart") restart = true;
+		if (i + 1 == argc) continue;
+		if (string(argv[i]) == "--workers") workerCount = stoi(argv[i + 1]);
+		if (string(argv[i]) == "--cores") isolatedCores = ParseCpuList(argv[i + 1]);
+		if (string(argv[i]) == "--checkpoint-interval") checkpointInterval = stol(argv[i + 1]);
+		if (string(argv[i]) == "--conflation-window") conflationWindow = stol(argv[i + 1]);
+	}
+	bool sharded = argc > 2 && string(argv[1]) == "--shards";
+	bool replay = restart || (argc > 1 && string(argv[1]) == "--replay");
+	if (sharded && restart)
+	{
+		cerr << "--restart resumes a replay and cannot be combined with --shards." << endl;
+		return 1;
+	}
+	GetExecutor().Configure(max(1, workerCount), isolatedCores);
+
+	// A restart carries on over the input files of the run it restarts, so they are kept.
+	if (!restart)
+	{
+		std::cout << TimeStamp() << "Data generating..." << endl;
+		TaskGroup generation;
+		GetExecutor().Submit(generation, GeneratePriceData);
+		GetExecutor().Submit(generation, GenerateTradeData);
+		GetExecutor().Submit(generation, GenerateMarketData);
+		GetExecutor().Submit(generation, GenerateInquiries);
+		GetExecutor().Wait(generation);
+		std::cout << TimeStamp() << "Data generated successfully." << endl;
+	}
 
 	cout << TimeStamp() << "Services initializing..." << endl;
 	PricingService<Bond> pricingService;
-	TradeBookingService<Bond> tradeBookingService;
+	CurveService<Bond> curveService;
+	TradeBookingService<Bond> tradeBookingService("tradejournal.dat", restart);
 	PositionService<Bond> positionService;
 	RiskService<Bond> riskService;
 	MarketDataService<Bond> marketDataService;
@@ -50,48 +91,202 @@ int main() {
 	ExecutionService<Bond> executionService;
 	StreamingService<Bond> streamingService;
 	InquiryService<Bond> inquiryService;
+	AutoQuoter<Bond> autoQuoter(&pricingService, &positionService);
+	StateStore<Bond> stateStore;
 	HistoricalDataService<Position<Bond>> historicalPositionService(POSITION);
 	HistoricalDataService<PV01<Bond>> historicalRiskService(RISK);
 	HistoricalDataService<ExecutionOrder<Bond>> historicalExecutionService(EXECUTION);
 	HistoricalDataService<PriceStream<Bond>> historicalStreamingService(STREAMING);
 	HistoricalDataService<Inquiry<Bond>> historicalInquiryService(INQUIRY);
+	EventQueue bookingQueue("booking");
+	EventQueue streamingQueue("streaming");
 	cout << TimeStamp() << "Services initialized successfully." << endl;
 
 	cout << TimeStamp() << "Services linking..." << endl;
+	pricingService.AddListener(curveService.GetListener());
+	curveService.AddListener(new QueuedListener<YieldCurve>(riskService.GetCurveListener(), &bookingQueue));
 	pricingService.AddListener(algoStreamingService.GetListener());
 	pricingService.AddListener(guiService.GetListener());
+	pricingService.AddListener(stateStore.GetPricingListener());
+	marketDataService.AddListener(stateStore.GetMarketDataListener());
+	positionService.AddListener(stateStore.GetPositionListener());
+	riskService.AddListener(stateStore.GetRiskListener());
 	algoStreamingService.AddListener(streamingService.GetListener());
 	streamingService.AddListener(historicalStreamingService.GetListener());
+	marketDataService.AddListener(executionService.GetMarketDataListener());
 	marketDataService.AddListener(algoExecutionService.GetListener());
 	algoExecutionService.AddListener(executionService.GetListener());
-	executionService.AddListener(tradeBookingService.GetListener());
+	executionService.AddListener(new QueuedListener<ExecutionOrder<Bond>>(tradeBookingService.GetListener(), &bookingQueue));
 	executionService.AddListener(historicalExecutionService.GetListener());
+	executionService.AddListener(algoExecutionService.GetExecutionListener());
 	tradeBookingService.AddListener(positionService.GetListener());
 	positionService.AddListener(riskService.GetListener());
+	positionService.AddListener(new QueuedListener<Position<Bond>>(algoStreamingService.GetPositionListener(), &streamingQueue));
 	positionService.AddListener(historicalPositionService.GetListener());
 	riskService.AddListener(historicalRiskService.GetListener());
+	riskService.AddListener(new QueuedListener<PV01<Bond>>(algoStreamingService.GetRiskListener(), &streamingQueue));
 	inquiryService.AddListener(historicalInquiryService.GetListener());
+	inquiryService.SetQuoter(&autoQuoter, 20000);
+	inquiryService.SetQuoteTtl(1000000);
+	streamingService.SetConflationWindow(conflationWindow);
+	// A local client per tier reads its session, so the sessions' sockets never fill while the clients keep up.
+	vector<StreamingClient*> streamingClients;
+	for (ClientTier tier : { TIER1, TIER2, TIER3 })
+	{
+		StreamingSession* session = streamingService.GetConnector()->AddSession(tier);
+		session->EntitleAll();
+		streamingClients.push_back(new StreamingClient(session));
+		streamingClients.back()->Start();
+	}
 	cout << TimeStamp() << "Services linked successfully." << endl;
 
-	cout << TimeStamp() << "Price data processing..." << endl;
-	ifstream priceData("prices.txt");
-	pricingService.GetConnector()->Subscribe(priceData);
-	cout << TimeStamp() << "Price data processed successfully." << endl;
-
-	cout << TimeStamp() << "Trade data processing..." << endl;
-	ifstream tradeData("trades.txt");
-	tradeBookingService.GetConnector()->Subscribe(tradeData);
-	cout << TimeStamp() << "Trade data processed successfully." << endl;
-
-	cout << TimeStamp() << "Market data processing..." << endl;
-	ifstream marketData("marketdata.txt");
-	marketDataService.GetConnector()->Subscribe(marketData);
-	cout << TimeStamp() << "Market data processed successfully." << endl;
-
-	cout << TimeStamp() << "Inquiry data processing..." << endl;
-	ifstream inquiryData("inquiries.txt");
-	inquiryService.GetConnector()->Subscribe(inquiryData);
-	cout << TimeStamp() << "Inquiry data processed successfully." << endl;
+	if (sharded)
+	{
+		// Trades and market data run through per-product shards, each with its own chain
+		// from market data to risk; prices and inquiries feed the streaming queue as above.
+		// Each shard risks its positions off the curve the prices fit, writes the history
+		// and the state store columns of the products it owns, and skews the streams
+		// through the streaming queue.
+		int shardCount = max(1, stoi(argv[2]));
+		cout << TimeStamp() << "Input data ingesting on " << shardCount << " shards..." << endl;
+		ShardedPipeline<Bond> pipeline(shardCount);
+		for (int i = 0; i < shardCount; ++i)
+		{
+			PipelineShard<Bond>& shard = pipeline.GetShard(i);
+			curveService.AddListener(new QueuedListener<YieldCurve>(shard.riskService.GetCurveListener(), &shard.queue));
+			shard.marketDataService.AddListener(stateStore.GetMarketDataListener());
+			shard.executionService.AddListener(historicalExecutionService.GetListener());
+			shard.positionService.AddListener(stateStore.GetPositionListener());
+			shard.positionService.AddListener(new QueuedListener<Position<Bond>>(algoStreamingService.GetPositionListener(), &streamingQueue));
+			shard.positionService.AddListener(historicalPositionService.GetListener());
+			shard.riskService.AddListener(stateStore.GetRiskListener());
+			shard.riskService.AddListener(historicalRiskService.GetListener());
+			shard.riskService.AddListener(new QueuedListener<PV01<Bond>>(algoStreamingService.GetRiskListener(), &streamingQueue));
+		}
+		pipeline.Start();
+		streamingQueue.Start();
+		IngestionManager ingestionManager;
+		ingestionManager.AddSource("prices.txt", pricingService.GetConnector(), &streamingQueue);
+		ingestionManager.AddSource("trades.txt", pipeline.GetTradeConnector());
+		ingestionManager.AddSource("marketdata.txt", pipeline.GetMarketDataConnector());
+		ingestionManager.AddSource("inquiries.txt", inquiryService.GetConnector(), &streamingQueue);
+		ingestionManager.Run();
+		// The shards are drained first, so the skews they post are on the streaming queue before its flush.
+		pipeline.Drain();
+		streamingQueue.Post([&streamingService]() { streamingService.FlushPrices(); });
+		streamingQueue.Drain();
+		streamingQueue.Stop();
+		cout << TimeStamp() << "Input data ingested successfully." << endl;
+
+		vector<Bond> frontEnd = { GetBond("91282CJL6"), GetBond("91282CJP7") };
+		vector<Bond> belly = { GetBond("91282CJN2"), GetBond("91282CJM4"), GetBond("91282CJJ1") };
+		vector<Bond> longEnd = { GetBond("912810TW8"), GetBond("912810TV0") };
+		cout << TimeStamp() << "Total position: " << pipeline.GetTotalPosition() << endl;
+		cout << TimeStamp() << "FrontEnd PV01: " << pipeline.GetBucketedRisk(BucketedSector<Bond>(frontEnd, "FrontEnd")).GetPV01() << endl;
+		cout << TimeStamp() << "Belly PV01: " << pipeline.GetBucketedRisk(BucketedSector<Bond>(belly, "Belly")).GetPV01() << endl;
+		cout << TimeStamp() << "LongEnd PV01: " << pipeline.GetBucketedRisk(BucketedSector<Bond>(longEnd, "LongEnd")).GetPV01() << endl;
+		pipeline.Stop();
+	}
+	else if (replay)
+	{
+		// Replay runs every service on this thread in event time, with the queues inline.
+		ReplayEngine replayEngine;
+		replayEngine.AddSource("prices.txt", pricingService.GetConnector());
+		replayEngine.AddSource("trades.txt", tradeBookingService.GetConnector());
+		replayEngine.AddSource("marketdata.txt", marketDataService.GetConnector());
+		replayEngine.AddSource("inquiries.txt", inquiryService.GetConnector());
+
+		Checkpointer<Bond> checkpointer("checkpoint.dat", &pricingService, &marketDataService, &algoExecutionService, &executionService, &tradeBookingService, &positionService, &riskService, &inquiryService,
+			&algoStreamingService, &streamingService, &curveService);
+		checkpointer.AddHistory(historicalPositionService.GetConnector());
+		checkpointer.AddHistory(historicalRiskService.GetConnector());
+		checkpointer.AddHistory(historicalExecutionService.GetConnector());
+		checkpointer.AddHistory(historicalStreamingService.GetConnector());
+		checkpointer.AddHistory(historicalInquiryService.GetConnector());
+		vector<InputOffset> offsets;
+		if (restart && checkpointer.Restore(offsets, replayEngine.GetClock()))
+		{
+			replayEngine.Resume(offsets);
+			for (auto& p : positionService.GetAllPositions())
+			{
+				Position<Bond> position = p.second;
+				stateStore.UpdatePosition(position);
+			}
+			for (auto& r : riskService.GetAllRisk())
+			{
+				stateStore.UpdateRisk(r.second);
+			}
+			for (auto& p : pricingService.GetAllPrices())
+			{
+				stateStore.UpdatePrice(p.second);
+			}
+			for (auto& b : marketDataService.GetVenueBooks())
+			{
+				stateStore.UpdateBidOffer(marketDataService.GetData(b.first));
+			}
+			cout << TimeStamp() << "Checkpoint at event time " << checkpointer.GetTime() << " restored." << endl;
+		}
+		else if (restart)
+		{
+			// With no checkpoint the run starts over, so the trades it journaled are dropped.
+			tradeBookingService.Restore(0);
+		}
+		replayEngine.SetCheckpoint(checkpointInterval, [&checkpointer](long _time, const vector<InputOffset>& _offsets)
+		{
+			if (!checkpointer.IsQuiescent()) return false;
+			checkpointer.Take(_time, _offsets);
+			return true;
+		});
+
+		cout << TimeStamp() << "Input data replaying..." << endl;
+		long events = replayEngine.Run();
+		streamingService.FlushPrices();
+		checkpointer.Wait();
+		cout << TimeStamp() << "Input data replayed successfully: " << events << " events, " << checkpointer.GetCount() << " checkpoints, " << checkpointer.GetSkippedCount() << " skipped." << endl;
+	}
+	else
+	{
+		// Prices and inquiries feed the streaming queue and trades the booking queue, which also
+		// take the positions, risk and executions produced on the other threads.
+		cout << TimeStamp() << "Input data ingesting..." << endl;
+		bookingQueue.Start();
+		streamingQueue.Start();
+		IngestionManager ingestionManager;
+		ingestionManager.AddSource("prices.txt", pricingService.GetConnector(), &streamingQueue);
+		ingestionManager.AddSource("trades.txt", tradeBookingService.GetConnector(), &bookingQueue);
+		ingestionManager.AddSource("marketdata.txt", marketDataService.GetConnector());
+		ingestionManager.AddSource("inquiries.txt", inquiryService.GetConnector(), &streamingQueue);
+		ingestionManager.Run();
+		bookingQueue.Drain();
+		// Held prices are flushed on the streaming thread, whose timer wheel holds their flush timers.
+		streamingQueue.Post([&streamingService]() { streamingService.FlushPrices(); });
+		streamingQueue.Drain();
+		bookingQueue.Stop();
+		streamingQueue.Stop();
+		cout << TimeStamp() << "Input data ingested successfully." << endl;
+	}
+	executionService.ProcessFills();
+	cout << TimeStamp() << "Total position: " << stateStore.GetTotalPosition() << ", total PV01: " << stateStore.GetTotalRisk() << endl;
+	long queryStart = GetMicrosecond();
+	map<string, HistoricalRecord> lastRisk = historicalRiskService.QueryLast(GetEpochMicrosecond());
+	size_t bidExecutions = historicalExecutionService.QueryByKey("BID", 0, GetEpochMicrosecond()).size();
+	cout << TimeStamp() << "History: last risk of " << lastRisk.size() << " products, " << bidExecutions << " bid executions, queried in " << GetMicrosecond() - queryStart << "us" << endl;
+	cout << TimeStamp() << "Prices streamed: " << streamingService.GetPublishedCount() << ", unchanged: " << streamingService.GetSuppressedCount() << ", conflated: " << streamingService.GetConflatedCount() << endl;
+	for (auto& c : streamingClients)
+	{
+		c->Stop();
+		StreamingSession* session = c->GetSession();
+		cout << TimeStamp() << "Streaming session " << session->GetSessionId() << " of tier " << session->GetTier() + 1 << ": " << c->GetFrameCount() << " frames received, "
+			<< session->GetThrottledCount() << " throttled, " << session->GetDroppedCount() << " dropped, " << session->GetQueuedCount() << " queued" << endl;
+	}
+	cout << TimeStamp() << "Inquiries quoted: " << autoQuoter.GetQuoteCount() << ", timed out: " << inquiryService.GetTimeoutCount() << ", max quote latency: " << inquiryService.GetMaxQuoteLatency() << "us" << endl;
+
+	for (auto& s : GetExecutor().GetStats())
+	{
+		cout << TimeStamp() << "Worker on cpu " << s.cpu << " node " << s.node << ": " << s.executed << " tasks, " << s.stolen << " stolen, max depth " << s.maxDepth << endl;
+	}
+	cout << TimeStamp() << "Tasks run by waiting threads: " << GetExecutor().GetHelpedCount() << endl;
+	GetExecutor().Shutdown();
 
 	cout << "---------------------- Program End ----------------------" << endl;
 
@@ -11,13 +11,22 @@
 
 #include <string>
 #include <vector>
+#include <climits>
+#include <cmath>
+#include <array>
+#include <algorithm>
 #include "soa.hpp"
+#include "snapshottable.hpp"
 
 using namespace std;
 
 // Side for market data
 enum PricingSide { BID, OFFER };
 
+// Venues that market data comes from and orders are executed on
+enum Market { BROKERTEC, ESPEED, CME };
+const int NUM_MARKETS = 3;
+
 /**
 * A market data order with price, quantity, and side.
 */
@@ -108,6 +117,187 @@ const Order& BidOffer::GetOfferOrder() const
 	return offerOrder;
 }
 
+// Convert a price to ticks of 1/256th, the finest treasury price increment.
+long PriceToTick(double _price)
+{
+	return llround(_price * 256.0);
+}
+
+/**
+* A price level of an order stack with the quantity of all orders at the price.
+*/
+struct LiquidityLevel
+{
+	double price;
+	long tick;
+	long quantity;
+};
+
+// Aggregate an order stack into price levels, best price first.
+void AggregateLevels(vector<LiquidityLevel>& _levels, const vector<Order>& _stack, bool _isBid)
+{
+	_levels.clear();
+	for (auto& o : _stack)
+	{
+		_levels.push_back({ o.GetPrice(), PriceToTick(o.GetPrice()), o.GetQuantity() });
+	}
+	sort(_levels.begin(), _levels.end(), [_isBid](const LiquidityLevel& a, const LiquidityLevel& b)
+	{
+		return _isBid ? a.tick > b.tick : a.tick < b.tick;
+	});
+
+	// Merge orders at the same price into one level.
+	size_t _count = 0;
+	for (size_t i = 0; i < _levels.size(); ++i)
+	{
+		if (_count > 0 && _levels[_count - 1].tick == _levels[i].tick) _levels[_count - 1].quantity += _levels[i].quantity;
+		else _levels[_count++] = _levels[i];
+	}
+	_levels.resize(_count);
+}
+
+/**
+* A price level of the consolidated book with the quantity each venue shows at the price.
+*/
+struct ConsolidatedLevel
+{
+	double price;
+	long tick;
+	long quantity;
+	array<long, NUM_MARKETS> venueQuantities;
+};
+
+/**
+* Consolidated book of a product across venues.
+* Keeps the latest price levels of every venue and applies only the levels
+* that changed between two books of a venue to the consolidated levels.
+*/
+class ConsolidatedBook
+{
+
+public:
+
+	// ctor for a consolidated book
+	ConsolidatedBook();
+
+	// Apply a new book of a venue
+	void Update(Market _market, const vector<Order>& _bidStack, const vector<Order>& _offerStack);
+
+	// Get the consolidated bid levels, best price first
+	const vector<ConsolidatedLevel>& GetBids() const;
+
+	// Get the consolidated offer levels, best price first
+	const vector<ConsolidatedLevel>& GetOffers() const;
+
+	// Get the price levels of a venue on a side, best price first
+	const vector<LiquidityLevel>& GetVenueLevels(Market _market, PricingSide _side) const;
+
+	// Get the best bid/offer across venues
+	BidOffer GetBidOffer() const;
+
+private:
+
+	array<vector<LiquidityLevel>, NUM_MARKETS> venueBids;
+	array<vector<LiquidityLevel>, NUM_MARKETS> venueOffers;
+	vector<ConsolidatedLevel> bids;
+	vector<ConsolidatedLevel> offers;
+	vector<LiquidityLevel> levels;
+
+	// Apply the difference between the old and new levels of a venue on a side
+	void Apply(vector<ConsolidatedLevel>& _book, Market _market, const vector<LiquidityLevel>& _old, const vector<LiquidityLevel>& _new, bool _isBid);
+
+	// Change the quantity of a venue at a price level
+	void Adjust(vector<ConsolidatedLevel>& _book, Market _market, const LiquidityLevel& _level, long _change, bool _isBid);
+
+};
+
+ConsolidatedBook::ConsolidatedBook()
+{
+	bids = vector<ConsolidatedLevel>();
+	offers = vector<ConsolidatedLevel>();
+	levels = vector<LiquidityLevel>();
+}
+
+void ConsolidatedBook::Update(Market _market, const vector<Order>& _bidStack, const vector<Order>& _offerStack)
+{
+	AggregateLevels(levels, _bidStack, true);
+	Apply(bids, _market, venueBids[_market], levels, true);
+	venueBids[_market].swap(levels);
+
+	AggregateLevels(levels, _offerStack, false);
+	Apply(offers, _market, venueOffers[_market], levels, false);
+	venueOffers[_market].swap(levels);
+}
+
+void ConsolidatedBook::Apply(vector<ConsolidatedLevel>& _book, Market _market, const vector<LiquidityLevel>& _old, const vector<LiquidityLevel>& _new, bool _isBid)
+{
+	// Both sides are sorted best price first, so one merge pass finds the changed levels.
+	size_t i = 0;
+	size_t j = 0;
+	while (i < _old.size() || j < _new.size())
+	{
+		bool _takeOld = j == _new.size() || (i < _old.size() && (_isBid ? _old[i].tick > _new[j].tick : _old[i].tick < _new[j].tick));
+		bool _takeNew = i == _old.size() || (j < _new.size() && (_isBid ? _new[j].tick > _old[i].tick : _new[j].tick < _old[i].tick));
+		if (_takeOld)
+		{
+			Adjust(_book, _market, _old[i], -_old[i].quantity, _isBid);
+			i++;
+		}
+		else if (_takeNew)
+		{
+			Adjust(_book, _market, _new[j], _new[j].quantity, _isBid);
+			j++;
+		}
+		else
+		{
+			if (_new[j].quantity != _old[i].quantity) Adjust(_book, _market, _new[j], _new[j].quantity - _old[i].quantity, _isBid);
+			i++;
+			j++;
+		}
+	}
+}
+
+void ConsolidatedBook::Adjust(vector<ConsolidatedLevel>& _book, Market _market, const LiquidityLevel& _level, long _change, bool _isBid)
+{
+	auto _it = lower_bound(_book.begin(), _book.end(), _level.tick, [_isBid](const ConsolidatedLevel& l, long _tick)
+	{
+		return _isBid ? l.tick > _tick : l.tick < _tick;
+	});
+
+	if (_it == _book.end() || _it->tick != _level.tick)
+	{
+		ConsolidatedLevel _new = { _level.price, _level.tick, 0, {} };
+		_it = _book.insert(_it, _new);
+	}
+	_it->quantity += _change;
+	_it->venueQuantities[_market] += _change;
+	if (_it->quantity == 0) _book.erase(_it);
+}
+
+const vector<ConsolidatedLevel>& ConsolidatedBook::GetBids() const
+{
+	return bids;
+}
+
+const vector<ConsolidatedLevel>& ConsolidatedBook::GetOffers() const
+{
+	return offers;
+}
+
+const vector<LiquidityLevel>& ConsolidatedBook::GetVenueLevels(Market _market, PricingSide _side) const
+{
+	return _side == BID ? venueBids[_market] : venueOffers[_market];
+}
+
+BidOffer ConsolidatedBook::GetBidOffer() const
+{
+	Order _bidOrder;
+	Order _offerOrder;
+	if (!bids.empty()) _bidOrder = Order(bids.front().price, bids.front().quantity, BID);
+	if (!offers.empty()) _offerOrder = Order(offers.front().price, offers.front().quantity, OFFER);
+	return BidOffer(_bidOrder, _offerOrder);
+}
+
 /**
 * Order book with a bid and offer stack.
 * Type T is the product type.
@@ -120,11 +310,14 @@ public:
 
 	// ctor for the order book
 	OrderBook() = default;
-	OrderBook(const T& _product, const vector<Order>& _bidStack, const vector<Order>& _offerStack);
+	OrderBook(const T& _product, const vector<Order>& _bidStack, const vector<Order>& _offerStack, Market _market = BROKERTEC);
 
 	// Get the product
 	const T& GetProduct() const;
 
+	// Get the venue of the order book
+	Market GetMarket() const;
+
 	// Get the bid stack
 	const vector<Order>& GetBidStack() const;
 
@@ -132,19 +325,21 @@ public:
 	const vector<Order>& GetOfferStack() const;
 
 	// Get the best bid/offer order
-	const BidOffer& GetBidOffer() const;
+	BidOffer GetBidOffer() const;
 
 private:
 	T product;
 	vector<Order> bidStack;
 	vector<Order> offerStack;
+	Market market;
 
 };
 
 template<typename T>
-OrderBook<T>::OrderBook(const T& _product, const vector<Order>& _bidStack, const vector<Order>& _offerStack) :
+OrderBook<T>::OrderBook(const T& _product, const vector<Order>& _bidStack, const vector<Order>& _offerStack, Market _market) :
 	product(_product), bidStack(_bidStack), offerStack(_offerStack)
 {
+	market = _market;
 }
 
 template<typename T>
@@ -153,6 +348,12 @@ const T& OrderBook<T>::GetProduct() const
 	return product;
 }
 
+template<typename T>
+Market OrderBook<T>::GetMarket() const
+{
+	return market;
+}
+
 template<typename T>
 const vector<Order>& OrderBook<T>::GetBidStack() const
 {
@@ -166,7 +367,7 @@ const vector<Order>& OrderBook<T>::GetOfferStack() const
 }
 
 template<typename T>
-const BidOffer& OrderBook<T>::GetBidOffer() const
+BidOffer OrderBook<T>::GetBidOffer() const
 {
 	double _bidPrice = INT_MIN;
 	Order _bidOrder;
@@ -195,6 +396,17 @@ const BidOffer& OrderBook<T>::GetBidOffer() const
 	return BidOffer(_bidOrder, _offerOrder);
 }
 
+/**
+* Snapshot of the best bid and offer of a product across venues, readable from any thread.
+*/
+struct BookSnapshot
+{
+	double bidPrice;
+	long bidQuantity;
+	double offerPrice;
+	long offerQuantity;
+};
+
 // Pre-declearations
 template<typename T>
 class MarketDataConnector;
@@ -210,7 +422,11 @@ class MarketDataService : public Service<string, OrderBook<T>>
 
 private:
 
-	map<string, OrderBook<T>> orderBooks;
+	map<Identifier, OrderBook<T>> orderBooks;
+	map<Identifier, array<OrderBook<T>, NUM_MARKETS>> venueBooks;
+	map<Identifier, ConsolidatedBook> consolidatedBooks;
+	map<Identifier, OrderBook<T>> aggregatedBooks;
+	SnapshotTable<BookSnapshot> snapshots;
 	vector<ServiceListener<OrderBook<T>>*> listeners;
 	MarketDataConnector<T>* connector;
 	int bookDepth;
@@ -239,18 +455,36 @@ public:
 	// Get the order book depth of the service
 	int GetBookDepth() const;
 
-	// Get the best bid/offer order
-	const BidOffer& GetBestBidOffer(const string& _productId);
+	// Get the latest order book of a product on a venue
+	const OrderBook<T>& GetVenueBook(const string& _productId, Market _market);
+
+	// Get the latest order books of all products on all venues, empty for a venue with none yet
+	const map<Identifier, array<OrderBook<T>, NUM_MARKETS>>& GetVenueBooks() const;
+
+	// Restore the latest order book of a product on its venue without notifying the listeners
+	void Restore(OrderBook<T>& _data);
 
-	// Aggregate the order book
+	// Get the consolidated book of a product across venues
+	const ConsolidatedBook& GetConsolidatedBook(const string& _productId);
+
+	// Get the best bid/offer order across venues
+	BidOffer GetBestBidOffer(const string& _productId);
+
+	// Aggregate the order book across venues, one order per price level
 	const OrderBook<T>& AggregateDepth(const string& _productId);
 
+	// Get the latest best bid and offer of a product without locking, from any thread
+	bool GetSnapshot(const string& _productId, BookSnapshot& _snapshot) const;
+
 };
 
 template<typename T>
 MarketDataService<T>::MarketDataService()
 {
-	orderBooks = map<string, OrderBook<T>>();
+	orderBooks = map<Identifier, OrderBook<T>>();
+	venueBooks = map<Identifier, array<OrderBook<T>, NUM_MARKETS>>();
+	consolidatedBooks = map<Identifier, ConsolidatedBook>();
+	aggregatedBooks = map<Identifier, OrderBook<T>>();
 	listeners = vector<ServiceListener<OrderBook<T>>*>();
 	connector = new MarketDataConnector<T>(this);
 	bookDepth = 5;
@@ -268,7 +502,12 @@ OrderBook<T>& MarketDataService<T>::GetData(string _key)
 template<typename T>
 void MarketDataService<T>::OnMessage(OrderBook<T>& _data)
 {
-	orderBooks[_data.GetProduct().GetProductId()] = _data;
+	Identifier _productId = _data.GetProduct().GetProductId();
+	orderBooks[_productId] = _data;
+	venueBooks[_productId][_data.GetMarket()] = _data;
+	consolidatedBooks[_productId].Update(_data.GetMarket(), _data.GetBidStack(), _data.GetOfferStack());
+	BidOffer _bidOffer = consolidatedBooks[_productId].GetBidOffer();
+	snapshots.Publish(_productId, { _bidOffer.GetBidOrder().GetPrice(), _bidOffer.GetBidOrder().GetQuantity(), _bidOffer.GetOfferOrder().GetPrice(), _bidOffer.GetOfferOrder().GetQuantity() });
 
 	for (auto& l : listeners)
 	{
@@ -301,47 +540,65 @@ int MarketDataService<T>::GetBookDepth() const
 }
 
 template<typename T>
-const BidOffer& MarketDataService<T>::GetBestBidOffer(const string& _productId)
+const OrderBook<T>& MarketDataService<T>::GetVenueBook(const string& _productId, Market _market)
+{
+	return venueBooks[_productId][_market];
+}
+
+template<typename T>
+const map<Identifier, array<OrderBook<T>, NUM_MARKETS>>& MarketDataService<T>::GetVenueBooks() const
+{
+	return venueBooks;
+}
+
+template<typename T>
+void MarketDataService<T>::Restore(OrderBook<T>& _data)
+{
+	Identifier _productId = _data.GetProduct().GetProductId();
+	orderBooks[_productId] = _data;
+	venueBooks[_productId][_data.GetMarket()] = _data;
+	consolidatedBooks[_productId].Update(_data.GetMarket(), _data.GetBidStack(), _data.GetOfferStack());
+	BidOffer _bidOffer = consolidatedBooks[_productId].GetBidOffer();
+	snapshots.Publish(_productId, { _bidOffer.GetBidOrder().GetPrice(), _bidOffer.GetBidOrder().GetQuantity(), _bidOffer.GetOfferOrder().GetPrice(), _bidOffer.GetOfferOrder().GetQuantity() });
+}
+
+template<typename T>
+const ConsolidatedBook& MarketDataService<T>::GetConsolidatedBook(const string& _productId)
+{
+	return consolidatedBooks[_productId];
+}
+
+template<typename T>
+BidOffer MarketDataService<T>::GetBestBidOffer(const string& _productId)
 {
-	return orderBooks[_productId].GetBidOffer();
+	return consolidatedBooks[_productId].GetBidOffer();
 }
 
 template<typename T>
 const OrderBook<T>& MarketDataService<T>::AggregateDepth(const string& _productId)
 {
-	T& _product = orderBooks[_productId].GetProduct();
+	const ConsolidatedBook& _book = consolidatedBooks[_productId];
 
-	vector<Order>& _bidStackFrom = orderBooks[_productId].GetBidStack();
-	unordered_map<double, long> _bidHashTable;
-	for (auto& b : _bidStackFrom)
-	{
-		double _price = b.GetPrice();
-		long _quantity = b.GetQuantity();
-		_bidHashTable[_price] += _quantity;
-	}
-	vector<Order> _bidStackTo;
-	for (auto& p : _bidHashTable)
+	vector<Order> _bidStack;
+	for (auto& l : _book.GetBids())
 	{
-		Order _bidOrder = Order(p.first, p.second, BID);
-		_bidStackTo.push_back(_bidOrder);
+		_bidStack.push_back(Order(l.price, l.quantity, BID));
 	}
 
-	vector<Order>& _offerStackFrom = orderBooks[_productId].GetOfferStack();
-	unordered_map<double, long> _offerHashTable;
-	for (auto& o : _offerStackFrom)
-	{
-		double _price = o.GetPrice();
-		long _quantity = o.GetQuantity();
-		_bidHashTable[_price] += _quantity;
-	}
-	vector<Order> _offerStackTo;
-	for (auto& p : _offerHashTable)
+	vector<Order> _offerStack;
+	for (auto& l : _book.GetOffers())
 	{
-		Order _offerOrder = Order(p.first, p.second, OFFER);
-		_offerStackTo.push_back(_offerOrder);
+		_offerStack.push_back(Order(l.price, l.quantity, OFFER));
 	}
 
-	return OrderBook<T>(_product, _bidStackTo, _offerStackTo);
+	aggregatedBooks[_productId] = OrderBook<T>(orderBooks[_productId].GetProduct(), _bidStack, _offerStack);
+	return aggregatedBooks[_productId];
+}
+
+template<typename T>
+bool MarketDataService<T>::GetSnapshot(const string& _productId, BookSnapshot& _snapshot) const
+{
+	return snapshots.Read(_productId, _snapshot);
 }
 
 /**
@@ -355,6 +612,10 @@ class MarketDataConnector : public Connector<OrderBook<T>>
 private:
 
 	MarketDataService<T>* service;
+	long count;
+	vector<Order> bidStack;
+	vector<Order> offerStack;
+	Market market;
 
 public:
 
@@ -368,12 +629,22 @@ public:
 	// Subscribe data from the Connector
 	void Subscribe(ifstream& _data);
 
+	// Subscribe one line of data from the Connector, publishing a book once all its levels arrived
+	void Subscribe(const string& _line);
+
+	// Is no book partly received?
+	bool IsBetweenBooks() const;
+
 };
 
 template<typename T>
 MarketDataConnector<T>::MarketDataConnector(MarketDataService<T>* _service)
 {
 	service = _service;
+	count = 0;
+	bidStack = vector<Order>();
+	offerStack = vector<Order>();
+	market = BROKERTEC;
 }
 
 template<typename T>
@@ -385,52 +656,64 @@ void MarketDataConnector<T>::Publish(OrderBook<T>& _data) {}
 template<typename T>
 void MarketDataConnector<T>::Subscribe(ifstream& _data)
 {
-	int _bookDepth = service->GetBookDepth();
-	int _thread = _bookDepth * 2;
-	long _count = 0;
-	vector<Order> _bidStack;
-	vector<Order> _offerStack;
 	string _line;
 	while (getline(_data, _line))
 	{
-		string _productId;
+		PollTimers();
+		Subscribe(_line);
+	}
+}
 
-		stringstream _lineStream(_line);
-		string _cell;
-		vector<string> _cells;
-		while (getline(_lineStream, _cell, ','))
-		{
-			_cells.push_back(_cell);
-		}
-		
-		_productId = _cells[0];
-		double _price = ConvertPrice(_cells[1]);
-		long _quantity = stol(_cells[2]);
-		PricingSide _side;
-		if (_cells[3] == "BID") _side = BID;
-		else if (_cells[3] == "OFFER") _side = OFFER;
-		Order _order(_price, _quantity, _side);
-		switch (_side)
-			{
-			case BID:
-				_bidStack.push_back(_order); 
-				break;
-			case OFFER:
-				_offerStack.push_back(_order); 
-				break;
-			}
-		
-		_count++;
-		if (_count % _thread == 0)
-		{
-			T _product = GetBond(_productId);
-			OrderBook<T> _orderBook(_product, _bidStack, _offerStack);
-			service->OnMessage(_orderBook);
+template<typename T>
+void MarketDataConnector<T>::Subscribe(const string& _line)
+{
+	stringstream _lineStream(_line);
+	string _cell;
+	vector<string> _cells;
+	while (getline(_lineStream, _cell, ','))
+	{
+		_cells.push_back(_cell);
+	}
 
-			_bidStack = vector<Order>();
-			_offerStack = vector<Order>();
-		}
+	string _productId = _cells[0];
+	double _price = ConvertPrice(_cells[1]);
+	long _quantity = stol(_cells[2]);
+	PricingSide _side;
+	if (_cells[3] == "BID") _side = BID;
+	else if (_cells[3] == "OFFER") _side = OFFER;
+	if (_cells.size() > 4)
+	{
+		if (_cells[4] == "BROKERTEC") market = BROKERTEC;
+		else if (_cells[4] == "ESPEED") market = ESPEED;
+		else if (_cells[4] == "CME") market = CME;
 	}
+	Order _order(_price, _quantity, _side);
+	switch (_side)
+	{
+	case BID:
+		bidStack.push_back(_order);
+		break;
+	case OFFER:
+		offerStack.push_back(_order);
+		break;
+	}
+
+	count++;
+	if (count % (service->GetBookDepth() * 2) == 0)
+	{
+		T _product = GetBond(_productId);
+		OrderBook<T> _orderBook(_product, bidStack, offerStack, market);
+		service->OnMessage(_orderBook);
+
+		bidStack = vector<Order>();
+		offerStack = vector<Order>();
+	}
+}
+
+template<typename T>
+bool MarketDataConnector<T>::IsBetweenBooks() const
+{
+	return count % (service->GetBookDepth() * 2) == 0;
 }
 
 #endif
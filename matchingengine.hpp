@@ -0,0 +1,544 @@
+/**
+* matchingengine.hpp
+* Defines a simulated exchange matching engine for one venue.
+*
+* @author Haonan Lu
+*/
+
+#ifndef MATCHING_ENGINE_HPP
+#define MATCHING_ENGINE_HPP
+
+#include <string>
+#include <vector>
+#include <climits>
+#include <cmath>
+#include <algorithm>
+#include "soa.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.hpp"
+
+using namespace std;
+
+/**
+* A fill of an order on a venue.
+*/
+class ExecutionFill
+{
+
+public:
+
+	// default constructor
+	ExecutionFill() = default;
+
+	// ctor for a fill
+	ExecutionFill(Identifier _orderId, Market _market, double _price, long _quantity, long _leavesQuantity);
+
+	// Get the ID of the order filled
+	const Identifier& GetOrderId() const;
+
+	// Get the venue of the fill
+	Market GetMarket() const;
+
+	// Get the fill price
+	double GetPrice() const;
+
+	// Get the fill quantity
+	long GetQuantity() const;
+
+	// Get the quantity of the order still working after this fill
+	long GetLeavesQuantity() const;
+
+private:
+	Identifier orderId;
+	Market market;
+	double price;
+	long quantity;
+	long leavesQuantity;
+
+};
+
+ExecutionFill::ExecutionFill(Identifier _orderId, Market _market, double _price, long _quantity, long _leavesQuantity)
+{
+	orderId = _orderId;
+	market = _market;
+	price = _price;
+	quantity = _quantity;
+	leavesQuantity = _leavesQuantity;
+}
+
+const Identifier& ExecutionFill::GetOrderId() const
+{
+	return orderId;
+}
+
+Market ExecutionFill::GetMarket() const
+{
+	return market;
+}
+
+double ExecutionFill::GetPrice() const
+{
+	return price;
+}
+
+long ExecutionFill::GetQuantity() const
+{
+	return quantity;
+}
+
+long ExecutionFill::GetLeavesQuantity() const
+{
+	return leavesQuantity;
+}
+
+/**
+* An order resting on the simulated venue, linked into the FIFO of its price level.
+*/
+struct RestingOrder
+{
+	Identifier orderId;
+	double price;
+	long tick;
+	long quantity;
+	int book;
+	bool isBuy;
+	int prev;
+	int next;
+};
+
+/**
+* One side of the resting orders of a product, stored flat by tick so that
+* finding a price level is an index and each level is a FIFO of orders.
+*/
+class PriceLadder
+{
+
+public:
+
+	// ctor for a ladder
+	PriceLadder(bool _isBuy);
+
+	// Are there no resting orders?
+	bool IsEmpty() const;
+
+	// Get the best tick with resting orders
+	long GetBestTick() const;
+
+	// Get the first order at the best tick
+	int GetBestOrder() const;
+
+	// Append an order to the end of the FIFO at its tick
+	void Append(vector<RestingOrder>& _orders, int _index);
+
+	// Unlink an order from its tick
+	void Unlink(vector<RestingOrder>& _orders, int _index);
+
+private:
+
+	struct Level
+	{
+		int head = -1;
+		int tail = -1;
+	};
+
+	bool isBuy;
+	long baseTick;
+	long bestTick;
+	long orderCount;
+	vector<Level> levels;
+
+	// Make room for a tick in the ladder
+	void Reserve(long _tick);
+
+};
+
+PriceLadder::PriceLadder(bool _isBuy)
+{
+	isBuy = _isBuy;
+	baseTick = 0;
+	bestTick = 0;
+	orderCount = 0;
+}
+
+bool PriceLadder::IsEmpty() const
+{
+	return orderCount == 0;
+}
+
+long PriceLadder::GetBestTick() const
+{
+	return bestTick;
+}
+
+int PriceLadder::GetBestOrder() const
+{
+	if (orderCount == 0) return -1;
+	return levels[bestTick - baseTick].head;
+}
+
+void PriceLadder::Reserve(long _tick)
+{
+	const long _margin = 512;
+	if (levels.empty())
+	{
+		baseTick = _tick - _margin;
+		levels.resize(2 * _margin);
+	}
+	else if (_tick < baseTick)
+	{
+		long _shift = baseTick - _tick + _margin;
+		levels.insert(levels.begin(), _shift, Level());
+		baseTick -= _shift;
+	}
+	else if (_tick >= baseTick + (long)levels.size())
+	{
+		levels.resize(_tick - baseTick + _margin);
+	}
+}
+
+void PriceLadder::Append(vector<RestingOrder>& _orders, int _index)
+{
+	RestingOrder& _order = _orders[_index];
+	Reserve(_order.tick);
+	Level& _level = levels[_order.tick - baseTick];
+
+	_order.prev = _level.tail;
+	_order.next = -1;
+	if (_level.tail >= 0) _orders[_level.tail].next = _index;
+	else _level.head = _index;
+	_level.tail = _index;
+
+	if (orderCount == 0 || (isBuy ? _order.tick > bestTick : _order.tick < bestTick)) bestTick = _order.tick;
+	orderCount++;
+}
+
+void PriceLadder::Unlink(vector<RestingOrder>& _orders, int _index)
+{
+	RestingOrder& _order = _orders[_index];
+	Level& _level = levels[_order.tick - baseTick];
+
+	if (_order.prev >= 0) _orders[_order.prev].next = _order.next;
+	else _level.head = _order.next;
+	if (_order.next >= 0) _orders[_order.next].prev = _order.prev;
+	else _level.tail = _order.prev;
+	orderCount--;
+
+	// Only emptying the best level moves the best price, and then to the nearest occupied level.
+	if (orderCount > 0 && _level.head < 0 && _order.tick == bestTick)
+	{
+		long _step = isBuy ? -1 : 1;
+		do bestTick += _step;
+		while (levels[bestTick - baseTick].head < 0);
+	}
+}
+
+/**
+* The book of one product on the simulated venue: the venue liquidity from
+* market data and our resting orders on each side.
+*/
+struct VenueBook
+{
+	vector<LiquidityLevel> bids;
+	vector<LiquidityLevel> offers;
+	PriceLadder buyOrders = PriceLadder(true);
+	PriceLadder sellOrders = PriceLadder(false);
+};
+
+/**
+* Simulated matching engine of one venue.
+* Orders match the venue liquidity of the latest market data in price-time
+* priority; unfilled LIMIT orders rest and fill when later market data crosses
+* them, while MARKET, IOC and FOK remainders are cancelled. Our own orders
+* never match each other. Fills are queued and collected with PollFills; an
+* order that ends without filling at all gets a fill of zero quantity.
+* Type T is the product type.
+*/
+template<typename T>
+class MatchingEngine
+{
+
+public:
+
+	// ctor for an engine
+	MatchingEngine(Market _market);
+
+	// Get the venue of the engine
+	Market GetMarket() const;
+
+	// Replace the venue liquidity of a product and fill the resting orders it crosses
+	void UpdateBook(const OrderBook<T>& _orderBook);
+
+	// Submit an order to the venue
+	void SubmitOrder(const ExecutionOrder<T>& _order);
+
+	// Cancel a resting order
+	bool CancelOrder(const string& _orderId);
+
+	// Move the queued fills to the vector
+	void PollFills(vector<ExecutionFill>& _fills);
+
+	// Get the number of resting orders
+	long GetRestingCount() const;
+
+	// Get the fills queued and not yet collected
+	const vector<ExecutionFill>& GetFills() const;
+
+	// Queue a fill not yet collected, when restoring the engine
+	void RestoreFill(const ExecutionFill& _fill);
+
+	// Get the venue liquidity of a product left after the fills taken from it, false if the venue has no book of the product
+	bool GetLiquidity(const string& _productId, OrderBook<T>& _orderBook) const;
+
+private:
+
+	Market market;
+	vector<VenueBook> books;
+	unordered_map<Identifier, int> bookIndices;
+	vector<RestingOrder> orders;
+	vector<int> freeOrders;
+	unordered_map<Identifier, int> orderIndices;
+	vector<ExecutionFill> fills;
+
+	// Get the index of the book of a product
+	int GetBook(const string& _productId);
+
+	// Get the liquidity available at or better than a limit tick
+	long GetAvailable(const vector<LiquidityLevel>& _levels, bool _isBuy, long _limitTick) const;
+
+	// Take liquidity up to a limit tick and return the quantity left
+	long Take(vector<LiquidityLevel>& _levels, bool _isBuy, long _limitTick, const string& _orderId, long _quantity);
+
+	// Fill resting orders crossed by the venue liquidity
+	void Uncross(PriceLadder& _ladder, vector<LiquidityLevel>& _levels, bool _isBuy);
+
+	// Remove a resting order from its ladder and recycle its slot
+	void Release(int _index);
+
+};
+
+template<typename T>
+MatchingEngine<T>::MatchingEngine(Market _market)
+{
+	market = _market;
+}
+
+template<typename T>
+Market MatchingEngine<T>::GetMarket() const
+{
+	return market;
+}
+
+template<typename T>
+int MatchingEngine<T>::GetBook(const string& _productId)
+{
+	auto _it = bookIndices.find(_productId);
+	if (_it != bookIndices.end()) return _it->second;
+
+	int _index = (int)books.size();
+	books.push_back(VenueBook());
+	bookIndices[_productId] = _index;
+	return _index;
+}
+
+template<typename T>
+void MatchingEngine<T>::UpdateBook(const OrderBook<T>& _orderBook)
+{
+	VenueBook& _book = books[GetBook(_orderBook.GetProduct().GetProductId())];
+	AggregateLevels(_book.bids, _orderBook.GetBidStack(), true);
+	AggregateLevels(_book.offers, _orderBook.GetOfferStack(), false);
+
+	Uncross(_book.buyOrders, _book.offers, true);
+	Uncross(_book.sellOrders, _book.bids, false);
+}
+
+template<typename T>
+long MatchingEngine<T>::GetAvailable(const vector<LiquidityLevel>& _levels, bool _isBuy, long _limitTick) const
+{
+	long _available = 0;
+	for (auto& l : _levels)
+	{
+		if (_isBuy ? l.tick > _limitTick : l.tick < _limitTick) break;
+		_available += l.quantity;
+	}
+	return _available;
+}
+
+template<typename T>
+long MatchingEngine<T>::Take(vector<LiquidityLevel>& _levels, bool _isBuy, long _limitTick, const string& _orderId, long _quantity)
+{
+	for (auto& l : _levels)
+	{
+		if (_quantity == 0) break;
+		if (_isBuy ? l.tick > _limitTick : l.tick < _limitTick) break;
+		if (l.quantity == 0) continue;
+
+		long _fillQuantity = min(l.quantity, _quantity);
+		l.quantity -= _fillQuantity;
+		_quantity -= _fillQuantity;
+		fills.push_back(ExecutionFill(_orderId, market, l.price, _fillQuantity, _quantity));
+	}
+	return _quantity;
+}
+
+template<typename T>
+void MatchingEngine<T>::SubmitOrder(const ExecutionOrder<T>& _order)
+{
+	int _bookIndex = GetBook(_order.GetProduct().GetProductId());
+	VenueBook& _book = books[_bookIndex];
+
+	// An order on the offer side lifts offers, an order on the bid side hits bids.
+	bool _isBuy = _order.GetPricingSide() == OFFER;
+	vector<LiquidityLevel>& _levels = _isBuy ? _book.offers : _book.bids;
+	long _quantity = _order.GetVisibleQuantity() + _order.GetHiddenQuantity();
+	long _limitTick = PriceToTick(_order.GetPrice());
+	OrderType _orderType = _order.GetOrderType();
+
+	switch (_orderType)
+	{
+	case MARKET:
+		_limitTick = _isBuy ? LONG_MAX : LONG_MIN;
+		break;
+	case FOK:
+		if (GetAvailable(_levels, _isBuy, _limitTick) < _quantity)
+		{
+			fills.push_back(ExecutionFill(_order.GetOrderId(), market, _order.GetPrice(), 0, 0));
+			return;
+		}
+		break;
+	case STOP:
+		fills.push_back(ExecutionFill(_order.GetOrderId(), market, _order.GetPrice(), 0, 0));
+		return;
+	default:
+		break;
+	}
+
+	size_t _firstFill = fills.size();
+	long _leaves = Take(_levels, _isBuy, _limitTick, _order.GetOrderId(), _quantity);
+	if (_leaves > 0 && _orderType == LIMIT)
+	{
+		int _index;
+		if (freeOrders.empty())
+		{
+			_index = (int)orders.size();
+			orders.push_back(RestingOrder());
+		}
+		else
+		{
+			_index = freeOrders.back();
+			freeOrders.pop_back();
+		}
+
+		RestingOrder& _resting = orders[_index];
+		_resting.orderId = _order.GetOrderId();
+		_resting.price = _order.GetPrice();
+		_resting.tick = _limitTick;
+		_resting.quantity = _leaves;
+		_resting.book = _bookIndex;
+		_resting.isBuy = _isBuy;
+		(_isBuy ? _book.buyOrders : _book.sellOrders).Append(orders, _index);
+		orderIndices[_resting.orderId] = _index;
+	}
+	else if (_leaves > 0 && fills.size() > _firstFill)
+	{
+		// The remainder is cancelled, so nothing is left working.
+		ExecutionFill& _last = fills.back();
+		_last = ExecutionFill(_last.GetOrderId(), market, _last.GetPrice(), _last.GetQuantity(), 0);
+	}
+	else if (_leaves > 0)
+	{
+		fills.push_back(ExecutionFill(_order.GetOrderId(), market, _order.GetPrice(), 0, 0));
+	}
+}
+
+template<typename T>
+void MatchingEngine<T>::Uncross(PriceLadder& _ladder, vector<LiquidityLevel>& _levels, bool _isBuy)
+{
+	size_t _level = 0;
+	while (!_ladder.IsEmpty())
+	{
+		while (_level < _levels.size() && _levels[_level].quantity == 0) _level++;
+		if (_level == _levels.size()) break;
+
+		LiquidityLevel& _liquidity = _levels[_level];
+		long _bestTick = _ladder.GetBestTick();
+		if (_isBuy ? _liquidity.tick > _bestTick : _liquidity.tick < _bestTick) break;
+
+		// Our resting order is the passive side, so it fills at its own price.
+		int _index = _ladder.GetBestOrder();
+		RestingOrder& _resting = orders[_index];
+		long _fillQuantity = min(_liquidity.quantity, _resting.quantity);
+		_liquidity.quantity -= _fillQuantity;
+		_resting.quantity -= _fillQuantity;
+		fills.push_back(ExecutionFill(_resting.orderId, market, _resting.price, _fillQuantity, _resting.quantity));
+		if (_resting.quantity == 0) Release(_index);
+	}
+}
+
+template<typename T>
+void MatchingEngine<T>::Release(int _index)
+{
+	RestingOrder& _resting = orders[_index];
+	VenueBook& _book = books[_resting.book];
+	(_resting.isBuy ? _book.buyOrders : _book.sellOrders).Unlink(orders, _index);
+	orderIndices.erase(_resting.orderId);
+	freeOrders.push_back(_index);
+}
+
+template<typename T>
+bool MatchingEngine<T>::CancelOrder(const string& _orderId)
+{
+	auto _it = orderIndices.find(_orderId);
+	if (_it == orderIndices.end()) return false;
+
+	Release(_it->second);
+	return true;
+}
+
+template<typename T>
+void MatchingEngine<T>::PollFills(vector<ExecutionFill>& _fills)
+{
+	_fills.clear();
+	_fills.swap(fills);
+}
+
+template<typename T>
+long MatchingEngine<T>::GetRestingCount() const
+{
+	return (long)orderIndices.size();
+}
+
+template<typename T>
+const vector<ExecutionFill>& MatchingEngine<T>::GetFills() const
+{
+	return fills;
+}
+
+template<typename T>
+void MatchingEngine<T>::RestoreFill(const ExecutionFill& _fill)
+{
+	fills.push_back(_fill);
+}
+
+template<typename T>
+bool MatchingEngine<T>::GetLiquidity(const string& _productId, OrderBook<T>& _orderBook) const
+{
+	auto _it = bookIndices.find(_productId);
+	if (_it == bookIndices.end()) return false;
+
+	// Levels emptied by fills are kept, so the liquidity is rebuilt level for level.
+	const VenueBook& _book = books[_it->second];
+	vector<Order> _bidStack;
+	for (auto& l : _book.bids)
+	{
+		_bidStack.push_back(Order(l.price, l.quantity, BID));
+	}
+	vector<Order> _offerStack;
+	for (auto& l : _book.offers)
+	{
+		_offerStack.push_back(Order(l.price, l.quantity, OFFER));
+	}
+	_orderBook = OrderBook<T>(GetBond(_productId), _bidStack, _offerStack, market);
+	return true;
+}
+
+#endif
@@ -12,6 +12,7 @@
 #include <string>
 #include <map>
 #include "soa.hpp"
+#include "snapshottable.hpp"
 #include "tradebookingservice.hpp"
 
 using namespace std;
@@ -116,6 +117,14 @@ vector<string> Position<T>::ToStrings() const
 }
 
 
+/**
+* Snapshot of the aggregate position of a product, readable from any thread.
+*/
+struct PositionSnapshot
+{
+	long aggregatePosition;
+};
+
 // Pre-declearations
 template<typename T>
 class PositionToTradeBookingListener;
@@ -131,7 +140,8 @@ class PositionService : public Service<string, Position<T>>
 
 private:
 
-	map<string, Position<T>> positions;
+	map<Identifier, Position<T>> positions;
+	SnapshotTable<PositionSnapshot> snapshots;
 	vector<ServiceListener<Position<T>>*> listeners;
 	PositionToTradeBookingListener<T>* listener;
 
@@ -156,6 +166,12 @@ public:
 	// Get the listener of the service
 	PositionToTradeBookingListener<T>* GetListener();
 
+	// Get the positions of all products
+	const map<Identifier, Position<T>>& GetAllPositions() const;
+
+	// Get the latest position of a product without locking, from any thread
+	bool GetSnapshot(const string& _productId, PositionSnapshot& _snapshot) const;
+
 	// Add a trade to the service
 	virtual void AddTrade(const Trade<T>& _trade);
 
@@ -164,7 +180,7 @@ public:
 template<typename T>
 PositionService<T>::PositionService()
 {
-	positions = map<string, Position<T>>();
+	positions = map<Identifier, Position<T>>();
 	listeners = vector<ServiceListener<Position<T>>*>();
 	listener = new PositionToTradeBookingListener<T>(this);
 }
@@ -182,6 +198,7 @@ template<typename T>
 void PositionService<T>::OnMessage(Position<T>& _data)
 {
 	positions[_data.GetProduct().GetProductId()] = _data;
+	snapshots.Publish(_data.GetProduct().GetProductId(), { _data.GetAggregatePosition() });
 }
 
 template<typename T>
@@ -202,11 +219,23 @@ const vector<ServiceListener<Position<T>>*>& PositionService<T>::GetListeners()
 	return listeners;
 }
 
+template<typename T>
+const map<Identifier, Position<T>>& PositionService<T>::GetAllPositions() const
+{
+	return positions;
+}
+
+template<typename T>
+bool PositionService<T>::GetSnapshot(const string& _productId, PositionSnapshot& _snapshot) const
+{
+	return snapshots.Read(_productId, _snapshot);
+}
+
 template<typename T>
 void PositionService<T>::AddTrade(const Trade<T>& _trade)
 {
 	T _product = _trade.GetProduct();
-	string _productId = _product.GetProductId();
+	Identifier _productId = _product.GetProductId();
 	double _price = _trade.GetPrice();
 	string _book = _trade.GetBook();
 	long _quantity = _trade.GetQuantity();
@@ -231,6 +260,7 @@ void PositionService<T>::AddTrade(const Trade<T>& _trade)
 		_positionTo.AddPosition(_book, _quantity);
 	}
 	positions[_productId] = _positionTo;
+	snapshots.Publish(_productId, { _positionTo.GetAggregatePosition() });
 
 	for (auto& l : listeners)
 	{
@@ -11,6 +11,7 @@
 
 #include <string>
 #include "soa.hpp"
+#include "snapshottable.hpp"
 
 /**
 * A price object consisting of mid and bid/offer spread.
@@ -88,6 +89,15 @@ vector<string> Price<T>::ToStrings() const
 	return _strings;
 }
 
+/**
+* Snapshot of the price of a product, readable from any thread.
+*/
+struct PriceSnapshot
+{
+	double mid;
+	double bidOfferSpread;
+};
+
 // Pre-declearations
 template<typename T>
 class PricingConnector;
@@ -103,7 +113,8 @@ class PricingService : public Service<string, Price<T>>
 
 private:
 
-	map<string, Price<T>> prices;
+	map<Identifier, Price<T>> prices;
+	SnapshotTable<PriceSnapshot> snapshots;
 	vector<ServiceListener<Price<T>>*> listeners;
 	PricingConnector<T>* connector;
 
@@ -128,12 +139,21 @@ public:
 	// Get the connector of the service
 	PricingConnector<T>* GetConnector();
 
+	// Get the latest price of a product without locking, from any thread
+	bool GetSnapshot(const string& _productId, PriceSnapshot& _snapshot) const;
+
+	// Get the prices of all products
+	const map<Identifier, Price<T>>& GetAllPrices() const;
+
+	// Restore the price of a product without notifying the listeners
+	void Restore(Price<T>& _data);
+
 };
 
 template<typename T>
 PricingService<T>::PricingService()
 {
-	prices = map<string, Price<T>>();
+	prices = map<Identifier, Price<T>>();
 	listeners = vector<ServiceListener<Price<T>>*>();
 	connector = new PricingConnector<T>(this);
 }
@@ -151,6 +171,7 @@ template<typename T>
 void PricingService<T>::OnMessage(Price<T>& _data)
 {
 	prices[_data.GetProduct().GetProductId()] = _data;
+	snapshots.Publish(_data.GetProduct().GetProductId(), { _data.GetMid(), _data.GetBidOfferSpread() });
 
 	for (auto& l : listeners)
 	{
@@ -176,6 +197,25 @@ PricingConnector<T>* PricingService<T>::GetConnector()
 	return connector;
 }
 
+template<typename T>
+bool PricingService<T>::GetSnapshot(const string& _productId, PriceSnapshot& _snapshot) const
+{
+	return snapshots.Read(_productId, _snapshot);
+}
+
+template<typename T>
+const map<Identifier, Price<T>>& PricingService<T>::GetAllPrices() const
+{
+	return prices;
+}
+
+template<typename T>
+void PricingService<T>::Restore(Price<T>& _data)
+{
+	prices[_data.GetProduct().GetProductId()] = _data;
+	snapshots.Publish(_data.GetProduct().GetProductId(), { _data.GetMid(), _data.GetBidOfferSpread() });
+}
+
 /**
 * Pricing Connector subscribing data to Pricing Service.
 * Type T is the product type.
@@ -200,6 +240,9 @@ public:
 	// Subscribe data from the Connector
 	void Subscribe(ifstream& _data);
 
+	// Subscribe one line of data from the Connector
+	void Subscribe(const string& _line);
+
 };
 
 template<typename T>
@@ -220,23 +263,30 @@ void PricingConnector<T>::Subscribe(ifstream& _data)
 	string _line;
 	while (getline(_data, _line))
 	{
-		stringstream _lineStream(_line);
-		string _cell;
-		vector<string> _cells;
-		while (getline(_lineStream, _cell, ','))
-		{
-			_cells.push_back(_cell);
-		}
-
-		string _productId = _cells[0];
-		double _bidPrice = ConvertPrice(_cells[1]);
-		double _offerPrice = ConvertPrice(_cells[2]);
-		double _midPrice = (_bidPrice + _offerPrice) / 2.0;
-		double _spread = _offerPrice - _bidPrice;
-		T _product = GetBond(_productId);
-		Price<T> _price(_product, _midPrice, _spread);
-		service->OnMessage(_price);
+		PollTimers();
+		Subscribe(_line);
 	}
 }
 
+template<typename T>
+void PricingConnector<T>::Subscribe(const string& _line)
+{
+	stringstream _lineStream(_line);
+	string _cell;
+	vector<string> _cells;
+	while (getline(_lineStream, _cell, ','))
+	{
+		_cells.push_back(_cell);
+	}
+
+	string _productId = _cells[0];
+	double _bidPrice = ConvertPrice(_cells[1]);
+	double _offerPrice = ConvertPrice(_cells[2]);
+	double _midPrice = (_bidPrice + _offerPrice) / 2.0;
+	double _spread = _offerPrice - _bidPrice;
+	T _product = GetBond(_productId);
+	Price<T> _price(_product, _midPrice, _spread);
+	service->OnMessage(_price);
+}
+
 #endif
@@ -13,6 +13,8 @@
 #include <string>
 #include <iomanip>
 #include <chrono>
+#include <span>
+#include "inlineid.hpp"
 
 using namespace std;
 
@@ -39,36 +41,69 @@ public:
 	Product() = default;
 
 	// ctor for a prduct
-  Product(string _productId, ProductType _productType);
+	Product(Identifier _productId, ProductType _productType);
 
 	// Get the product identifier
-	const string& GetProductId() const;
+	const Identifier& GetProductId() const;
 
 	// Get the product type
 	ProductType GetProductType() const;
 
 private:
-	string productId;
+	Identifier productId;
 	ProductType productType;
 
 };
 
 enum BondIdType { CUSIP, ISIN };
 
+/**
+* Day count and Interest Rate Swap enums
+*/
+enum DayCountConvention { THIRTY_THREE_SIXTY, ACT_THREE_SIXTY, ACT_ACT };
+enum PaymentFrequency { QUARTERLY, SEMI_ANNUAL, ANNUAL };
+enum FloatingIndex { LIBOR, EURIBOR };
+enum FloatingIndexTenor { TENOR_1M, TENOR_3M, TENOR_6M, TENOR_12M };
+enum Currency { USD, EUR, GBP };
+enum SwapType { STANDARD, FORWARD, IMM, MAC, BASIS };
+enum SwapLegType { OUTRIGHT, CURVE, FLY };
+
+/**
+* Immutable reference data of a bond, stored once in the reference data
+* table and shared by every Bond naming it. A record fills one cache line;
+* the cash-flow schedule lives in the table and is only pointed at.
+*/
+struct alignas(64) BondReference
+{
+	Identifier productId;
+	InlineId<8> ticker;
+	double coupon;
+	std::chrono::year_month_day maturityDate;
+	BondIdType bondIdType;
+	DayCountConvention dayCountConvention;
+	int cashFlowCount;
+	const std::chrono::year_month_day* cashFlowDates;
+};
+
+// Reference data of a bond unknown to the table, so a default Bond is safe to read.
+const BondReference EMPTY_BOND_REFERENCE = {};
+
 /**
 * Bond product class
+* A bond keeps its identifier for keyed lookups and points at its reference
+* data for everything else, so copying it into events costs a few words.
 */
 class Bond : public Product
 {
 
 public:
 
-	// ctor for a bond
-	Bond(string _productId, BondIdType _bondIdType, string _ticker, double _coupon, std::chrono::year_month_day _maturityDate);
-	Bond() = default;
+	// ctor for a bond over its reference data
+	Bond(const BondReference* _reference);
+	Bond();
 
 	// Get the ticker
-	const string& GetTicker() const;
+	string_view GetTicker() const;
 
 	// Get the coupon
 	double GetCoupon() const;
@@ -79,29 +114,23 @@ public:
 	// Get the bond identifier type
 	BondIdType GetBondIdType() const;
 
+	// Get the day count convention of the coupons
+	DayCountConvention GetDayCountConvention() const;
+
+	// Get the coupon payment dates, ending at maturity
+	span<const std::chrono::year_month_day> GetCashFlowDates() const;
+
+	// Get the shared reference data
+	const BondReference& GetReference() const;
+
 	// Print the bond
 	friend ostream& operator<<(ostream& _output, const Bond& _bond);
 
 private:
-	string productId;
-	BondIdType bondIdType;
-	string ticker;
-	double coupon;
-	std::chrono::year_month_day maturityDate;
+	const BondReference* reference;
 
 };
 
-/**
-* Interest Rate Swap enums
-*/
-enum DayCountConvention { THIRTY_THREE_SIXTY, ACT_THREE_SIXTY };
-enum PaymentFrequency { QUARTERLY, SEMI_ANNUAL, ANNUAL };
-enum FloatingIndex { LIBOR, EURIBOR };
-enum FloatingIndexTenor { TENOR_1M, TENOR_3M, TENOR_6M, TENOR_12M };
-enum Currency { USD, EUR, GBP };
-enum SwapType { STANDARD, FORWARD, IMM, MAC, BASIS };
-enum SwapLegType { OUTRIGHT, CURVE, FLY };
-
 /**
 * Interest Rate Swap product
 */
@@ -114,7 +143,7 @@ public:
 	IRSwap() = default;
 
 	// ctor for a swap
-	IRSwap(string productId, DayCountConvention _fixedLegDayCountConvention, DayCountConvention _floatingLegDayCountConvention, PaymentFrequency _fixedLegPaymentFrequency, FloatingIndex _floatingIndex, FloatingIndexTenor _floatingIndexTenor, std::chrono::year_month_day _effectiveDate, std::chrono::year_month_day _terminationDate, Currency _currency, int termYears, SwapType _swapType, SwapLegType _swapLegType);
+	IRSwap(Identifier _productId, DayCountConvention _fixedLegDayCountConvention, DayCountConvention _floatingLegDayCountConvention, PaymentFrequency _fixedLegPaymentFrequency, FloatingIndex _floatingIndex, FloatingIndexTenor _floatingIndexTenor, std::chrono::year_month_day _effectiveDate, std::chrono::year_month_day _terminationDate, Currency _currency, int termYears, SwapType _swapType, SwapLegType _swapLegType);
 
 	// Get the fixed leg daycount convention
 	DayCountConvention GetFixedLegDayCountConvention() const;
@@ -174,13 +203,13 @@ private:
 
 };
 
-Product::Product(string _productId, ProductType _productType)
+Product::Product(Identifier _productId, ProductType _productType)
 {
 	productId = _productId;
 	productType = _productType;
 }
 
-const string& Product::GetProductId() const
+const Identifier& Product::GetProductId() const
 {
 	return productId;
 }
@@ -190,41 +219,58 @@ ProductType Product::GetProductType() const
 	return productType;
 }
 
-Bond::Bond(string _productId, BondIdType _bondIdType, string _ticker, double _coupon, std::chrono::year_month_day _maturityDate) : Product(_productId, BOND)
+Bond::Bond(const BondReference* _reference) : Product(_reference->productId, BOND)
+{
+	reference = _reference;
+}
+
+Bond::Bond() : Product(Identifier(), BOND)
 {
-	bondIdType = _bondIdType;
-	ticker = _ticker;
-	coupon = _coupon;
-	maturityDate = _maturityDate;
+	reference = &EMPTY_BOND_REFERENCE;
 }
 
-const string& Bond::GetTicker() const
+string_view Bond::GetTicker() const
 {
-	return ticker;
+	return reference->ticker;
 }
 
 double Bond::GetCoupon() const
 {
-	return coupon;
+	return reference->coupon;
 }
 
 const std::chrono::year_month_day& Bond::GetMaturityDate() const
 {
-	return maturityDate;
+	return reference->maturityDate;
 }
 
 BondIdType Bond::GetBondIdType() const
 {
-	return bondIdType;
+	return reference->bondIdType;
+}
+
+DayCountConvention Bond::GetDayCountConvention() const
+{
+	return reference->dayCountConvention;
+}
+
+span<const std::chrono::year_month_day> Bond::GetCashFlowDates() const
+{
+	return span<const std::chrono::year_month_day>(reference->cashFlowDates, reference->cashFlowCount);
+}
+
+const BondReference& Bond::GetReference() const
+{
+	return *reference;
 }
 
 ostream& operator<<(ostream& _output, const Bond& _bond)
 {
-	_output << _bond.ticker << " " << _bond.coupon << " " << _bond.GetMaturityDate();
+	_output << _bond.GetTicker() << " " << _bond.GetCoupon() << " " << _bond.GetMaturityDate();
 	return _output;
 }
 
-IRSwap::IRSwap(string _productId, DayCountConvention _fixedLegDayCountConvention, DayCountConvention _floatingLegDayCountConvention, PaymentFrequency _fixedLegPaymentFrequency, FloatingIndex _floatingIndex, FloatingIndexTenor _floatingIndexTenor, std::chrono::year_month_day _effectiveDate, std::chrono::year_month_day _terminationDate, Currency _currency, int _termYears, SwapType _swapType, SwapLegType _swapLegType) :
+IRSwap::IRSwap(Identifier _productId, DayCountConvention _fixedLegDayCountConvention, DayCountConvention _floatingLegDayCountConvention, PaymentFrequency _fixedLegPaymentFrequency, FloatingIndex _floatingIndex, FloatingIndexTenor _floatingIndexTenor, std::chrono::year_month_day _effectiveDate, std::chrono::year_month_day _terminationDate, Currency _currency, int _termYears, SwapType _swapType, SwapLegType _swapLegType) :
 	Product(_productId, IRSWAP)
 {
 	fixedLegDayCountConvention = _fixedLegDayCountConvention;
@@ -308,6 +354,7 @@ string IRSwap::ToString(DayCountConvention dayCountConvention) const
 	switch (dayCountConvention) {
 	case THIRTY_THREE_SIXTY: return "30/360";
 	case ACT_THREE_SIXTY: return "Act/360";
+	case ACT_ACT: return "Act/Act";
 	default: return "";
 	}
 }
@@ -0,0 +1,120 @@
+/**
+* referencedata.hpp
+* Defines the immutable reference data table shared by all bonds.
+*
+* @author Haonan Lu
+*/
+
+#ifndef REFERENCE_DATA_HPP
+#define REFERENCE_DATA_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <chrono>
+#include "products.hpp"
+
+using namespace std;
+using namespace chrono;
+
+/**
+* Table of bond reference data, built once on first use and never changed
+* afterwards, so any thread may read it without locking. Records are
+* cache-line aligned and contiguous, and their addresses stay valid for the
+* life of the process; a Bond holds one of them by pointer. The coupon
+* schedules of all bonds share one array the records point into.
+*/
+class ReferenceData
+{
+
+public:
+
+	// Get the table
+	static const ReferenceData& Instance();
+
+	// Get the reference data of a product, nullptr when unknown
+	const BondReference* Find(string_view _productId) const;
+
+	// Get all records, in table order
+	const vector<BondReference>& GetBonds() const;
+
+private:
+
+	// ctor for the table of US Treasury 2Y, 3Y, 5Y, 7Y, 10Y, 20Y and 30Y
+	ReferenceData();
+
+	// Add a semi-annual bond paying from its issue date to maturity
+	void Add(Identifier _productId, InlineId<8> _ticker, double _coupon, year_month_day _issueDate, year_month_day _maturityDate);
+
+	vector<BondReference> bonds;
+	vector<year_month_day> cashFlowDates;
+	unordered_map<Identifier, int> index;
+
+};
+
+ReferenceData::ReferenceData()
+{
+	Add("91282CJL6", "US2Y", 0.04875, 2023y / 11 / 30, 2025y / 11 / 30);
+	Add("91282CJP7", "US3Y", 0.04375, 2023y / 12 / 15, 2026y / 12 / 15);
+	Add("91282CJN2", "US5Y", 0.04375, 2023y / 11 / 30, 2028y / 11 / 30);
+	Add("91282CJM4", "US7Y", 0.04375, 2023y / 11 / 30, 2030y / 11 / 30);
+	Add("91282CJJ1", "US10Y", 0.04500, 2023y / 11 / 15, 2033y / 11 / 15);
+	Add("912810TW8", "US20Y", 0.04750, 2023y / 11 / 30, 2043y / 11 / 15);
+	Add("912810TV0", "US30Y", 0.04750, 2023y / 11 / 15, 2053y / 11 / 15);
+
+	// Schedules are only pointed at once the shared array has stopped growing.
+	int _offset = 0;
+	for (auto& b : bonds)
+	{
+		b.cashFlowDates = cashFlowDates.data() + _offset;
+		_offset += b.cashFlowCount;
+	}
+}
+
+void ReferenceData::Add(Identifier _productId, InlineId<8> _ticker, double _coupon, year_month_day _issueDate, year_month_day _maturityDate)
+{
+	// Roll back from maturity in six-month steps, holding month ends at the month end.
+	vector<year_month_day> _dates;
+	for (int i = 0; ; ++i)
+	{
+		year_month_day _date = _maturityDate - months(6 * i);
+		if (!_date.ok()) _date = year_month_day_last(_date.year(), month_day_last(_date.month()));
+		if (sys_days(_date) <= sys_days(_issueDate)) break;
+		_dates.push_back(_date);
+	}
+
+	BondReference _bond = {};
+	_bond.productId = _productId;
+	_bond.ticker = _ticker;
+	_bond.coupon = _coupon;
+	_bond.maturityDate = _maturityDate;
+	_bond.bondIdType = CUSIP;
+	_bond.dayCountConvention = ACT_ACT;
+	_bond.cashFlowCount = (int)_dates.size();
+	_bond.cashFlowDates = nullptr;
+
+	cashFlowDates.insert(cashFlowDates.end(), _dates.rbegin(), _dates.rend());
+	index[_productId] = (int)bonds.size();
+	bonds.push_back(_bond);
+}
+
+const ReferenceData& ReferenceData::Instance()
+{
+	static const ReferenceData _table;
+	return _table;
+}
+
+const BondReference* ReferenceData::Find(string_view _productId) const
+{
+	auto _it = index.find(Identifier(_productId));
+	if (_it == index.end()) return nullptr;
+	return &bonds[_it->second];
+}
+
+const vector<BondReference>& ReferenceData::GetBonds() const
+{
+	return bonds;
+}
+
+#endif
@@ -0,0 +1,295 @@
+/**
+* replayengine.hpp
+* Defines the replay engine merging timestamped input files into one event stream.
+*
+* @author Haonan Lu
+*/
+
+#ifndef REPLAY_ENGINE_HPP
+#define REPLAY_ENGINE_HPP
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <fstream>
+#include <functional>
+#include <thread>
+#include "soa.hpp"
+#include "timerwheel.hpp"
+
+using namespace std;
+
+// Get the event time of a line, its last column in microseconds.
+long GetEventTime(const string& _line)
+{
+	size_t _pos = _line.find_last_of(',');
+	return stol(_pos == string::npos ? _line : _line.substr(_pos + 1));
+}
+
+/**
+* An input file of the replay and the connector its lines go to.
+* The line read ahead starts at lineOffset; position is how far the file has been read.
+*/
+struct ReplaySource
+{
+	string name;
+	ifstream file;
+	function<void(const string&)> subscribe;
+	string line;
+	long time;
+	long count;
+	long position;
+	long lineOffset;
+};
+
+/**
+* How far an input file has been replayed: the byte offset of its first
+* line not yet dispatched and the number of lines dispatched before it.
+*/
+struct InputOffset
+{
+	char name[64];
+	long offset;
+	long count;
+};
+
+/**
+* Replay engine.
+* Merges input files, each ordered by the event time in its last column,
+* into one time-ordered stream and hands every line to the connector of its
+* file. The engine moves a virtual clock to each event time before
+* dispatching, and installs it on the timer wheel for the run so services
+* and timers run on event time. A replay seeds the IDs generated on its
+* thread from the event time it starts at, so every run of the same input
+* generates the same IDs. Speed 1 replays at the original pace, N at N times
+* the pace, and 0 as fast as possible.
+* Every checkpoint interval of event time the engine reports the input
+* offsets reached, between two events, so state saved then matches them
+* exactly; a later replay resumed from those offsets carries on after them.
+* Offsets are only reported once all events of an event time are done, and
+* a checkpoint function returning false is called again after the next
+* event time, for services with state in flight.
+*/
+class ReplayEngine
+{
+
+public:
+
+	// ctor for an engine
+	ReplayEngine(double _speed = 0);
+
+	// Add an input file feeding a connector
+	template<typename V>
+	void AddSource(const string& _path, Connector<V>* _connector);
+
+	// Get the speed of the replay
+	double GetSpeed() const;
+
+	// Set the speed of the replay, 0 for as fast as possible
+	void SetSpeed(double _speed);
+
+	// Get the virtual clock of the replay
+	VirtualClock& GetClock();
+
+	// Replay all sources and return the number of events
+	long Run();
+
+	// Get the number of events replayed from a source
+	long GetEventCount(const string& _name) const;
+
+	// Get the largest delay of an event behind its scheduled wall time in microseconds
+	long GetMaxLag() const;
+
+	// Get the mean delay of events behind their scheduled wall time in microseconds
+	double GetMeanLag() const;
+
+	// Call a function with the input offsets every interval of event time in microseconds, 0 for never; it returns false to be called again later
+	void SetCheckpoint(long _interval, function<bool(long, const vector<InputOffset>&)> _checkpoint);
+
+	// Start the sources from the offsets reached by an earlier replay
+	void Resume(const vector<InputOffset>& _offsets);
+
+	// Get the input offsets reached so far
+	vector<InputOffset> GetOffsets() const;
+
+private:
+
+	vector<ReplaySource*> sources;
+	VirtualClock clock;
+	double speed;
+	long eventCount;
+	long maxLag;
+	long totalLag;
+	long checkpointInterval;
+	function<bool(long, const vector<InputOffset>&)> checkpoint;
+	bool resumed;
+
+	// Read the next line of a source, false at its end
+	bool Advance(ReplaySource* _source);
+
+};
+
+ReplayEngine::ReplayEngine(double _speed)
+{
+	sources = vector<ReplaySource*>();
+	speed = _speed;
+	eventCount = 0;
+	maxLag = 0;
+	totalLag = 0;
+	checkpointInterval = 0;
+	resumed = false;
+}
+
+template<typename V>
+void ReplayEngine::AddSource(const string& _path, Connector<V>* _connector)
+{
+	ReplaySource* _source = new ReplaySource();
+	_source->name = _path;
+	_source->file.open(_path);
+	_source->subscribe = [_connector](const string& _line) { _connector->Subscribe(_line); };
+	_source->count = 0;
+	_source->position = 0;
+	_source->lineOffset = 0;
+	sources.push_back(_source);
+}
+
+double ReplayEngine::GetSpeed() const
+{
+	return speed;
+}
+
+void ReplayEngine::SetSpeed(double _speed)
+{
+	speed = _speed;
+}
+
+VirtualClock& ReplayEngine::GetClock()
+{
+	return clock;
+}
+
+bool ReplayEngine::Advance(ReplaySource* _source)
+{
+	while (true)
+	{
+		_source->lineOffset = _source->position;
+		if (!getline(_source->file, _source->line)) return false;
+		_source->position += (long)_source->line.size() + 1;
+		if (_source->line.empty()) continue;
+		_source->time = GetEventTime(_source->line);
+		return true;
+	}
+}
+
+long ReplayEngine::Run()
+{
+	// Min-heap of the next event of each source; ties keep the order sources were added.
+	typedef pair<pair<long, int>, ReplaySource*> Event;
+	priority_queue<Event, vector<Event>, greater<Event>> _events;
+	for (size_t i = 0; i < sources.size(); ++i)
+	{
+		if (Advance(sources[i])) _events.push({ { sources[i]->time, (int)i }, sources[i] });
+	}
+	if (_events.empty()) return 0;
+
+	long _startTime = _events.top().first.first;
+	clock.SetTime(_startTime);
+	ClockGuard _clockGuard(GetTimerWheel(), &clock);
+	// A resumed replay carries on the ID sequence restored with its state.
+	if (!resumed) GetIdSequence() = { (uint64_t)_startTime, 0 };
+	steady_clock::time_point _wallStart = steady_clock::now();
+
+	long _count = 0;
+	long _checkpointTime = _startTime;
+	while (!_events.empty())
+	{
+		Event _event = _events.top();
+		_events.pop();
+		ReplaySource* _source = _event.second;
+		long _time = _event.first.first;
+
+		if (speed > 0)
+		{
+			steady_clock::time_point _due = _wallStart + microseconds((long)((_time - _startTime) / speed));
+			this_thread::sleep_until(_due);
+			long _lag = duration_cast<microseconds>(steady_clock::now() - _due).count();
+			maxLag = max(maxLag, _lag);
+			totalLag += _lag;
+		}
+
+		clock.SetTime(_time);
+		PollTimers();
+		_source->subscribe(_source->line);
+		_source->count++;
+		_count++;
+
+		if (Advance(_source)) _events.push({ { _source->time, _event.first.second }, _source });
+
+		bool _isLastOfTime = _events.empty() || _events.top().first.first > _time;
+		if (checkpointInterval > 0 && _isLastOfTime && _time - _checkpointTime >= checkpointInterval && checkpoint(_time, GetOffsets()))
+		{
+			_checkpointTime = _time;
+		}
+	}
+
+	eventCount += _count;
+	return _count;
+}
+
+long ReplayEngine::GetEventCount(const string& _name) const
+{
+	for (auto& s : sources)
+	{
+		if (s->name == _name) return s->count;
+	}
+	return 0;
+}
+
+long ReplayEngine::GetMaxLag() const
+{
+	return maxLag;
+}
+
+double ReplayEngine::GetMeanLag() const
+{
+	return eventCount == 0 ? 0.0 : (double)totalLag / eventCount;
+}
+
+void ReplayEngine::SetCheckpoint(long _interval, function<bool(long, const vector<InputOffset>&)> _checkpoint)
+{
+	checkpointInterval = _interval;
+	checkpoint = _checkpoint;
+}
+
+void ReplayEngine::Resume(const vector<InputOffset>& _offsets)
+{
+	resumed = true;
+	for (auto& o : _offsets)
+	{
+		for (auto& s : sources)
+		{
+			if (s->name != o.name) continue;
+			s->file.clear();
+			s->file.seekg(o.offset);
+			s->position = o.offset;
+			s->lineOffset = o.offset;
+			s->count = o.count;
+		}
+	}
+}
+
+vector<InputOffset> ReplayEngine::GetOffsets() const
+{
+	vector<InputOffset> _offsets;
+	for (auto& s : sources)
+	{
+		InputOffset _offset;
+		CopyField(_offset.name, s->name);
+		_offset.offset = s->lineOffset;
+		_offset.count = s->count;
+		_offsets.push_back(_offset);
+	}
+	return _offsets;
+}
+
+#endif
@@ -10,7 +10,9 @@
 #define RISK_SERVICE_HPP
 
 #include "soa.hpp"
+#include "snapshottable.hpp"
 #include "positionservice.hpp"
+#include "curveservice.hpp"
 
 /**
 * PV01 risk.
@@ -144,12 +146,24 @@ const string& BucketedSector<T>::GetName() const
 	return name;
 }
 
+/**
+* Snapshot of the risk of a product, readable from any thread.
+*/
+struct RiskSnapshot
+{
+	double pv01;
+	long quantity;
+};
+
 // Pre-declearations to avoid errors.
 template<typename T>
 class RiskToPositionListener;
+template<typename T>
+class RiskToCurveListener;
 
 /**
 * Risk Service to vend out risk for a particular security and across a risk bucketed sector.
+* Positions are risked off the latest fitted treasury curve, or at fixed PV01s until there is one.
 * Keyed on product identifier.
 * Type T is the product type.
 */
@@ -159,9 +173,16 @@ class RiskService : public Service<string, PV01 <T> >
 
 private:
 
-	map<string, PV01<T>> pv01s;
+	map<Identifier, PV01<T>> pv01s;
+	SnapshotTable<RiskSnapshot> snapshots;
 	vector<ServiceListener<PV01<T>>*> listeners;
 	RiskToPositionListener<T>* listener;
+	RiskToCurveListener<T>* curveListener;
+	YieldCurve curve;
+	unordered_map<Identifier, double> curvePV01s;
+
+	// Get the PV01 of a product per 100 face off the latest curve, or its fixed PV01 until a curve is fitted
+	double GetProductPV01(const T& _product);
 
 public:
 
@@ -184,20 +205,33 @@ public:
 	// Get the listener of the service
 	RiskToPositionListener<T>* GetListener();
 
+	// Get the curve listener of the service
+	RiskToCurveListener<T>* GetCurveListener();
+
 	// Add a position that the service will risk
 	void AddPosition(Position<T>& _position);
 
+	// Risk positions added from now on off a newly fitted curve
+	void UpdateCurve(const YieldCurve& _curve);
+
 	// Get the bucketed risk for the bucket sector
-	const PV01<BucketedSector<T>>& GetBucketedRisk(const BucketedSector<T>& _sector) const;
+	PV01<BucketedSector<T>> GetBucketedRisk(const BucketedSector<T>& _sector) const;
+
+	// Get the latest risk of a product without locking, from any thread
+	bool GetSnapshot(const string& _productId, RiskSnapshot& _snapshot) const;
+
+	// Get the risk of all products
+	const map<Identifier, PV01<T>>& GetAllRisk() const;
 
 };
 
 template<typename T>
 RiskService<T>::RiskService()
 {
-	pv01s = map<string, PV01<T>>();
+	pv01s = map<Identifier, PV01<T>>();
 	listeners = vector<ServiceListener<PV01<T>>*>();
 	listener = new RiskToPositionListener<T>(this);
+	curveListener = new RiskToCurveListener<T>(this);
 }
 
 template<typename T>
@@ -213,6 +247,7 @@ template<typename T>
 void RiskService<T>::OnMessage(PV01<T>& _data)
 {
 	pv01s[_data.GetProduct().GetProductId()] = _data;
+	snapshots.Publish(_data.GetProduct().GetProductId(), { _data.GetPV01(), _data.GetQuantity() });
 }
 
 template<typename T>
@@ -233,15 +268,41 @@ RiskToPositionListener<T>* RiskService<T>::GetListener()
 	return listener;
 }
 
+template<typename T>
+RiskToCurveListener<T>* RiskService<T>::GetCurveListener()
+{
+	return curveListener;
+}
+
+template<typename T>
+double RiskService<T>::GetProductPV01(const T& _product)
+{
+	Identifier _productId = _product.GetProductId();
+	if (curve.GetVersion() == 0) return GetPV01Value(_productId);
+
+	// Each product is priced off a curve once, the first time it is risked.
+	auto _it = curvePV01s.find(_productId);
+	if (_it == curvePV01s.end()) _it = curvePV01s.insert({ _productId, curve.GetPV01(_product.GetCoupon(), curve.GetTenor(_product.GetMaturityDate())) }).first;
+	return _it->second;
+}
+
+template<typename T>
+void RiskService<T>::UpdateCurve(const YieldCurve& _curve)
+{
+	curve = _curve;
+	curvePV01s.clear();
+}
+
 template<typename T>
 void RiskService<T>::AddPosition(Position<T>& _position)
 {
 	T _product = _position.GetProduct();
-	string _productId = _product.GetProductId();
-	double _pv01Value = GetPV01Value(_productId);
+	Identifier _productId = _product.GetProductId();
+	double _pv01Value = GetProductPV01(_product);
 	long _quantity = _position.GetAggregatePosition();
 	PV01<T> _pv01(_product, _pv01Value, _quantity);
 	pv01s[_productId] = _pv01;
+	snapshots.Publish(_productId, { _pv01Value, _quantity });
 
 	for (auto& l : listeners)
 	{
@@ -250,22 +311,35 @@ void RiskService<T>::AddPosition(Position<T>& _position)
 }
 
 template<typename T>
-const PV01<BucketedSector<T>>& RiskService<T>::GetBucketedRisk(const BucketedSector<T>& _sector) const
+PV01<BucketedSector<T>> RiskService<T>::GetBucketedRisk(const BucketedSector<T>& _sector) const
 {
 	BucketedSector<T> _product = _sector;
 	double _pv01 = 0;
 	long _quantity = 1;
 
-	vector<T>& _products = _sector.GetProducts();
+	const vector<T>& _products = _sector.GetProducts();
 	for (auto& p : _products)
 	{
-		string _pId = p.GetProductId();
-		_pv01 += pv01s[_pId].GetPV01() * pv01s[_pId].GetQuantity();
+		auto _it = pv01s.find(p.GetProductId());
+		if (_it == pv01s.end()) continue;
+		_pv01 += _it->second.GetPV01() * _it->second.GetQuantity();
 	}
 
 	return PV01<BucketedSector<T>>(_product, _pv01, _quantity);
 }
 
+template<typename T>
+bool RiskService<T>::GetSnapshot(const string& _productId, RiskSnapshot& _snapshot) const
+{
+	return snapshots.Read(_productId, _snapshot);
+}
+
+template<typename T>
+const map<Identifier, PV01<T>>& RiskService<T>::GetAllRisk() const
+{
+	return pv01s;
+}
+
 /**
 * Risk Service Listener subscribing data from Position Service to Risk Service.
 * Type T is the product type.
@@ -316,4 +390,54 @@ void RiskToPositionListener<T>::ProcessRemove(Position<T>& _data) {}
 template<typename T>
 void RiskToPositionListener<T>::ProcessUpdate(Position<T>& _data) {}
 
+/**
+* Risk Service Listener subscribing data from Curve Service to Risk Service.
+* Type T is the product type.
+*/
+template<typename T>
+class RiskToCurveListener : public ServiceListener<YieldCurve>
+{
+
+private:
+
+	RiskService<T>* service;
+
+public:
+
+	// Connector and Destructor
+	RiskToCurveListener(RiskService<T>* _service);
+	~RiskToCurveListener();
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(YieldCurve& _data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(YieldCurve& _data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(YieldCurve& _data);
+
+};
+
+template<typename T>
+RiskToCurveListener<T>::RiskToCurveListener(RiskService<T>* _service)
+{
+	service = _service;
+}
+
+template<typename T>
+RiskToCurveListener<T>::~RiskToCurveListener() {}
+
+template<typename T>
+void RiskToCurveListener<T>::ProcessAdd(YieldCurve& _data)
+{
+	service->UpdateCurve(_data);
+}
+
+template<typename T>
+void RiskToCurveListener<T>::ProcessRemove(YieldCurve& _data) {}
+
+template<typename T>
+void RiskToCurveListener<T>::ProcessUpdate(YieldCurve& _data) {}
+
 #endif
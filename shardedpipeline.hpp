@@ -0,0 +1,388 @@
+/**
+* shardedpipeline.hpp
+* Defines the pipeline partitioning products across shards running on their own cores.
+*
+* @author Haonan Lu
+*/
+
+#ifndef SHARDED_PIPELINE_HPP
+#define SHARDED_PIPELINE_HPP
+
+#include <string>
+#include <vector>
+#include <future>
+#include <unordered_map>
+#include "soa.hpp"
+#include "eventqueue.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.hpp"
+#include "executionservice.hpp"
+#include "tradebookingservice.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+
+using namespace std;
+
+// Get the column of a line, empty when the line is shorter.
+string GetColumn(const string& _line, int _column)
+{
+	size_t _start = 0;
+	for (int i = 0; i < _column; ++i)
+	{
+		_start = _line.find(',', _start);
+		if (_start == string::npos) return "";
+		_start++;
+	}
+	size_t _end = _line.find(',', _start);
+	return _line.substr(_start, _end == string::npos ? string::npos : _end - _start);
+}
+
+/**
+* One shard of the pipeline: its own chain of product services, from market
+* data and trades to positions and risk, run serially on its event queue.
+* Type T is the product type.
+*/
+template<typename T>
+struct PipelineShard
+{
+	EventQueue queue;
+	MarketDataService<T> marketDataService;
+	AlgoExecutionService<T> algoExecutionService;
+	ExecutionService<T> executionService;
+	TradeBookingService<T> tradeBookingService;
+	PositionService<T> positionService;
+	RiskService<T> riskService;
+
+	// ctor for a shard
+	PipelineShard(string _name);
+};
+
+template<typename T>
+PipelineShard<T>::PipelineShard(string _name) :
+	queue(_name), tradeBookingService("tradejournal_" + _name + ".dat")
+{
+	marketDataService.AddListener(executionService.GetMarketDataListener());
+	marketDataService.AddListener(algoExecutionService.GetListener());
+	algoExecutionService.AddListener(executionService.GetListener());
+	executionService.AddListener(tradeBookingService.GetListener());
+	executionService.AddListener(algoExecutionService.GetExecutionListener());
+	tradeBookingService.AddListener(positionService.GetListener());
+	positionService.AddListener(riskService.GetListener());
+}
+
+/**
+* Connector in front of the connectors of the shards, sending each line to
+* the queue of the shard owning its product. Lines are handed over in
+* batches per shard, so a queue is woken once per batch rather than per
+* line; Flush hands over what is left. Lines must come from one thread.
+* Type V is the data type of the connectors.
+*/
+template<typename V>
+class ShardedConnector : public Connector<V>
+{
+
+private:
+
+	static const size_t BATCH_SIZE = 64;
+
+	vector<Connector<V>*> connectors;
+	vector<EventQueue*> queues;
+	vector<vector<string>> batches;
+	unordered_map<Identifier, size_t> shardIndices;
+	int productColumn;
+
+	// Hand the batch of a shard over to its queue
+	void Flush(size_t _shard);
+
+public:
+
+	// Connector and Destructor
+	ShardedConnector(const vector<Connector<V>*>& _connectors, const vector<EventQueue*>& _queues, int _productColumn = 0);
+	~ShardedConnector();
+
+	// Publish data to the Connector
+	void Publish(V& _data);
+
+	// Subscribe data from the Connector
+	void Subscribe(ifstream& _data);
+
+	// Subscribe one line of data from the Connector
+	void Subscribe(const string& _line);
+
+	// Hand the lines still batched over to the shards
+	void Flush();
+
+};
+
+template<typename V>
+ShardedConnector<V>::ShardedConnector(const vector<Connector<V>*>& _connectors, const vector<EventQueue*>& _queues, int _productColumn)
+{
+	connectors = _connectors;
+	queues = _queues;
+	batches = vector<vector<string>>(_connectors.size());
+	shardIndices = unordered_map<Identifier, size_t>();
+	productColumn = _productColumn;
+}
+
+template<typename V>
+ShardedConnector<V>::~ShardedConnector() {}
+
+template<typename V>
+void ShardedConnector<V>::Publish(V& _data) {}
+
+template<typename V>
+void ShardedConnector<V>::Subscribe(ifstream& _data)
+{
+	string _line;
+	while (getline(_data, _line))
+	{
+		Subscribe(_line);
+	}
+	Flush();
+}
+
+template<typename V>
+void ShardedConnector<V>::Subscribe(const string& _line)
+{
+	string _productId = GetColumn(_line, productColumn);
+	auto _it = shardIndices.find(_productId);
+	if (_it == shardIndices.end())
+	{
+		_it = shardIndices.emplace(_productId, GetProductHandle(_productId) % connectors.size()).first;
+	}
+
+	size_t _shard = _it->second;
+	batches[_shard].push_back(_line);
+	if (batches[_shard].size() >= BATCH_SIZE) Flush(_shard);
+}
+
+template<typename V>
+void ShardedConnector<V>::Flush(size_t _shard)
+{
+	if (batches[_shard].empty()) return;
+	Connector<V>* _connector = connectors[_shard];
+	vector<string> _batch;
+	_batch.swap(batches[_shard]);
+	queues[_shard]->Post([_connector, _batch]()
+	{
+		for (auto& l : _batch) _connector->Subscribe(l);
+	});
+}
+
+template<typename V>
+void ShardedConnector<V>::Flush()
+{
+	for (size_t i = 0; i < batches.size(); ++i)
+	{
+		Flush(i);
+	}
+}
+
+/**
+* Sharded pipeline.
+* Partitions products across shards by product handle, each shard owning its
+* own services on its own thread, so products never share state across
+* shards. Aggregates across products are merged from per-shard partial
+* results computed on each shard's own thread.
+* Type T is the product type.
+*/
+template<typename T>
+class ShardedPipeline
+{
+
+public:
+
+	// ctor for a pipeline of a number of shards
+	ShardedPipeline(int _shardCount);
+	~ShardedPipeline();
+
+	// Get the number of shards
+	int GetShardCount() const;
+
+	// Get the shard owning a product
+	PipelineShard<T>& GetShard(const string& _productId);
+
+	// Get a shard by index
+	PipelineShard<T>& GetShard(int _index);
+
+	// Get the connector routing market data to the shards
+	ShardedConnector<OrderBook<T>>* GetMarketDataConnector();
+
+	// Get the connector routing trades to the shards
+	ShardedConnector<Trade<T>>* GetTradeConnector();
+
+	// Start the threads of the shards
+	void Start();
+
+	// Hand over the batched lines and wait until every shard has processed all data routed to it and its fills
+	void Drain();
+
+	// Stop the threads of the shards
+	void Stop();
+
+	// Get the bucketed risk of a sector, merged across shards
+	PV01<BucketedSector<T>> GetBucketedRisk(const BucketedSector<T>& _sector);
+
+	// Get the aggregate position over all products and books, merged across shards
+	long GetTotalPosition();
+
+private:
+
+	vector<PipelineShard<T>*> shards;
+	ShardedConnector<OrderBook<T>>* marketDataConnector;
+	ShardedConnector<Trade<T>>* tradeConnector;
+
+	// Run a task on every shard and collect the results in shard order
+	template<typename R>
+	vector<R> Gather(function<R(PipelineShard<T>&)> _task);
+
+};
+
+template<typename T>
+ShardedPipeline<T>::ShardedPipeline(int _shardCount)
+{
+	shards = vector<PipelineShard<T>*>();
+	vector<Connector<OrderBook<T>>*> _marketDataConnectors;
+	vector<Connector<Trade<T>>*> _tradeConnectors;
+	vector<EventQueue*> _queues;
+	for (int i = 0; i < _shardCount; ++i)
+	{
+		PipelineShard<T>* _shard = new PipelineShard<T>("shard" + to_string(i));
+		shards.push_back(_shard);
+		_marketDataConnectors.push_back(_shard->marketDataService.GetConnector());
+		_tradeConnectors.push_back(_shard->tradeBookingService.GetConnector());
+		_queues.push_back(&_shard->queue);
+	}
+	marketDataConnector = new ShardedConnector<OrderBook<T>>(_marketDataConnectors, _queues);
+	tradeConnector = new ShardedConnector<Trade<T>>(_tradeConnectors, _queues);
+}
+
+template<typename T>
+ShardedPipeline<T>::~ShardedPipeline()
+{
+	Stop();
+}
+
+template<typename T>
+int ShardedPipeline<T>::GetShardCount() const
+{
+	return (int)shards.size();
+}
+
+template<typename T>
+PipelineShard<T>& ShardedPipeline<T>::GetShard(const string& _productId)
+{
+	return *shards[GetProductHandle(_productId) % shards.size()];
+}
+
+template<typename T>
+PipelineShard<T>& ShardedPipeline<T>::GetShard(int _index)
+{
+	return *shards[_index];
+}
+
+template<typename T>
+ShardedConnector<OrderBook<T>>* ShardedPipeline<T>::GetMarketDataConnector()
+{
+	return marketDataConnector;
+}
+
+template<typename T>
+ShardedConnector<Trade<T>>* ShardedPipeline<T>::GetTradeConnector()
+{
+	return tradeConnector;
+}
+
+template<typename T>
+void ShardedPipeline<T>::Start()
+{
+	for (auto& s : shards)
+	{
+		s->queue.Start();
+	}
+}
+
+template<typename T>
+void ShardedPipeline<T>::Drain()
+{
+	marketDataConnector->Flush();
+	tradeConnector->Flush();
+	for (auto& s : shards)
+	{
+		s->queue.Drain();
+	}
+
+	// Fills left in the matching engines after the last book are booked as well.
+	for (auto& s : shards)
+	{
+		PipelineShard<T>* _shard = s;
+		_shard->queue.Post([_shard]() { _shard->executionService.ProcessFills(); });
+	}
+	for (auto& s : shards)
+	{
+		s->queue.Drain();
+	}
+}
+
+template<typename T>
+void ShardedPipeline<T>::Stop()
+{
+	for (auto& s : shards)
+	{
+		s->queue.Stop();
+	}
+}
+
+template<typename T>
+template<typename R>
+vector<R> ShardedPipeline<T>::Gather(function<R(PipelineShard<T>&)> _task)
+{
+	// Each partial result is computed on the shard's own thread, after the data already routed to it.
+	vector<promise<R>> _promises(shards.size());
+	vector<R> _results;
+	for (size_t i = 0; i < shards.size(); ++i)
+	{
+		PipelineShard<T>* _shard = shards[i];
+		promise<R>* _promise = &_promises[i];
+		_shard->queue.Post([_shard, _promise, _task]() { _promise->set_value(_task(*_shard)); });
+	}
+	for (auto& p : _promises)
+	{
+		_results.push_back(p.get_future().get());
+	}
+	return _results;
+}
+
+template<typename T>
+PV01<BucketedSector<T>> ShardedPipeline<T>::GetBucketedRisk(const BucketedSector<T>& _sector)
+{
+	vector<double> _partials = Gather<double>([_sector](PipelineShard<T>& _shard)
+	{
+		return _shard.riskService.GetBucketedRisk(_sector).GetPV01();
+	});
+
+	double _pv01 = 0;
+	for (auto& p : _partials) _pv01 += p;
+	return PV01<BucketedSector<T>>(_sector, _pv01, 1);
+}
+
+template<typename T>
+long ShardedPipeline<T>::GetTotalPosition()
+{
+	vector<long> _partials = Gather<long>([](PipelineShard<T>& _shard)
+	{
+		long _total = 0;
+		for (auto& p : _shard.positionService.GetAllPositions())
+		{
+			Position<T> _position = p.second;
+			_total += _position.GetAggregatePosition();
+		}
+		return _total;
+	});
+
+	long _total = 0;
+	for (auto& p : _partials) _total += p;
+	return _total;
+}
+
+#endif
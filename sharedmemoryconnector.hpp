@@ -0,0 +1,591 @@
+/**
+* sharedmemoryconnector.hpp
+* Defines a Connector over a shared-memory ring buffer and the wire
+* encodings of the data types that cross process boundaries.
+*
+* @author Haonan Lu
+*/
+
+#ifndef SHARED_MEMORY_CONNECTOR_HPP
+#define SHARED_MEMORY_CONNECTOR_HPP
+
+#include <string>
+#include <cstring>
+#include <atomic>
+#include <thread>
+#include <type_traits>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "soa.hpp"
+#include "pricingservice.hpp"
+#include "tradebookingservice.hpp"
+
+using namespace std;
+
+/**
+* Wire encoding of a price.
+*/
+struct PriceWire
+{
+	char productId[16];
+	double mid;
+	double bidOfferSpread;
+};
+
+/**
+* Wire encoding of one order of an order book.
+*/
+struct OrderWire
+{
+	double price;
+	long quantity;
+	int side;
+};
+
+/**
+* Wire encoding of an order book with up to ten orders a side.
+*/
+struct OrderBookWire
+{
+	char productId[16];
+	int market;
+	int bidCount;
+	int offerCount;
+	OrderWire bids[10];
+	OrderWire offers[10];
+};
+
+/**
+* Wire encoding of an execution order.
+*/
+struct ExecutionOrderWire
+{
+	char productId[16];
+	char orderId[24];
+	char parentOrderId[24];
+	int side;
+	int orderType;
+	double price;
+	long visibleQuantity;
+	long hiddenQuantity;
+	bool isChildOrder;
+	char executionId[24];
+};
+
+static_assert(is_trivially_copyable<PriceWire>::value, "PriceWire must be trivially copyable");
+static_assert(is_trivially_copyable<OrderBookWire>::value, "OrderBookWire must be trivially copyable");
+static_assert(is_trivially_copyable<ExecutionOrderWire>::value, "ExecutionOrderWire must be trivially copyable");
+
+/**
+* Wire format of a data type: the trivially-copyable encoding and the
+* conversions to and from it. Specialized for each type sent across processes.
+* Type V is the data type.
+*/
+template<typename V>
+struct WireFormat;
+
+template<typename T>
+struct WireFormat<Price<T>>
+{
+	typedef PriceWire Type;
+
+	static void Encode(const Price<T>& _data, PriceWire& _wire)
+	{
+		CopyField(_wire.productId, _data.GetProduct().GetProductId());
+		_wire.mid = _data.GetMid();
+		_wire.bidOfferSpread = _data.GetBidOfferSpread();
+	}
+
+	static Price<T> Decode(const PriceWire& _wire)
+	{
+		T _product = GetBond(_wire.productId);
+		return Price<T>(_product, _wire.mid, _wire.bidOfferSpread);
+	}
+};
+
+template<typename T>
+struct WireFormat<OrderBook<T>>
+{
+	typedef OrderBookWire Type;
+
+	static void Encode(const OrderBook<T>& _data, OrderBookWire& _wire)
+	{
+		CopyField(_wire.productId, _data.GetProduct().GetProductId());
+		_wire.market = _data.GetMarket();
+		const vector<Order>& _bidStack = _data.GetBidStack();
+		const vector<Order>& _offerStack = _data.GetOfferStack();
+		_wire.bidCount = (int)min(_bidStack.size(), (size_t)10);
+		_wire.offerCount = (int)min(_offerStack.size(), (size_t)10);
+		for (int i = 0; i < _wire.bidCount; ++i)
+		{
+			_wire.bids[i] = { _bidStack[i].GetPrice(), _bidStack[i].GetQuantity(), _bidStack[i].GetSide() };
+		}
+		for (int i = 0; i < _wire.offerCount; ++i)
+		{
+			_wire.offers[i] = { _offerStack[i].GetPrice(), _offerStack[i].GetQuantity(), _offerStack[i].GetSide() };
+		}
+	}
+
+	static OrderBook<T> Decode(const OrderBookWire& _wire)
+	{
+		vector<Order> _bidStack;
+		vector<Order> _offerStack;
+		for (int i = 0; i < _wire.bidCount; ++i)
+		{
+			_bidStack.push_back(Order(_wire.bids[i].price, _wire.bids[i].quantity, (PricingSide)_wire.bids[i].side));
+		}
+		for (int i = 0; i < _wire.offerCount; ++i)
+		{
+			_offerStack.push_back(Order(_wire.offers[i].price, _wire.offers[i].quantity, (PricingSide)_wire.offers[i].side));
+		}
+		T _product = GetBond(_wire.productId);
+		return OrderBook<T>(_product, _bidStack, _offerStack, (Market)_wire.market);
+	}
+};
+
+template<typename T>
+struct WireFormat<ExecutionOrder<T>>
+{
+	typedef ExecutionOrderWire Type;
+
+	static void Encode(const ExecutionOrder<T>& _data, ExecutionOrderWire& _wire)
+	{
+		CopyField(_wire.productId, _data.GetProduct().GetProductId());
+		CopyField(_wire.orderId, _data.GetOrderId());
+		CopyField(_wire.parentOrderId, _data.GetParentOrderId());
+		_wire.side = _data.GetPricingSide();
+		_wire.orderType = _data.GetOrderType();
+		_wire.price = _data.GetPrice();
+		_wire.visibleQuantity = _data.GetVisibleQuantity();
+		_wire.hiddenQuantity = _data.GetHiddenQuantity();
+		_wire.isChildOrder = _data.IsChildOrder();
+		CopyField(_wire.executionId, _data.GetExecutionId());
+	}
+
+	static ExecutionOrder<T> Decode(const ExecutionOrderWire& _wire)
+	{
+		T _product = GetBond(_wire.productId);
+		return ExecutionOrder<T>(_product, (PricingSide)_wire.side, _wire.orderId, (OrderType)_wire.orderType, _wire.price, _wire.visibleQuantity, _wire.hiddenQuantity, _wire.parentOrderId, _wire.isChildOrder, _wire.executionId);
+	}
+};
+
+template<typename T>
+struct WireFormat<Trade<T>>
+{
+	typedef TradeWire Type;
+
+	static void Encode(const Trade<T>& _data, TradeWire& _wire)
+	{
+		EncodeTrade(_data, _wire);
+	}
+
+	static Trade<T> Decode(const TradeWire& _wire)
+	{
+		return DecodeTrade<T>(_wire);
+	}
+};
+
+/**
+* Broadcast ring buffer in POSIX shared memory.
+* Any number of processes may write; each slot carries the sequence number
+* of its payload, so every reader keeps its own cursor and sees every
+* message in sequence order, or learns how many it lost when lapped.
+* Type W is the trivially-copyable payload type.
+*/
+template<typename W>
+class SharedMemoryRing
+{
+
+public:
+
+	// ctor for a ring, creating the shared memory if it does not exist
+	SharedMemoryRing(const string& _name, uint64_t _capacity);
+	~SharedMemoryRing();
+
+	// Is the ring mapped?
+	bool IsOpen() const;
+
+	// Get the number of slots
+	uint64_t GetCapacity() const;
+
+	// Get the sequence number of the next message to be written
+	uint64_t GetHead() const;
+
+	// Write a message and return its sequence number
+	uint64_t Write(const W& _payload);
+
+	// Read the message at the cursor and advance it; false if it is not written yet
+	bool Read(uint64_t& _cursor, W& _payload, uint64_t& _lost);
+
+	// Mark the ring closed once the writers are done
+	void Close();
+
+	// Have the writers closed the ring?
+	bool IsClosed() const;
+
+	// Remove the shared memory name
+	static void Unlink(const string& _name);
+
+private:
+
+	struct alignas(64) Header
+	{
+		atomic<uint64_t> magic;
+		uint64_t capacity;
+		uint64_t slotSize;
+		atomic<uint64_t> closed;
+		alignas(64) atomic<uint64_t> head;
+	};
+
+	struct alignas(64) Slot
+	{
+		atomic<uint64_t> sequence;
+		W payload;
+	};
+
+	static const uint64_t MAGIC = 0x534d52494e473031;
+
+	Header* header;
+	Slot* slots;
+	size_t mappedSize;
+	uint64_t capacity;
+
+};
+
+template<typename W>
+SharedMemoryRing<W>::SharedMemoryRing(const string& _name, uint64_t _capacity)
+{
+	static_assert(is_trivially_copyable<W>::value, "ring payload must be trivially copyable");
+	static_assert(atomic<uint64_t>::is_always_lock_free, "ring needs lock-free 64-bit atomics");
+
+	header = nullptr;
+	slots = nullptr;
+	capacity = _capacity;
+	mappedSize = sizeof(Header) + sizeof(Slot) * capacity;
+
+	bool _created = true;
+	int _fd = shm_open(_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+	if (_fd < 0)
+	{
+		_created = false;
+		_fd = shm_open(_name.c_str(), O_RDWR, 0600);
+	}
+	if (_fd < 0) return;
+
+	if (_created && ftruncate(_fd, mappedSize) != 0)
+	{
+		close(_fd);
+		return;
+	}
+
+	// The creator may still be sizing the segment.
+	struct stat _stat;
+	while (!_created && fstat(_fd, &_stat) == 0 && (size_t)_stat.st_size < sizeof(Header)) this_thread::yield();
+
+	void* _memory = mmap(nullptr, sizeof(Header), PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+	if (_memory == MAP_FAILED)
+	{
+		close(_fd);
+		return;
+	}
+
+	Header* _header = (Header*)_memory;
+	if (_created)
+	{
+		_header->capacity = capacity;
+		_header->slotSize = sizeof(Slot);
+		_header->closed.store(0, memory_order_relaxed);
+		_header->head.store(0, memory_order_relaxed);
+		_header->magic.store(MAGIC, memory_order_release);
+	}
+	else
+	{
+		while (_header->magic.load(memory_order_acquire) != MAGIC) this_thread::yield();
+		capacity = _header->capacity;
+	}
+	uint64_t _slotSize = _header->slotSize;
+	munmap(_memory, sizeof(Header));
+
+	// A ring created for another payload type would be read as garbage.
+	mappedSize = sizeof(Header) + sizeof(Slot) * capacity;
+	if (_slotSize != sizeof(Slot) || fstat(_fd, &_stat) != 0 || (size_t)_stat.st_size < mappedSize)
+	{
+		close(_fd);
+		return;
+	}
+
+	_memory = mmap(nullptr, mappedSize, PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+	close(_fd);
+	if (_memory == MAP_FAILED) return;
+
+	header = (Header*)_memory;
+	slots = (Slot*)((char*)_memory + sizeof(Header));
+}
+
+template<typename W>
+SharedMemoryRing<W>::~SharedMemoryRing()
+{
+	if (header) munmap(header, mappedSize);
+}
+
+template<typename W>
+bool SharedMemoryRing<W>::IsOpen() const
+{
+	return header != nullptr;
+}
+
+template<typename W>
+uint64_t SharedMemoryRing<W>::GetCapacity() const
+{
+	return capacity;
+}
+
+template<typename W>
+uint64_t SharedMemoryRing<W>::GetHead() const
+{
+	return header->head.load(memory_order_acquire);
+}
+
+template<typename W>
+uint64_t SharedMemoryRing<W>::Write(const W& _payload)
+{
+	// A slot holds 2 * seq + 1 while seq is being written and 2 * seq + 2 once it is complete.
+	uint64_t _sequence = header->head.fetch_add(1, memory_order_acq_rel);
+	Slot& _slot = slots[_sequence % capacity];
+	_slot.sequence.store(2 * _sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	memcpy((void*)&_slot.payload, &_payload, sizeof(W));
+	_slot.sequence.store(2 * _sequence + 2, memory_order_release);
+	return _sequence;
+}
+
+template<typename W>
+bool SharedMemoryRing<W>::Read(uint64_t& _cursor, W& _payload, uint64_t& _lost)
+{
+	Slot& _slot = slots[_cursor % capacity];
+	uint64_t _expected = 2 * _cursor + 2;
+	uint64_t _before = _slot.sequence.load(memory_order_acquire);
+	if (_before == _expected)
+	{
+		memcpy(&_payload, (const void*)&_slot.payload, sizeof(W));
+		atomic_thread_fence(memory_order_acquire);
+		if (_slot.sequence.load(memory_order_relaxed) == _expected)
+		{
+			_cursor++;
+			return true;
+		}
+	}
+	else if (_before < _expected)
+	{
+		return false;
+	}
+
+	// A writer has lapped this reader; skip to the oldest message still in the ring.
+	uint64_t _head = GetHead();
+	uint64_t _oldest = _head > capacity ? _head - capacity + 1 : 0;
+	if (_oldest > _cursor)
+	{
+		_lost += _oldest - _cursor;
+		_cursor = _oldest;
+	}
+	return false;
+}
+
+template<typename W>
+void SharedMemoryRing<W>::Close()
+{
+	header->closed.store(1, memory_order_release);
+}
+
+template<typename W>
+bool SharedMemoryRing<W>::IsClosed() const
+{
+	return header->closed.load(memory_order_acquire) != 0;
+}
+
+template<typename W>
+void SharedMemoryRing<W>::Unlink(const string& _name)
+{
+	shm_unlink(_name.c_str());
+}
+
+/**
+* Shared Memory Connector publishing data to and subscribing data from a shared-memory ring,
+* so that a Service in one process can feed a Service in another on the same host.
+* Type V is the data type.
+*/
+template<typename V>
+class SharedMemoryConnector : public Connector<V>
+{
+
+private:
+
+	Service<string, V>* service;
+	SharedMemoryRing<typename WireFormat<V>::Type> ring;
+	uint64_t cursor;
+	uint64_t lostCount;
+
+public:
+
+	// Connector and Destructor
+	SharedMemoryConnector(const string& _name, Service<string, V>* _service, uint64_t _capacity = 65536);
+	~SharedMemoryConnector();
+
+	// Publish data to the Connector
+	void Publish(V& _data);
+
+	// Subscribe data from the Connector until the writers close the ring; the ring is the source, so there is no file to read
+	void Subscribe(ifstream& _data);
+
+	// Deliver all messages available in the ring to the service and return how many
+	long Poll();
+
+	// Close the ring once this process is done publishing to it
+	void Close();
+
+	// Is the shared memory mapped?
+	bool IsOpen() const;
+
+	// Get the number of messages lost by falling behind the writers
+	uint64_t GetLostCount() const;
+
+};
+
+template<typename V>
+SharedMemoryConnector<V>::SharedMemoryConnector(const string& _name, Service<string, V>* _service, uint64_t _capacity) :
+	ring(_name, _capacity)
+{
+	service = _service;
+	lostCount = 0;
+	cursor = 0;
+	if (ring.IsOpen())
+	{
+		// Late joiners start from the oldest message still in the ring.
+		uint64_t _head = ring.GetHead();
+		cursor = _head > ring.GetCapacity() ? _head - ring.GetCapacity() : 0;
+	}
+}
+
+template<typename V>
+SharedMemoryConnector<V>::~SharedMemoryConnector() {}
+
+template<typename V>
+void SharedMemoryConnector<V>::Publish(V& _data)
+{
+	if (!ring.IsOpen()) return;
+
+	typename WireFormat<V>::Type _wire;
+	WireFormat<V>::Encode(_data, _wire);
+	ring.Write(_wire);
+}
+
+template<typename V>
+void SharedMemoryConnector<V>::Subscribe(ifstream& /* _data */)
+{
+	if (!ring.IsOpen() || service == nullptr) return;
+
+	while (!ring.IsClosed())
+	{
+		if (Poll() == 0) this_thread::yield();
+	}
+	// Everything written before the ring was closed is now visible.
+	Poll();
+}
+
+template<typename V>
+long SharedMemoryConnector<V>::Poll()
+{
+	if (!ring.IsOpen() || service == nullptr) return 0;
+
+	long _count = 0;
+	typename WireFormat<V>::Type _wire;
+	while (true)
+	{
+		uint64_t _cursor = cursor;
+		if (ring.Read(cursor, _wire, lostCount))
+		{
+			V _data = WireFormat<V>::Decode(_wire);
+			service->OnMessage(_data);
+			_count++;
+		}
+		else if (cursor == _cursor)
+		{
+			// Caught up, or the next message is still being written.
+			break;
+		}
+	}
+	return _count;
+}
+
+template<typename V>
+void SharedMemoryConnector<V>::Close()
+{
+	if (ring.IsOpen()) ring.Close();
+}
+
+template<typename V>
+bool SharedMemoryConnector<V>::IsOpen() const
+{
+	return ring.IsOpen();
+}
+
+template<typename V>
+uint64_t SharedMemoryConnector<V>::GetLostCount() const
+{
+	return lostCount;
+}
+
+/**
+* Listener publishing every added item of a Service to a Connector,
+* e.g. to hand a Service's output to a SharedMemoryConnector.
+* Type V is the data type.
+*/
+template<typename V>
+class ConnectorListener : public ServiceListener<V>
+{
+
+private:
+
+	Connector<V>* connector;
+
+public:
+
+	// Connector and Destructor
+	ConnectorListener(Connector<V>* _connector);
+	~ConnectorListener();
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(V& _data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(V& _data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(V& _data);
+
+};
+
+template<typename V>
+ConnectorListener<V>::ConnectorListener(Connector<V>* _connector)
+{
+	connector = _connector;
+}
+
+template<typename V>
+ConnectorListener<V>::~ConnectorListener() {}
+
+template<typename V>
+void ConnectorListener<V>::ProcessAdd(V& _data)
+{
+	connector->Publish(_data);
+}
+
+template<typename V>
+void ConnectorListener<V>::ProcessRemove(V& _data) {}
+
+template<typename V>
+void ConnectorListener<V>::ProcessUpdate(V& _data) {}
+
+#endif
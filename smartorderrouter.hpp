@@ -0,0 +1,279 @@
+/**
+* smartorderrouter.hpp
+* Defines the smart order router splitting orders across venues.
+*
+* @author Haonan Lu
+*/
+
+#ifndef SMART_ORDER_ROUTER_HPP
+#define SMART_ORDER_ROUTER_HPP
+
+#include <string>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include "soa.hpp"
+#include "marketdataservice.hpp"
+#include "algoexecutionservice.hpp"
+#include "matchingengine.hpp"
+
+using namespace std;
+
+/**
+* The top of book of a product on one venue.
+*/
+struct VenueQuote
+{
+	double bidPrice = 0;
+	long bidQuantity = 0;
+	double offerPrice = 0;
+	long offerQuantity = 0;
+	bool hasQuote = false;
+};
+
+/**
+* A slice of an order routed to one venue.
+*/
+struct RouteSlice
+{
+	Market market;
+	long quantity;
+};
+
+/**
+* A child order sent by the router, tracked until it is done on its venue.
+*/
+struct ChildOrderState
+{
+	Market market;
+	long quantity;
+	long filledQuantity;
+};
+
+/**
+* Smart order router.
+* Caches the top of book of every venue per product and an estimate of how
+* much of what is sent to each venue gets filled, then splits an order into
+* slices by venue price, displayed size and fill probability.
+* Type T is the product type.
+*/
+template<typename T>
+class SmartOrderRouter
+{
+
+public:
+
+	// ctor for a router
+	SmartOrderRouter();
+
+	// Update the cached top of book of a product on the venue of the book
+	void UpdateQuote(const OrderBook<T>& _orderBook);
+
+	// Get the cached top of book of a product on a venue
+	const VenueQuote& GetQuote(const string& _productId, Market _market);
+
+	// Split an order into slices across venues
+	void Route(const ExecutionOrder<T>& _order, vector<RouteSlice>& _slices);
+
+	// Track a child order sent to a venue
+	void AddChildOrder(const string& _orderId, Market _market, long _quantity);
+
+	// Record a fill of a child order, updating the fill probability of its venue once it is done
+	void OnFill(const ExecutionFill& _fill);
+
+	// Get the child orders not yet done
+	const unordered_map<Identifier, ChildOrderState>& GetChildOrders() const;
+
+	// Restore a child order not yet done, when restoring the router
+	void RestoreChildOrder(const string& _orderId, const ChildOrderState& _state);
+
+	// Get the estimated fraction of an order a venue fills
+	double GetFillProbability(Market _market) const;
+
+	// Set the estimated fraction of an order a venue fills, when restoring the router
+	void SetFillProbability(Market _market, double _probability);
+
+	// Set the weight of the latest child order in the fill probability estimate
+	void SetFillProbabilityWeight(double _weight);
+
+private:
+
+	vector<array<VenueQuote, NUM_MARKETS>> quotes;
+	array<double, NUM_MARKETS> fillProbabilities;
+	unordered_map<Identifier, ChildOrderState> childOrders;
+	double fillProbabilityWeight;
+	VenueQuote emptyQuote;
+
+	// Get the quotes of a product, growing the cache on first use
+	array<VenueQuote, NUM_MARKETS>& GetQuotes(const string& _productId);
+
+};
+
+template<typename T>
+SmartOrderRouter<T>::SmartOrderRouter()
+{
+	fillProbabilities.fill(1.0);
+	fillProbabilityWeight = 0.1;
+}
+
+template<typename T>
+array<VenueQuote, NUM_MARKETS>& SmartOrderRouter<T>::GetQuotes(const string& _productId)
+{
+	size_t _handle = GetProductHandle(_productId);
+	if (_handle >= quotes.size()) quotes.resize(_handle + 1);
+	return quotes[_handle];
+}
+
+template<typename T>
+void SmartOrderRouter<T>::UpdateQuote(const OrderBook<T>& _orderBook)
+{
+	VenueQuote& _quote = GetQuotes(_orderBook.GetProduct().GetProductId())[_orderBook.GetMarket()];
+	_quote = VenueQuote();
+
+	// Aggregate the displayed size at the best price of each side.
+	for (auto& o : _orderBook.GetBidStack())
+	{
+		if (_quote.bidQuantity == 0 || o.GetPrice() > _quote.bidPrice)
+		{
+			_quote.bidPrice = o.GetPrice();
+			_quote.bidQuantity = o.GetQuantity();
+		}
+		else if (o.GetPrice() == _quote.bidPrice) _quote.bidQuantity += o.GetQuantity();
+	}
+	for (auto& o : _orderBook.GetOfferStack())
+	{
+		if (_quote.offerQuantity == 0 || o.GetPrice() < _quote.offerPrice)
+		{
+			_quote.offerPrice = o.GetPrice();
+			_quote.offerQuantity = o.GetQuantity();
+		}
+		else if (o.GetPrice() == _quote.offerPrice) _quote.offerQuantity += o.GetQuantity();
+	}
+	_quote.hasQuote = _quote.bidQuantity > 0 || _quote.offerQuantity > 0;
+}
+
+template<typename T>
+const VenueQuote& SmartOrderRouter<T>::GetQuote(const string& _productId, Market _market)
+{
+	size_t _handle = GetProductHandle(_productId);
+	if (_handle >= quotes.size()) return emptyQuote;
+	return quotes[_handle][_market];
+}
+
+template<typename T>
+void SmartOrderRouter<T>::Route(const ExecutionOrder<T>& _order, vector<RouteSlice>& _slices)
+{
+	_slices.clear();
+	const array<VenueQuote, NUM_MARKETS>& _quotes = GetQuotes(_order.GetProduct().GetProductId());
+	bool _isBuy = _order.GetPricingSide() == OFFER;
+	bool _isMarket = _order.GetOrderType() == MARKET;
+	long _quantity = _order.GetVisibleQuantity() + _order.GetHiddenQuantity();
+
+	// Rank the venues quoting the side we take within the limit price.
+	array<int, NUM_MARKETS> _venues;
+	array<double, NUM_MARKETS> _prices;
+	array<long, NUM_MARKETS> _sizes;
+	int _count = 0;
+	for (int m = 0; m < NUM_MARKETS; ++m)
+	{
+		const VenueQuote& _quote = _quotes[m];
+		double _price = _isBuy ? _quote.offerPrice : _quote.bidPrice;
+		long _size = _isBuy ? _quote.offerQuantity : _quote.bidQuantity;
+		if (_size <= 0) continue;
+		if (!_isMarket && (_isBuy ? _price > _order.GetPrice() : _price < _order.GetPrice())) continue;
+
+		_venues[_count] = m;
+		_prices[m] = _price;
+		_sizes[m] = _size;
+		_count++;
+	}
+	sort(_venues.begin(), _venues.begin() + _count, [&](int a, int b)
+	{
+		if (_prices[a] != _prices[b]) return _isBuy ? _prices[a] < _prices[b] : _prices[a] > _prices[b];
+		return _sizes[a] * fillProbabilities[a] > _sizes[b] * fillProbabilities[b];
+	});
+
+	// Take the displayed size of each venue in turn.
+	for (int i = 0; i < _count && _quantity > 0; ++i)
+	{
+		int m = _venues[i];
+		long _sliceQuantity = min(_sizes[m], _quantity);
+		_slices.push_back({ (Market)m, _sliceQuantity });
+		_quantity -= _sliceQuantity;
+	}
+
+	// The remainder goes to the venue most likely to fill it, on top of any slice already there.
+	if (_quantity > 0)
+	{
+		int _best = _count > 0 ? _venues[0] : 0;
+		for (int i = 0; i < _count; ++i)
+		{
+			if (fillProbabilities[_venues[i]] > fillProbabilities[_best]) _best = _venues[i];
+		}
+		if (_count == 0)
+		{
+			for (int m = 1; m < NUM_MARKETS; ++m)
+			{
+				if (fillProbabilities[m] > fillProbabilities[_best]) _best = m;
+			}
+		}
+
+		auto _it = find_if(_slices.begin(), _slices.end(), [_best](const RouteSlice& s) { return s.market == _best; });
+		if (_it != _slices.end()) _it->quantity += _quantity;
+		else _slices.push_back({ (Market)_best, _quantity });
+	}
+}
+
+template<typename T>
+void SmartOrderRouter<T>::AddChildOrder(const string& _orderId, Market _market, long _quantity)
+{
+	childOrders[_orderId] = { _market, _quantity, 0 };
+}
+
+template<typename T>
+void SmartOrderRouter<T>::OnFill(const ExecutionFill& _fill)
+{
+	auto _it = childOrders.find(_fill.GetOrderId());
+	if (_it == childOrders.end()) return;
+
+	ChildOrderState& _child = _it->second;
+	_child.filledQuantity += _fill.GetQuantity();
+	if (_fill.GetLeavesQuantity() > 0) return;
+
+	double _filled = (double)_child.filledQuantity / (double)_child.quantity;
+	double& _probability = fillProbabilities[_child.market];
+	_probability += fillProbabilityWeight * (_filled - _probability);
+	childOrders.erase(_it);
+}
+
+template<typename T>
+const unordered_map<Identifier, ChildOrderState>& SmartOrderRouter<T>::GetChildOrders() const
+{
+	return childOrders;
+}
+
+template<typename T>
+void SmartOrderRouter<T>::RestoreChildOrder(const string& _orderId, const ChildOrderState& _state)
+{
+	childOrders[_orderId] = _state;
+}
+
+template<typename T>
+double SmartOrderRouter<T>::GetFillProbability(Market _market) const
+{
+	return fillProbabilities[_market];
+}
+
+template<typename T>
+void SmartOrderRouter<T>::SetFillProbability(Market _market, double _probability)
+{
+	fillProbabilities[_market] = _probability;
+}
+
+template<typename T>
+void SmartOrderRouter<T>::SetFillProbabilityWeight(double _weight)
+{
+	fillProbabilityWeight = _weight;
+}
+
+#endif
@@ -0,0 +1,178 @@
+/**
+* snapshottable.hpp
+* Defines the seqlock snapshots of per-product service state for lock-free readers.
+*
+* @author Haonan Lu
+*/
+
+#ifndef SNAPSHOT_TABLE_HPP
+#define SNAPSHOT_TABLE_HPP
+
+#include <string>
+#include <atomic>
+#include <memory>
+#include <cstring>
+#include <cstdint>
+#include <type_traits>
+#include <thread>
+#include "funcs.hpp"
+
+using namespace std;
+
+// Number of product handles a snapshot table covers
+const int MAX_PRODUCTS = 1024;
+
+/**
+* Sequence lock over a trivially copyable value.
+* The writer makes the sequence odd, stores the value and makes it even
+* again; a reader copies the value and retries if the sequence was odd or
+* moved meanwhile. Readers never block the writer and take no lock. The
+* value is kept in atomic words, so a torn copy is discarded, never a data
+* race. There must be one writer at a time.
+* Type V is the value type.
+*/
+template<typename V>
+class alignas(64) SeqLock
+{
+
+	static_assert(is_trivially_copyable<V>::value, "SeqLock needs a trivially copyable value");
+
+public:
+
+	// ctor for an empty lock
+	SeqLock();
+
+	// Store a value, from the single writer
+	void Store(const V& _value);
+
+	// Load a consistent copy of the value, false when none was stored yet
+	bool Load(V& _value) const;
+
+	// Get the number of values stored
+	unsigned GetVersion() const;
+
+private:
+
+	static const size_t WORDS = (sizeof(V) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+	atomic<unsigned> sequence;
+	atomic<uint64_t> words[WORDS];
+
+};
+
+template<typename V>
+SeqLock<V>::SeqLock()
+{
+	sequence.store(0, memory_order_relaxed);
+	for (auto& w : words) w.store(0, memory_order_relaxed);
+}
+
+template<typename V>
+void SeqLock<V>::Store(const V& _value)
+{
+	uint64_t _buffer[WORDS] = {};
+	memcpy(_buffer, &_value, sizeof(V));
+
+	unsigned _sequence = sequence.load(memory_order_relaxed);
+	sequence.store(_sequence + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	for (size_t i = 0; i < WORDS; ++i)
+	{
+		words[i].store(_buffer[i], memory_order_relaxed);
+	}
+	sequence.store(_sequence + 2, memory_order_release);
+}
+
+template<typename V>
+bool SeqLock<V>::Load(V& _value) const
+{
+	uint64_t _buffer[WORDS];
+	while (true)
+	{
+		unsigned _before = sequence.load(memory_order_acquire);
+		if (_before == 0) return false;
+		if (_before & 1)
+		{
+			this_thread::yield();
+			continue;
+		}
+
+		for (size_t i = 0; i < WORDS; ++i)
+		{
+			_buffer[i] = words[i].load(memory_order_relaxed);
+		}
+		atomic_thread_fence(memory_order_acquire);
+		if (sequence.load(memory_order_relaxed) == _before) break;
+	}
+	memcpy(&_value, _buffer, sizeof(V));
+	return true;
+}
+
+template<typename V>
+unsigned SeqLock<V>::GetVersion() const
+{
+	return sequence.load(memory_order_acquire) / 2;
+}
+
+/**
+* Table of seqlock snapshots indexed by product handle.
+* Slots are allocated up front and never move, so readers on any thread can
+* look a product up while the service thread publishes, and each slot sits
+* on its own cache line so products do not contend.
+* Type V is the snapshot type.
+*/
+template<typename V>
+class SnapshotTable
+{
+
+public:
+
+	// ctor for a table of all product handles
+	SnapshotTable();
+
+	// Publish the snapshot of a product
+	void Publish(const string& _productId, const V& _snapshot);
+
+	// Read the snapshot of a product, false when it has none
+	bool Read(const string& _productId, V& _snapshot) const;
+
+	// Get the number of snapshots published for a product
+	unsigned GetVersion(const string& _productId) const;
+
+private:
+
+	unique_ptr<SeqLock<V>[]> slots;
+
+};
+
+template<typename V>
+SnapshotTable<V>::SnapshotTable()
+{
+	slots = unique_ptr<SeqLock<V>[]>(new SeqLock<V>[MAX_PRODUCTS]);
+}
+
+template<typename V>
+void SnapshotTable<V>::Publish(const string& _productId, const V& _snapshot)
+{
+	int _handle = GetProductHandle(_productId);
+	if (_handle >= MAX_PRODUCTS) return;
+	slots[_handle].Store(_snapshot);
+}
+
+template<typename V>
+bool SnapshotTable<V>::Read(const string& _productId, V& _snapshot) const
+{
+	int _handle = GetProductHandle(_productId);
+	if (_handle >= MAX_PRODUCTS) return false;
+	return slots[_handle].Load(_snapshot);
+}
+
+template<typename V>
+unsigned SnapshotTable<V>::GetVersion(const string& _productId) const
+{
+	int _handle = GetProductHandle(_productId);
+	if (_handle >= MAX_PRODUCTS) return 0;
+	return slots[_handle].GetVersion();
+}
+
+#endif
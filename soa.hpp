@@ -15,8 +15,11 @@
 #include <fstream>
 #include <map>
 #include <unordered_map>
+#include <thread>
 #include "products.hpp"
 #include "funcs.hpp"
+#include "timerwheel.hpp"
+#include "executor.hpp"
 
 using namespace std;
 
@@ -31,6 +34,8 @@ class ServiceListener
 
 public:
 
+	virtual ~ServiceListener() = default;
+
 	// Listener callback to process an add event to the Service
 	virtual void ProcessAdd(V& _data) = 0;
 
@@ -81,11 +86,53 @@ class Connector
 
 public:
 
+	virtual ~Connector() = default;
+
 	// Publish data to the Connector
 	virtual void Publish(V & data) = 0;
 
 	// Subscribe data from the Connector
 	virtual void Subscribe(ifstream & data) = 0;
+
+	// Subscribe one line of data from the Connector, for connectors fed line by line
+	virtual void Subscribe(const string & /* line */) {}
+};
+
+// Get the timer wheel of the thread, running on the wall clock unless given another clock.
+TimerWheel& GetTimerWheel()
+{
+	static WallClock _wallClock;
+	thread_local TimerWheel _wheel(&_wallClock);
+	return _wheel;
+}
+
+// Fire the timers due on the timer wheel of the thread.
+long PollTimers()
+{
+	return GetTimerWheel().Poll();
+}
+
+// Get the executor shared by all services, inline until configured.
+Executor& GetExecutor()
+{
+	static Executor _executor;
+	return _executor;
+}
+
+/**
+* Sequence of IDs generated on a thread: the seed and the number of IDs drawn from it.
+*/
+struct IdSequence
+{
+	uint64_t seed;
+	uint64_t count;
 };
 
+// Get the ID sequence of the thread, seeded at random unless seeded again, e.g. by a replay.
+IdSequence& GetIdSequence()
+{
+	thread_local IdSequence _sequence = { (uint64_t)steady_clock::now().time_since_epoch().count() ^ hash<thread::id>()(this_thread::get_id()), 0 };
+	return _sequence;
+}
+
 #endif
@@ -0,0 +1,512 @@
+/**
+* statestore.hpp
+* Defines the columnar store mirroring the live per-product state of the services.
+*
+* @author Haonan Lu
+*/
+
+#ifndef STATE_STORE_HPP
+#define STATE_STORE_HPP
+
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+#include "soa.hpp"
+#include "snapshottable.hpp"
+#include "pricingservice.hpp"
+#include "marketdataservice.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+
+using namespace std;
+
+// Books positions are kept in, one position column each
+const int BOOK_COUNT = 3;
+const string BOOKS[BOOK_COUNT] = { "TRSY1", "TRSY2", "TRSY3" };
+
+/**
+* Columns of per-product state, one array per field indexed by product
+* handle. Each array is cache-line aligned and contiguous, so a scan over
+* one field reads only that field and vectorizes.
+*/
+struct StateColumns
+{
+	alignas(64) double mid[MAX_PRODUCTS];
+	alignas(64) double spread[MAX_PRODUCTS];
+	alignas(64) double bestBid[MAX_PRODUCTS];
+	alignas(64) double bestOffer[MAX_PRODUCTS];
+	alignas(64) long bestBidQuantity[MAX_PRODUCTS];
+	alignas(64) long bestOfferQuantity[MAX_PRODUCTS];
+	alignas(64) long positions[BOOK_COUNT][MAX_PRODUCTS];
+	alignas(64) long aggregatePosition[MAX_PRODUCTS];
+	alignas(64) double pv01[MAX_PRODUCTS];
+	alignas(64) double risk[MAX_PRODUCTS];
+};
+
+// Pre-declearations
+template<typename T>
+class StateToPricingListener;
+template<typename T>
+class StateToMarketDataListener;
+template<typename T>
+class StateToPositionListener;
+template<typename T>
+class StateToRiskListener;
+
+/**
+* Structure-of-arrays mirror of the latest price, best bid/offer, positions
+* per book and risk of every product, kept current by listeners on the
+* pricing, market data, position and risk services. Reports and risk
+* scenarios scan the columns linearly instead of walking the service maps.
+* Each field of a product has one writer, the thread running the service
+* feeding it, or the shard owning the product when several shards feed the
+* same field; handles are claimed atomically and the store takes no lock, so scan it from that thread or once the queues
+* feeding it are drained. Readers on other threads use the snapshots of
+* the services instead.
+* Type T is the product type.
+*/
+template<typename T>
+class StateStore
+{
+
+private:
+
+	unique_ptr<StateColumns> columns;
+	atomic<int> productCount;
+	StateToPricingListener<T>* pricingListener;
+	StateToMarketDataListener<T>* marketDataListener;
+	StateToPositionListener<T>* positionListener;
+	StateToRiskListener<T>* riskListener;
+
+	// Get the handle of a product, counting it in the scans, -1 when the store is full
+	int GetHandle(const string& _productId);
+
+public:
+
+	// Constructor and destructor
+	StateStore();
+	~StateStore();
+
+	// Update the price of a product
+	void UpdatePrice(const Price<T>& _price);
+
+	// Update the best bid/offer of a product from its order book
+	void UpdateBidOffer(const OrderBook<T>& _orderBook);
+
+	// Update the positions of a product
+	void UpdatePosition(Position<T>& _position);
+
+	// Update the risk of a product
+	void UpdateRisk(const PV01<T>& _pv01);
+
+	// Get the number of product handles the scans cover
+	int GetProductCount() const;
+
+	// Get the columns, indexed by product handle
+	const StateColumns& GetColumns() const;
+
+	// Get the aggregate position over all products and books
+	long GetTotalPosition() const;
+
+	// Get the position of a book over all products
+	long GetBookPosition(const string& _book) const;
+
+	// Get the risk over all products
+	double GetTotalRisk() const;
+
+	// Get the bucketed risk for the bucket sector
+	PV01<BucketedSector<T>> GetBucketedRisk(const BucketedSector<T>& _sector) const;
+
+	// Get the change in value for a yield shift per product handle, in basis points
+	double GetScenarioPnl(const vector<double>& _shifts) const;
+
+	// Get the listener on the pricing service
+	StateToPricingListener<T>* GetPricingListener();
+
+	// Get the listener on the market data service
+	StateToMarketDataListener<T>* GetMarketDataListener();
+
+	// Get the listener on the position service
+	StateToPositionListener<T>* GetPositionListener();
+
+	// Get the listener on the risk service
+	StateToRiskListener<T>* GetRiskListener();
+
+};
+
+template<typename T>
+StateStore<T>::StateStore()
+{
+	columns = unique_ptr<StateColumns>(new StateColumns());
+	productCount.store(0, memory_order_relaxed);
+	pricingListener = new StateToPricingListener<T>(this);
+	marketDataListener = new StateToMarketDataListener<T>(this);
+	positionListener = new StateToPositionListener<T>(this);
+	riskListener = new StateToRiskListener<T>(this);
+}
+
+template<typename T>
+StateStore<T>::~StateStore() {}
+
+template<typename T>
+int StateStore<T>::GetHandle(const string& _productId)
+{
+	int _handle = GetProductHandle(_productId);
+	if (_handle >= MAX_PRODUCTS) return -1;
+
+	int _count = productCount.load(memory_order_relaxed);
+	while (_count <= _handle && !productCount.compare_exchange_weak(_count, _handle + 1, memory_order_relaxed));
+	return _handle;
+}
+
+template<typename T>
+void StateStore<T>::UpdatePrice(const Price<T>& _price)
+{
+	int _handle = GetHandle(_price.GetProduct().GetProductId());
+	if (_handle < 0) return;
+	columns->mid[_handle] = _price.GetMid();
+	columns->spread[_handle] = _price.GetBidOfferSpread();
+}
+
+template<typename T>
+void StateStore<T>::UpdateBidOffer(const OrderBook<T>& _orderBook)
+{
+	int _handle = GetHandle(_orderBook.GetProduct().GetProductId());
+	if (_handle < 0) return;
+	BidOffer _bidOffer = _orderBook.GetBidOffer();
+	columns->bestBid[_handle] = _bidOffer.GetBidOrder().GetPrice();
+	columns->bestOffer[_handle] = _bidOffer.GetOfferOrder().GetPrice();
+	columns->bestBidQuantity[_handle] = _bidOffer.GetBidOrder().GetQuantity();
+	columns->bestOfferQuantity[_handle] = _bidOffer.GetOfferOrder().GetQuantity();
+}
+
+template<typename T>
+void StateStore<T>::UpdatePosition(Position<T>& _position)
+{
+	int _handle = GetHandle(_position.GetProduct().GetProductId());
+	if (_handle < 0) return;
+	map<string, long> _positions = _position.GetPositions();
+	for (int i = 0; i < BOOK_COUNT; ++i)
+	{
+		auto _it = _positions.find(BOOKS[i]);
+		columns->positions[i][_handle] = _it == _positions.end() ? 0 : _it->second;
+	}
+	columns->aggregatePosition[_handle] = _position.GetAggregatePosition();
+}
+
+template<typename T>
+void StateStore<T>::UpdateRisk(const PV01<T>& _pv01)
+{
+	int _handle = GetHandle(_pv01.GetProduct().GetProductId());
+	if (_handle < 0) return;
+	columns->pv01[_handle] = _pv01.GetPV01();
+	columns->risk[_handle] = _pv01.GetPV01() * _pv01.GetQuantity();
+}
+
+template<typename T>
+int StateStore<T>::GetProductCount() const
+{
+	return productCount.load(memory_order_relaxed);
+}
+
+template<typename T>
+const StateColumns& StateStore<T>::GetColumns() const
+{
+	return *columns;
+}
+
+template<typename T>
+long StateStore<T>::GetTotalPosition() const
+{
+	const long* _positions = columns->aggregatePosition;
+	int _count = GetProductCount();
+	long _total = 0;
+	for (int i = 0; i < _count; ++i) _total += _positions[i];
+	return _total;
+}
+
+template<typename T>
+long StateStore<T>::GetBookPosition(const string& _book) const
+{
+	const string* _it = find(BOOKS, BOOKS + BOOK_COUNT, _book);
+	if (_it == BOOKS + BOOK_COUNT) return 0;
+
+	const long* _positions = columns->positions[_it - BOOKS];
+	int _count = GetProductCount();
+	long _total = 0;
+	for (int i = 0; i < _count; ++i) _total += _positions[i];
+	return _total;
+}
+
+template<typename T>
+double StateStore<T>::GetTotalRisk() const
+{
+	const double* _risk = columns->risk;
+	int _count = GetProductCount();
+	double _total = 0;
+	for (int i = 0; i < _count; ++i) _total += _risk[i];
+	return _total;
+}
+
+template<typename T>
+PV01<BucketedSector<T>> StateStore<T>::GetBucketedRisk(const BucketedSector<T>& _sector) const
+{
+	double _pv01 = 0;
+	for (auto& p : _sector.GetProducts())
+	{
+		int _handle = GetProductHandle(p.GetProductId());
+		if (_handle < GetProductCount()) _pv01 += columns->risk[_handle];
+	}
+	return PV01<BucketedSector<T>>(_sector, _pv01, 1);
+}
+
+template<typename T>
+double StateStore<T>::GetScenarioPnl(const vector<double>& _shifts) const
+{
+	const double* _risk = columns->risk;
+	int _count = min(GetProductCount(), (int)_shifts.size());
+	double _pnl = 0;
+	for (int i = 0; i < _count; ++i) _pnl -= _risk[i] * _shifts[i];
+	return _pnl;
+}
+
+template<typename T>
+StateToPricingListener<T>* StateStore<T>::GetPricingListener()
+{
+	return pricingListener;
+}
+
+template<typename T>
+StateToMarketDataListener<T>* StateStore<T>::GetMarketDataListener()
+{
+	return marketDataListener;
+}
+
+template<typename T>
+StateToPositionListener<T>* StateStore<T>::GetPositionListener()
+{
+	return positionListener;
+}
+
+template<typename T>
+StateToRiskListener<T>* StateStore<T>::GetRiskListener()
+{
+	return riskListener;
+}
+
+/**
+* State Store Listener subscribing data from Pricing Service to State Store.
+* Type T is the product type.
+*/
+template<typename T>
+class StateToPricingListener : public ServiceListener<Price<T>>
+{
+
+private:
+
+	StateStore<T>* store;
+
+public:
+
+	// Connector and Destructor
+	StateToPricingListener(StateStore<T>* _store);
+	~StateToPricingListener();
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(Price<T>& _data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(Price<T>& _data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(Price<T>& _data);
+
+};
+
+template<typename T>
+StateToPricingListener<T>::StateToPricingListener(StateStore<T>* _store)
+{
+	store = _store;
+}
+
+template<typename T>
+StateToPricingListener<T>::~StateToPricingListener() {}
+
+template<typename T>
+void StateToPricingListener<T>::ProcessAdd(Price<T>& _data)
+{
+	store->UpdatePrice(_data);
+}
+
+template<typename T>
+void StateToPricingListener<T>::ProcessRemove(Price<T>& _data) {}
+
+template<typename T>
+void StateToPricingListener<T>::ProcessUpdate(Price<T>& _data)
+{
+	store->UpdatePrice(_data);
+}
+
+/**
+* State Store Listener subscribing data from Market Data Service to State Store.
+* Type T is the product type.
+*/
+template<typename T>
+class StateToMarketDataListener : public ServiceListener<OrderBook<T>>
+{
+
+private:
+
+	StateStore<T>* store;
+
+public:
+
+	// Connector and Destructor
+	StateToMarketDataListener(StateStore<T>* _store);
+	~StateToMarketDataListener();
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(OrderBook<T>& _data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(OrderBook<T>& _data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(OrderBook<T>& _data);
+
+};
+
+template<typename T>
+StateToMarketDataListener<T>::StateToMarketDataListener(StateStore<T>* _store)
+{
+	store = _store;
+}
+
+template<typename T>
+StateToMarketDataListener<T>::~StateToMarketDataListener() {}
+
+template<typename T>
+void StateToMarketDataListener<T>::ProcessAdd(OrderBook<T>& _data)
+{
+	store->UpdateBidOffer(_data);
+}
+
+template<typename T>
+void StateToMarketDataListener<T>::ProcessRemove(OrderBook<T>& _data) {}
+
+template<typename T>
+void StateToMarketDataListener<T>::ProcessUpdate(OrderBook<T>& _data)
+{
+	store->UpdateBidOffer(_data);
+}
+
+/**
+* State Store Listener subscribing data from Position Service to State Store.
+* Type T is the product type.
+*/
+template<typename T>
+class StateToPositionListener : public ServiceListener<Position<T>>
+{
+
+private:
+
+	StateStore<T>* store;
+
+public:
+
+	// Connector and Destructor
+	StateToPositionListener(StateStore<T>* _store);
+	~StateToPositionListener();
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(Position<T>& _data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(Position<T>& _data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(Position<T>& _data);
+
+};
+
+template<typename T>
+StateToPositionListener<T>::StateToPositionListener(StateStore<T>* _store)
+{
+	store = _store;
+}
+
+template<typename T>
+StateToPositionListener<T>::~StateToPositionListener() {}
+
+template<typename T>
+void StateToPositionListener<T>::ProcessAdd(Position<T>& _data)
+{
+	store->UpdatePosition(_data);
+}
+
+template<typename T>
+void StateToPositionListener<T>::ProcessRemove(Position<T>& _data) {}
+
+template<typename T>
+void StateToPositionListener<T>::ProcessUpdate(Position<T>& _data)
+{
+	store->UpdatePosition(_data);
+}
+
+/**
+* State Store Listener subscribing data from Risk Service to State Store.
+* Type T is the product type.
+*/
+template<typename T>
+class StateToRiskListener : public ServiceListener<PV01<T>>
+{
+
+private:
+
+	StateStore<T>* store;
+
+public:
+
+	// Connector and Destructor
+	StateToRiskListener(StateStore<T>* _store);
+	~StateToRiskListener();
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(PV01<T>& _data);
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(PV01<T>& _data);
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(PV01<T>& _data);
+
+};
+
+template<typename T>
+StateToRiskListener<T>::StateToRiskListener(StateStore<T>* _store)
+{
+	store = _store;
+}
+
+template<typename T>
+StateToRiskListener<T>::~StateToRiskListener() {}
+
+template<typename T>
+void StateToRiskListener<T>::ProcessAdd(PV01<T>& _data)
+{
+	store->UpdateRisk(_data);
+}
+
+template<typename T>
+void StateToRiskListener<T>::ProcessRemove(PV01<T>& _data) {}
+
+template<typename T>
+void StateToRiskListener<T>::ProcessUpdate(PV01<T>& _data)
+{
+	store->UpdateRisk(_data);
+}
+
+#endif
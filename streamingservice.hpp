@@ -9,11 +9,44 @@
 #ifndef STREAMING_SERVICE_HPP
 #define STREAMING_SERVICE_HPP
 
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <cerrno>
+#include <climits>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
 #include "soa.hpp"
 #include "algostreamingservice.hpp"
 
+// Client tiers for streaming sessions
+enum ClientTier { TIER1, TIER2, TIER3 };
+
+/**
+* Conflation state of one product: the last stream sent to listeners
+* and the latest stream held back inside the conflation window.
+* Type T is the product type.
+*/
+template<typename T>
+struct ConflationState
+{
+	PriceStream<T> published;
+	PriceStream<T> pending;
+	bool hasPublished = false;
+	bool hasPending = false;
+	long publishedTime = 0;
+	TimerHandle flushTimer;
+};
+
 // Pre-declearations to avoid errors.
 template<typename T>
+class StreamingConnector;
+template<typename T>
 class StreamingToAlgoStreamingListener;
 
 /**
@@ -27,9 +60,21 @@ class StreamingService : public Service<string, PriceStream<T>>
 
 private:
 
-	map<string, PriceStream<T>> priceStreams;
+	map<Identifier, PriceStream<T>> priceStreams;
 	vector<ServiceListener<PriceStream<T>>*> listeners;
+	StreamingConnector<T>* connector;
 	ServiceListener<AlgoStream<T>>* listener;
+	unordered_map<Identifier, ConflationState<T>> conflations;
+	long conflationWindow;
+	long publishedCount;
+	long suppressedCount;
+	long conflatedCount;
+
+	// Send a price stream to listeners and remember it as the last published
+	void Send(ConflationState<T>& _state, PriceStream<T>& _priceStream);
+
+	// Publish the price stream of a product held back by the conflation window
+	void FlushPrice(const string& _productId);
 
 public:
 
@@ -49,20 +94,53 @@ public:
 	// Get all listeners on the Service
 	const vector<ServiceListener<PriceStream<T>>*>& GetListeners() const;
 
+	// Get the connector of the service
+	StreamingConnector<T>* GetConnector();
+
 	// Get the listener of the service
 	ServiceListener<AlgoStream<T>>* GetListener();
 
 	// Publish two-way prices
 	void PublishPrice(PriceStream<T>& _priceStream);
 
+	// Publish all price streams held back by the conflation window
+	void FlushPrices();
+
+	// Get the conflation window in microseconds
+	long GetConflationWindow() const;
+
+	// Set the conflation window in microseconds, zero only suppresses unchanged quotes
+	void SetConflationWindow(long _conflationWindow);
+
+	// Get the number of price streams sent to listeners
+	long GetPublishedCount() const;
+
+	// Get the number of price streams suppressed as unchanged
+	long GetSuppressedCount() const;
+
+	// Get the number of price streams replaced inside the conflation window
+	long GetConflatedCount() const;
+
+	// Get the conflation state of each product
+	const unordered_map<Identifier, ConflationState<T>>& GetConflations() const;
+
+	// Restore the last price stream of a product sent to listeners and when it was sent, when restoring the service
+	void RestorePublished(const PriceStream<T>& _priceStream, long _time);
+
 };
 
 template<typename T>
 StreamingService<T>::StreamingService()
 {
-	priceStreams = map<string, PriceStream<T>>();
+	priceStreams = map<Identifier, PriceStream<T>>();
 	listeners = vector<ServiceListener<PriceStream<T>>*>();
+	connector = new StreamingConnector<T>(this);
 	listener = new StreamingToAlgoStreamingListener<T>(this);
+	conflations = unordered_map<Identifier, ConflationState<T>>();
+	conflationWindow = 0;
+	publishedCount = 0;
+	suppressedCount = 0;
+	conflatedCount = 0;
 }
 
 template<typename T>
@@ -92,6 +170,12 @@ const vector<ServiceListener<PriceStream<T>>*>& StreamingService<T>::GetListener
 	return listeners;
 }
 
+template<typename T>
+StreamingConnector<T>* StreamingService<T>::GetConnector()
+{
+	return connector;
+}
+
 template<typename T>
 ServiceListener<AlgoStream<T>>* StreamingService<T>::GetListener()
 {
@@ -101,12 +185,657 @@ ServiceListener<AlgoStream<T>>* StreamingService<T>::GetListener()
 template<typename T>
 void StreamingService<T>::PublishPrice(PriceStream<T>& _priceStream)
 {
+	const string& _productId = _priceStream.GetProduct().GetProductId();
+	ConflationState<T>& _state = conflations[_productId];
+	TimerWheel& _wheel = GetTimerWheel();
+	bool _unchanged = _state.hasPublished
+		&& _state.published.GetBidOrder() == _priceStream.GetBidOrder()
+		&& _state.published.GetOfferOrder() == _priceStream.GetOfferOrder();
+	if (_unchanged)
+	{
+		// The quote went back to what clients already have, so any held quote is stale.
+		if (_state.hasPending) conflatedCount++;
+		_state.hasPending = false;
+		_wheel.Cancel(_state.flushTimer);
+		suppressedCount++;
+		return;
+	}
+
+	if (conflationWindow > 0 && _state.hasPublished)
+	{
+		long _elapsed = _wheel.Now() - _state.publishedTime;
+		if (_elapsed < conflationWindow)
+		{
+			// The held stream goes out when the window closes unless a newer one replaces it first.
+			if (_state.hasPending) conflatedCount++;
+			else _state.flushTimer = _wheel.Schedule(_state.publishedTime + conflationWindow, [this, _productId]() { FlushPrice(_productId); });
+			_state.pending = _priceStream;
+			_state.hasPending = true;
+			return;
+		}
+	}
+
+	if (_state.hasPending) conflatedCount++;
+	_state.hasPending = false;
+	_wheel.Cancel(_state.flushTimer);
+	Send(_state, _priceStream);
+}
+
+template<typename T>
+void StreamingService<T>::Send(ConflationState<T>& _state, PriceStream<T>& _priceStream)
+{
+	_state.published = _priceStream;
+	_state.hasPublished = true;
+	_state.publishedTime = GetTimerWheel().Now();
+	publishedCount++;
+	connector->Publish(_priceStream);
+
 	for (auto& l : listeners)
 	{
 		l->ProcessAdd(_priceStream);
 	}
 }
 
+template<typename T>
+void StreamingService<T>::FlushPrice(const string& _productId)
+{
+	ConflationState<T>& _state = conflations[_productId];
+	if (!_state.hasPending) return;
+
+	_state.hasPending = false;
+	PriceStream<T> _priceStream = _state.pending;
+	Send(_state, _priceStream);
+}
+
+template<typename T>
+void StreamingService<T>::FlushPrices()
+{
+	for (auto& c : conflations)
+	{
+		ConflationState<T>& _state = c.second;
+		if (!_state.hasPending) continue;
+
+		GetTimerWheel().Cancel(_state.flushTimer);
+		_state.hasPending = false;
+		PriceStream<T> _priceStream = _state.pending;
+		Send(_state, _priceStream);
+	}
+	connector->Flush();
+}
+
+template<typename T>
+long StreamingService<T>::GetConflationWindow() const
+{
+	return conflationWindow;
+}
+
+template<typename T>
+void StreamingService<T>::SetConflationWindow(long _conflationWindow)
+{
+	conflationWindow = _conflationWindow;
+}
+
+template<typename T>
+long StreamingService<T>::GetPublishedCount() const
+{
+	return publishedCount;
+}
+
+template<typename T>
+long StreamingService<T>::GetSuppressedCount() const
+{
+	return suppressedCount;
+}
+
+template<typename T>
+long StreamingService<T>::GetConflatedCount() const
+{
+	return conflatedCount;
+}
+
+template<typename T>
+const unordered_map<Identifier, ConflationState<T>>& StreamingService<T>::GetConflations() const
+{
+	return conflations;
+}
+
+template<typename T>
+void StreamingService<T>::RestorePublished(const PriceStream<T>& _priceStream, long _time)
+{
+	ConflationState<T>& _state = conflations[_priceStream.GetProduct().GetProductId()];
+	_state.published = _priceStream;
+	_state.hasPublished = true;
+	_state.publishedTime = _time;
+}
+
+/**
+* A client session of the streaming publisher over a local Unix domain socket.
+* Frames are shared by reference with every other session and never copied;
+* queued frames are written with a single gathered write per flush.
+*/
+class StreamingSession
+{
+
+public:
+
+	// ctor for a session
+	StreamingSession(int _sessionId, ClientTier _tier, long _throttle);
+	~StreamingSession();
+
+	// Get the session ID
+	int GetSessionId() const;
+
+	// Get the client tier
+	ClientTier GetTier() const;
+
+	// Get the minimum interval between updates of a product in microseconds
+	long GetThrottle() const;
+
+	// Set the minimum interval between updates of a product in microseconds
+	void SetThrottle(long _throttle);
+
+	// Get the client end of the socket
+	int GetClientSocket() const;
+
+	// Entitle the client to a product
+	void Entitle(const string& _productId);
+
+	// Entitle the client to all products
+	void EntitleAll();
+
+	// Is the client entitled to a product handle?
+	bool IsEntitled(int _handle) const;
+
+	// Queue a frame of a product, holding it back while the product is throttled
+	void Enqueue(int _handle, const shared_ptr<const string>& _frame, steady_clock::time_point _now);
+
+	// Write queued frames to the socket
+	void Flush(steady_clock::time_point _now);
+
+	// Get the number of frames written
+	long GetSentCount() const;
+
+	// Get the number of frames replaced while throttled
+	long GetThrottledCount() const;
+
+	// Get the number of frames dropped because the client fell behind
+	long GetDroppedCount() const;
+
+	// Get the number of frames queued and not yet written
+	long GetQueuedCount() const;
+
+private:
+	int sessionId;
+	ClientTier tier;
+	long throttle;
+	int socket;
+	int clientSocket;
+	bool allProducts;
+	vector<char> entitlements;
+	vector<steady_clock::time_point> sentTimes;
+	vector<shared_ptr<const string>> heldFrames;
+	long heldCount;
+	deque<shared_ptr<const string>> outbox;
+	size_t outboxOffset;
+	size_t maxOutbox;
+	long sentCount;
+	long throttledCount;
+	long droppedCount;
+
+	// Push a frame to the outbox, dropping the oldest unsent frame when full
+	void Push(int _handle, const shared_ptr<const string>& _frame, steady_clock::time_point _now);
+
+};
+
+StreamingSession::StreamingSession(int _sessionId, ClientTier _tier, long _throttle)
+{
+	sessionId = _sessionId;
+	tier = _tier;
+	throttle = _throttle;
+	allProducts = false;
+	heldCount = 0;
+	outboxOffset = 0;
+	maxOutbox = 4096;
+	sentCount = 0;
+	throttledCount = 0;
+	droppedCount = 0;
+
+	int _sockets[2];
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, _sockets) == 0)
+	{
+		socket = _sockets[0];
+		clientSocket = _sockets[1];
+	}
+	else
+	{
+		socket = -1;
+		clientSocket = -1;
+	}
+}
+
+StreamingSession::~StreamingSession()
+{
+	if (socket >= 0) close(socket);
+	if (clientSocket >= 0) close(clientSocket);
+}
+
+int StreamingSession::GetSessionId() const
+{
+	return sessionId;
+}
+
+ClientTier StreamingSession::GetTier() const
+{
+	return tier;
+}
+
+long StreamingSession::GetThrottle() const
+{
+	return throttle;
+}
+
+void StreamingSession::SetThrottle(long _throttle)
+{
+	throttle = _throttle;
+}
+
+int StreamingSession::GetClientSocket() const
+{
+	return clientSocket;
+}
+
+void StreamingSession::Entitle(const string& _productId)
+{
+	int _handle = GetProductHandle(_productId);
+	if ((int)entitlements.size() <= _handle) entitlements.resize(_handle + 1, 0);
+	entitlements[_handle] = 1;
+}
+
+void StreamingSession::EntitleAll()
+{
+	allProducts = true;
+}
+
+bool StreamingSession::IsEntitled(int _handle) const
+{
+	return allProducts || (_handle < (int)entitlements.size() && entitlements[_handle]);
+}
+
+void StreamingSession::Enqueue(int _handle, const shared_ptr<const string>& _frame, steady_clock::time_point _now)
+{
+	if (!IsEntitled(_handle)) return;
+	if ((int)sentTimes.size() <= _handle)
+	{
+		sentTimes.resize(_handle + 1);
+		heldFrames.resize(_handle + 1);
+	}
+
+	long _elapsed = duration_cast<microseconds>(_now - sentTimes[_handle]).count();
+	if (throttle > 0 && _elapsed < throttle)
+	{
+		if (heldFrames[_handle]) throttledCount++;
+		else heldCount++;
+		heldFrames[_handle] = _frame;
+		return;
+	}
+
+	if (heldFrames[_handle])
+	{
+		heldFrames[_handle].reset();
+		heldCount--;
+		throttledCount++;
+	}
+	Push(_handle, _frame, _now);
+}
+
+void StreamingSession::Push(int _handle, const shared_ptr<const string>& _frame, steady_clock::time_point _now)
+{
+	sentTimes[_handle] = _now;
+	outbox.push_back(_frame);
+	if (outbox.size() > maxOutbox)
+	{
+		// Never drop a frame the client has partially received.
+		auto _oldest = outboxOffset > 0 ? outbox.begin() + 1 : outbox.begin();
+		outbox.erase(_oldest);
+		droppedCount++;
+	}
+}
+
+void StreamingSession::Flush(steady_clock::time_point _now)
+{
+	if (heldCount > 0)
+	{
+		for (int h = 0; h < (int)heldFrames.size(); ++h)
+		{
+			if (!heldFrames[h]) continue;
+			if (duration_cast<microseconds>(_now - sentTimes[h]).count() < throttle) continue;
+
+			Push(h, heldFrames[h], _now);
+			heldFrames[h].reset();
+			heldCount--;
+		}
+	}
+
+	while (!outbox.empty() && socket >= 0)
+	{
+		iovec _iov[IOV_MAX];
+		int _count = 0;
+		for (auto& f : outbox)
+		{
+			if (_count == IOV_MAX) break;
+			size_t _offset = _count == 0 ? outboxOffset : 0;
+			_iov[_count].iov_base = (void*)(f->data() + _offset);
+			_iov[_count].iov_len = f->size() - _offset;
+			_count++;
+		}
+
+		msghdr _message = {};
+		_message.msg_iov = _iov;
+		_message.msg_iovlen = _count;
+		ssize_t _written = sendmsg(socket, &_message, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (_written <= 0) break;
+
+		size_t _remaining = (size_t)_written;
+		while (_remaining > 0)
+		{
+			size_t _left = outbox.front()->size() - outboxOffset;
+			if (_remaining < _left)
+			{
+				outboxOffset += _remaining;
+				break;
+			}
+			_remaining -= _left;
+			outbox.pop_front();
+			outboxOffset = 0;
+			sentCount++;
+		}
+	}
+}
+
+long StreamingSession::GetSentCount() const
+{
+	return sentCount;
+}
+
+long StreamingSession::GetThrottledCount() const
+{
+	return throttledCount;
+}
+
+long StreamingSession::GetDroppedCount() const
+{
+	return droppedCount;
+}
+
+long StreamingSession::GetQueuedCount() const
+{
+	return (long)outbox.size();
+}
+
+/**
+* A local client of a streaming session reading frames from the client end of its socket.
+* Once started it reads on its own thread, so the session can keep writing to it;
+* a client not started reads only when asked, like a client that stalls.
+* Frames are counted by product, the first field of each line.
+*/
+class StreamingClient
+{
+
+public:
+
+	// ctor for a client of a session
+	StreamingClient(StreamingSession* _session);
+	~StreamingClient();
+
+	// Start reading on a thread of the client
+	void Start();
+
+	// Stop the reading thread once it has read all frames written so far
+	void Stop();
+
+	// Read the frames written so far without waiting and return how many
+	long Read();
+
+	// Get the session of the client
+	StreamingSession* GetSession() const;
+
+	// Get the number of frames received
+	long GetFrameCount() const;
+
+	// Get the number of frames of a product received
+	long GetFrameCount(const string& _productId) const;
+
+	// Get the last frame received, without its line end
+	string GetLastFrame() const;
+
+private:
+
+	StreamingSession* session;
+	thread reader;
+	atomic<bool> isRunning;
+	mutable mutex lock;
+	string partial;
+	string lastFrame;
+	unordered_map<string, long> productCounts;
+	long frameCount;
+
+};
+
+StreamingClient::StreamingClient(StreamingSession* _session)
+{
+	session = _session;
+	isRunning = false;
+	frameCount = 0;
+}
+
+StreamingClient::~StreamingClient()
+{
+	Stop();
+}
+
+void StreamingClient::Start()
+{
+	if (isRunning) return;
+	isRunning = true;
+	reader = thread([this]()
+	{
+		pollfd _poll = { session->GetClientSocket(), POLLIN, 0 };
+		while (isRunning)
+		{
+			if (poll(&_poll, 1, 10) > 0) Read();
+		}
+	});
+}
+
+void StreamingClient::Stop()
+{
+	if (!isRunning) return;
+	isRunning = false;
+	reader.join();
+	Read();
+}
+
+long StreamingClient::Read()
+{
+	lock_guard<mutex> _lock(lock);
+	int _socket = session->GetClientSocket();
+	if (_socket < 0) return 0;
+
+	long _count = 0;
+	char _buffer[65536];
+	ssize_t _read;
+	while ((_read = recv(_socket, _buffer, sizeof(_buffer), MSG_DONTWAIT)) > 0)
+	{
+		partial.append(_buffer, (size_t)_read);
+		size_t _start = 0;
+		size_t _end;
+		while ((_end = partial.find('\n', _start)) != string::npos)
+		{
+			lastFrame = partial.substr(_start, _end - _start);
+			productCounts[lastFrame.substr(0, lastFrame.find(','))]++;
+			frameCount++;
+			_count++;
+			_start = _end + 1;
+		}
+		partial.erase(0, _start);
+	}
+	return _count;
+}
+
+StreamingSession* StreamingClient::GetSession() const
+{
+	return session;
+}
+
+long StreamingClient::GetFrameCount() const
+{
+	lock_guard<mutex> _lock(lock);
+	return frameCount;
+}
+
+long StreamingClient::GetFrameCount(const string& _productId) const
+{
+	lock_guard<mutex> _lock(lock);
+	auto _it = productCounts.find(_productId);
+	return _it == productCounts.end() ? 0 : _it->second;
+}
+
+string StreamingClient::GetLastFrame() const
+{
+	lock_guard<mutex> _lock(lock);
+	return lastFrame;
+}
+
+/**
+* Streaming Connector publishing price streams from Streaming Service to client sessions.
+* Each update is encoded once and the same buffer is shared by all sessions.
+* Type T is the product type.
+*/
+template<typename T>
+class StreamingConnector : public Connector<PriceStream<T>>
+{
+
+private:
+
+	StreamingService<T>* service;
+	vector<StreamingSession*> sessions;
+	long batchSize;
+	long batchCount;
+
+public:
+
+	// Connector and Destructor
+	StreamingConnector(StreamingService<T>* _service);
+	~StreamingConnector();
+
+	// Publish data to the Connector
+	void Publish(PriceStream<T>& _data);
+
+	// Subscribe data from the Connector
+	void Subscribe(ifstream& _data);
+
+	// Add a client session with the default throttle of its tier
+	StreamingSession* AddSession(ClientTier _tier);
+
+	// Get all client sessions
+	const vector<StreamingSession*>& GetSessions() const;
+
+	// Set the number of updates between socket flushes
+	void SetBatchSize(long _batchSize);
+
+	// Write queued frames of all sessions
+	void Flush();
+
+};
+
+template<typename T>
+StreamingConnector<T>::StreamingConnector(StreamingService<T>* _service)
+{
+	service = _service;
+	sessions = vector<StreamingSession*>();
+	batchSize = 64;
+	batchCount = 0;
+}
+
+template<typename T>
+StreamingConnector<T>::~StreamingConnector()
+{
+	for (auto& s : sessions) delete s;
+}
+
+template<typename T>
+void StreamingConnector<T>::Publish(PriceStream<T>& _data)
+{
+	if (sessions.empty()) return;
+
+	string _encoded;
+	vector<string> _strings = _data.ToStrings();
+	for (auto& s : _strings)
+	{
+		_encoded += s;
+		_encoded += ",";
+	}
+	_encoded.back() = '\n';
+	shared_ptr<const string> _frame = make_shared<const string>(move(_encoded));
+
+	int _handle = GetProductHandle(_data.GetProduct().GetProductId());
+	steady_clock::time_point _now = steady_clock::now();
+	for (auto& s : sessions)
+	{
+		s->Enqueue(_handle, _frame, _now);
+	}
+
+	if (++batchCount >= batchSize) Flush();
+}
+
+template<typename T>
+void StreamingConnector<T>::Subscribe(ifstream& _data) {}
+
+template<typename T>
+StreamingSession* StreamingConnector<T>::AddSession(ClientTier _tier)
+{
+	long _throttle = 0;
+	switch (_tier)
+	{
+	case TIER1:
+		_throttle = 0;
+		break;
+	case TIER2:
+		_throttle = 100000;
+		break;
+	case TIER3:
+		_throttle = 1000000;
+		break;
+	}
+
+	StreamingSession* _session = new StreamingSession((int)sessions.size(), _tier, _throttle);
+	sessions.push_back(_session);
+	return _session;
+}
+
+template<typename T>
+const vector<StreamingSession*>& StreamingConnector<T>::GetSessions() const
+{
+	return sessions;
+}
+
+template<typename T>
+void StreamingConnector<T>::SetBatchSize(long _batchSize)
+{
+	batchSize = _batchSize;
+}
+
+template<typename T>
+void StreamingConnector<T>::Flush()
+{
+	batchCount = 0;
+	steady_clock::time_point _now = steady_clock::now();
+	for (auto& s : sessions)
+	{
+		s->Flush(_now);
+	}
+}
+
 /**
 * Streaming Service Listener subscribing data from Algo Streaming Service to Streaming Service.
 * Type T is the product type.
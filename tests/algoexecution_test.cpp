@@ -0,0 +1,213 @@
+/**
+* algoexecution_test.cpp
+* Tests that parent orders worked by the execution algorithms on a virtual
+* clock send child orders of the expected quantities against fixed books,
+* are released once filled or cancelled with their slots reused, and stay
+* within a participation cap of the quantity executed in the product.
+*
+* @author Haonan Lu
+*/
+
+#include "check.hpp"
+#include "algoexecutionservice.hpp"
+
+const string PRODUCT_ID = "91282CJJ1";
+const long START = 1000000000;
+const long SECOND = 1000000;
+
+/**
+* Listener keeping the child orders sent, filling each at once up to a fill quantity.
+*/
+class ChildCapture : public ServiceListener<AlgoExecution<Bond>>
+{
+
+public:
+
+	AlgoExecutionService<Bond>* service;
+	long fillQuantity;
+	vector<ExecutionOrder<Bond>> children;
+
+	// ctor for a capture filling child orders of a service
+	ChildCapture(AlgoExecutionService<Bond>* _service, long _fillQuantity) : service(_service), fillQuantity(_fillQuantity) {}
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(AlgoExecution<Bond>& _data)
+	{
+		ExecutionOrder<Bond> _child = *_data.GetExecutionOrder();
+		if (!_child.IsChildOrder()) return;
+		children.push_back(_child);
+		long _fill = min(fillQuantity, _child.GetVisibleQuantity());
+		if (_fill > 0) service->OnExecution(GetExecution(_child.GetOrderId(), _fill));
+	}
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(AlgoExecution<Bond>&) {}
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(AlgoExecution<Bond>&) {}
+
+	// Get an execution of a quantity on a venue order routed from an order
+	static ExecutionOrder<Bond> GetExecution(const string& _orderId, long _quantity)
+	{
+		return ExecutionOrder<Bond>(GetBond(PRODUCT_ID), OFFER, "VENUE", IOC, 100.0, _quantity, 0, _orderId, true);
+	}
+
+};
+
+/**
+* An algo execution service on a virtual clock, with its child orders captured.
+*/
+struct AlgoHarness
+{
+	VirtualClock clock = VirtualClock(START);
+	ClockGuard guard = ClockGuard(GetTimerWheel(), &clock);
+	AlgoExecutionService<Bond> service;
+	ChildCapture capture;
+
+	// ctor for a harness filling child orders up to a quantity
+	AlgoHarness(long _fillQuantity) : capture(&service, _fillQuantity)
+	{
+		service.AddListener(&capture);
+	}
+
+	// Move the clock to a number of seconds from the start, fire the timers due and tick the product with a book
+	void TickAt(double _seconds, double _offerPrice = 100.0)
+	{
+		clock.SetTime(START + (long)(_seconds * SECOND));
+		PollTimers();
+		vector<Order> _bids = { Order(99.5, 5000000, BID) };
+		vector<Order> _offers = { Order(_offerPrice, 5000000, OFFER) };
+		OrderBook<Bond> _book(GetBond(PRODUCT_ID), _bids, _offers, BROKERTEC);
+		service.AlgoExecuteOrder(_book);
+	}
+
+	// Get the quantities of the child orders sent so far
+	vector<long> GetChildQuantities() const
+	{
+		vector<long> _quantities;
+		for (auto& c : capture.children)
+		{
+			_quantities.push_back(c.GetVisibleQuantity());
+		}
+		return _quantities;
+	}
+};
+
+// A TWAP parent sends a lot a second against the offer, and is released once its last child fills it.
+void TestTwap()
+{
+	AlgoHarness harness(10000000);
+	TwapAlgo twap;
+	string orderId = harness.service.AddParentOrder(GetBond(PRODUCT_ID), OFFER, 10000000, 10000000, 0.0, &twap, 10 * SECOND, SECOND);
+	for (int s = 0; s < 10; ++s)
+	{
+		harness.TickAt(s);
+	}
+	Check(harness.GetChildQuantities() == vector<long>(9, 1000000), "a TWAP parent sends one lot a second after the start");
+	Check(harness.service.GetFilledQuantity(orderId) == 9000000, "the parent has its children's fills");
+	Check(harness.capture.children.back().GetPrice() == 100.0 && harness.capture.children.back().GetOrderType() == IOC && harness.capture.children.back().GetParentOrderId() == orderId, "a buy child order is an IOC at the offer of its parent");
+
+	harness.TickAt(10);
+	Check(harness.capture.children.size() == 10 && harness.capture.children.back().GetVisibleQuantity() == 1000000, "the last child order sends the rest at the end of the schedule");
+	Check(harness.service.GetActiveParentCount() == 0 && harness.service.GetFilledQuantity(orderId) == 0, "a parent filled by its last child is done and released");
+	Check(GetTimerWheel().GetCount() == 0, "a parent filled inside its child order is not rescheduled");
+	harness.TickAt(11);
+	Check(harness.capture.children.size() == 10, "a released parent sends nothing more");
+}
+
+// A VWAP parent follows its volume profile, rounded down to lots.
+void TestVwap()
+{
+	AlgoHarness harness(10000000);
+	VwapAlgo vwap({ 1.0, 3.0 });
+	harness.service.AddParentOrder(GetBond(PRODUCT_ID), BID, 10000000, 10000000, 0.0, &vwap, 10 * SECOND, 5 * SECOND);
+	harness.TickAt(0);
+	harness.TickAt(5);
+	harness.TickAt(10);
+	Check(harness.GetChildQuantities() == vector<long>({ 2000000, 8000000 }), "a VWAP parent fills a quarter of its quantity in the first half and the rest in the second");
+	Check(harness.capture.children.front().GetPrice() == 99.5, "a sell child order goes at the bid");
+}
+
+// An iceberg parent shows at most its visible quantity, refreshed as it fills, and waits while the touch is outside its limit.
+void TestIceberg()
+{
+	AlgoHarness harness(1500000);
+	IcebergAlgo iceberg;
+	string orderId = harness.service.AddParentOrder(GetBond(PRODUCT_ID), OFFER, 5000000, 2000000, 100.0, &iceberg, 10 * SECOND, SECOND);
+	harness.TickAt(0, 100.0 + 1.0 / 256.0);
+	Check(harness.capture.children.empty(), "no child is sent while the offer is above the limit");
+	harness.TickAt(1);
+	harness.TickAt(2);
+	Check(harness.GetChildQuantities() == vector<long>({ 2000000, 2000000 }) && harness.service.GetFilledQuantity(orderId) == 3000000, "each child shows the visible quantity while fills come in below it");
+	harness.TickAt(3);
+	harness.TickAt(4);
+	Check(harness.GetChildQuantities() == vector<long>({ 2000000, 2000000, 2000000, 500000 }), "the last child shows only what is left");
+	Check(harness.service.GetActiveParentCount() == 0 && GetTimerWheel().GetCount() == 0, "a filled iceberg is released and not rescheduled");
+}
+
+// A cancelled parent sends nothing more, and its slot is reused once released, whether or not it was due.
+void TestCancel()
+{
+	AlgoHarness harness(0);
+	TwapAlgo twap;
+	string first = harness.service.AddParentOrder(GetBond(PRODUCT_ID), OFFER, 10000000, 10000000, 0.0, &twap, 10 * SECOND, SECOND);
+	harness.TickAt(0);
+	harness.TickAt(1);
+	Check(harness.capture.children.size() == 1, "an unfilled parent sends its target");
+	Check(harness.service.CancelParentOrder(first) && !harness.service.CancelParentOrder(first), "a parent is cancelled once");
+	Check(harness.service.GetActiveParentCount() == 0 && GetTimerWheel().GetCount() == 0, "a cancelled parent has no timer left");
+
+	string second = harness.service.AddParentOrder(GetBond(PRODUCT_ID), OFFER, 10000000, 10000000, 0.0, &twap, 10 * SECOND, SECOND);
+	Check(second != first && harness.service.GetParentSlotCount() == 1, "a new parent reuses the slot of a cancelled one");
+	harness.TickAt(2);
+	harness.TickAt(3);
+	Check(harness.capture.children.size() == 3 && harness.capture.children.back().GetParentOrderId() == second, "only the new parent sends child orders");
+
+	// The second parent is due once its timer fires, and is cancelled before its product ticks.
+	harness.clock.SetTime(START + 4 * SECOND);
+	PollTimers();
+	Check(harness.service.CancelParentOrder(second), "a due parent is cancelled");
+	string third = harness.service.AddParentOrder(GetBond(PRODUCT_ID), OFFER, 10000000, 10000000, 0.0, &twap, 10 * SECOND, SECOND);
+	Check(harness.service.GetParentSlotCount() == 2, "a due parent keeps its slot until its product ticks");
+	harness.TickAt(4);
+	string fourth = harness.service.AddParentOrder(GetBond(PRODUCT_ID), OFFER, 10000000, 10000000, 0.0, &twap, 10 * SECOND, SECOND);
+	Check(harness.service.GetParentSlotCount() == 2 && harness.service.GetActiveParentCount() == 2, "the slot of a cancelled due parent is reused after the tick");
+	Check(harness.capture.children.size() == 3, "a cancelled due parent sends nothing on the tick");
+
+	// Timers left on the wheel of the thread would outlive the service.
+	harness.service.CancelParentOrder(third);
+	harness.service.CancelParentOrder(fourth);
+	Check(GetTimerWheel().GetCount() == 0, "cancelled parents leave no timers");
+}
+
+// A participation cap holds a parent to a fraction of the quantity executed in its product since it started.
+void TestParticipationCap()
+{
+	AlgoHarness harness(10000000);
+	TwapAlgo twap;
+	ParticipationCap cap(&twap, 0.1);
+	harness.service.OnExecution(ChildCapture::GetExecution("EARLIER", 50000000));
+	string orderId = harness.service.AddParentOrder(GetBond(PRODUCT_ID), OFFER, 10000000, 10000000, 0.0, &cap, 10 * SECOND, SECOND);
+	harness.TickAt(0);
+	harness.TickAt(1);
+	Check(harness.capture.children.empty(), "nothing is sent before anything executes in the product, whatever executed before the parent");
+
+	harness.service.OnExecution(ChildCapture::GetExecution("OTHER", 20000000));
+	harness.service.OnExecution(ExecutionOrder<Bond>(GetBond("912810TW8"), OFFER, "VENUE", IOC, 100.0, 90000000, 0, "OTHER", true));
+	harness.TickAt(2);
+	Check(harness.GetChildQuantities() == vector<long>({ 2000000 }), "the parent takes a tenth of the quantity executed in its product, not in others");
+	harness.TickAt(3);
+	Check(harness.GetChildQuantities() == vector<long>({ 2000000, 200000 }), "the parent's own fills count toward the quantity executed");
+	Check(harness.service.GetActiveParentCount() == 1, "a capped parent stays active");
+	harness.service.CancelParentOrder(orderId);
+}
+
+int main()
+{
+	TestTwap();
+	TestVwap();
+	TestIceberg();
+	TestCancel();
+	TestParticipationCap();
+	return CheckResult("algoexecution_test");
+}
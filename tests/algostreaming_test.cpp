@@ -0,0 +1,114 @@
+/**
+* algostreaming_test.cpp
+* Tests that streamed two-way prices are skewed by position and risk at the scale of the book.
+*
+* @author Haonan Lu
+*/
+
+#include "check.hpp"
+#include "algostreamingservice.hpp"
+#include "positionservice.hpp"
+#include "riskservice.hpp"
+
+/**
+* Listener keeping the last two-way price streamed.
+*/
+class StreamCapture : public ServiceListener<AlgoStream<Bond>>
+{
+
+public:
+
+	PriceStream<Bond> last;
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(AlgoStream<Bond>& _data) { last = *_data.GetPriceStream(); }
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(AlgoStream<Bond>&) {}
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(AlgoStream<Bond>&) {}
+
+};
+
+const string PRODUCT_ID = "912810TV0";
+const double MID = 100.0;
+const double SPREAD = 1.0 / 64.0;
+
+// Stream a price with the product held at a position and get the stream.
+PriceStream<Bond> StreamAtPosition(AlgoStreamingService<Bond>& _service, StreamCapture& _capture, long _quantity)
+{
+	Position<Bond> _position(GetBond(PRODUCT_ID));
+	string _book = "TRSY1";
+	_position.AddPosition(_book, _quantity);
+	_service.GetPositionListener()->ProcessAdd(_position);
+	Price<Bond> _price(GetBond(PRODUCT_ID), MID, SPREAD);
+	_service.GetListener()->ProcessAdd(_price);
+	return _capture.last;
+}
+
+// Stream a price with the product at a risk and get the stream.
+PriceStream<Bond> StreamAtRisk(AlgoStreamingService<Bond>& _service, StreamCapture& _capture, long _quantity)
+{
+	PV01<Bond> _pv01(GetBond(PRODUCT_ID), 0.3, _quantity);
+	_service.GetRiskListener()->ProcessAdd(_pv01);
+	Price<Bond> _price(GetBond(PRODUCT_ID), MID, SPREAD);
+	_service.GetListener()->ProcessAdd(_price);
+	return _capture.last;
+}
+
+double GetMid(const PriceStream<Bond>& _stream)
+{
+	return (_stream.GetBidOrder().GetPrice() + _stream.GetOfferOrder().GetPrice()) / 2.0;
+}
+
+double GetSpread(const PriceStream<Bond>& _stream)
+{
+	return _stream.GetOfferOrder().GetPrice() - _stream.GetBidOrder().GetPrice();
+}
+
+// A growing short position raises the price step by step up to the positions the book reaches, and a long one lowers it.
+void TestSkewFollowsPosition()
+{
+	AlgoStreamingService<Bond> service;
+	StreamCapture capture;
+	service.AddListener(&capture);
+
+	double flat = GetMid(StreamAtPosition(service, capture, 0));
+	double shortMid = GetMid(StreamAtPosition(service, capture, -100000000));
+	PriceStream<Bond> shorter = StreamAtPosition(service, capture, -300000000);
+	double shortestMid = GetMid(StreamAtPosition(service, capture, -578000000));
+	double longMid = GetMid(StreamAtPosition(service, capture, 300000000));
+
+	Check(flat == MID, "a flat position leaves the price alone");
+	Check(shortMid > flat, "a short position raises the price");
+	Check(GetMid(shorter) > shortMid, "a larger short position raises the price further");
+	Check(shortestMid > GetMid(shorter), "the largest short position of the book still moves the price");
+	Check(shortestMid - MID < 1.0 / 128.0, "the largest short position of the book is inside the shift limit");
+	Check(longMid < flat, "a long position lowers the price");
+	Check(shorter.GetOfferOrder().GetVisibleQuantity() < shorter.GetBidOrder().GetVisibleQuantity(), "a short position cuts the offer size");
+}
+
+// Growing risk widens the spread step by step up to the risk the book reaches.
+void TestSkewFollowsRisk()
+{
+	AlgoStreamingService<Bond> service;
+	StreamCapture capture;
+	service.AddListener(&capture);
+
+	double flat = GetSpread(StreamAtRisk(service, capture, 0));
+	double risky = GetSpread(StreamAtRisk(service, capture, -100000000));
+	double riskiest = GetSpread(StreamAtRisk(service, capture, -578000000));
+
+	Check(fabs(flat - SPREAD) < 1e-12, "no risk leaves the spread alone");
+	Check(risky > flat, "risk widens the spread");
+	Check(riskiest > risky, "more risk widens the spread further");
+	Check(riskiest < 2.0 * SPREAD, "the largest risk of the book is inside the widening limit");
+}
+
+int main()
+{
+	TestSkewFollowsPosition();
+	TestSkewFollowsRisk();
+	return CheckResult("algostreaming_test");
+}
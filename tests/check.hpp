@@ -0,0 +1,34 @@
+/**
+* check.hpp
+* Defines the checks shared by the test programs.
+*
+* @author Haonan Lu
+*/
+
+#ifndef CHECK_HPP
+#define CHECK_HPP
+
+#include <iostream>
+#include <string>
+
+using namespace std;
+
+// Number of checks failed so far
+int checkFailures = 0;
+
+// Check a condition, reporting it when it does not hold.
+void Check(bool _condition, const string& _description)
+{
+	if (_condition) return;
+	cout << "FAILED: " << _description << endl;
+	checkFailures++;
+}
+
+// Report the checks and get the exit status of the test program.
+int CheckResult(const string& _name)
+{
+	cout << _name << ": " << (checkFailures == 0 ? "passed" : to_string(checkFailures) + " checks failed") << endl;
+	return checkFailures == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,136 @@
+/**
+* consolidatedbook_test.cpp
+* Tests that the consolidated book, updated from the levels that changed
+* between two books of a venue, always matches a book rebuilt from the
+* latest book of every venue.
+*
+* @author Haonan Lu
+*/
+
+#include <random>
+#include "check.hpp"
+#include "marketdataservice.hpp"
+
+const double TICK = 1.0 / 256.0;
+
+// Rebuild the levels of a side from the latest stack of every venue, best price first.
+vector<ConsolidatedLevel> Rebuild(const array<vector<Order>, NUM_MARKETS>& _stacks, bool _isBid)
+{
+	map<long, ConsolidatedLevel> _levels;
+	for (int m = 0; m < NUM_MARKETS; ++m)
+	{
+		for (auto& o : _stacks[m])
+		{
+			long _tick = PriceToTick(o.GetPrice());
+			ConsolidatedLevel& _level = _levels.insert({ _tick, { o.GetPrice(), _tick, 0, {} } }).first->second;
+			_level.quantity += o.GetQuantity();
+			_level.venueQuantities[m] += o.GetQuantity();
+		}
+	}
+	vector<ConsolidatedLevel> _book;
+	for (auto& l : _levels)
+	{
+		_book.push_back(l.second);
+	}
+	if (_isBid) reverse(_book.begin(), _book.end());
+	return _book;
+}
+
+// Are two sides of a book the same level for level, venue for venue?
+bool IsSame(const vector<ConsolidatedLevel>& _book, const vector<ConsolidatedLevel>& _expected)
+{
+	if (_book.size() != _expected.size()) return false;
+	for (size_t i = 0; i < _book.size(); ++i)
+	{
+		if (_book[i].tick != _expected[i].tick || _book[i].price != _expected[i].price || _book[i].quantity != _expected[i].quantity) return false;
+		if (_book[i].venueQuantities != _expected[i].venueQuantities) return false;
+	}
+	return true;
+}
+
+/**
+* A consolidated book with the latest stacks sent to it by venue.
+*/
+struct TrackedBook
+{
+	ConsolidatedBook book;
+	array<vector<Order>, NUM_MARKETS> bidStacks;
+	array<vector<Order>, NUM_MARKETS> offerStacks;
+
+	// Send a new book of a venue
+	void Update(Market _market, const vector<Order>& _bidStack, const vector<Order>& _offerStack)
+	{
+		bidStacks[_market] = _bidStack;
+		offerStacks[_market] = _offerStack;
+		book.Update(_market, _bidStack, _offerStack);
+	}
+
+	// Does the book match one rebuilt from the latest stacks?
+	bool IsRebuilt() const
+	{
+		return IsSame(book.GetBids(), Rebuild(bidStacks, true)) && IsSame(book.GetOffers(), Rebuild(offerStacks, false));
+	}
+};
+
+// Levels are added, modified and removed across venues, one venue at a time.
+void TestIncrementalUpdates()
+{
+	TrackedBook tracked;
+	tracked.Update(BROKERTEC, { Order(99.5, 1000000, BID), Order(99.5 - TICK, 2000000, BID) }, { Order(99.5 + TICK, 1000000, OFFER) });
+	Check(tracked.IsRebuilt(), "a first venue book is added whole");
+	tracked.Update(ESPEED, { Order(99.5, 3000000, BID), Order(99.5 - 2 * TICK, 1000000, BID) }, { Order(99.5 + TICK, 2000000, OFFER), Order(99.5 + 2 * TICK, 1000000, OFFER) });
+	Check(tracked.IsRebuilt(), "a second venue adds to shared levels and adds its own");
+	const ConsolidatedLevel& best = tracked.book.GetBids().front();
+	Check(best.quantity == 4000000 && best.venueQuantities[BROKERTEC] == 1000000 && best.venueQuantities[ESPEED] == 3000000, "a shared level keeps the quantity of each venue");
+
+	tracked.Update(BROKERTEC, { Order(99.5, 1500000, BID), Order(99.5 - TICK, 2000000, BID) }, { Order(99.5 + TICK, 1000000, OFFER) });
+	Check(tracked.IsRebuilt(), "a venue modifies the quantity of a shared level");
+	tracked.Update(ESPEED, { Order(99.5 - 2 * TICK, 1000000, BID) }, { Order(99.5 + 2 * TICK, 1000000, OFFER) });
+	Check(tracked.IsRebuilt(), "a venue removes its quantity from shared levels");
+	Check(tracked.book.GetBids().front().quantity == 1500000 && tracked.book.GetBids().front().venueQuantities[ESPEED] == 0, "a shared level stays for the venue still showing it");
+	tracked.Update(BROKERTEC, {}, {});
+	Check(tracked.IsRebuilt(), "a venue pulls all its levels");
+	Check(tracked.book.GetBids().size() == 1 && tracked.book.GetOffers().size() == 1, "levels no venue shows are removed");
+
+	tracked.Update(CME, { Order(99.0, 1000000, BID), Order(99.0, 2000000, BID), Order(100.0, 1000000, BID) }, { Order(101.0, 1000000, OFFER), Order(100.5, 1000000, OFFER), Order(100.5, 1000000, OFFER) });
+	Check(tracked.IsRebuilt(), "orders of a venue at one price merge into one level, and stacks in any order are sorted");
+	BidOffer bidOffer = tracked.book.GetBidOffer();
+	Check(bidOffer.GetBidOrder().GetPrice() == 100.0 && bidOffer.GetOfferOrder().GetPrice() == 99.5 + 2 * TICK, "the best bid and offer are taken across venues");
+}
+
+// Random books of random venues applied one after another always match a full rebuild.
+void TestRandomUpdates()
+{
+	mt19937 rng(20231201);
+	uniform_int_distribution<int> venue(0, NUM_MARKETS - 1);
+	uniform_int_distribution<int> depth(0, 6);
+	uniform_int_distribution<int> offset(0, 12);
+	uniform_int_distribution<int> size(1, 5);
+	TrackedBook tracked;
+	long mismatches = 0;
+	for (int step = 0; step < 20000; ++step)
+	{
+		// The mid drifts, so levels come and go at both ends of each side.
+		double mid = 100.0 + ((step / 500) % 8 - 4) * TICK;
+		vector<Order> bidStack;
+		vector<Order> offerStack;
+		for (int n = depth(rng); n > 0; --n)
+		{
+			bidStack.push_back(Order(mid - (1 + offset(rng)) * TICK, size(rng) * 1000000, BID));
+		}
+		for (int n = depth(rng); n > 0; --n)
+		{
+			offerStack.push_back(Order(mid + (1 + offset(rng)) * TICK, size(rng) * 1000000, OFFER));
+		}
+		tracked.Update((Market)venue(rng), bidStack, offerStack);
+		if (!tracked.IsRebuilt()) mismatches++;
+	}
+	Check(mismatches == 0, "incremental updates match a full rebuild after every random book, " + to_string(mismatches) + " did not");
+}
+
+int main()
+{
+	TestIncrementalUpdates();
+	TestRandomUpdates();
+	return CheckResult("consolidatedbook_test");
+}
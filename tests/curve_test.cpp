@@ -0,0 +1,105 @@
+/**
+* curve_test.cpp
+* Tests that the bootstrapped treasury curve reprices the bonds it is fitted
+* to and that positions are risked off it.
+*
+* @author Haonan Lu
+*/
+
+#include "check.hpp"
+#include "curveservice.hpp"
+#include "riskservice.hpp"
+
+const vector<double> MIDS = { 99.5, 99.75, 100.25, 100.0, 99.25, 101.5, 98.75 };
+
+// Get the accrued interest per 100 face of a bond paying a semi-annual coupon to a tenor, as GetBondYield accrues it.
+double GetAccrued(double _coupon, double _tenor)
+{
+	int _n = (int)ceil(_tenor * 2.0 - 1e-9);
+	double _f = _tenor * 2.0 - (_n - 1);
+	return _coupon * 100.0 / 2.0 * (1.0 - _f);
+}
+
+// Bonds paying the par yields the curve is fitted to price at par, at the pillars and on the grid between them.
+void TestParBondsReprice()
+{
+	vector<double> tenors = { 2, 3, 5, 7, 10, 20, 30 };
+	vector<double> parYields = { 0.0475, 0.045, 0.0425, 0.043, 0.044, 0.047, 0.046 };
+	YieldCurve curve("UST", from_string("2023/12/01"));
+	curve.Fit(tenors, parYields);
+
+	for (size_t i = 0; i < tenors.size(); ++i)
+	{
+		Check(fabs(curve.GetBondPrice(parYields[i], tenors[i]) - 100.0) < 1e-9, "the " + to_string((int)tenors[i]) + "Y par bond prices at par off the curve");
+		Check(fabs(GetBondYield(100.0, parYields[i], tenors[i], 0.05) - parYields[i]) < 1e-10, "the " + to_string((int)tenors[i]) + "Y par bond yields its coupon");
+	}
+	for (double tenor = 0.5; tenor <= 30.0; tenor += 0.5)
+	{
+		Check(fabs(curve.GetBondPrice(curve.GetParYield(tenor), tenor) - 100.0) < 1e-9, "a par bond of " + to_string(tenor) + " years prices at par off the curve");
+	}
+}
+
+// A curve fitted to market prices matches the yield of each bond at its pillar and prices each bond back near its mid.
+void TestCurveRepricesMarket()
+{
+	CurveService<Bond> curveService;
+	for (size_t i = 0; i < CUSIPS.size(); ++i)
+	{
+		Price<Bond> price(GetBond(CUSIPS[i]), MIDS[i], 1.0 / 128.0);
+		curveService.UpdatePrice(price);
+	}
+	const YieldCurve& curve = curveService.GetCurve();
+	Check(curveService.GetFitCount() == 1, "the curve is fitted once every pillar is quoted");
+
+	for (size_t i = 0; i < CUSIPS.size(); ++i)
+	{
+		Bond bond = GetBond(CUSIPS[i]);
+		double tenor = curve.GetTenor(bond.GetMaturityDate());
+		double yield = GetBondYield(MIDS[i], bond.GetCoupon(), tenor, bond.GetCoupon());
+		double cleanPrice = curve.GetBondPrice(bond.GetCoupon(), tenor) - GetAccrued(bond.GetCoupon(), tenor);
+		Check(fabs(curve.GetParYield(tenor) - yield) < 1e-12, CUSIPS[i] + " pillar holds the yield of its mid");
+		Check(fabs(cleanPrice - MIDS[i]) < 1.0 / 16.0, CUSIPS[i] + " reprices within a sixteenth of its mid");
+	}
+}
+
+// Positions are risked at fixed PV01s until the curve is fitted and off the curve afterwards.
+void TestRiskOffCurve()
+{
+	CurveService<Bond> curveService;
+	RiskService<Bond> riskService;
+	curveService.AddListener(riskService.GetCurveListener());
+
+	Position<Bond> position(GetBond("91282CJJ1"));
+	string book = "TRSY1";
+	position.AddPosition(book, 1000000);
+	riskService.AddPosition(position);
+	Check(riskService.GetData("91282CJJ1").GetPV01() == GetPV01Value("91282CJJ1"), "risk before the curve is fitted is at the fixed PV01");
+
+	for (size_t i = 0; i < CUSIPS.size(); ++i)
+	{
+		Price<Bond> price(GetBond(CUSIPS[i]), MIDS[i], 1.0 / 128.0);
+		curveService.UpdatePrice(price);
+	}
+	const YieldCurve& curve = curveService.GetCurve();
+	double previous = 0;
+	for (auto& c : CUSIPS)
+	{
+		Bond bond = GetBond(c);
+		Position<Bond> bondPosition(bond);
+		bondPosition.AddPosition(book, 1000000);
+		riskService.AddPosition(bondPosition);
+		double pv01 = riskService.GetData(c).GetPV01();
+		Check(fabs(pv01 - curve.GetPV01(bond.GetCoupon(), curve.GetTenor(bond.GetMaturityDate()))) < 1e-12, c + " is risked off the curve");
+		Check(pv01 > previous, c + " has more PV01 than shorter bonds");
+		previous = pv01;
+	}
+	Check(fabs(riskService.GetData("91282CJJ1").GetPV01() - 0.08) < 0.01, "the 10Y PV01 is about 8 cents per 100 face");
+}
+
+int main()
+{
+	TestParBondsReprice();
+	TestCurveRepricesMarket();
+	TestRiskOffCurve();
+	return CheckResult("curve_test");
+}
@@ -0,0 +1,114 @@
+/**
+* executor_test.cpp
+* Tests that the executor runs every task once with any number of workers,
+* that nested ParallelFor calls complete without deadlock, and that a
+* thread waiting on a group runs tasks rather than blocking.
+*
+* @author Haonan Lu
+*/
+
+#include <memory>
+#include "check.hpp"
+#include "executor.hpp"
+
+// Get the number of tasks run by the workers of an executor and by threads waiting on it.
+long GetExecutedCount(const Executor& _executor)
+{
+	long _executed = _executor.GetHelpedCount();
+	for (auto& s : _executor.GetStats())
+	{
+		_executed += s.executed;
+	}
+	return _executed;
+}
+
+// Nested ParallelFor over an outer and inner range runs every inner index once.
+void TestNestedParallelFor(int _workerCount)
+{
+	Executor executor;
+	executor.Configure(_workerCount);
+	const long outer = 1000;
+	const long inner = 100;
+	unique_ptr<atomic<long>[]> runs(new atomic<long>[outer * inner]);
+	for (long i = 0; i < outer * inner; ++i)
+	{
+		runs[i].store(0);
+	}
+
+	executor.ParallelFor(0, outer, [&](long i)
+	{
+		executor.ParallelFor(0, inner, [&](long j) { runs[i * inner + j].fetch_add(1); }, 10);
+	});
+	long wrong = 0;
+	for (long i = 0; i < outer * inner; ++i)
+	{
+		if (runs[i].load() != 1) wrong++;
+	}
+	Check(wrong == 0, "nested ParallelFor runs every index once with " + to_string(_workerCount) + " workers, " + to_string(wrong) + " did not");
+}
+
+// Independent tasks submitted from outside, in one group, all run once and are counted by whoever ran them.
+void TestStress(int _workerCount)
+{
+	Executor executor;
+	executor.Configure(_workerCount);
+	const long count = 200000;
+	unique_ptr<atomic<char>[]> runs(new atomic<char>[count]);
+	for (long i = 0; i < count; ++i)
+	{
+		runs[i].store(0);
+	}
+
+	TaskGroup group;
+	for (long i = 0; i < count; ++i)
+	{
+		executor.Submit(group, [&runs, i]() { runs[i].fetch_add(1); });
+	}
+	executor.Wait(group);
+	long wrong = 0;
+	for (long i = 0; i < count; ++i)
+	{
+		if (runs[i].load() != 1) wrong++;
+	}
+	Check(group.GetPendingCount() == 0 && wrong == 0, to_string(count) + " tasks run once each with " + to_string(_workerCount) + " workers, " + to_string(wrong) + " did not");
+
+	// A worker counts a task just after finishing it, so the last counts may land after the wait.
+	long executed = GetExecutedCount(executor);
+	for (int tries = 0; executed < count && tries < 1000; ++tries)
+	{
+		this_thread::sleep_for(chrono::milliseconds(1));
+		executed = GetExecutedCount(executor);
+	}
+	Check(_workerCount == 0 || executed == count, "every task is counted by the worker or waiting thread that ran it with " + to_string(_workerCount) + " workers");
+}
+
+// A worker waiting on tasks it submitted runs them itself, so a single worker never deadlocks on its own group.
+void TestWaitOnWorker()
+{
+	Executor executor;
+	executor.Configure(1);
+	atomic<long> inner(0);
+	TaskGroup outer;
+	executor.Submit(outer, [&executor, &inner]()
+	{
+		TaskGroup group;
+		for (int i = 0; i < 100; ++i)
+		{
+			executor.Submit(group, [&inner]() { inner.fetch_add(1); });
+		}
+		executor.Wait(group);
+	});
+	executor.Wait(outer);
+	Check(inner.load() == 100, "a worker waiting on its own group runs the tasks of the group");
+}
+
+int main()
+{
+	for (int workers : { 0, 1, 4, 8 })
+	{
+		TestNestedParallelFor(workers);
+		TestStress(workers);
+	}
+	TestWaitOnWorker();
+	return CheckResult("executor_test");
+}
@@ -0,0 +1,139 @@
+/**
+* hashindex_benchmark.cpp
+* Compares the hash index with std::map and std::unordered_map on the
+* 12-character IDs of GenerateId: the time per insert, per lookup of a
+* present key and per lookup of an absent key, and the memory taken.
+* Usage: hashindex_benchmark [key counts...] [map|unordered_map|hashindex...]
+* The key counts default to 1M and 100M, and every structure is run unless
+* some are named; each structure is filled and freed before the next.
+*
+* @author Haonan Lu
+*/
+
+#include <chrono>
+#include <map>
+#include <iomanip>
+#include <malloc.h>
+#include <unistd.h>
+#include "algoexecutionservice.hpp"
+#include "hashindex.hpp"
+
+const uint64_t KEY_SEED = 20231201;
+const uint64_t MISS_SEED = 20231202;
+
+// Get a key of a sequence, the ID GenerateId draws at that count of the sequence.
+string GetKey(uint64_t _seed, uint64_t _count)
+{
+	GetIdSequence() = IdSequence{ _seed, _count };
+	return GenerateId();
+}
+
+// Get the resident memory of the process in megabytes.
+double GetResidentMegabytes()
+{
+	long _size = 0;
+	long _resident = 0;
+	ifstream _statm("/proc/self/statm");
+	_statm >> _size >> _resident;
+	return _resident * (double)sysconf(_SC_PAGESIZE) / (1024.0 * 1024.0);
+}
+
+// Get the nanoseconds since a time point.
+double GetNanoseconds(chrono::steady_clock::time_point _start)
+{
+	return (double)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - _start).count();
+}
+
+// Insert a key with a value into a standard map.
+template<typename M>
+void Insert(M& _index, const string& _key, long _value)
+{
+	_index.emplace(_key, _value);
+}
+
+// Insert a key with a value into a hash index.
+void Insert(HashIndex<long>& _index, const string& _key, long _value)
+{
+	_index.Insert(_key, _value);
+}
+
+// Does a standard map hold a key?
+template<typename M>
+long Contains(const M& _index, const string& _key)
+{
+	return _index.find(_key) != _index.end() ? 1 : 0;
+}
+
+// Does a hash index hold a key?
+long Contains(const HashIndex<long>& _index, const string& _key)
+{
+	return _index.Find(_key) != nullptr ? 1 : 0;
+}
+
+// Fill a structure with keys, look every key up in a scattered order and as many absent keys, and report per operation.
+template<typename M>
+void Run(const string& _name, long _count)
+{
+	malloc_trim(0);
+	double _baseline = GetResidentMegabytes();
+	M* _index = new M();
+	long _found = 0;
+
+	auto _start = chrono::steady_clock::now();
+	for (long i = 0; i < _count; ++i)
+	{
+		Insert(*_index, GetKey(KEY_SEED, i), i);
+	}
+	double _insert = GetNanoseconds(_start) / _count;
+	double _megabytes = GetResidentMegabytes() - _baseline;
+
+	// Keys are looked up at a prime stride, visiting each once in an order unlike the insert order.
+	const long _stride = 1000003;
+	_start = chrono::steady_clock::now();
+	for (long i = 0, j = 0; i < _count; ++i, j = (j + _stride) % _count)
+	{
+		_found += Contains(*_index, GetKey(KEY_SEED, j));
+	}
+	double _hit = GetNanoseconds(_start) / _count;
+
+	_start = chrono::steady_clock::now();
+	for (long i = 0; i < _count; ++i)
+	{
+		_found += Contains(*_index, GetKey(MISS_SEED, i));
+	}
+	double _miss = GetNanoseconds(_start) / _count;
+	delete _index;
+
+	cout << setw(10) << _count << "  " << left << setw(14) << _name << right << fixed << setprecision(1)
+		<< setw(10) << _insert << setw(10) << _hit << setw(10) << _miss << setw(10) << _megabytes
+		<< (_found == _count ? "" : "  (lookups found " + to_string(_found) + " keys)") << endl;
+}
+
+int main(int argc, char* argv[])
+{
+	vector<long> _counts;
+	vector<string> _names;
+	for (int i = 1; i < argc; ++i)
+	{
+		string _argument = argv[i];
+		if (isdigit((unsigned char)_argument[0])) _counts.push_back(stol(_argument));
+		else _names.push_back(_argument);
+	}
+	if (_counts.empty()) _counts = { 1000000, 100000000 };
+	if (_names.empty()) _names = { "map", "unordered_map", "hashindex" };
+
+	// Generating each key is part of every time, as it is for the IDs the services look up.
+	cout << setw(10) << "keys" << "  " << left << setw(14) << "structure" << right
+		<< setw(10) << "insert ns" << setw(10) << "hit ns" << setw(10) << "miss ns" << setw(10) << "MB" << endl;
+	for (long _count : _counts)
+	{
+		for (auto& _name : _names)
+		{
+			if (_name == "map") Run<map<string, long>>(_name, _count);
+			else if (_name == "unordered_map") Run<unordered_map<string, long>>(_name, _count);
+			else if (_name == "hashindex") Run<HashIndex<long>>(_name, _count);
+			else cout << "unknown structure " << _name << endl;
+		}
+	}
+	return 0;
+}
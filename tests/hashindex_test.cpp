@@ -0,0 +1,159 @@
+/**
+* hashindex_test.cpp
+* Tests that the hash index reuses the tombstones of erased keys, rehashes
+* in place or grows as the table fills under deletes, and finds keys whose
+* probe sequence wraps around the end of the table.
+*
+* @author Haonan Lu
+*/
+
+#include <random>
+#include <unordered_map>
+#include "check.hpp"
+#include "hashindex.hpp"
+
+// Get the key of a number, 12 characters like the IDs of GenerateId.
+string GetKey(long _number)
+{
+	string _key = to_string(_number);
+	return string(12 - _key.size(), 'K') + _key;
+}
+
+// Does the index hold exactly the keys and values of a map, by lookup and by visiting every key?
+bool IsSame(HashIndex<long>& _index, const unordered_map<string, long>& _expected)
+{
+	if (_index.Size() != _expected.size()) return false;
+	for (auto& e : _expected)
+	{
+		const long* _value = _index.Find(e.first);
+		if (_value == nullptr || *_value != e.second) return false;
+	}
+	size_t _visited = 0;
+	bool _same = true;
+	_index.ForEach([&](const string& _key, long _value)
+	{
+		auto _found = _expected.find(_key);
+		_same = _same && _found != _expected.end() && _found->second == _value;
+		_visited++;
+	});
+	return _same && _visited == _expected.size();
+}
+
+// An erased key leaves a tombstone that an insert probing past it takes, even in a table with no growth left.
+void TestTombstoneReuse()
+{
+	HashIndex<long> index;
+	for (long i = 0; i < 10; ++i)
+	{
+		index.Insert(GetKey(i), i);
+	}
+	Check(index.Erase(GetKey(5)) && !index.Erase(GetKey(5)), "a key is erased once");
+	Check(index.Find(GetKey(5)) == nullptr && index.Size() == 9 && index.GetDeletedCount() == 1, "an erased key leaves a tombstone");
+	Check(index.Insert(GetKey(5), 50).second && *index.Find(GetKey(5)) == 50, "an erased key is inserted again with its new value");
+	Check(index.GetDeletedCount() == 0 && index.Size() == 10, "the key inserted again takes its own tombstone");
+
+	HashIndex<long> full;
+	full.Reserve(14);
+	for (long i = 0; i < 14; ++i)
+	{
+		full.Insert(GetKey(i), i);
+	}
+	size_t capacity = full.GetCapacity();
+	Check(capacity == 16, "fourteen keys fill a table of sixteen slots to its load");
+	for (long i = 0; i < 14; ++i)
+	{
+		full.Erase(GetKey(i));
+		full.Insert(GetKey(i), i + 100);
+	}
+	Check(full.GetCapacity() == capacity && full.GetDeletedCount() == 0, "a full table reuses the tombstone of each key erased and inserted again without growing");
+	bool found = true;
+	for (long i = 0; i < 14; ++i)
+	{
+		found = found && full.Find(GetKey(i)) != nullptr && *full.Find(GetKey(i)) == i + 100;
+	}
+	Check(found, "every key inserted again is found with its new value");
+}
+
+// A table churning through keys at a steady size is cleaned in place, and one filling up doubles, losing no key either way.
+void TestRehashUnderDeletes()
+{
+	HashIndex<long> index;
+	unordered_map<string, long> expected;
+	const long live = 1000;
+	for (long i = 0; i < live; ++i)
+	{
+		index.Insert(GetKey(i), i);
+		expected[GetKey(i)] = i;
+	}
+	size_t capacity = index.GetCapacity();
+	size_t maxDeleted = 0;
+	long cleanings = 0;
+	for (long i = live; i < 100 * live; ++i)
+	{
+		index.Erase(GetKey(i - live));
+		expected.erase(GetKey(i - live));
+		size_t deleted = index.GetDeletedCount();
+		index.Insert(GetKey(i), i);
+		expected[GetKey(i)] = i;
+		if (index.GetDeletedCount() + 1 < deleted) cleanings++;
+		maxDeleted = max(maxDeleted, index.GetDeletedCount());
+		if (index.GetCapacity() != capacity) break;
+	}
+	Check(index.GetCapacity() == capacity, "a table churning at a steady size keeps its capacity");
+	Check(cleanings > 0 && live + maxDeleted <= (long)(capacity - capacity / 8), "tombstones are cleaned by rehashing in place before the table passes its load");
+	Check(IsSame(index, expected), "every live key is found after rehashing in place, and no erased one");
+
+	for (long i = 0; i < 20 * live; ++i)
+	{
+		if (i % 3 == 0 && !expected.empty())
+		{
+			index.Erase(expected.begin()->first);
+			expected.erase(expected.begin());
+		}
+		index.Insert(GetKey(200 * live + i), i);
+		expected[GetKey(200 * live + i)] = i;
+	}
+	Check(index.GetCapacity() > capacity && index.GetDeletedCount() < index.GetCapacity() / 8, "a table filling up under deletes doubles and drops its tombstones");
+	Check(IsSame(index, expected), "every live key is found after doubling, and no erased one");
+}
+
+// Random inserts and erases over a small table, where most probe groups wrap around its end, match an ordinary map.
+void TestWraparound()
+{
+	mt19937 rng(20231201);
+	for (long keys : { 14, 28, 56 })
+	{
+		uniform_int_distribution<long> key(0, keys - 1);
+		uniform_int_distribution<int> operation(0, 2);
+		HashIndex<long> index;
+		unordered_map<string, long> expected;
+		long mismatches = 0;
+		for (long step = 0; step < 200000; ++step)
+		{
+			// A key past the inline size, or holding a null, goes to the map on the side.
+			long number = key(rng);
+			string id = number % 7 == 0 ? GetKey(number) + "LONGER" : number % 11 == 0 ? GetKey(number).replace(3, 1, 1, '\0') : GetKey(number);
+			if (operation(rng) == 0)
+			{
+				if (index.Erase(id) != (expected.erase(id) == 1)) mismatches++;
+			}
+			else
+			{
+				bool inserted = expected.insert({ id, step }).second;
+				pair<long*, bool> result = index.Insert(id, step);
+				if (result.second != inserted || *result.first != expected[id]) mismatches++;
+			}
+			if (step % 1000 == 0 && !IsSame(index, expected)) mismatches++;
+		}
+		Check(mismatches == 0 && IsSame(index, expected), "random inserts and erases of " + to_string(keys) + " keys match an ordinary map");
+		Check(index.GetCapacity() <= 64, "a small key set keeps a small table of " + to_string(index.GetCapacity()) + " slots");
+	}
+}
+
+int main()
+{
+	TestTombstoneReuse();
+	TestRehashUnderDeletes();
+	TestWraparound();
+	return CheckResult("hashindex_test");
+}
@@ -0,0 +1,37 @@
+#!/bin/sh
+# Run the trading system in a fresh directory and check that every record
+# reached its history file: one streaming line per price, one inquiry line
+# per inquiry, and one position and one risk line per trade and execution.
+# Arguments after the binary are passed to it, such as --shards 4.
+
+set -eu
+
+binary="$1"
+shift
+directory="$(mktemp -d)"
+trap 'rm -rf "$directory"' EXIT
+cd "$directory"
+"$binary" "$@" > output.txt
+
+lines() {
+	wc -l < "$1" | tr -d ' '
+}
+
+status=0
+check() {
+	if [ "$2" -ne "$3" ]; then
+		echo "$1: $2 lines, expected $3"
+		status=1
+	fi
+}
+
+if [ "$(lines executions.txt)" -eq 0 ]; then
+	echo "executions.txt: no lines"
+	status=1
+fi
+bookings=$(($(lines trades.txt) + $(lines executions.txt)))
+check streaming.txt "$(lines streaming.txt)" "$(lines prices.txt)"
+check allinquiries.txt "$(lines allinquiries.txt)" "$(lines inquiries.txt)"
+check positions.txt "$(lines positions.txt)" "$bookings"
+check risk.txt "$(lines risk.txt)" "$bookings"
+exit "$status"
@@ -0,0 +1,143 @@
+/**
+* matchingengine_test.cpp
+* Tests that the simulated venue matches orders in price-time priority,
+* rests and partially fills LIMIT orders, and cancels the remainders of
+* IOC, MARKET and FOK orders.
+*
+* @author Haonan Lu
+*/
+
+#include "check.hpp"
+#include "matchingengine.hpp"
+
+const string PRODUCT_ID = "91282CJM4";
+const double TICK = 1.0 / 256.0;
+
+// Get a book of the product on the venue.
+OrderBook<Bond> GetBook(const vector<Order>& _bids, const vector<Order>& _offers)
+{
+	return OrderBook<Bond>(GetBond(PRODUCT_ID), _bids, _offers, BROKERTEC);
+}
+
+// Get an order of the product; an order on the offer side buys and one on the bid side sells.
+ExecutionOrder<Bond> GetOrder(const string& _orderId, PricingSide _side, OrderType _orderType, double _price, long _quantity)
+{
+	return ExecutionOrder<Bond>(GetBond(PRODUCT_ID), _side, _orderId, _orderType, _price, _quantity, 0, _orderId, false);
+}
+
+// Collect the fills of the engine.
+vector<ExecutionFill> Poll(MatchingEngine<Bond>& _engine)
+{
+	vector<ExecutionFill> _fills;
+	_engine.PollFills(_fills);
+	return _fills;
+}
+
+// Check a fill against its order, price, quantity and leaves quantity.
+void CheckFill(const vector<ExecutionFill>& _fills, size_t _index, const string& _orderId, double _price, long _quantity, long _leaves, const string& _description)
+{
+	if (_index >= _fills.size())
+	{
+		Check(false, _description + " fills");
+		return;
+	}
+	const ExecutionFill& _fill = _fills[_index];
+	Check(_fill.GetOrderId() == _orderId && _fill.GetPrice() == _price && _fill.GetQuantity() == _quantity && _fill.GetLeavesQuantity() == _leaves, _description);
+}
+
+// An order takes the best levels first, up to its limit, and leaves the rest of the venue liquidity.
+void TestTakeLevels()
+{
+	MatchingEngine<Bond> engine(BROKERTEC);
+	engine.UpdateBook(GetBook({ Order(99.5, 1000000, BID) }, { Order(100.0 + TICK, 3000000, OFFER), Order(100.0, 2000000, OFFER), Order(100.0 + 2 * TICK, 5000000, OFFER) }));
+
+	engine.SubmitOrder(GetOrder("BUY1", OFFER, LIMIT, 100.0 + TICK, 4000000));
+	vector<ExecutionFill> fills = Poll(engine);
+	Check(fills.size() == 2, "a buy walks two levels");
+	CheckFill(fills, 0, "BUY1", 100.0, 2000000, 2000000, "a buy fills at the best offer first");
+	CheckFill(fills, 1, "BUY1", 100.0 + TICK, 2000000, 0, "a buy fills the rest at the next offer");
+	Check(engine.GetRestingCount() == 0, "a filled order does not rest");
+
+	OrderBook<Bond> liquidity;
+	Check(engine.GetLiquidity(PRODUCT_ID, liquidity), "the venue has liquidity of the product");
+	const vector<Order>& offers = liquidity.GetOfferStack();
+	Check(offers.size() == 3 && offers[0].GetQuantity() == 0 && offers[1].GetQuantity() == 1000000 && offers[2].GetQuantity() == 5000000, "the liquidity taken is gone from the venue");
+
+	engine.SubmitOrder(GetOrder("SELL1", BID, LIMIT, 99.5, 500000));
+	fills = Poll(engine);
+	CheckFill(fills, 0, "SELL1", 99.5, 500000, 0, "a sell hits the bid");
+}
+
+// A LIMIT order partially filled rests, and resting orders fill by price and then by time when the venue crosses them.
+void TestPriceTimePriority()
+{
+	MatchingEngine<Bond> engine(BROKERTEC);
+	engine.UpdateBook(GetBook({ Order(99.5, 1000000, BID) }, { Order(100.0 - TICK, 1000000, OFFER), Order(100.5, 1000000, OFFER) }));
+
+	engine.SubmitOrder(GetOrder("FIRST", OFFER, LIMIT, 100.0 - TICK, 2000000));
+	vector<ExecutionFill> fills = Poll(engine);
+	Check(fills.size() == 1, "a limit order takes what is inside its limit");
+	CheckFill(fills, 0, "FIRST", 100.0 - TICK, 1000000, 1000000, "a limit order is partially filled");
+	Check(engine.GetRestingCount() == 1, "the remainder of a limit order rests");
+
+	engine.SubmitOrder(GetOrder("SECOND", OFFER, LIMIT, 100.0 - TICK, 1000000));
+	engine.SubmitOrder(GetOrder("BETTER", OFFER, LIMIT, 100.0, 1000000));
+	engine.SubmitOrder(GetOrder("WORSE", OFFER, LIMIT, 99.75, 1000000));
+	Check(Poll(engine).empty() && engine.GetRestingCount() == 4, "orders inside the spread rest without fills");
+
+	engine.UpdateBook(GetBook({ Order(99.5, 1000000, BID) }, { Order(100.0 - 2 * TICK, 2500000, OFFER) }));
+	fills = Poll(engine);
+	Check(fills.size() == 3, "the venue fills three resting orders");
+	CheckFill(fills, 0, "BETTER", 100.0, 1000000, 0, "the best priced order fills first, at its own price");
+	CheckFill(fills, 1, "FIRST", 100.0 - TICK, 1000000, 0, "the earlier order at a price fills before the later one");
+	CheckFill(fills, 2, "SECOND", 100.0 - TICK, 500000, 500000, "the later order at a price is partially filled");
+	Check(engine.GetRestingCount() == 2, "partially filled and untouched orders keep resting");
+
+	Check(engine.CancelOrder("SECOND") && !engine.CancelOrder("SECOND"), "a resting order is cancelled once");
+	Check(!engine.CancelOrder("FIRST"), "a filled order cannot be cancelled");
+	engine.SubmitOrder(GetOrder("REUSED", OFFER, LIMIT, 99.75, 1000000));
+	engine.UpdateBook(GetBook({ Order(99.5, 1000000, BID) }, { Order(99.75, 1500000, OFFER) }));
+	fills = Poll(engine);
+	Check(fills.size() == 2, "only the orders left at the price fill");
+	CheckFill(fills, 0, "WORSE", 99.75, 1000000, 0, "an order keeps its time priority over an order in a reused slot");
+	CheckFill(fills, 1, "REUSED", 99.75, 500000, 500000, "an order in a reused slot fills after it");
+}
+
+// IOC and MARKET remainders are cancelled with the last fill, and orders that cannot fill end with a fill of zero.
+void TestRemainders()
+{
+	MatchingEngine<Bond> engine(ESPEED);
+	engine.UpdateBook(GetBook({ Order(99.5, 1000000, BID), Order(99.0, 1000000, BID) }, { Order(100.0, 1000000, OFFER), Order(101.0, 1000000, OFFER) }));
+
+	engine.SubmitOrder(GetOrder("IOC1", OFFER, IOC, 100.0, 3000000));
+	vector<ExecutionFill> fills = Poll(engine);
+	Check(fills.size() == 1, "an IOC order takes only what is inside its limit");
+	CheckFill(fills, 0, "IOC1", 100.0, 1000000, 0, "an IOC remainder is cancelled with its last fill");
+	Check(engine.GetRestingCount() == 0, "an IOC remainder does not rest");
+
+	engine.SubmitOrder(GetOrder("IOC2", OFFER, IOC, 100.0, 1000000));
+	fills = Poll(engine);
+	CheckFill(fills, 0, "IOC2", 100.0, 0, 0, "an IOC order with nothing to take ends with a fill of zero");
+
+	engine.SubmitOrder(GetOrder("MKT1", BID, MARKET, 0.0, 3000000));
+	fills = Poll(engine);
+	Check(fills.size() == 2, "a market order walks every level whatever its price");
+	CheckFill(fills, 0, "MKT1", 99.5, 1000000, 2000000, "a market order fills at the best bid first");
+	CheckFill(fills, 1, "MKT1", 99.0, 1000000, 0, "a market remainder is cancelled with its last fill");
+	Check(engine.GetRestingCount() == 0, "a market remainder does not rest");
+
+	engine.SubmitOrder(GetOrder("FOK1", OFFER, FOK, 101.0, 2000000));
+	fills = Poll(engine);
+	CheckFill(fills, 0, "FOK1", 101.0, 0, 0, "a FOK order that cannot fill whole ends with a fill of zero");
+	engine.SubmitOrder(GetOrder("FOK2", OFFER, FOK, 101.0, 1000000));
+	fills = Poll(engine);
+	CheckFill(fills, 0, "FOK2", 101.0, 1000000, 0, "a FOK order that can fill whole fills");
+}
+
+int main()
+{
+	TestTakeLevels();
+	TestPriceTimePriority();
+	TestRemainders();
+	return CheckResult("matchingengine_test");
+}
@@ -0,0 +1,43 @@
+#!/bin/sh
+# Replay the input in a fresh directory taking checkpoints, then restart from
+# the last checkpoint over the same input and check that the restarted run
+# ends in the same state: the same totals and the same history records.
+
+set -eu
+
+binary="$1"
+interval="$2"
+directory="$(mktemp -d)"
+trap 'rm -rf "$directory"' EXIT
+cd "$directory"
+
+histories="positions.txt risk.txt executions.txt streaming.txt allinquiries.txt"
+
+"$binary" --replay --checkpoint-interval "$interval" > full.txt
+mkdir full
+for h in $histories; do cp "$h" full/; done
+
+"$binary" --restart > restart.txt
+if ! grep -q "Checkpoint at event time .* restored" restart.txt; then
+	echo "no checkpoint restored"
+	exit 1
+fi
+
+status=0
+full_total="$(grep "Total position" full.txt | cut -d' ' -f3-)"
+restart_total="$(grep "Total position" restart.txt | cut -d' ' -f3-)"
+if [ "$full_total" != "$restart_total" ]; then
+	echo "full run: $full_total; restarted run: $restart_total"
+	status=1
+fi
+# Lines start with the wall-clock time they were written, the rest is the record.
+records() {
+	cut -d, -f2- "$1"
+}
+for h in $histories; do
+	if [ "$(records "full/$h")" != "$(records "$h")" ]; then
+		echo "$h differs from the full run"
+		status=1
+	fi
+done
+exit "$status"
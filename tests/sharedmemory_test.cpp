@@ -0,0 +1,276 @@
+/**
+* sharedmemory_test.cpp
+* Tests that prices, order books, execution orders and trades published by
+* one process through shared memory arrive whole in another, in order,
+* while both run and when the writer laps the reader.
+*
+* @author Haonan Lu
+*/
+
+#include <sys/wait.h>
+#include "check.hpp"
+#include "sharedmemoryconnector.hpp"
+#include "algoexecutionservice.hpp"
+
+/**
+* Service keeping every message its connector delivers, in order.
+* Type V is the data type.
+*/
+template<typename V>
+class ReceivingService : public Service<string, V>
+{
+
+private:
+
+	vector<V> received;
+	vector<ServiceListener<V>*> listeners;
+
+public:
+
+	// Get data on our service given a key
+	V& GetData(string _key) { return received.at(stoul(_key)); }
+
+	// The callback that a Connector should invoke for any new or updated data
+	void OnMessage(V& _data) { received.push_back(_data); }
+
+	// Add a listener to the Service for callbacks on add, remove, and update events for data to the Service
+	void AddListener(ServiceListener<V>* _listener) { listeners.push_back(_listener); }
+
+	// Get all listeners on the Service
+	const vector<ServiceListener<V>*>& GetListeners() const { return listeners; }
+
+	// Get the messages received
+	const vector<V>& GetReceived() const { return received; }
+
+};
+
+// Publish messages from a child process and get what this process receives of them.
+template<typename V>
+vector<V> SendAcross(const string& _type, vector<V> _messages)
+{
+	string _name = "/sharedmemory_test_" + _type + "_" + to_string(getpid());
+	ReceivingService<V> _service;
+	SharedMemoryConnector<V> _receiver(_name, &_service, 64);
+	Check(_receiver.IsOpen(), _type + " ring is mapped");
+
+	pid_t _pid = fork();
+	if (_pid == 0)
+	{
+		SharedMemoryConnector<V> _sender(_name, nullptr, 64);
+		for (auto& m : _messages)
+		{
+			_sender.Publish(m);
+		}
+		_exit(_sender.IsOpen() ? 0 : 1);
+	}
+
+	int _status = -1;
+	waitpid(_pid, &_status, 0);
+	Check(WIFEXITED(_status) && WEXITSTATUS(_status) == 0, _type + " sender exits cleanly");
+	_receiver.Poll();
+	SharedMemoryRing<typename WireFormat<V>::Type>::Unlink(_name);
+
+	Check(_receiver.GetLostCount() == 0, _type + " messages are not lost");
+	Check(_service.GetReceived().size() == _messages.size(), _type + " messages all arrive");
+	return _service.GetReceived();
+}
+
+// Check that two orders of a book match in every field.
+void CheckOrder(const Order& _sent, const Order& _received, const string& _description)
+{
+	Check(_received.GetPrice() == _sent.GetPrice(), _description + " price");
+	Check(_received.GetQuantity() == _sent.GetQuantity(), _description + " quantity");
+	Check(_received.GetSide() == _sent.GetSide(), _description + " side");
+}
+
+// Prices keep their product, mid and spread.
+void TestPrices()
+{
+	vector<Price<Bond>> sent = { Price<Bond>(GetBond("91282CJL6"), 99.515625, 1.0 / 128.0), Price<Bond>(GetBond("912810TV0"), 100.0078125, 1.0 / 64.0) };
+	vector<Price<Bond>> received = SendAcross("price", sent);
+	for (size_t i = 0; i < min(sent.size(), received.size()); ++i)
+	{
+		Check(received[i].GetProduct().GetProductId() == sent[i].GetProduct().GetProductId(), "price product");
+		Check(received[i].GetMid() == sent[i].GetMid(), "price mid");
+		Check(received[i].GetBidOfferSpread() == sent[i].GetBidOfferSpread(), "price bid/offer spread");
+	}
+}
+
+// Order books keep their product, venue and every level of both stacks.
+void TestOrderBooks()
+{
+	vector<Order> bids = { Order(99.5, 10000000, BID), Order(99.49609375, 20000000, BID), Order(99.4921875, 30000000, BID) };
+	vector<Order> offers = { Order(99.50390625, 10000000, OFFER), Order(99.5078125, 20000000, OFFER) };
+	vector<OrderBook<Bond>> sent = { OrderBook<Bond>(GetBond("91282CJN2"), bids, offers, ESPEED), OrderBook<Bond>(GetBond("91282CJJ1"), offers, bids, CME) };
+	vector<OrderBook<Bond>> received = SendAcross("orderbook", sent);
+	for (size_t i = 0; i < min(sent.size(), received.size()); ++i)
+	{
+		Check(received[i].GetProduct().GetProductId() == sent[i].GetProduct().GetProductId(), "order book product");
+		Check(received[i].GetMarket() == sent[i].GetMarket(), "order book market");
+		const vector<Order>& sentBids = sent[i].GetBidStack();
+		const vector<Order>& receivedBids = received[i].GetBidStack();
+		const vector<Order>& sentOffers = sent[i].GetOfferStack();
+		const vector<Order>& receivedOffers = received[i].GetOfferStack();
+		Check(receivedBids.size() == sentBids.size(), "order book bid count");
+		Check(receivedOffers.size() == sentOffers.size(), "order book offer count");
+		for (size_t j = 0; j < min(sentBids.size(), receivedBids.size()); ++j)
+		{
+			CheckOrder(sentBids[j], receivedBids[j], "order book bid");
+		}
+		for (size_t j = 0; j < min(sentOffers.size(), receivedOffers.size()); ++j)
+		{
+			CheckOrder(sentOffers[j], receivedOffers[j], "order book offer");
+		}
+	}
+}
+
+// Execution orders keep every field, including an execution ID longer than an order ID.
+void TestExecutionOrders()
+{
+	vector<ExecutionOrder<Bond>> sent = {
+		ExecutionOrder<Bond>(GetBond("91282CJM4"), BID, "PARENT01", LIMIT, 99.75, 4000000, 6000000, "PARENT01", false),
+		ExecutionOrder<Bond>(GetBond("91282CJP7"), OFFER, "PARENT01-2", IOC, 100.25, 1000000, 2000000, "PARENT01", true, "PARENT01-2.1234567") };
+	vector<ExecutionOrder<Bond>> received = SendAcross("executionorder", sent);
+	for (size_t i = 0; i < min(sent.size(), received.size()); ++i)
+	{
+		Check(received[i].GetProduct().GetProductId() == sent[i].GetProduct().GetProductId(), "execution order product");
+		Check(received[i].GetPricingSide() == sent[i].GetPricingSide(), "execution order side");
+		Check(received[i].GetOrderId() == sent[i].GetOrderId(), "execution order ID");
+		Check(received[i].GetOrderType() == sent[i].GetOrderType(), "execution order type");
+		Check(received[i].GetPrice() == sent[i].GetPrice(), "execution order price");
+		Check(received[i].GetVisibleQuantity() == sent[i].GetVisibleQuantity(), "execution order visible quantity");
+		Check(received[i].GetHiddenQuantity() == sent[i].GetHiddenQuantity(), "execution order hidden quantity");
+		Check(received[i].GetParentOrderId() == sent[i].GetParentOrderId(), "execution order parent ID");
+		Check(received[i].IsChildOrder() == sent[i].IsChildOrder(), "execution order child flag");
+		Check(received[i].GetExecutionId() == sent[i].GetExecutionId(), "execution order execution ID");
+	}
+}
+
+// Trades keep every field, including a trade ID taken from an execution ID.
+void TestTrades()
+{
+	vector<Trade<Bond>> sent = { Trade<Bond>(GetBond("912810TW8"), "PARENT01-2.1234567", 100.25, "TRSY3", 2000000, SELL), Trade<Bond>(GetBond("91282CJL6"), "TRADE0001", 99.0, "TRSY1", 5000000, BUY) };
+	vector<Trade<Bond>> received = SendAcross("trade", sent);
+	for (size_t i = 0; i < min(sent.size(), received.size()); ++i)
+	{
+		Check(received[i].GetProduct().GetProductId() == sent[i].GetProduct().GetProductId(), "trade product");
+		Check(received[i].GetTradeId() == sent[i].GetTradeId(), "trade ID");
+		Check(received[i].GetPrice() == sent[i].GetPrice(), "trade price");
+		Check(received[i].GetBook() == sent[i].GetBook(), "trade book");
+		Check(received[i].GetQuantity() == sent[i].GetQuantity(), "trade quantity");
+		Check(received[i].GetSide() == sent[i].GetSide(), "trade side");
+	}
+}
+
+// A ring cannot be opened for a payload other than the one it was created for.
+void TestSlotSizeMismatch()
+{
+	string _name = "/sharedmemory_test_mismatch_" + to_string(getpid());
+	SharedMemoryRing<OrderBookWire> _orderBooks(_name, 64);
+	SharedMemoryRing<PriceWire> _prices(_name, 64);
+	SharedMemoryRing<OrderBookWire>::Unlink(_name);
+
+	Check(_orderBooks.IsOpen(), "the order book ring is mapped");
+	Check(!_prices.IsOpen(), "the order book ring is not mapped as a price ring");
+}
+
+// Check that prices numbered from a first mid arrive in order and whole, and get the last mid.
+double CheckSequence(const vector<Price<Bond>>& _received, size_t _from, double _previous, const string& _description)
+{
+	bool _ordered = true;
+	bool _whole = true;
+	for (size_t i = _from; i < _received.size(); ++i)
+	{
+		_ordered = _ordered && _received[i].GetMid() > _previous;
+		_whole = _whole && _received[i].GetBidOfferSpread() == _received[i].GetMid() / 1024.0;
+		_previous = _received[i].GetMid();
+	}
+	Check(_ordered, _description + " arrive in order");
+	Check(_whole, _description + " arrive whole");
+	return _previous;
+}
+
+// A writer and a reader running at the same time: the reader keeps up, is lapped while it stalls, and then follows a free-running writer to the end.
+void TestConcurrentLap()
+{
+	const uint64_t _capacity = 8;
+	const long _burst = 5 * _capacity;
+	const long _stream = 100000;
+	string _name = "/sharedmemory_test_lap_" + to_string(getpid());
+	ReceivingService<Price<Bond>> _service;
+	SharedMemoryConnector<Price<Bond>> _receiver(_name, &_service, _capacity);
+	int _toWriter[2];
+	int _toReader[2];
+	Check(pipe(_toWriter) == 0 && pipe(_toReader) == 0, "the processes can signal each other");
+
+	pid_t _pid = fork();
+	if (_pid == 0)
+	{
+		SharedMemoryConnector<Price<Bond>> _sender(_name, nullptr, _capacity);
+		long _mid = 0;
+		auto _publish = [&](long _count)
+		{
+			for (long i = 0; i < _count; ++i)
+			{
+				++_mid;
+				Price<Bond> _price(GetBond("91282CJL6"), _mid, _mid / 1024.0);
+				_sender.Publish(_price);
+			}
+		};
+		char _signal = 0;
+		_publish(_capacity / 2);
+		bool _ok = read(_toWriter[0], &_signal, 1) == 1;
+		_publish(_burst);
+		_ok = _ok && write(_toReader[1], &_signal, 1) == 1;
+		_ok = _ok && read(_toWriter[0], &_signal, 1) == 1;
+		_publish(_stream);
+		_sender.Close();
+		_exit(_ok && _sender.IsOpen() ? 0 : 1);
+	}
+
+	// Keep up with the writer while it publishes less than a ring.
+	char _signal = 0;
+	while (_service.GetReceived().size() < _capacity / 2)
+	{
+		_receiver.Poll();
+	}
+	Check(_receiver.GetLostCount() == 0, "a reader keeping up loses nothing");
+	double _last = CheckSequence(_service.GetReceived(), 0, 0, "messages read while written");
+
+	// Stall while the writer laps the ring several times.
+	Check(write(_toWriter[1], &_signal, 1) == 1 && read(_toReader[0], &_signal, 1) == 1, "the writer finishes its burst");
+	size_t _before = _service.GetReceived().size();
+	_receiver.Poll();
+	long _total = _capacity / 2 + _burst;
+	Check(_receiver.GetLostCount() > 0, "a lapped reader counts the messages it lost");
+	Check((long)(_service.GetReceived().size() + _receiver.GetLostCount()) == _total, "a lapped reader receives or counts every message");
+	Check(_service.GetReceived().size() - _before < _capacity, "a lapped reader receives no more than the ring holds");
+	_last = CheckSequence(_service.GetReceived(), _before, _last, "messages left in the ring after a lap");
+	Check(_last == _total, "a lapped reader catches up to the last message");
+
+	// Follow a free-running writer until it closes the ring.
+	_before = _service.GetReceived().size();
+	Check(write(_toWriter[1], &_signal, 1) == 1, "the writer is released");
+	ifstream _none;
+	_receiver.Subscribe(_none);
+	_total += _stream;
+	Check((long)(_service.GetReceived().size() + _receiver.GetLostCount()) == _total, "a reader following a running writer receives or counts every message");
+	_last = CheckSequence(_service.GetReceived(), _before, _last, "messages read from a running writer");
+	Check(_last == _total, "subscribing reads up to the last message before the ring is closed");
+
+	int _status = -1;
+	waitpid(_pid, &_status, 0);
+	Check(WIFEXITED(_status) && WEXITSTATUS(_status) == 0, "lapping writer exits cleanly");
+	SharedMemoryRing<PriceWire>::Unlink(_name);
+}
+
+int main()
+{
+	TestPrices();
+	TestOrderBooks();
+	TestExecutionOrders();
+	TestTrades();
+	TestSlotSizeMismatch();
+	TestConcurrentLap();
+	return CheckResult("sharedmemory_test");
+}
@@ -0,0 +1,120 @@
+/**
+* smartorderrouter_test.cpp
+* Tests that the smart order router ranks venues by price, displayed size
+* and fill probability within the limit price, places the remainder on the
+* venue most likely to fill it, and learns fill probabilities from fills.
+*
+* @author Haonan Lu
+*/
+
+#include "check.hpp"
+#include "smartorderrouter.hpp"
+
+const string PRODUCT_ID = "91282CJJ1";
+const double TICK = 1.0 / 256.0;
+
+// Quote the product on a venue with one bid and one offer.
+void Quote(SmartOrderRouter<Bond>& _router, Market _market, double _bidPrice, long _bidQuantity, double _offerPrice, long _offerQuantity)
+{
+	vector<Order> _bids = { Order(_bidPrice, _bidQuantity, BID) };
+	vector<Order> _offers = { Order(_offerPrice, _offerQuantity, OFFER) };
+	_router.UpdateQuote(OrderBook<Bond>(GetBond(PRODUCT_ID), _bids, _offers, _market));
+}
+
+// Route an order of the product; an order on the offer side buys and one on the bid side sells.
+vector<RouteSlice> Route(SmartOrderRouter<Bond>& _router, PricingSide _side, OrderType _orderType, double _price, long _quantity)
+{
+	ExecutionOrder<Bond> _order(GetBond(PRODUCT_ID), _side, "ORDER", _orderType, _price, _quantity, 0, "ORDER", false);
+	vector<RouteSlice> _slices;
+	_router.Route(_order, _slices);
+	return _slices;
+}
+
+// Check that the slices go to the venues in order with the quantities given.
+void CheckSlices(const vector<RouteSlice>& _slices, const vector<RouteSlice>& _expected, const string& _description)
+{
+	bool _same = _slices.size() == _expected.size();
+	for (size_t i = 0; _same && i < _slices.size(); ++i)
+	{
+		_same = _slices[i].market == _expected[i].market && _slices[i].quantity == _expected[i].quantity;
+	}
+	Check(_same, _description);
+}
+
+// A router quoting the product on every venue: ESPEED offers the best price, BROKERTEC and CME the same price at different sizes.
+SmartOrderRouter<Bond> GetRouter()
+{
+	SmartOrderRouter<Bond> _router;
+	Quote(_router, BROKERTEC, 99.5, 3000000, 100.0, 2000000);
+	Quote(_router, ESPEED, 99.5 - TICK, 4000000, 100.0 - TICK, 1000000);
+	Quote(_router, CME, 99.5, 1000000, 100.0, 5000000);
+	return _router;
+}
+
+// Venues rank by price, then by displayed size weighted by fill probability.
+void TestRanking()
+{
+	SmartOrderRouter<Bond> router = GetRouter();
+	CheckSlices(Route(router, OFFER, LIMIT, 100.0, 4000000), { { ESPEED, 1000000 }, { CME, 3000000 } }, "a buy takes the best offer first, then the larger size at the next price");
+	CheckSlices(Route(router, BID, LIMIT, 99.5 - TICK, 5000000), { { BROKERTEC, 3000000 }, { CME, 1000000 }, { ESPEED, 1000000 } }, "a sell takes the best bids first, larger size first, then the next price");
+
+	router.SetFillProbability(CME, 0.3);
+	CheckSlices(Route(router, OFFER, LIMIT, 100.0, 4000000), { { ESPEED, 1000000 }, { BROKERTEC, 2000000 }, { CME, 1000000 } }, "a venue unlikely to fill ranks behind a smaller one at the same price");
+}
+
+// Venues outside the limit price are left out, unless the order is a market order.
+void TestLimitFilter()
+{
+	SmartOrderRouter<Bond> router = GetRouter();
+	CheckSlices(Route(router, OFFER, LIMIT, 100.0 - TICK, 1000000), { { ESPEED, 1000000 } }, "a buy only goes to offers within its limit");
+	CheckSlices(Route(router, BID, LIMIT, 99.5, 3000000), { { BROKERTEC, 3000000 } }, "a sell only goes to bids within its limit");
+	CheckSlices(Route(router, OFFER, MARKET, 0.0, 8000000), { { ESPEED, 1000000 }, { CME, 5000000 }, { BROKERTEC, 2000000 } }, "a market order goes to every venue whatever its price");
+}
+
+// What the displayed sizes do not cover goes to the venue most likely to fill it, on top of its slice.
+void TestRemainder()
+{
+	SmartOrderRouter<Bond> router = GetRouter();
+	router.SetFillProbability(ESPEED, 0.5);
+	router.SetFillProbability(BROKERTEC, 0.9);
+	router.SetFillProbability(CME, 0.3);
+	CheckSlices(Route(router, OFFER, LIMIT, 100.0, 10000000), { { ESPEED, 1000000 }, { BROKERTEC, 4000000 }, { CME, 5000000 } }, "the remainder is added to the slice of the venue most likely to fill");
+	CheckSlices(Route(router, OFFER, LIMIT, 100.0 - TICK, 3000000), { { ESPEED, 3000000 } }, "the remainder only goes to a venue within the limit");
+	CheckSlices(Route(router, OFFER, LIMIT, 99.0, 2000000), { { BROKERTEC, 2000000 } }, "with no venue within the limit the order rests on the venue most likely to fill");
+
+	SmartOrderRouter<Bond> empty;
+	CheckSlices(Route(empty, BID, LIMIT, 99.0, 2000000), { { BROKERTEC, 2000000 } }, "with no quotes the order goes to the first venue");
+}
+
+// A venue's fill probability moves toward the fraction of each child order it filled, once the child order is done.
+void TestFillProbability()
+{
+	SmartOrderRouter<Bond> router;
+	router.AddChildOrder("CHILD1", ESPEED, 4000000);
+	router.OnFill(ExecutionFill(string("CHILD1"), ESPEED, 100.0, 1000000, 3000000));
+	Check(router.GetFillProbability(ESPEED) == 1.0, "a partial fill leaves the fill probability alone");
+	Check(router.GetChildOrders().size() == 1, "a partially filled child order is still tracked");
+	router.OnFill(ExecutionFill(string("CHILD1"), ESPEED, 100.0, 1000000, 0));
+	Check(fabs(router.GetFillProbability(ESPEED) - 0.95) < 1e-12, "a child order half filled moves the fill probability a tenth of the way to a half");
+	Check(router.GetChildOrders().empty(), "a done child order is no longer tracked");
+
+	router.AddChildOrder("CHILD2", ESPEED, 2000000);
+	router.OnFill(ExecutionFill(string("CHILD2"), ESPEED, 100.0, 0, 0));
+	Check(fabs(router.GetFillProbability(ESPEED) - 0.855) < 1e-12, "a child order not filled at all moves the fill probability toward zero");
+	router.OnFill(ExecutionFill(string("OTHER"), ESPEED, 100.0, 0, 0));
+	Check(fabs(router.GetFillProbability(ESPEED) - 0.855) < 1e-12, "fills of orders the router did not send are ignored");
+	Check(router.GetFillProbability(BROKERTEC) == 1.0 && router.GetFillProbability(CME) == 1.0, "other venues keep their fill probability");
+
+	Quote(router, ESPEED, 99.5, 3000000, 100.0, 3000000);
+	Quote(router, CME, 99.5, 3000000, 100.0, 3000000);
+	CheckSlices(Route(router, OFFER, LIMIT, 100.0, 8000000), { { CME, 5000000 }, { ESPEED, 3000000 } }, "a venue that filled less ranks behind an equal one and gets no remainder");
+}
+
+int main()
+{
+	TestRanking();
+	TestLimitFilter();
+	TestRemainder();
+	TestFillProbability();
+	return CheckResult("smartorderrouter_test");
+}
@@ -0,0 +1,194 @@
+/**
+* streaming_test.cpp
+* Tests that streamed prices are conflated within the conflation window on
+* event time and flushed on the thread that holds them, and that client
+* sessions receive the frames of their tier and entitlements.
+*
+* @author Haonan Lu
+*/
+
+#include "check.hpp"
+#include "eventqueue.hpp"
+#include "streamingservice.hpp"
+
+/**
+* Listener keeping every price stream sent to listeners.
+*/
+class PublishedCapture : public ServiceListener<PriceStream<Bond>>
+{
+
+public:
+
+	vector<PriceStream<Bond>> published;
+
+	// Listener callback to process an add event to the Service
+	void ProcessAdd(PriceStream<Bond>& _data) { published.push_back(_data); }
+
+	// Listener callback to process a remove event to the Service
+	void ProcessRemove(PriceStream<Bond>&) {}
+
+	// Listener callback to process an update event to the Service
+	void ProcessUpdate(PriceStream<Bond>&) {}
+
+};
+
+const string PRODUCT_ID = "91282CJN2";
+const long WINDOW = 10000;
+
+// Get a two-way price of a product around a mid.
+PriceStream<Bond> GetStream(const string& _productId, double _mid)
+{
+	PriceStreamOrder _bid(_mid - 1.0 / 256.0, 1000000, 2000000, BID);
+	PriceStreamOrder _offer(_mid + 1.0 / 256.0, 1000000, 2000000, OFFER);
+	return PriceStream<Bond>(GetBond(_productId), _bid, _offer);
+}
+
+// Get a two-way price of the product around a mid.
+PriceStream<Bond> GetStream(double _mid)
+{
+	return GetStream(PRODUCT_ID, _mid);
+}
+
+// Get the mid of a price stream.
+double GetMid(const PriceStream<Bond>& _stream)
+{
+	return (_stream.GetBidOrder().GetPrice() + _stream.GetOfferOrder().GetPrice()) / 2.0;
+}
+
+// Publish a price at a time on the clock and fire the timers due.
+void PublishAt(StreamingService<Bond>& _service, VirtualClock& _clock, long _time, double _mid)
+{
+	_clock.SetTime(_time);
+	PollTimers();
+	PriceStream<Bond> _stream = GetStream(_mid);
+	_service.PublishPrice(_stream);
+}
+
+// Move the clock to a time and fire the timers due.
+void PollAt(VirtualClock& _clock, long _time)
+{
+	_clock.SetTime(_time);
+	PollTimers();
+}
+
+// Prices inside the window are held and replaced, go out when it closes, and quotes back at the published price are dropped.
+void TestConflation()
+{
+	VirtualClock clock(1000000);
+	ClockGuard guard(GetTimerWheel(), &clock);
+	StreamingService<Bond> service;
+	PublishedCapture capture;
+	service.AddListener(&capture);
+	service.SetConflationWindow(WINDOW);
+	long start = clock.Now();
+
+	PublishAt(service, clock, start, 99.0);
+	Check(capture.published.size() == 1, "the first price goes out at once");
+	PublishAt(service, clock, start + 1000, 99.0);
+	Check(capture.published.size() == 1 && service.GetSuppressedCount() == 1, "an unchanged price is suppressed");
+
+	PublishAt(service, clock, start + 2000, 99.25);
+	PublishAt(service, clock, start + 4000, 99.5);
+	PollAt(clock, start + WINDOW - 1000);
+	Check(capture.published.size() == 1, "prices inside the window are held");
+	Check(service.GetConflatedCount() == 1, "a held price replaced inside the window is conflated");
+	PollAt(clock, start + WINDOW);
+	Check(capture.published.size() == 2 && GetMid(capture.published.back()) == 99.5, "the latest held price goes out when the window closes");
+
+	PublishAt(service, clock, start + 3 * WINDOW, 100.0);
+	Check(capture.published.size() == 3, "a price after the window goes out at once");
+
+	PublishAt(service, clock, start + 3 * WINDOW + 2000, 100.25);
+	PublishAt(service, clock, start + 3 * WINDOW + 3000, 100.0);
+	PollAt(clock, start + 5 * WINDOW);
+	Check(capture.published.size() == 3, "a held price is dropped when the quote goes back to the published one");
+	Check(service.GetConflatedCount() == 2 && service.GetSuppressedCount() == 2, "the dropped price is conflated and the quote suppressed");
+
+	PublishAt(service, clock, start + 5 * WINDOW + 1000, 100.5);
+	service.FlushPrices();
+	Check(capture.published.size() == 4 && GetMid(capture.published.back()) == 100.5, "flushing sends a held price at once");
+	PollAt(clock, start + 7 * WINDOW);
+	Check(capture.published.size() == 4, "a flushed price is not sent again when its window closes");
+	Check(service.GetPublishedCount() == 4, "every price sent is counted");
+}
+
+// A price held on a queue thread is flushed by a task on that thread, cancelling the timer on its wheel.
+void TestFlushOnOwningThread()
+{
+	EventQueue queue("streaming");
+	StreamingService<Bond> service;
+	PublishedCapture capture;
+	service.AddListener(&capture);
+	service.SetConflationWindow(60000000);
+	queue.Start();
+	queue.Post([&service]() { PriceStream<Bond> _stream = GetStream(99.0); service.PublishPrice(_stream); });
+	queue.Post([&service]() { PriceStream<Bond> _stream = GetStream(99.5); service.PublishPrice(_stream); });
+	queue.Drain();
+	Check(capture.published.size() == 1, "a price inside the window is held on the queue thread");
+
+	long pending = -1;
+	queue.Post([&service, &pending]() { service.FlushPrices(); pending = GetTimerWheel().GetCount(); });
+	queue.Drain();
+	queue.Stop();
+	Check(capture.published.size() == 2 && GetMid(capture.published.back()) == 99.5, "the held price is flushed on the queue thread");
+	Check(pending == 0, "flushing cancels the flush timer on the wheel of the queue thread");
+}
+
+// Sessions get every frame they are entitled to unless throttled, and a stalled client loses the oldest frames only.
+void TestSessionFanOut()
+{
+	const long count = 20000;
+	const string other = "912810TV0";
+	StreamingService<Bond> service;
+	StreamingConnector<Bond>* connector = service.GetConnector();
+	connector->SetBatchSize(1);
+	StreamingSession* all = connector->AddSession(TIER1);
+	all->EntitleAll();
+	StreamingSession* entitled = connector->AddSession(TIER1);
+	entitled->Entitle(PRODUCT_ID);
+	StreamingSession* throttled = connector->AddSession(TIER2);
+	throttled->EntitleAll();
+	StreamingSession* stalled = connector->AddSession(TIER1);
+	stalled->EntitleAll();
+	Check(throttled->GetThrottle() == 100000 && connector->AddSession(TIER3)->GetThrottle() == 1000000, "tiers 2 and 3 are throttled by default");
+	throttled->SetThrottle(60000000);
+
+	StreamingClient allClient(all);
+	StreamingClient entitledClient(entitled);
+	StreamingClient throttledClient(throttled);
+	StreamingClient stalledClient(stalled);
+	allClient.Start();
+	entitledClient.Start();
+	throttledClient.Start();
+	for (long i = 0; i < count; ++i)
+	{
+		PriceStream<Bond> _stream = GetStream(i % 2 == 0 ? PRODUCT_ID : other, 99.0 + i / 256.0);
+		service.PublishPrice(_stream);
+	}
+	connector->Flush();
+	allClient.Stop();
+	entitledClient.Stop();
+	throttledClient.Stop();
+
+	Check(allClient.GetFrameCount() == count && all->GetSentCount() == count, "a client keeping up receives every frame");
+	Check(all->GetDroppedCount() == 0 && all->GetQueuedCount() == 0, "a client keeping up loses nothing");
+	Check(entitledClient.GetFrameCount(PRODUCT_ID) == count / 2 && entitledClient.GetFrameCount(other) == 0, "a client receives only the products it is entitled to");
+	Check(throttledClient.GetFrameCount(PRODUCT_ID) == 1 && throttledClient.GetFrameCount(other) == 1, "a throttled client receives the first frame of each product");
+	Check(throttled->GetThrottledCount() == count - 4, "a throttled client has the later frames replaced but the latest of each product held");
+
+	Check(stalled->GetDroppedCount() > 0, "a stalled client has frames dropped");
+	while (stalledClient.Read() > 0 || stalled->GetQueuedCount() > 0)
+	{
+		connector->Flush();
+	}
+	Check(stalledClient.GetFrameCount() + stalled->GetDroppedCount() == count, "a stalled client receives or has dropped every frame");
+	Check(stalledClient.GetLastFrame() == allClient.GetLastFrame(), "a stalled client catches up to the latest frame");
+}
+
+int main()
+{
+	TestConflation();
+	TestFlushOnOwningThread();
+	TestSessionFanOut();
+	return CheckResult("streaming_test");
+}
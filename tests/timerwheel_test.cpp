@@ -0,0 +1,185 @@
+/**
+* timerwheel_test.cpp
+* Tests that timers on the hierarchical timer wheel fire at their tick
+* whichever level they start on, that cancelled and rescheduled timers
+* fire only as last set, and that large clock jumps fire everything due.
+*
+* @author Haonan Lu
+*/
+
+#include <random>
+#include <map>
+#include "check.hpp"
+#include "soa.hpp"
+
+const long RESOLUTION = 1000;
+const long START = 123456789;
+
+/**
+* Timers scheduled on a wheel over a virtual clock, with the clock time each one fired at.
+*/
+struct FiredTimers
+{
+	VirtualClock clock = VirtualClock(START);
+	TimerWheel wheel = TimerWheel(&clock, RESOLUTION);
+	map<string, long> fired;
+
+	// Schedule a named timer a number of ticks from the start
+	TimerHandle Schedule(const string& _name, long _ticks)
+	{
+		return wheel.Schedule(START + _ticks * RESOLUTION, [this, _name]() { fired[_name] = clock.Now(); });
+	}
+
+	// Move the clock to a number of ticks from the start and fire the timers due
+	long PollAt(long _ticks)
+	{
+		clock.SetTime(START + _ticks * RESOLUTION);
+		return wheel.Poll();
+	}
+
+	// Has a named timer fired?
+	bool HasFired(const string& _name) const
+	{
+		return fired.count(_name) > 0;
+	}
+};
+
+// Timers starting on each level fire on their tick and not a tick before, after cascading down.
+void TestCascades()
+{
+	FiredTimers timers;
+	map<string, long> due = { { "level0", 200 }, { "level1", 300 }, { "level1wrap", 70000 - 1 }, { "level2", 70000 }, { "level3", (1L << 24) + 5 } };
+	for (auto& d : due)
+	{
+		timers.Schedule(d.first, d.second);
+	}
+	Check(timers.wheel.GetCount() == (long)due.size(), "every timer is scheduled");
+
+	for (auto& d : due)
+	{
+		timers.PollAt(d.second - 1);
+		Check(!timers.HasFired(d.first), d.first + " timer does not fire a tick early");
+		timers.PollAt(d.second);
+		Check(timers.HasFired(d.first) && timers.fired[d.first] == START + d.second * RESOLUTION, d.first + " timer fires on its tick");
+	}
+	Check(timers.wheel.GetCount() == 0, "fired timers are no longer scheduled");
+}
+
+// A cancelled timer never fires, and a rescheduled one fires only at its new time, across levels.
+void TestCancelAndReschedule()
+{
+	FiredTimers timers;
+	TimerHandle cancelled = timers.Schedule("cancelled", 70000);
+	TimerHandle sooner = timers.Schedule("sooner", (1L << 24) + 5);
+	TimerHandle later = timers.Schedule("later", 350);
+	TimerHandle kept = timers.Schedule("kept", 500);
+
+	timers.PollAt(300);
+	Check(timers.wheel.Cancel(cancelled) && !timers.wheel.Cancel(cancelled), "a timer is cancelled once");
+	Check(!timers.wheel.IsScheduled(cancelled), "a cancelled timer is not scheduled");
+	Check(timers.wheel.Reschedule(sooner, START + 400 * RESOLUTION), "a timer on the top level is moved down");
+	Check(timers.wheel.Reschedule(later, START + 80000 * RESOLUTION), "a timer on the first level is moved up");
+
+	TimerHandle reused = timers.Schedule("reused", 600);
+	Check(!timers.wheel.Cancel(cancelled), "the handle of a cancelled timer does not cancel a timer reusing its slot");
+
+	timers.PollAt(399);
+	Check(timers.fired.empty(), "nothing fires before the earliest time");
+	timers.PollAt(400);
+	Check(timers.HasFired("sooner") && timers.fired["sooner"] == START + 400 * RESOLUTION, "a timer moved down fires at its new time");
+	timers.PollAt(79999);
+	Check(timers.HasFired("kept") && timers.HasFired("reused") && !timers.HasFired("later"), "a timer moved up does not fire at its old time");
+	timers.PollAt(1L << 25);
+	Check(timers.HasFired("later") && timers.fired["later"] == START + (1L << 25) * RESOLUTION, "a timer moved up fires once its new time passes");
+	Check(!timers.HasFired("cancelled"), "a cancelled timer never fires");
+	Check(!timers.wheel.Reschedule(kept, START) && !timers.wheel.Cancel(kept), "a fired timer cannot be moved or cancelled");
+	Check(timers.wheel.GetCount() == 0, "nothing is left scheduled");
+}
+
+// One poll after a jump of a month fires every timer due on the way in time order, and none not yet due.
+void TestLargeJump()
+{
+	const long day = 86400000000L / RESOLUTION;
+	FiredTimers timers;
+	vector<string> order;
+	vector<long> ticks = { 5, 300, 70000, 3600000, 10 * day, 29 * day, 60 * day };
+	for (size_t i = 0; i < ticks.size(); ++i)
+	{
+		string name = to_string(ticks[i]);
+		timers.wheel.Schedule(START + ticks[i] * RESOLUTION, [&order, name]() { order.push_back(name); });
+	}
+
+	long fired = timers.PollAt(30 * day);
+	Check(fired == 6, "a month's jump fires the six timers due within it");
+	bool ordered = order.size() == 6;
+	for (size_t i = 0; ordered && i < order.size(); ++i)
+	{
+		ordered = order[i] == to_string(ticks[i]);
+	}
+	Check(ordered, "timers fired by a jump fire in time order");
+	Check(timers.wheel.GetCount() == 1, "a timer beyond the jump stays scheduled");
+
+	timers.PollAt(60 * day - 1);
+	Check(order.size() == 6, "a timer beyond the levels does not fire early");
+	timers.PollAt(60 * day);
+	Check(order.size() == 7, "a timer beyond the levels fires on its tick");
+
+	timers.PollAt(365 * day);
+	Check(timers.wheel.Poll() == 0 && timers.wheel.GetCount() == 0, "an empty wheel jumps straight to the clock");
+}
+
+// Random timers polled at random steps each fire at the first poll at or after their time.
+void TestRandomPolls()
+{
+	mt19937_64 rng(20231201);
+	uniform_int_distribution<long> when(1, 1L << 26);
+	uniform_int_distribution<long> step(1, 1L << 18);
+	VirtualClock clock(START);
+	TimerWheel wheel(&clock, RESOLUTION);
+	const long count = 5000;
+	long previous = 0;
+	long now = 0;
+	long fired = 0;
+	long misfired = 0;
+	for (long i = 0; i < count; ++i)
+	{
+		long due = when(rng);
+		wheel.Schedule(START + due * RESOLUTION, [&, due]()
+		{
+			fired++;
+			if (due > now || due <= previous) misfired++;
+		});
+	}
+
+	while (now < (1L << 26))
+	{
+		previous = now;
+		now = min(now + step(rng), 1L << 26);
+		clock.SetTime(START + now * RESOLUTION);
+		wheel.Poll();
+	}
+	Check(fired == count, "every random timer fires");
+	Check(misfired == 0, "every random timer fires at the first poll at or after its time");
+}
+
+// A guard installs a clock on a wheel for its scope and puts the previous clock back.
+void TestClockGuard()
+{
+	const Clock* wallClock = GetTimerWheel().GetClock();
+	{
+		VirtualClock clock(START);
+		ClockGuard guard(GetTimerWheel(), &clock);
+		Check(GetTimerWheel().GetClock() == &clock && GetTimerWheel().Now() == START, "a guard installs its clock");
+	}
+	Check(GetTimerWheel().GetClock() == wallClock, "a guard puts the previous clock back");
+}
+
+int main()
+{
+	TestCascades();
+	TestCancelAndReschedule();
+	TestLargeJump();
+	TestRandomPolls();
+	TestClockGuard();
+	return CheckResult("timerwheel_test");
+}
@@ -0,0 +1,80 @@
+/**
+* tradebooking_test.cpp
+* Tests the booking of partial fills and the reopening of the trade journal.
+*
+* @author Haonan Lu
+*/
+
+#include <cstdio>
+#include "check.hpp"
+#include "tradebookingservice.hpp"
+#include "positionservice.hpp"
+
+const string JOURNAL_PATH = "tradebooking_test.dat";
+
+// A 3MM order resting on a venue and filled as 1MM and then 2MM books both fills.
+void TestPartialFills()
+{
+	ExecutionService<Bond> executionService;
+	TradeBookingService<Bond> tradeBookingService(JOURNAL_PATH);
+	PositionService<Bond> positionService;
+	executionService.AddListener(tradeBookingService.GetListener());
+	tradeBookingService.AddListener(positionService.GetListener());
+
+	Bond bond = GetBond("91282CJL6");
+	ExecutionOrder<Bond> order(bond, OFFER, "PARTIALFILL1", LIMIT, 100.0, 3000000, 0, "PARTIALFILL1", false);
+	executionService.ExecuteOrder(order, BROKERTEC);
+
+	vector<Order> bids = { Order(99.9, 1000000, BID) };
+	OrderBook<Bond> firstBook(bond, bids, { Order(99.99, 1000000, OFFER) }, BROKERTEC);
+	executionService.UpdateBook(firstBook);
+	executionService.ProcessFills();
+	OrderBook<Bond> secondBook(bond, bids, { Order(99.99, 2000000, OFFER) }, BROKERTEC);
+	executionService.UpdateBook(secondBook);
+	executionService.ProcessFills();
+
+	Check(tradeBookingService.GetTradeCount() == 2, "both fills are booked");
+	Check(positionService.GetData("91282CJL6").GetAggregatePosition() == 3000000, "the position is the whole 3MM");
+	Check(string(tradeBookingService.GetData("PARTIALFILL1.1").GetTradeId()) == "PARTIALFILL1.1", "the first fill is booked under its execution ID");
+	Check(tradeBookingService.GetData("PARTIALFILL1.2").GetQuantity() == 2000000, "the second fill is booked under its execution ID");
+
+	ExecutionOrder<Bond> repeated(bond, OFFER, "PARTIALFILL1", LIMIT, 99.99, 2000000, 0, "PARTIALFILL1", false, "PARTIALFILL1.2");
+	tradeBookingService.GetListener()->ProcessAdd(repeated);
+	Check(tradeBookingService.GetTradeCount() == 2, "a fill seen twice is booked once");
+	Check(positionService.GetData("91282CJL6").GetAggregatePosition() == 3000000, "a fill seen twice moves the position once");
+}
+
+// A journal left by an earlier run is emptied, unless it is reopened for a restart.
+void TestJournalReopen()
+{
+	Bond bond = GetBond("91282CJP7");
+	Trade<Bond> trade(bond, "JOURNALTRADE", 99.5, "TRSY1", 1000000, BUY);
+	{
+		TradeBookingService<Bond> tradeBookingService(JOURNAL_PATH);
+		tradeBookingService.BookTrade(trade);
+		Check(tradeBookingService.GetJournal()->GetCount() == 1, "the trade is journaled");
+	}
+	{
+		TradeBookingService<Bond> tradeBookingService(JOURNAL_PATH, true);
+		tradeBookingService.Restore(tradeBookingService.GetJournal()->GetCount());
+		Check(tradeBookingService.GetTradeCount() == 1, "a restart indexes the journaled trade");
+		tradeBookingService.BookTrade(trade);
+		Check(tradeBookingService.GetJournal()->GetCount() == 1, "a restart does not book a journaled trade again");
+	}
+	{
+		TradeBookingService<Bond> tradeBookingService(JOURNAL_PATH);
+		Check(tradeBookingService.GetJournal()->GetCount() == 0, "a new run starts with an empty journal");
+		tradeBookingService.BookTrade(trade);
+		Check(tradeBookingService.GetTradeCount() == 1, "a new run books a trade whose ID an earlier run booked");
+	}
+}
+
+int main()
+{
+	remove(JOURNAL_PATH.c_str());
+	TestPartialFills();
+	remove(JOURNAL_PATH.c_str());
+	TestJournalReopen();
+	remove(JOURNAL_PATH.c_str());
+	return CheckResult("tradebooking_test");
+}
@@ -0,0 +1,436 @@
+/**
+* timerwheel.hpp
+* Defines the clocks and the hierarchical timer wheel driving time-based callbacks.
+*
+* @author Haonan Lu
+*/
+
+#ifndef TIMER_WHEEL_HPP
+#define TIMER_WHEEL_HPP
+
+#include <vector>
+#include <functional>
+#include <algorithm>
+#include "funcs.hpp"
+
+using namespace std;
+
+/**
+* A source of time in microseconds.
+*/
+class Clock
+{
+
+public:
+
+	virtual ~Clock() = default;
+
+	// Get the current time in microseconds
+	virtual long Now() const = 0;
+
+};
+
+/**
+* Clock following the steady wall clock.
+*/
+class WallClock : public Clock
+{
+
+public:
+
+	// Get the current time in microseconds
+	long Now() const override;
+
+};
+
+long WallClock::Now() const
+{
+	return GetMicrosecond();
+}
+
+/**
+* Clock following event time, moved forward explicitly, e.g. by a replay.
+*/
+class VirtualClock : public Clock
+{
+
+public:
+
+	// ctor for a clock
+	VirtualClock(long _time = 0);
+
+	// Get the current time in microseconds
+	long Now() const override;
+
+	// Set the current time in microseconds; time never goes backwards
+	void SetTime(long _time);
+
+	// Move the current time forward
+	void Advance(long _duration);
+
+private:
+
+	long time;
+
+};
+
+VirtualClock::VirtualClock(long _time)
+{
+	time = _time;
+}
+
+long VirtualClock::Now() const
+{
+	return time;
+}
+
+void VirtualClock::SetTime(long _time)
+{
+	if (_time > time) time = _time;
+}
+
+void VirtualClock::Advance(long _duration)
+{
+	if (_duration > 0) time += _duration;
+}
+
+/**
+* Handle of a scheduled timer. The generation tells a live timer from a
+* slot that has since been fired, cancelled or reused.
+*/
+struct TimerHandle
+{
+	int index = -1;
+	unsigned generation = 0;
+};
+
+/**
+* Hashed hierarchical timer wheel.
+* Time is cut into ticks of a resolution; four levels of 256 slots cover
+* 2^32 ticks, each level a coarser wheel whose slots are cascaded down as
+* the finer wheel wraps. Timers live in a pooled array linked into their
+* slot, so scheduling, cancelling and rescheduling are O(1) and there is no
+* priority queue. Timers fire when Poll moves the wheel up to its clock.
+*/
+class TimerWheel
+{
+
+public:
+
+	// ctor for a wheel on a clock with a resolution in microseconds
+	TimerWheel(const Clock* _clock, long _resolution = 1000);
+
+	// Get the clock of the wheel
+	const Clock* GetClock() const;
+
+	// Set the clock of the wheel, moving the wheel to its time
+	void SetClock(const Clock* _clock);
+
+	// Get the current time of the clock
+	long Now() const;
+
+	// Schedule a callback at a time
+	TimerHandle Schedule(long _time, function<void()> _callback);
+
+	// Schedule a callback after a delay from now
+	TimerHandle ScheduleAfter(long _delay, function<void()> _callback);
+
+	// Cancel a timer, false when it already fired or was cancelled
+	bool Cancel(TimerHandle& _handle);
+
+	// Move a timer to a new time, false when it already fired or was cancelled
+	bool Reschedule(const TimerHandle& _handle, long _time);
+
+	// Is a timer still scheduled?
+	bool IsScheduled(const TimerHandle& _handle) const;
+
+	// Fire all timers due by the time of the clock and return how many fired
+	long Poll();
+
+	// Get the number of scheduled timers
+	long GetCount() const;
+
+private:
+
+	static const int LEVELS = 4;
+	static const int SLOT_BITS = 8;
+	static const int SLOTS = 1 << SLOT_BITS;
+	static const long SLOT_MASK = SLOTS - 1;
+
+	struct Timer
+	{
+		long time;
+		int slot;
+		int prev;
+		int next;
+		unsigned generation;
+		function<void()> callback;
+	};
+
+	const Clock* clock;
+	long resolution;
+	long currentTick;
+	long count;
+	bool isExpiring;
+	vector<Timer> timers;
+	vector<int> freeTimers;
+	vector<int> slots;
+	long levelCounts[LEVELS];
+
+	// Link a timer into the slot of its time
+	void Place(int _index);
+
+	// Unlink a timer from its slot
+	void Unlink(int _index);
+
+	// Move the timers of a coarser level down to finer levels
+	void Cascade(int _level);
+
+	// Fire the timers of the current tick
+	long Expire();
+
+};
+
+TimerWheel::TimerWheel(const Clock* _clock, long _resolution)
+{
+	clock = _clock;
+	resolution = _resolution;
+	currentTick = clock->Now() / resolution;
+	count = 0;
+	isExpiring = false;
+	timers = vector<Timer>();
+	freeTimers = vector<int>();
+	slots = vector<int>(LEVELS * SLOTS, -1);
+	fill(levelCounts, levelCounts + LEVELS, 0);
+}
+
+const Clock* TimerWheel::GetClock() const
+{
+	return clock;
+}
+
+void TimerWheel::SetClock(const Clock* _clock)
+{
+	clock = _clock;
+
+	// Pending timers keep their times and are placed again against the new clock.
+	vector<int> _pending;
+	for (size_t s = 0; s < slots.size(); ++s)
+	{
+		for (int i = slots[s]; i >= 0; i = timers[i].next) _pending.push_back(i);
+		slots[s] = -1;
+	}
+	fill(levelCounts, levelCounts + LEVELS, 0);
+	currentTick = clock->Now() / resolution;
+	for (auto& i : _pending) Place(i);
+}
+
+long TimerWheel::Now() const
+{
+	return clock->Now();
+}
+
+void TimerWheel::Place(int _index)
+{
+	// A timer due now that is scheduled by a firing timer waits for the next tick, so a timer
+	// rescheduling itself cannot keep the wheel on the same tick.
+	Timer& _timer = timers[_index];
+	long _tick = max(_timer.time / resolution, currentTick + (isExpiring ? 1 : 0));
+	long _delta = _tick - currentTick;
+
+	// A timer beyond the top level waits in its last slot and is placed again when cascaded.
+	int _level = 0;
+	while (_level < LEVELS - 1 && _delta >= (1L << (SLOT_BITS * (_level + 1)))) _level++;
+	if (_delta >= (1L << (SLOT_BITS * LEVELS))) _tick = currentTick + (1L << (SLOT_BITS * LEVELS)) - 1;
+
+	int _slot = _level * SLOTS + (int)((_tick >> (SLOT_BITS * _level)) & SLOT_MASK);
+	_timer.slot = _slot;
+	_timer.prev = -1;
+	_timer.next = slots[_slot];
+	if (_timer.next >= 0) timers[_timer.next].prev = _index;
+	slots[_slot] = _index;
+	levelCounts[_level]++;
+}
+
+void TimerWheel::Unlink(int _index)
+{
+	Timer& _timer = timers[_index];
+	if (_timer.prev >= 0) timers[_timer.prev].next = _timer.next;
+	else slots[_timer.slot] = _timer.next;
+	if (_timer.next >= 0) timers[_timer.next].prev = _timer.prev;
+	levelCounts[_timer.slot / SLOTS]--;
+}
+
+TimerHandle TimerWheel::Schedule(long _time, function<void()> _callback)
+{
+	int _index;
+	if (freeTimers.empty())
+	{
+		_index = (int)timers.size();
+		timers.push_back(Timer());
+		timers[_index].generation = 0;
+	}
+	else
+	{
+		_index = freeTimers.back();
+		freeTimers.pop_back();
+	}
+
+	Timer& _timer = timers[_index];
+	_timer.time = _time;
+	_timer.callback = move(_callback);
+	Place(_index);
+	count++;
+	return { _index, _timer.generation };
+}
+
+TimerHandle TimerWheel::ScheduleAfter(long _delay, function<void()> _callback)
+{
+	return Schedule(clock->Now() + _delay, move(_callback));
+}
+
+bool TimerWheel::IsScheduled(const TimerHandle& _handle) const
+{
+	return _handle.index >= 0 && _handle.index < (int)timers.size() && timers[_handle.index].generation == _handle.generation && timers[_handle.index].slot >= 0;
+}
+
+bool TimerWheel::Cancel(TimerHandle& _handle)
+{
+	if (!IsScheduled(_handle)) return false;
+
+	Timer& _timer = timers[_handle.index];
+	Unlink(_handle.index);
+	_timer.slot = -1;
+	_timer.generation++;
+	_timer.callback = nullptr;
+	freeTimers.push_back(_handle.index);
+	count--;
+	_handle.index = -1;
+	return true;
+}
+
+bool TimerWheel::Reschedule(const TimerHandle& _handle, long _time)
+{
+	if (!IsScheduled(_handle)) return false;
+
+	Unlink(_handle.index);
+	timers[_handle.index].time = _time;
+	Place(_handle.index);
+	return true;
+}
+
+void TimerWheel::Cascade(int _level)
+{
+	int _slot = (int)((currentTick >> (SLOT_BITS * _level)) & SLOT_MASK);
+	if (_slot == 0 && _level < LEVELS - 1) Cascade(_level + 1);
+
+	int _index = slots[_level * SLOTS + _slot];
+	slots[_level * SLOTS + _slot] = -1;
+	while (_index >= 0)
+	{
+		int _next = timers[_index].next;
+		levelCounts[_level]--;
+		Place(_index);
+		_index = _next;
+	}
+}
+
+long TimerWheel::Expire()
+{
+	// Callbacks may schedule or cancel timers, including in this slot, so take one at a time.
+	long _fired = 0;
+	int& _head = slots[currentTick & SLOT_MASK];
+	while (_head >= 0)
+	{
+		int _index = _head;
+		Timer& _timer = timers[_index];
+		Unlink(_index);
+		_timer.slot = -1;
+		_timer.generation++;
+		function<void()> _callback = move(_timer.callback);
+		_timer.callback = nullptr;
+		freeTimers.push_back(_index);
+		count--;
+
+		bool _wasExpiring = isExpiring;
+		isExpiring = true;
+		_callback();
+		isExpiring = _wasExpiring;
+		_fired++;
+	}
+	return _fired;
+}
+
+long TimerWheel::Poll()
+{
+	long _nowTick = clock->Now() / resolution;
+	long _fired = 0;
+	while (currentTick <= _nowTick)
+	{
+		// With nothing scheduled the wheel jumps straight to the clock.
+		if (count == 0)
+		{
+			currentTick = _nowTick + 1;
+			break;
+		}
+
+		if ((currentTick & SLOT_MASK) == 0) Cascade(1);
+
+		// With the finer levels empty the wheel jumps to the next slot of the first level holding timers,
+		// so a large clock jump costs one step per occupied slot rather than one per tick.
+		int _level = 0;
+		while (_level < LEVELS - 1 && levelCounts[_level] == 0) _level++;
+		if (_level > 0)
+		{
+			long _span = 1L << (SLOT_BITS * _level);
+			currentTick = min((currentTick / _span + 1) * _span, _nowTick + 1);
+			continue;
+		}
+
+		_fired += Expire();
+		currentTick++;
+	}
+	return _fired;
+}
+
+long TimerWheel::GetCount() const
+{
+	return count;
+}
+
+/**
+* Guard installing a clock on a timer wheel for a scope and putting back the
+* clock the wheel had before when the scope ends.
+*/
+class ClockGuard
+{
+
+public:
+
+	// ctor for a guard installing a clock on a wheel
+	ClockGuard(TimerWheel& _wheel, const Clock* _clock);
+	~ClockGuard();
+
+	ClockGuard(const ClockGuard&) = delete;
+	ClockGuard& operator=(const ClockGuard&) = delete;
+
+private:
+
+	TimerWheel& wheel;
+	const Clock* previous;
+
+};
+
+ClockGuard::ClockGuard(TimerWheel& _wheel, const Clock* _clock) :
+	wheel(_wheel)
+{
+	previous = wheel.GetClock();
+	wheel.SetClock(_clock);
+}
+
+ClockGuard::~ClockGuard()
+{
+	wheel.SetClock(previous);
+}
+
+#endif
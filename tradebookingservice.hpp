@@ -11,7 +11,10 @@
 
 #include <string>
 #include <vector>
+#include <type_traits>
 #include "soa.hpp"
+#include "journal.hpp"
+#include "hashindex.hpp"
 #include "executionservice.hpp"
 
 // Trade sides
@@ -31,13 +34,13 @@ public:
 	Trade() = default;
 
 	// ctor for a trade
-	Trade(const T& _product, string _tradeId, double _price, string _book, long _quantity, Side _side);
+	Trade(const T& _product, TradeIdentifier _tradeId, double _price, string _book, long _quantity, Side _side);
 
 	// Get the product
 	const T& GetProduct() const;
 
 	// Get the trade ID
-	const string& GetTradeId() const;
+	const TradeIdentifier& GetTradeId() const;
 
 	// Get the mid price
 	double GetPrice() const;
@@ -54,7 +57,7 @@ public:
 private:
 
 	T product;
-	string tradeId;
+	TradeIdentifier tradeId;
 	double price;
 	string book;
 	long quantity;
@@ -63,7 +66,7 @@ private:
 };
 
 template<typename T>
-Trade<T>::Trade(const T& _product, string _tradeId, double _price, string _book, long _quantity, Side _side) :
+Trade<T>::Trade(const T& _product, TradeIdentifier _tradeId, double _price, string _book, long _quantity, Side _side) :
 	product(_product)
 {
 	tradeId = _tradeId;
@@ -80,7 +83,7 @@ const T& Trade<T>::GetProduct() const
 }
 
 template<typename T>
-const string& Trade<T>::GetTradeId() const
+const TradeIdentifier& Trade<T>::GetTradeId() const
 {
 	return tradeId;
 }
@@ -109,6 +112,41 @@ Side Trade<T>::GetSide() const
 	return side;
 }
 
+/**
+* Wire encoding of a trade, also the record of the trade journal.
+*/
+struct TradeWire
+{
+	char productId[16];
+	char tradeId[24];
+	char book[16];
+	double price;
+	long quantity;
+	int side;
+};
+
+static_assert(is_trivially_copyable<TradeWire>::value, "TradeWire must be trivially copyable");
+
+// Encode a trade into its fixed-size record.
+template<typename T>
+void EncodeTrade(const Trade<T>& _trade, TradeWire& _wire)
+{
+	CopyField(_wire.productId, _trade.GetProduct().GetProductId());
+	CopyField(_wire.tradeId, _trade.GetTradeId());
+	CopyField(_wire.book, _trade.GetBook());
+	_wire.price = _trade.GetPrice();
+	_wire.quantity = _trade.GetQuantity();
+	_wire.side = _trade.GetSide();
+}
+
+// Decode a trade from its fixed-size record.
+template<typename T>
+Trade<T> DecodeTrade(const TradeWire& _wire)
+{
+	T _product = GetBond(_wire.productId);
+	return Trade<T>(_product, _wire.tradeId, _wire.price, _wire.book, _wire.quantity, (Side)_wire.side);
+}
+
 /**
 * Pre-declearations to avoid errors.
 */
@@ -120,6 +158,12 @@ class TradeBookingToExecutionListener;
 /**
 * Trade Booking Service to book trades to a particular book.
 * Keyed on trade identifier.
+* Booked trades are appended to a memory-mapped journal, the system of
+* record, and only the offset of each trade is kept in memory, so the live
+* store stays a small index however many trades are booked. A journal left
+* by an earlier run is emptied, since trade IDs repeat from run to run,
+* unless the service is restarting that run: the journal is then kept and
+* its trades are indexed again by Restore.
 * Type T is the product type.
 */
 template<typename T>
@@ -128,15 +172,17 @@ class TradeBookingService : public Service<string, Trade<T>>
 
 private:
 
-	map<string, Trade<T>> trades;
+	Journal<TradeWire>* journal;
+	HashIndex<long, 24> tradeOffsets;
+	Trade<T> lastTrade;
 	vector<ServiceListener<Trade<T>>*> listeners;
 	TradeBookingConnector<T>* connector;
 	TradeBookingToExecutionListener<T>* listener;
 
 public:
 
-	// Constructor and destructor
-	TradeBookingService();
+	// Constructor and destructor, reopening the trades of the journal only for a restart
+	TradeBookingService(string _journalPath = "tradejournal.dat", bool _reopen = false);
 	~TradeBookingService();
 
 	// Get data on our service given a key
@@ -157,38 +203,52 @@ public:
 	// Get the listener of the service
 	TradeBookingToExecutionListener<T>* GetListener();
 
-	// Book the trade
+	// Book the trade, notifying the listeners once; a trade already booked is ignored
 	void BookTrade(Trade<T>& _trade);
 
+	// Get the number of trades booked
+	long GetTradeCount() const;
+
+	// Get the journal of the service
+	Journal<TradeWire>* GetJournal();
+
+	// Go back to the trades booked when the journal held a number of them, dropping the later ones and indexing the others
+	void Restore(long _journalCount);
+
 };
 
 template<typename T>
-TradeBookingService<T>::TradeBookingService()
+TradeBookingService<T>::TradeBookingService(string _journalPath, bool _reopen)
 {
-	trades = map<string, Trade<T>>();
+	journal = new Journal<TradeWire>(_journalPath);
+	tradeOffsets = HashIndex<long, 24>();
 	listeners = vector<ServiceListener<Trade<T>>*>();
 	connector = new TradeBookingConnector<T>(this);
 	listener = new TradeBookingToExecutionListener<T>(this);
+
+	if (!_reopen) journal->Truncate(0);
 }
 
 template<typename T>
-TradeBookingService<T>::~TradeBookingService() {}
+TradeBookingService<T>::~TradeBookingService()
+{
+	delete journal;
+}
 
 template<typename T>
 Trade<T>& TradeBookingService<T>::GetData(string _key)
 {
-	return trades[_key];
+	// The trade is decoded from the journal; the reference is valid until the next call.
+	const long* _offset = tradeOffsets.Find(_key);
+	if (!_offset || *_offset < 0) lastTrade = Trade<T>();
+	else lastTrade = DecodeTrade<T>(journal->Get(*_offset));
+	return lastTrade;
 }
 
 template<typename T>
 void TradeBookingService<T>::OnMessage(Trade<T>& _data)
 {
-	trades[_data.GetTradeId()] = _data;
-
-	for (auto& l : listeners)
-	{
-		l->ProcessAdd(_data);
-	}
+	BookTrade(_data);
 }
 
 template<typename T>
@@ -218,12 +278,44 @@ TradeBookingToExecutionListener<T>* TradeBookingService<T>::GetListener()
 template<typename T>
 void TradeBookingService<T>::BookTrade(Trade<T>& _trade)
 {
+	auto _inserted = tradeOffsets.Insert(_trade.GetTradeId(), -1);
+	if (!_inserted.second) return;
+
+	TradeWire _record;
+	EncodeTrade(_trade, _record);
+	*_inserted.first = journal->Append(_record);
+
 	for (auto& l : listeners)
 	{
 		l->ProcessAdd(_trade);
 	}
 }
 
+template<typename T>
+long TradeBookingService<T>::GetTradeCount() const
+{
+	return (long)tradeOffsets.Size();
+}
+
+template<typename T>
+Journal<TradeWire>* TradeBookingService<T>::GetJournal()
+{
+	return journal;
+}
+
+template<typename T>
+void TradeBookingService<T>::Restore(long _journalCount)
+{
+	journal->Truncate(_journalCount);
+	long _count = journal->GetCount();
+	tradeOffsets = HashIndex<long, 24>();
+	tradeOffsets.Reserve(_count);
+	for (long i = 0; i < _count; ++i)
+	{
+		tradeOffsets.Insert(journal->Get(i).tradeId, i);
+	}
+}
+
 /**
 * Trade Booking Connector subscribing data to Trading Booking Service.
 * Type T is the product type.
@@ -248,6 +340,9 @@ public:
 	// Subscribe data from the Connector
 	void Subscribe(ifstream& _data);
 
+	// Subscribe one line of data from the Connector
+	void Subscribe(const string& _line);
+
 };
 
 template<typename T>
@@ -268,30 +363,39 @@ void TradeBookingConnector<T>::Subscribe(ifstream& _data)
 	string _line;
 	while (getline(_data, _line))
 	{
-		stringstream _lineStream(_line);
-		string _cell;
-		vector<string> _cells;
-		while (getline(_lineStream, _cell, ','))
-		{
-			_cells.push_back(_cell);
-		}
-
-		string _productId = _cells[0];
-		string _tradeId = _cells[1];
-		double _price = ConvertPrice(_cells[2]);
-		string _book = _cells[3];
-		long _quantity = stol(_cells[4]);
-		Side _side;
-		if (_cells[5] == "BUY") _side = BUY;
-		else if (_cells[5] == "SELL") _side = SELL;
-		T _product = GetBond(_productId);
-		Trade<T> _trade(_product, _tradeId, _price, _book, _quantity, _side);
-		service->OnMessage(_trade);
+		PollTimers();
+		Subscribe(_line);
 	}
 }
 
+template<typename T>
+void TradeBookingConnector<T>::Subscribe(const string& _line)
+{
+	stringstream _lineStream(_line);
+	string _cell;
+	vector<string> _cells;
+	while (getline(_lineStream, _cell, ','))
+	{
+		_cells.push_back(_cell);
+	}
+
+	string _productId = _cells[0];
+	string _tradeId = _cells[1];
+	double _price = ConvertPrice(_cells[2]);
+	string _book = _cells[3];
+	long _quantity = stol(_cells[4]);
+	Side _side;
+	if (_cells[5] == "BUY") _side = BUY;
+	else if (_cells[5] == "SELL") _side = SELL;
+	T _product = GetBond(_productId);
+	Trade<T> _trade(_product, _tradeId, _price, _book, _quantity, _side);
+	service->OnMessage(_trade);
+}
+
 /**
 * Trade Booking Service Listener subscribing data from Execution Service to Trading Booking Service.
+* Each fill is booked as a trade under its execution ID, so the partial
+* fills of one order are all booked while a fill seen twice is booked once.
 * Type T is the product type.
 */
 template<typename T>
@@ -318,6 +422,12 @@ public:
 	// Listener callback to process an update event to the Service
 	void ProcessUpdate(ExecutionOrder<T>& _data);
 
+	// Get the number of executions booked, which picks the book of the next
+	long GetCount() const;
+
+	// Set the number of executions booked, when restoring the listener
+	void SetCount(long _count);
+
 };
 
 template<typename T>
@@ -336,7 +446,7 @@ void TradeBookingToExecutionListener<T>::ProcessAdd(ExecutionOrder<T>& _data)
 	count++;
 	T _product = _data.GetProduct();
 	PricingSide _pricingSide = _data.GetPricingSide();
-	string _orderId = _data.GetOrderId();
+	TradeIdentifier _tradeId = _data.GetExecutionId().empty() ? TradeIdentifier(string_view(_data.GetOrderId())) : _data.GetExecutionId();
 	double _price = _data.GetPrice();
 	long _visibleQuantity = _data.GetVisibleQuantity();
 	long _hiddenQuantity = _data.GetHiddenQuantity();
@@ -366,8 +476,7 @@ void TradeBookingToExecutionListener<T>::ProcessAdd(ExecutionOrder<T>& _data)
 	}
 	long _quantity = _visibleQuantity + _hiddenQuantity;
 
-	Trade<T> _trade(_product, _orderId, _price, _book, _quantity, _side);
-	service->OnMessage(_trade);
+	Trade<T> _trade(_product, _tradeId, _price, _book, _quantity, _side);
 	service->BookTrade(_trade);
 }
 
@@ -377,4 +486,16 @@ void TradeBookingToExecutionListener<T>::ProcessRemove(ExecutionOrder<T>& _data)
 template<typename T>
 void TradeBookingToExecutionListener<T>::ProcessUpdate(ExecutionOrder<T>& _data) {}
 
+template<typename T>
+long TradeBookingToExecutionListener<T>::GetCount() const
+{
+	return count;
+}
+
+template<typename T>
+void TradeBookingToExecutionListener<T>::SetCount(long _count)
+{
+	count = _count;
+}
+
 #endif